@@ -15,6 +15,8 @@
  */
 
 #include <linux/types.h>
+#include "nat64/common/log_time.h"
+#include "nat64/common/stats.h"
 #include "nat64/common/types.h"
 
 
@@ -57,8 +59,16 @@ enum config_mode {
 	MODE_BIB = (1 << 3),
 	/** The current message is talking about the session tables. */
 	MODE_SESSION = (1 << 4),
-	/** The current message is talking about log times for benchmark. */
+	/** The current message is talking about the latency histograms. */
 	MODE_LOGTIME = (1 << 5),
+	/** The current message is talking about configuration transactions. */
+	MODE_TRANSACTION = (1 << 9),
+	/** The current message is talking about the session events queued for the standby NAT64. */
+	MODE_SYNC = (1 << 10),
+	/** The current message is talking about the binary BIB/session log. */
+	MODE_LOG = (1 << 11),
+	/** The current message is talking about Jool's packet counters. */
+	MODE_STATS = (1 << 12),
 };
 
 /**
@@ -73,10 +83,14 @@ enum config_mode {
 #define POOL4_OPS (DATABASE_OPS)
 #define BLACKLIST_OPS (DATABASE_OPS)
 #define RFC6791_OPS (DATABASE_OPS)
-#define EAMT_OPS (DATABASE_OPS)
-#define BIB_OPS (DATABASE_OPS & ~OP_FLUSH)
-#define SESSION_OPS (OP_DISPLAY | OP_COUNT)
-#define LOGTIME_OPS (OP_DISPLAY)
+#define EAMT_OPS (DATABASE_OPS | OP_LOAD)
+#define BIB_OPS ((DATABASE_OPS & ~OP_FLUSH) | OP_LOAD)
+#define SESSION_OPS (OP_DISPLAY | OP_COUNT | OP_LOAD)
+#define LOGTIME_OPS (OP_DISPLAY | OP_FLUSH)
+#define TRANSACTION_OPS (OP_DISPLAY | OP_UPDATE)
+#define SYNC_OPS (OP_DISPLAY)
+#define LOG_OPS (OP_DISPLAY)
+#define STATS_OPS (OP_DISPLAY | OP_FLUSH)
 /**
  * @}
  */
@@ -94,6 +108,8 @@ enum config_operation {
 	OP_REMOVE = (1 << 4),
 	/* The userspace app wants to clear some table. */
 	OP_FLUSH = (1 << 5),
+	/** The userspace app wants to add many elements to the table being requested at once. */
+	OP_LOAD = (1 << 6),
 };
 
 /**
@@ -104,17 +120,20 @@ enum config_operation {
 #define POOL_MODES (MODE_POOL6 | MODE_POOL4 | MODE_BLACKLIST | MODE_RFC6791)
 #define TABLE_MODES (MODE_EAMT | MODE_BIB | MODE_SESSION)
 
-#define DISPLAY_MODES (MODE_GLOBAL | POOL_MODES | TABLE_MODES | MODE_LOGTIME)
+#define DISPLAY_MODES (MODE_GLOBAL | POOL_MODES | TABLE_MODES | MODE_LOGTIME | MODE_TRANSACTION \
+		| MODE_SYNC | MODE_LOG | MODE_STATS)
 #define COUNT_MODES (POOL_MODES | TABLE_MODES)
 #define ADD_MODES (POOL_MODES | MODE_EAMT | MODE_BIB)
 #define REMOVE_MODES (POOL_MODES | MODE_EAMT | MODE_BIB)
-#define FLUSH_MODES (POOL_MODES | MODE_EAMT)
-#define UPDATE_MODES (MODE_GLOBAL)
+#define FLUSH_MODES (POOL_MODES | MODE_EAMT | MODE_LOGTIME | MODE_STATS)
+#define LOAD_MODES (MODE_EAMT | MODE_BIB | MODE_SESSION)
+#define UPDATE_MODES (MODE_GLOBAL | MODE_TRANSACTION)
 
 #define SIIT_MODES (MODE_GLOBAL | MODE_POOL6 | MODE_BLACKLIST | MODE_RFC6791 \
-		| MODE_EAMT | MODE_LOGTIME)
+		| MODE_EAMT | MODE_LOGTIME | MODE_TRANSACTION | MODE_STATS)
 #define NAT64_MODES (MODE_GLOBAL | MODE_POOL6 | MODE_POOL4 | MODE_BIB \
-		| MODE_SESSION | MODE_LOGTIME)
+		| MODE_SESSION | MODE_LOGTIME | MODE_TRANSACTION | MODE_SYNC \
+		| MODE_LOG | MODE_STATS)
 /**
  * @}
  */
@@ -228,20 +247,46 @@ union request_eamt {
 	struct {
 		/* Nothing needed here ATM. */
 	} flush;
+	struct {
+		/** Number of entries in the batch. */
+		__u32 count;
+		/* The entries follow, as an array of "struct eam_entry_usr"s. */
+	} load;
 };
 
 /**
- * Configuration for the "Log time" module.
+ * Configuration for the latency histograms.
+ * OP_DISPLAY wants the histogram of the packets of protocols "l3_proto" and "l4_proto" (the
+ * incoming ones) in stage "stage" (enum logtime_stage). OP_FLUSH resets every histogram and
+ * ignores the fields.
  */
 struct request_logtime {
 	__u8 l3_proto;
 	__u8 l4_proto;
-	union {
-		struct {
-			/** If this is false, this is the first chunk the app is requesting. (boolean) */
-			__u8 iterate;
-		} display;
-	};
+	__u8 stage;
+};
+
+enum transaction_action {
+	/** Start staging configuration changes instead of applying them. */
+	TXN_BEGIN,
+	/** Apply the staged changes. */
+	TXN_COMMIT,
+	/** Drop the staged changes. */
+	TXN_ABORT,
+};
+
+/**
+ * Configuration transactions.
+ *
+ * While a transaction is open, changes to pool6 and (in SIIT) the EAMT, the blacklist and the
+ * RFC6791 pool are staged in private copies of the tables. The packet path keeps using the old
+ * ones until the transaction is committed, at which point each of them is replaced in one step.
+ *
+ * OP_DISPLAY answers with a __u8 (boolean) telling whether there's a transaction in progress.
+ */
+struct request_transaction {
+	/** See enum transaction_action. Only meaningful in OP_UPDATE requests. */
+	__u8 action;
 };
 
 /**
@@ -252,12 +297,10 @@ struct request_bib {
 	__u8 l4_proto;
 	union {
 		struct {
-			__u8 addr4_set;
-			/**
-			 * Address the userspace app received in the last chunk. Iteration should contiue
-			 * from here.
+			/*
+			 * Nothing needed here. The kernel remembers where it is in the table for as
+			 * long as the dump lasts.
 			 */
-			struct ipv4_transport_addr addr4;
 		} display;
 		struct {
 			/* Nothing needed here. */
@@ -278,6 +321,14 @@ struct request_bib {
 			/** The IPv4 transport address of the entry the user wants to remove. */
 			struct ipv4_transport_addr addr4;
 		} remove;
+		struct {
+			/** Number of entries in the batch. */
+			__u32 count;
+			/*
+			 * The entries follow, as an array of "struct bib_entry_usr"s.
+			 * ("is_static" is ignored; they're all static.)
+			 */
+		} load;
 	};
 };
 
@@ -289,24 +340,24 @@ struct request_session {
 	__u8 l4_proto;
 	union {
 		struct {
-			/** Are remote4 and local4 set? */
-			__u8 connection_set;
-			/**
-			 * Remote node from the connection the userspace app
-			 * received in the last chunk. Iteration should continue
-			 * from here.
-			 */
-			struct ipv4_transport_addr remote4;
-			/**
-			 * Remote IPv6 node's IPv4 mask, from the connection the
-			 * userspace app received in the last chunk.
-			 * Iteration should continue from here.
-			 */
-			struct ipv4_transport_addr local4;
+			/* Nothing needed here; see request_bib.display. */
 		} display;
 		struct {
 			/* Nothing needed here. */
 		} count;
+		struct {
+			/** Number of entries in the batch. */
+			__u32 count;
+			/**
+			 * Do the records come from the active NAT64 (see MODE_SYNC)? If so, they
+			 * can update or remove existing sessions instead of only adding new ones.
+			 */
+			__u8 sync;
+			/*
+			 * The entries follow, as an array of "struct session_record_usr"s.
+			 * All of them have to belong to the "l4_proto" table.
+			 */
+		} load;
 	};
 };
 
@@ -321,15 +372,19 @@ enum global_type {
 	TCP_TRANS_TIMEOUT,
 	FRAGMENT_TIMEOUT,
 
-	MAX_PKTS,
+	/* Took MAX_PKTS's place; userspace rejects the old (packet count) flags. */
+	SO_MAX_MEM,
 	SRC_ICMP6ERRS_BETTER,
 
 	BIB_LOGGING,
 	SESSION_LOGGING,
+	LOGGING_BINARY,
+	SESSION_SYNC,
 
 	DROP_BY_ADDR,
 	DROP_ICMP6_INFO,
 	DROP_EXTERNAL_TCP,
+	STATELESS_EXTERNAL_TCP,
 #else
 	COMPUTE_UDP_CSUM_ZERO,
 	RANDOMIZE_RFC6791,
@@ -346,6 +401,7 @@ enum global_type {
 	DISABLE,
 	ENABLE,
 	ATOMIC_FRAGMENTS,
+	LATENCY_HISTOGRAMS,
 };
 
 /**
@@ -362,15 +418,17 @@ union request_global {
 };
 
 /**
- * A logtime node entry, from the eyes of userspace.
- *
- * It holds the "struct timespec" which include seconds and nanoseconds, that specific how time
- * the skb need to be translated to IPv6 -> IPv4 or IPv4 -> IPv6.
+ * A latency histogram, added up across all CPUs, from the eyes of userspace.
+ * See nat64/common/log_time.h for the meaning of the buckets. All times are in nanoseconds.
  */
-struct logtime_entry_usr {
-#ifdef BENCHMARK
-	struct timespec time;
-#endif
+struct logtime_histogram_usr {
+	/** Number of packets measured. */
+	__u64 count;
+	/** Sum of their latencies. */
+	__u64 sum;
+	/** The largest latency measured. */
+	__u64 max;
+	__u64 buckets[LOGTIME_BUCKETS];
 };
 
 /**
@@ -402,6 +460,88 @@ struct session_entry_usr {
 	struct ipv4_transport_addr remote4;
 	__u64 dying_time;
 	__u8 state;
+	/** See enum session_timer_type. */
+	__u8 timer;
+};
+
+enum session_record_flags {
+	/** The BIB entry was added by the user. */
+	SESSION_RECORD_STATIC_BIB = (1 << 0),
+	/** The record only carries a BIB entry; the session fields are meaningless. */
+	SESSION_RECORD_BIB_ONLY = (1 << 1),
+	/** The session died; only its addresses are meaningful. */
+	SESSION_RECORD_REMOVED = (1 << 2),
+	/**
+	 * Events were lost; the receiver should ask for the whole tables again.
+	 * Nothing else in the record is meaningful.
+	 */
+	SESSION_RECORD_RESYNC = (1 << 3),
+};
+
+/**
+ * A session and its BIB entry, as they are saved before the module is removed and restored after
+ * it is inserted again (see OP_LOAD in MODE_SESSION).
+ *
+ * The BIB entry is the one which maps "remote6" to "local4". Static BIB entries which have no
+ * sessions travel as records flagged SESSION_RECORD_BIB_ONLY.
+ */
+struct session_record_usr {
+	struct ipv6_transport_addr remote6;
+	struct ipv6_transport_addr local6;
+	struct ipv4_transport_addr local4;
+	struct ipv4_transport_addr remote4;
+	/** Milliseconds the session had left to live when it was saved. */
+	__u32 ttl;
+	/** See enum l4_protocol. */
+	__u8 l4_proto;
+	/** See enum tcp_state. */
+	__u8 state;
+	/** See enum session_timer_type. */
+	__u8 timer;
+	/** See enum session_record_flags. */
+	__u8 flags;
+	/**
+	 * Order in which the active NAT64 queued the record for synchronization (see MODE_SYNC).
+	 * Global, so it orders records queued by different CPUs as well. Zero in anything else.
+	 */
+	__u64 seq;
+};
+
+enum log_event_type {
+	/** A BIB entry was created. */
+	LOG_EVENT_BIB_ADD,
+	/** A BIB entry died. */
+	LOG_EVENT_BIB_REMOVE,
+	/** A session was created. */
+	LOG_EVENT_SESSION_ADD,
+	/** A session died. */
+	LOG_EVENT_SESSION_REMOVE,
+	/** A session was inserted by the user (see OP_LOAD in MODE_SESSION). */
+	LOG_EVENT_SESSION_RESTORE,
+	/** The kernel's queue overflowed; "lost" events were dropped. Addresses are meaningless. */
+	LOG_EVENT_LOST,
+};
+
+/**
+ * A BIB or session creation or removal, as the kernel hands it to the logging daemon (see
+ * MODE_LOG).
+ *
+ * BIB events only use "remote6" (the entry's IPv6 transport address) and "local4" (its IPv4
+ * transport address).
+ */
+struct log_event_usr {
+	/** Nanoseconds since the epoch (UTC) at which the event happened. */
+	__u64 time;
+	struct ipv6_transport_addr remote6;
+	struct ipv6_transport_addr local6;
+	struct ipv4_transport_addr local4;
+	struct ipv4_transport_addr remote4;
+	/** Only meaningful in LOG_EVENT_LOST events. */
+	__u32 lost;
+	/** See enum l4_protocol. */
+	__u8 l4_proto;
+	/** See enum log_event_type. */
+	__u8 type;
 };
 
 /**
@@ -497,6 +637,13 @@ struct global_config {
 	/** Length of the mtu_plateaus array. */
 	__u16 mtu_plateau_count;
 
+	/**
+	 * Record every packet's latency in the --logTime histograms?
+	 * Off by default because it costs a few clock reads per packet.
+	 * Boolean.
+	 */
+	__u8 latency_histograms;
+
 #ifdef STATEFUL
 	/**
 	 * Time values in this structure should be read as jiffies in the kernel, milliseconds in
@@ -522,9 +669,14 @@ struct global_config {
 	__u8 drop_icmp6_info;
 	/** Drop externally initiated TCP connections? (IPv4 initiated) (boolean) */
 	__u8 drop_external_tcp;
+	/**
+	 * Admit externally initiated TCP connections without creating state until the IPv6 node
+	 * answers? (boolean)
+	 */
+	__u8 stateless_external_tcp;
 
-	/** Maximum number of simultaneous TCP connections Jool wil tolerate. */
-	__u64 max_stored_pkts;
+	/** Maximum number of bytes the packets stored for Simultaneous Open can take up. */
+	__u64 so_max_mem;
 	/** True = issue #132 behaviour. False = RFC 6146 behaviour. (boolean) */
 	__u8 src_icmp6errs_better;
 
@@ -532,6 +684,10 @@ struct global_config {
 	__u8 bib_logging;
 	/** Log sessions as they are created and destroyed? */
 	__u8 session_logging;
+	/** Queue the BIB and session logs in binary form instead of printing them? (boolean) */
+	__u8 logging_binary;
+	/** Queue session events for the standby translator? (boolean) */
+	__u8 session_sync;
 #else
 	/**
 	 * Amend the UDP checksum of incoming IPv4-UDP packets when it's zero?
@@ -40,12 +40,38 @@
  * This value cannot be configured from the userspace app (this is on purpose).
  */
 #define TCP_INCOMING_SYN (6)
+/**
+ * A session which keeps being refreshed but does not change otherwise is reported to the peer (see
+ * session_sync.h) at most once every this many seconds.
+ */
+#define SESSION_SYNC_REFRESH (10)
 /** Default session lifetime for ICMP bindings, in seconds. */
 #define ICMP_DEFAULT (1 * 60)
 
 /** Default time interval fragments are allowed to arrive in. In seconds. */
 #define FRAGMENT_MIN (2)
 
+/**
+ * Once the fragments waiting for reassembly take up more than this many bytes, the oldest packets
+ * start being discarded...
+ */
+#define FRAGMENT_HIGH_THRESH (4 * 1024 * 1024)
+/** ... until they are back to this many bytes. */
+#define FRAGMENT_LOW_THRESH (3 * 1024 * 1024)
+/**
+ * Maximum number of bytes the fragments coming from a single source can take up. Fragments which
+ * would go over this are dropped.
+ */
+#define FRAGMENT_SOURCE_THRESH (512 * 1024)
+
+/** In fragment forwarding mode, maximum number of fragmented packets tracked at once. */
+#define FRAGMENT_FWD_MAX_PACKETS 4096
+/**
+ * In fragment forwarding mode, maximum number of fragments that can be waiting for their first
+ * fragment at once.
+ */
+#define FRAGMENT_FWD_MAX_WAITING 1024
+
 /*
  * The timers will never sleep less than this amount of jiffies. This is because I don't think we
  * need to interrupt the kernel too much.
@@ -67,11 +93,13 @@
 #define DEFAULT_ADDR_DEPENDENT_FILTERING false
 #define DEFAULT_FILTER_ICMPV6_INFO false
 #define DEFAULT_DROP_EXTERNAL_CONNECTIONS false
-#define DEFAULT_MAX_STORED_PKTS 10
-#define DEFAULT_MAX_STORED_PKTS 10
+#define DEFAULT_STATELESS_EXTERNAL_CONNECTIONS false
+#define DEFAULT_SO_MAX_MEM (64 * 1024)
 #define DEFAULT_SRC_ICMP6ERRS_BETTER false
 #define DEFAULT_BIB_LOGGING false
 #define DEFAULT_SESSION_LOGGING false
+#define DEFAULT_LOGGING_BINARY false
+#define DEFAULT_SESSION_SYNC false
 
 #define DEFAULT_RESET_TRAFFIC_CLASS false
 #define DEFAULT_RESET_TOS false
@@ -82,6 +110,7 @@
 #define DEFAULT_LOWER_MTU_FAIL true
 #define DEFAULT_COMPUTE_UDP_CSUM0 false
 #define DEFAULT_RANDOMIZE_RFC6791 true
+#define DEFAULT_LATENCY_HISTOGRAMS false
 #define DEFAULT_MTU_PLATEAUS { 65535, 32000, 17914, 8166, 4352, 2002, 1492, 1006, 508, 296, 68 }
 
 
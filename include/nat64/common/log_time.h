@@ -0,0 +1,67 @@
+#ifndef _JOOL_COMMON_LOG_TIME_H
+#define _JOOL_COMMON_LOG_TIME_H
+
+/**
+ * @file
+ * Layout of the latency histograms (see MODE_LOGTIME), shared by the kernel module (which fills
+ * them) and the userspace application (which prints them).
+ *
+ * The buckets are log-linear, in the spirit of HdrHistogram: every power of two is split into
+ * LOGTIME_SUB_BUCKETS equally wide buckets, so a latency is always known with a relative error of
+ * 1 / LOGTIME_SUB_BUCKETS (12.5%) or better, no matter its magnitude. Values are nanoseconds; the
+ * buckets cover up to 2^32 ns (~4.3 seconds) and anything slower lands in the last one.
+ */
+
+#include <linux/types.h>
+
+/** log2(LOGTIME_SUB_BUCKETS). */
+#define LOGTIME_SUB_BUCKET_BITS 3
+#define LOGTIME_SUB_BUCKETS (1 << LOGTIME_SUB_BUCKET_BITS)
+/** Number of bits of the largest value the histograms can tell apart from the ones above it. */
+#define LOGTIME_VALUE_BITS 32
+/** Number of buckets in each histogram. */
+#define LOGTIME_BUCKETS ((LOGTIME_VALUE_BITS - LOGTIME_SUB_BUCKET_BITS + 1) * LOGTIME_SUB_BUCKETS)
+
+/**
+ * The pieces of the translation pipeline whose latency is measured.
+ */
+enum logtime_stage {
+	/** From the packet's arrival until its tuple is known (validation and classification). */
+	LOGTIME_STAGE_CLASSIFY = 0,
+	/** Filtering, session handling and the translation itself. */
+	LOGTIME_STAGE_TRANSLATE,
+	/** Routing and handing the translated packet to the kernel. */
+	LOGTIME_STAGE_SEND,
+	/** From the packet's arrival until its translated version was sent. */
+	LOGTIME_STAGE_TOTAL,
+};
+
+#define LOGTIME_STAGE_COUNT (LOGTIME_STAGE_TOTAL + 1)
+
+/**
+ * Returns the number of right shifts bucket "index"'s values were subjected to; the bucket is
+ * 2^(this) nanoseconds wide.
+ */
+static inline unsigned int logtime_bucket_shift(unsigned int index)
+{
+	return (index < LOGTIME_SUB_BUCKETS) ? 0 : (index >> LOGTIME_SUB_BUCKET_BITS) - 1;
+}
+
+/**
+ * Returns the smallest value (in nanoseconds) bucket "index" counts.
+ */
+static inline __u64 logtime_bucket_floor(unsigned int index)
+{
+	unsigned int shift = logtime_bucket_shift(index);
+	return ((__u64) (index - (shift << LOGTIME_SUB_BUCKET_BITS))) << shift;
+}
+
+/**
+ * Returns the smallest value (in nanoseconds) bucket "index" does not count.
+ */
+static inline __u64 logtime_bucket_ceil(unsigned int index)
+{
+	return logtime_bucket_floor(index) + (1ULL << logtime_bucket_shift(index));
+}
+
+#endif /* _JOOL_COMMON_LOG_TIME_H */
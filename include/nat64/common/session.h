@@ -27,4 +27,16 @@ enum tcp_state {
 	TRANS,
 };
 
+/**
+ * The timers that kill sessions. Each session is subscribed to exactly one of them; the timer
+ * decides how long the session can remain idle.
+ */
+enum session_timer_type {
+	SESSIONTIMER_UDP,
+	SESSIONTIMER_ICMP,
+	SESSIONTIMER_TRANS,
+	SESSIONTIMER_EST,
+	SESSIONTIMER_SYN,
+};
+
 #endif /* _JOOL_COMMON_SESSION_H */
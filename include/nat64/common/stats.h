@@ -0,0 +1,106 @@
+#ifndef _JOOL_COMMON_STATS_H
+#define _JOOL_COMMON_STATS_H
+
+/**
+ * @file
+ * Jool's own packet counters (see MODE_STATS), shared by the kernel module (which increments
+ * them) and the userspace application (which prints them).
+ *
+ * The kernel's IP MIB (which Jool also feeds; see nat64/mod/common/stats.h) cannot tell apart
+ * Jool's packets from everyone else's, nor which step of the translation gave up on them. These
+ * can.
+ */
+
+#include <linux/types.h>
+
+/**
+ * The steps of the translation pipeline whose verdicts are counted.
+ */
+enum stats_stage {
+	/** Header validation, checksums and (if enabled) defragmentation. */
+	STATS_STAGE_PREPARE = 0,
+	/** Computing the incoming tuple. */
+	STATS_STAGE_DETERMINE_IN_TUPLE,
+	/** Matching forwarded fragments with their first fragment. */
+	STATS_STAGE_FRAGMENTS,
+	/** Filtering, and BIB and session handling. */
+	STATS_STAGE_FILTERING,
+	/** Computing the outgoing tuple. */
+	STATS_STAGE_COMPUTE_OUT_TUPLE,
+	/** Building the translated packet. */
+	STATS_STAGE_TRANSLATE,
+	/** Translating hairpinned packets again. */
+	STATS_STAGE_HAIRPINNING,
+	/** Routing and handing the packet over to the kernel. */
+	STATS_STAGE_SEND,
+};
+
+#define STATS_STAGE_COUNT (STATS_STAGE_SEND + 1)
+
+/**
+ * What a stage can do with a packet, other than passing it on to the next one.
+ */
+enum stats_verdict {
+	/** The packet was returned to the kernel, untranslated. */
+	STATS_ACCEPTED = 0,
+	/** The packet was dropped. */
+	STATS_DROPPED,
+	/** Jool kept the packet for later (e.g. a fragment waiting for the rest of its packet). */
+	STATS_STOLEN,
+};
+
+#define STATS_VERDICT_COUNT (STATS_STOLEN + 1)
+
+/**
+ * Why Jool refused to translate packets.
+ *
+ * Almost all of them mean the packet was dropped. The exception is DROP_NO_BIB, which (for UDP and
+ * ICMP packets arriving from IPv4) returns the packet to the kernel instead, since it might be
+ * meant for the translator's own host.
+ */
+enum drop_reason {
+	/** The packet was truncated, or its headers didn't make sense. */
+	DROP_MALFORMED = 0,
+	/** The packet's checksum was wrong. */
+	DROP_CHECKSUM,
+	/** The packet (or the one inside of its ICMP error) had an untranslatable protocol. */
+	DROP_UNKNOWN_PROTO,
+	/** The packet's addresses didn't match the pools (or would have caused a hairpin loop). */
+	DROP_ADDRESS,
+	/** A packet arrived from IPv4 and there was no BIB entry for it. */
+	DROP_NO_BIB,
+	/** A packet from IPv6 needed a new BIB entry and pool4 had no transport addresses left. */
+	DROP_POOL4_EXHAUSTED,
+	/** Policy: address-dependent filtering, --dropInfo or --dropTCP. */
+	DROP_FILTERED,
+	/** Jool ran out of memory. */
+	DROP_ENOMEM,
+	/** The translated packet could not be routed. */
+	DROP_ROUTE,
+	/** The translated packet exceeded the outgoing MTU and could not be fragmented. */
+	DROP_PMTU,
+	/** The kernel refused to send the translated packet. */
+	DROP_XMIT,
+	/** The packet's TTL or Hop Limit ran out (Jool answered with a Time Exceeded error). */
+	DROP_TTL,
+};
+
+#define DROP_REASON_COUNT (DROP_TTL + 1)
+
+/**
+ * Jool's packet counters, from the eyes of userspace. In the kernel, every CPU has one of these.
+ */
+struct stats_usr {
+	/** Packets Jool was asked to translate (ie. packets the pools claimed). */
+	__u64 received;
+	/** Packets which were translated and sent. */
+	__u64 translated;
+	/** Packets which were translated and then hairpinned (and therefore translated again). */
+	__u64 hairpinned;
+	/** Number of packets each stage did not let through, per verdict. */
+	__u64 stages[STATS_STAGE_COUNT][STATS_VERDICT_COUNT];
+	/** Number of packets refused for each reason. */
+	__u64 drops[DROP_REASON_COUNT];
+};
+
+#endif /* _JOOL_COMMON_STATS_H */
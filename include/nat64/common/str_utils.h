@@ -35,4 +35,9 @@ const char *l3proto_to_string(l3_protocol proto);
  */
 const char *l4proto_to_string(l4_protocol proto);
 
+/**
+ * Returns a string version of "type" (see enum log_event_type).
+ */
+const char *log_event_to_string(__u8 type);
+
 #endif /* _JOOL_COMMON_STR_UTILS_H */
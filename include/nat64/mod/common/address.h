@@ -2,6 +2,7 @@
 #define _JOOL_MOD_ADDRESS_H
 
 #include <linux/string.h>
+#include <asm/byteorder.h>
 #include "nat64/common/types.h"
 
 
@@ -48,6 +49,32 @@ void addr4_set_bit(struct in_addr *addr, unsigned int pos, bool value);
 __u32 addr6_get_bit(struct in6_addr *addr, unsigned int pos);
 void addr6_set_bit(struct in6_addr *addr, unsigned int pos, bool value);
 
+/**
+ * @{
+ * IPv6 addresses as two 64-bit host-order halves: "hi" (bytes 0-7) and "lo" (bytes 8-15).
+ * Handy to operate on addresses a word at a time instead of a bit or a byte at a time.
+ */
+static inline __u64 addr6_get_hi(const struct in6_addr *addr)
+{
+	return ((__u64) be32_to_cpu(addr->s6_addr32[0]) << 32) | be32_to_cpu(addr->s6_addr32[1]);
+}
+
+static inline __u64 addr6_get_lo(const struct in6_addr *addr)
+{
+	return ((__u64) be32_to_cpu(addr->s6_addr32[2]) << 32) | be32_to_cpu(addr->s6_addr32[3]);
+}
+
+static inline void addr6_set_halves(struct in6_addr *addr, __u64 hi, __u64 lo)
+{
+	addr->s6_addr32[0] = cpu_to_be32((__u32) (hi >> 32));
+	addr->s6_addr32[1] = cpu_to_be32((__u32) hi);
+	addr->s6_addr32[2] = cpu_to_be32((__u32) (lo >> 32));
+	addr->s6_addr32[3] = cpu_to_be32((__u32) lo);
+}
+/**
+ * @}
+ */
+
 /**
  * The kernel has a ipv6_addr_cmp(), but not a ipv4_addr_cmp().
  * Of course, that is because in_addrs are, to most intents and purposes, 32-bit integer values.
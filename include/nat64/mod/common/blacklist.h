@@ -6,4 +6,9 @@
 bool is_blacklisted4(const __be32 addr32);
 bool is_blacklisted6(const struct in6_addr *addr);
 
+/** Executes "func" with "arg" on every prefix from the IPv4 blacklist. */
+int blacklist4_for_each(int (*func)(struct ipv4_prefix *, void *), void *arg);
+/** Executes "func" with "arg" on every prefix from the IPv6 blacklist. */
+int blacklist6_for_each(int (*func)(struct ipv6_prefix *, void *), void *arg);
+
 #endif /* _JOOL_MOD_BLACKLIST_H */
@@ -0,0 +1,44 @@
+#ifndef _JOOL_MOD_CLASSIFIER_H
+#define _JOOL_MOD_CLASSIFIER_H
+
+/**
+ * @file
+ * Decides, at the hooks, whether a packet is meant for translation.
+ *
+ * The blacklists and (if stateful) the pools are compiled into one sorted list of disjoint address
+ * ranges per protocol, each tagged with the class its addresses belong to. Classifying an address
+ * is then a binary search over that list, no matter how many prefixes it came from. Traffic which
+ * is not meant for translation is therefore rejected after one lookup per address.
+ *
+ * The compiled lists are replaced (never edited) by classifier_rebuild(), which has to be called
+ * every time the pools change.
+ *
+ * @author Alberto Leiva
+ */
+
+#include <linux/types.h>
+#include <linux/in6.h>
+
+int classifier_init(void);
+void classifier_destroy(void);
+
+/**
+ * Recompiles the lists out of the current blacklists and pools.
+ * Calls must be serialized by the caller (ie. the configuration mutex).
+ *
+ * If this fails, the classifier falls back to querying the blacklists and pools directly.
+ */
+int classifier_rebuild(void);
+
+/**
+ * Returns whether the IPv4 packet going from "saddr" to "daddr" should be translated.
+ * The caller must hold rcu_read_lock_bh().
+ */
+bool classifier_translate4(__be32 saddr, __be32 daddr);
+/**
+ * Returns whether the IPv6 packet going from "saddr" to "daddr" should be translated.
+ * The caller must hold rcu_read_lock_bh().
+ */
+bool classifier_translate6(struct in6_addr *saddr, struct in6_addr *daddr);
+
+#endif /* _JOOL_MOD_CLASSIFIER_H */
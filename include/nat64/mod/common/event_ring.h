@@ -0,0 +1,66 @@
+#ifndef _JOOL_MOD_EVENT_RING_H
+#define _JOOL_MOD_EVENT_RING_H
+
+/**
+ * @file
+ * A queue of fixed-size events, split in one ring per CPU so the packet path never shares a lock
+ * (or even a cache line) with anyone else.
+ *
+ * Each ring has exactly one producer (the CPU that owns it, with bottom halves disabled) and one
+ * consumer (whoever is draining), so it needs no locks; only barriers. If a ring is full, the new
+ * event is dropped and counted, and the next drain reports the loss.
+ *
+ * Order is only kept within each CPU.
+ */
+
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/types.h>
+
+struct event_ring_cpu;
+
+struct event_ring {
+	struct event_ring_cpu __percpu *cpus;
+	/** Size of each event, in bytes. */
+	size_t event_size;
+	/** Number of events each CPU can queue. Power of two. */
+	unsigned int capacity;
+	/** Serializes the consumers. */
+	struct mutex drain_mutex;
+};
+
+/**
+ * Prepares "ring" to hold "capacity" events of "event_size" bytes per CPU. "capacity" has to be a
+ * power of two.
+ */
+int evring_init(struct event_ring *ring, size_t event_size, unsigned int capacity);
+/**
+ * Call during destruction to avoid memory leaks.
+ */
+void evring_destroy(struct event_ring *ring);
+
+/**
+ * Queues a copy of "event" in the current CPU's ring.
+ *
+ * Never sleeps and never blocks. If the ring is full, the event is dropped.
+ */
+void evring_add(struct event_ring *ring, const void *event);
+
+/**
+ * Hands the queued events to "func", one by one, oldest first (within each CPU).
+ *
+ * Before each CPU's events, if that CPU dropped any since the last drain, "lost" is called with
+ * the number of them.
+ *
+ * If either callback returns nonzero, the iteration stops and whatever that callback was told
+ * stays pending, so it can be retried by the next call. The other CPUs are not visited in that
+ * case.
+ *
+ * Can sleep.
+ */
+int evring_drain(struct event_ring *ring,
+		int (*lost)(unsigned int cpu, unsigned long count, void *arg),
+		int (*func)(void *event, void *arg),
+		void *arg);
+
+#endif /* _JOOL_MOD_EVENT_RING_H */
@@ -3,37 +3,60 @@
 
 /**
  * @file
- * Log file for benchmark purpose.
+ * Latency histograms of the translation pipeline, one per (incoming layer-3 protocol, incoming
+ * layer-4 protocol, stage).
  *
- * This code is not used during normal translations; we link it only when we want to measure stuff.
+ * Each CPU owns a full set of histograms which is allocated once and only ever incremented, so
+ * measuring a packet costs a clock read and a handful of additions on cache lines nobody else
+ * writes; no locks, no allocations. The sets are only added up when userspace asks for them.
+ *
+ * See nat64/common/log_time.h for the bucket layout and the stages.
  *
  * @author Daniel Hernandez
  */
 
-#include <linux/spinlock.h>
-#include <linux/time.h>
+#include <linux/ktime.h>
+#include "nat64/common/config.h"
 #include "nat64/mod/common/packet.h"
 
-struct log_time_db {
-	struct list_head list;
-	spinlock_t lock;
-};
+/**
+ * Returns the current time, in the units logtime() wants.
+ */
+static inline __u64 logtime_now(void)
+{
+	return ktime_to_ns(ktime_get());
+}
 
-struct log_node {
-	struct timespec time;
-	struct list_head list_hook;
-};
+__u64 __logtime(struct packet *pkt, enum logtime_stage stage, __u64 since);
+
+/**
+ * Records, in "pkt"'s "stage" histogram, the time that has elapsed since "since" (which should
+ * have been taken from logtime_now() or pkt->start_time).
+ *
+ * Returns the current time, so the caller can use it as the start of the next stage.
+ * If --latency-histograms is off, does nothing (not even read the clock) and returns zero.
+ *
+ * Has to be called with bottom halves disabled (which is always the case in the packet path).
+ */
+static inline __u64 logtime(struct packet *pkt, enum logtime_stage stage, __u64 since)
+{
+	return pkt->config->latency_histograms ? __logtime(pkt, stage, since) : 0;
+}
 
 /**
- * Increases the counter of the structure and add to the sum delta time registered.
+ * Adds up every CPU's histogram of packets of "l3_proto" and "l4_proto" in stage "stage", and
+ * leaves the result in "result".
+ *
+ * The packet path is not stopped while this happens, so the result might be slightly
+ * inconsistent (e.g. "count" might be off by the few packets that were being recorded).
  */
-int logtime(struct packet *pkt);
+int logtime_get(l3_protocol l3_proto, l4_protocol l4_proto, enum logtime_stage stage,
+		struct logtime_histogram_usr *result);
 /**
- * Iterate over a "struct log_time_db" (which is given by the l3_protocol and l4_protocol) and
- * each iteration do the "func" call and then delete the node.
+ * Empties every histogram. Measurements that are taking place meanwhile might survive.
  */
-int logtime_iterate_and_delete(l3_protocol l3_proto, l4_protocol l4_proto,
-		int (*func)(struct log_node *, void *), void *arg);
+void logtime_flush(void);
+
 int logtime_init(void);
 void logtime_destroy(void);
 
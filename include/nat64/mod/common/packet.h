@@ -14,6 +14,7 @@
 #include <linux/tcp.h>
 #include <linux/icmp.h>
 
+#include "nat64/common/config.h"
 #include "nat64/mod/common/types.h"
 
 
@@ -192,13 +193,21 @@ struct packet {
 	 * translated. Also used by the packet queue.
 	 */
 	struct packet *original_pkt;
+	/**
+	 * Snapshot of the global configuration, taken once as the packet entered Jool.
+	 * Every translation decision made on behalf of this packet should read from here, so
+	 * they all agree with each other and don't need to take RCU locks of their own.
+	 * Only valid while the RCU read-side critical section the packet was initialized in
+	 * lasts; do not keep it around if you store the packet for later.
+	 */
+	struct global_config *config;
 
-#ifdef BENCHMARK
 	/**
-	 * Log the time in epoch when this skb arrives to jool. For benchmark purposes.
+	 * Moment (ktime_get(), in nanoseconds) this packet (or the one it's being translated from)
+	 * arrived to Jool. For the latency histograms; see log_time.h.
+	 * Zero if config->latency_histograms was off.
 	 */
-	struct timespec start_time;
-#endif
+	__u64 start_time;
 };
 
 /**
@@ -215,9 +224,8 @@ static inline void pkt_fill(struct packet *pkt, struct sk_buff *skb,
 	pkt->hdr_frag = hdr_frag;
 	pkt->payload = payload;
 	pkt->original_pkt = original_pkt;
-#ifdef BENCHMARK
-	pkt->start_time = original_pkt->start_time;
-#endif
+	pkt->config = original_pkt ? original_pkt->config : NULL;
+	pkt->start_time = original_pkt ? original_pkt->start_time : 0;
 }
 
 /**
@@ -469,6 +477,9 @@ static inline bool pkt_is_icmp4_error(const struct packet *pkt)
  *
  * This function can change the packet's pointers. If you eg. stored a pointer to
  * skb_network_header(skb), you will need to assign it again (by calling skb_network_header again).
+ *
+ * It also takes the packet's configuration snapshot (pkt->config), so the caller must be holding
+ * rcu_read_lock_bh() for as long as it intends to use "pkt".
  */
 int pkt_init_ipv6(struct packet *pkt, struct sk_buff *skb);
 int pkt_init_ipv4(struct packet *pkt, struct sk_buff *skb);
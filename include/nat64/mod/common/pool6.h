@@ -36,6 +36,8 @@ int pool6_flush(void);
  * Because you're not actually borrowing the prefix,
  * - you don't have to return it, and
  * - this function can also be described as a way to infer "addr"'s actual network prefix.
+ *
+ * If several prefixes contain "addr", the longest one wins.
  */
 int pool6_get(struct in6_addr *addr, struct ipv6_prefix *prefix);
 /**
@@ -56,6 +58,20 @@ int pool6_add(struct ipv6_prefix *prefix);
  */
 int pool6_remove(struct ipv6_prefix *prefix);
 
+/**
+ * From now on, pool6_add(), pool6_remove() and pool6_flush() edit a private copy of the pool
+ * instead of the one the packet path uses.
+ */
+void pool6_txn_begin(void);
+/**
+ * Replaces the pool with the copy, in one step. Cannot fail.
+ */
+void pool6_txn_commit(void);
+/**
+ * Drops the copy.
+ */
+void pool6_txn_abort(void);
+
 /**
  * Executes the "func" function with the "arg" argument on every prefix in the pool.
  */
@@ -30,7 +30,7 @@ struct translation_steps {
 struct translation_steps *ttpcomm_get_steps(enum l3_protocol l3_proto, enum l4_protocol l4_proto);
 
 int copy_payload(struct packet *in, struct packet *out);
-bool will_need_frag_hdr(struct iphdr *in_hdr);
+bool will_need_frag_hdr(struct global_config *config, struct iphdr *in_hdr);
 verdict ttpcomm_translate_inner_packet(struct tuple *outer_tuple, struct packet *in,
 		struct packet *out);
 
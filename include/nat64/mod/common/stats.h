@@ -3,15 +3,19 @@
 
 /**
  * @file
- * A wrapper for the kernel's stat functions.
+ * A wrapper for the kernel's stat functions, and Jool's own packet counters.
  *
- * This exists because, based on experience, we can't really afford the assumptions that led to
- * those functions lacking argument validations.
+ * The wrapper exists because, based on experience, we can't really afford the assumptions that led
+ * to those functions lacking argument validations.
+ *
+ * The counters are described in nat64/common/stats.h. Every CPU increments its own, so they're
+ * cheap enough to be always on; they're only added up when userspace asks for them.
  *
  * @author Alberto Leiva
  * @author Daniel Hernandez
  */
 
+#include "nat64/common/stats.h"
 #include "nat64/mod/common/packet.h"
 
 /**
@@ -30,4 +34,38 @@ void inc_stats_skb4(struct sk_buff *skb, int field);
  * @}
  */
 
+/**
+ * @{
+ * Increment Jool's counters.
+ */
+void stats_received(void);
+void stats_translated(void);
+void stats_hairpinned(void);
+void stats_drop(enum drop_reason reason);
+void __stats_verdict(enum stats_stage stage, verdict result);
+/**
+ * @}
+ */
+
+/**
+ * Accounts "result" as the outcome of "stage", unless it is VERDICT_CONTINUE. Returns "result",
+ * so it can wrap the stage's call.
+ */
+static inline verdict stats_verdict(enum stats_stage stage, verdict result)
+{
+	if (result != VERDICT_CONTINUE)
+		__stats_verdict(stage, result);
+	return result;
+}
+
+/**
+ * Adds up every CPU's counters and leaves the result in "result".
+ * The packet path is not stopped while this happens, so the counters might not add up exactly.
+ */
+void stats_get(struct stats_usr *result);
+/**
+ * Sets every counter to zero. Packets being counted meanwhile might survive.
+ */
+void stats_flush(void);
+
 #endif /* _JOOL_MOD_STATS_H */
@@ -0,0 +1,65 @@
+#ifndef _JOOL_MOD_TRIE_H
+#define _JOOL_MOD_TRIE_H
+
+/**
+ * @file
+ * A path-compressed binary trie which maps address prefixes to arbitrary values, meant for longest
+ * prefix match lookups on the packet path.
+ *
+ * Only the bits in which the stored prefixes actually differ get a node, so a trie of n prefixes
+ * has exactly n leaves and n - 1 branching nodes, no matter how long the prefixes are. A lookup
+ * visits one node per branching bit on its way and compares the full prefix once it reaches a leaf.
+ *
+ * The prefixes stored in a single trie must not overlap; trie_add() refuses to insert a prefix
+ * that contains or is contained by an existing one. Because of this, the only match an address can
+ * have is also the longest one.
+ *
+ * Readers (trie_find()) only need rcu_read_lock_bh(). Writers need to be serialized by the caller,
+ * and need to be able to sleep. The trie releases its removed nodes through call_rcu_bh(), so
+ * modules which use tries need to rcu_barrier_bh() before they are unloaded.
+ *
+ * @author Alberto Leiva
+ */
+
+#include <linux/rcupdate.h>
+
+struct trie {
+	/** Either the topmost branching node or the only leaf. NULL if the trie is empty. */
+	void __rcu *root;
+	/** Length of the keys, in bytes. */
+	unsigned int key_len;
+};
+
+void trie_init(struct trie *trie, unsigned int key_len);
+/**
+ * Releases the trie's nodes. Assumes nobody else is looking at it anymore.
+ * The values are the caller's responsibility.
+ */
+void trie_destroy(struct trie *trie);
+
+/**
+ * Makes the "prefix_len"-bit prefix of "key" point to "value".
+ *
+ * Returns -EEXIST if the prefix overlaps with one already present in the trie.
+ */
+int trie_add(struct trie *trie, const void *key, __u8 prefix_len, void *value);
+/**
+ * Reverts trie_add(trie, key, prefix_len, value).
+ *
+ * Does not wait for the readers. Those which are already walking the trie might still find
+ * "value", so the caller has to let an RCU-bh grace period elapse before releasing it.
+ */
+int trie_remove(struct trie *trie, const void *key, __u8 prefix_len, void *value);
+/**
+ * Empties the trie. Same as trie_remove(), readers might still find the old values until a grace
+ * period elapses.
+ */
+void trie_flush(struct trie *trie);
+
+/**
+ * Returns the value whose prefix contains "key", or NULL if there's no such prefix.
+ * The caller must hold rcu_read_lock_bh().
+ */
+void *trie_find(struct trie *trie, const void *key);
+
+#endif /* _JOOL_MOD_TRIE_H */
@@ -9,7 +9,9 @@
  */
 
 #include "nat64/common/types.h"
+#include <linux/kref.h>
 #include <linux/netfilter.h>
+#include <linux/version.h>
 #include "nat64/mod/common/address.h"
 
 /**
@@ -146,6 +148,21 @@ static inline bool is_5_tuple(struct tuple *tuple)
  */
 void log_tuple(struct tuple *tuple);
 
+/**
+ * Increments "kref" unless it already reached zero (ie. its object is being released).
+ * Returns whether it succeeded.
+ *
+ * kref_get_unless_zero() only exists since Linux 3.8.
+ */
+static inline bool kref_get_unless_zero_compat(struct kref *kref)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 8, 0)
+	return kref_get_unless_zero(kref);
+#else
+	return atomic_add_unless(&kref->refcount, 1, 0);
+#endif
+}
+
 /**
  * @{
  * Returns true if "type" (which is assumed to have been extracted from a ICMP header) represents
@@ -12,6 +12,7 @@
 
 #include "nat64/mod/common/types.h"
 #include "nat64/mod/common/packet.h"
+#include <linux/rcupdate.h>
 
 /* ------------------------------ BIB Entries ----------------------------------- */
 
@@ -53,10 +54,24 @@ struct bib_entry {
 	struct rb_node tree6_hook;
 	/** Appends this entry to the database's IPv4 index. */
 	struct rb_node tree4_hook;
+	/** Appends this entry to the database's IPv6 hash index. See bibdb_prefetch(). */
+	struct hlist_node hash6_hook;
+	/** Appends this entry to the database's IPv4 hash index. See bibdb_prefetch(). */
+	struct hlist_node hash4_hook;
 
 	/** A reference for the IPv4 borrowed from pool4, this is hold it just for keeping the
 	 * host6_node alive in the database.*/
 	struct host_addr4 *host4_addr;
+
+	/** Appends this entry to its table's snapshot list. See bibdb_for_each(). */
+	struct list_head list_hook;
+	/**
+	 * Position of this entry in the snapshot list; bigger means newer.
+	 * Zero if the entry is not part of the database.
+	 */
+	unsigned long serial;
+	/** Defers the entry's release until the snapshot readers are done with it. */
+	struct rcu_head rcu;
 };
 
 /**
@@ -107,8 +122,10 @@ int bib_return_lockless(struct bib_entry *bib);
 /**
  * Initializes the three tables (UDP, TCP and ICMP).
  * Call during initialization for the remaining functions to work properly.
+ * "hash_size" is the number of buckets of the hash indexes (rounded up to a power of two). Zero
+ * means default.
  */
-int bibdb_init(void);
+int bibdb_init(unsigned int hash_size);
 /**
  * Empties the BIB tables, freeing any memory being used by them.
  * Call during destruction to avoid memory leaks.
@@ -131,6 +148,16 @@ void bibdb_destroy(void);
  */
 int bibdb_get(struct tuple *tuple, struct bib_entry **result);
 
+/**
+ * First phase of a bibdb_get() (or bibdb_get_or_create_ipv6()) of "tuple": computes the hash
+ * bucket the entry would be in, and starts pulling it into the cache without waiting for it.
+ *
+ * Callers which will need several entries are expected to prefetch all of them before resolving
+ * any, so the memory latency of the lookups overlaps instead of being paid once per lookup.
+ * Grabs no locks, and it's harmless if the entry turns out not to exist.
+ */
+void bibdb_prefetch(struct tuple *tuple);
+
 /**
  * Makes "result" point to the BIB entry from the "l4_proto" table whose IPv4 side (address and
  * port) is "addr".
@@ -181,6 +208,16 @@ int bibdb_get_or_create_ipv6(struct packet *pkt, struct tuple *tuple, struct bib
  *		memory allocation failed.
  */
 int bibdb_add(struct bib_entry *entry);
+/**
+ * Adds the "count" entries from "entries" to "l4_proto"'s table, taking its lock only once. Every
+ * entry's hash buckets are prefetched (see bibdb_prefetch()) before any of them is resolved.
+ * NULL slots are skipped. The result of each insertion (same as bibdb_add()'s) is written in the
+ * corresponding slot of "results"; the ones skipped are left alone.
+ *
+ * Returns error only if the batch could not be attempted at all.
+ */
+int bibdb_add_batch(l4_protocol l4_proto, struct bib_entry **entries, unsigned int count,
+		__s32 *results);
 
 /**
  * Attempts to remove the "entry" entry from its BIB. It doesn't kfree "entry".
@@ -195,18 +232,37 @@ int bibdb_remove(struct bib_entry *entry, bool lock);
 /**
  * Runs the "func" function for every entry in the table whose protocol is "l4_proto".
  *
+ * This does not lock the table; see sessiondb_for_each() for the consequences.
+ *
  * @param l4_proto protocol of the table you want to iterate in.
  * @param func function you want to execute for every entry. Will receive both the entry and "arg"
  * 		as parameters. you can break iteration early by having this function return nonzero.
  * @param arg something you want to send func for every entry.
  */
 int bibdb_for_each(l4_protocol l4_proto, int (*func)(struct bib_entry *, void *), void *arg);
+
+/**
+ * Remembers where a bibdb_iterate() stopped. See struct sessiondb_cursor.
+ */
+struct bibdb_cursor {
+	/** The last entry visited, or NULL. The cursor holds a reference to it. */
+	struct bib_entry *bib;
+	/** Serial of the last entry visited, in case it leaves the database in the meantime. */
+	unsigned long serial;
+};
+
+/**
+ * Similar to bibdb_for_each(), except it continues from wherever "cursor" was left, and moves it
+ * to the last entry "func" accepted. See sessiondb_iterate().
+ *
+ * Note that, while the cursor points to a BIB entry, the entry will not expire.
+ */
+int bibdb_iterate(l4_protocol l4_proto, int (*func)(struct bib_entry *, void *), void *arg,
+		struct bibdb_cursor *cursor);
 /**
- * Similar to bibdb_for_each(), except it only runs the function for BIB entries whose IPv4
- * transport address is "addr".
+ * Drops "cursor"'s reference to its entry.
  */
-int bibdb_iterate_by_ipv4(l4_protocol l4_proto, int (*func)(struct bib_entry *, void *), void *arg,
-		struct ipv4_transport_addr *offset);
+void bibdb_cursor_release(struct bibdb_cursor *cursor);
 /**
  * Sets in the value pointed by "result" the number of entries in the database whose protocol is
  * "l4_proto".
@@ -0,0 +1,50 @@
+#ifndef _JOOL_MOD_EVENT_LOG_H
+#define _JOOL_MOD_EVENT_LOG_H
+
+/**
+ * @file
+ * The binary version of the BIB and session logs.
+ *
+ * Printing a line per BIB entry or session does not scale; at a few tens of thousands of new
+ * sessions per second, printk() becomes the bottleneck and the kernel's log buffer overflows. So,
+ * while global_config.logging_binary is on, the databases queue fixed-size records here instead
+ * (see event_ring.h) and the jool-log daemon collects them (through MODE_LOG) and stores them.
+ * Converting them into text is also jool-log's business.
+ */
+
+#include "nat64/common/config.h"
+
+struct bib_entry;
+struct session_entry;
+
+
+/**
+ * Call during initialization for the remaining functions to work properly.
+ */
+int eventlog_init(void);
+/**
+ * Call during destruction to avoid memory leaks.
+ */
+void eventlog_destroy(void);
+
+/**
+ * Queues the "type" event of "bib". Never sleeps.
+ */
+void eventlog_bib(const struct bib_entry *bib, enum log_event_type type);
+/**
+ * Queues the "type" event of "session". Never sleeps.
+ */
+void eventlog_session(const struct session_entry *session, enum log_event_type type);
+
+/**
+ * Hands the queued events to "func", one by one, oldest first (within each CPU). If events were
+ * lost, "func" is told first through a LOG_EVENT_LOST event.
+ *
+ * If "func" returns nonzero, the iteration stops and the event it was given stays queued.
+ *
+ * Can sleep.
+ */
+int eventlog_drain(int (*func)(struct log_event_usr *, void *), void *arg);
+
+
+#endif /* _JOOL_MOD_EVENT_LOG_H */
@@ -0,0 +1,60 @@
+#ifndef _JOOL_MOD_FRAGMENT_CACHE_H
+#define _JOOL_MOD_FRAGMENT_CACHE_H
+
+/**
+ * @file
+ * Support for the fragment forwarding mode, in which fragments are translated as they arrive
+ * instead of being reassembled first.
+ *
+ * Only the first fragment of a packet carries the layer-4 header, so only the first fragment can
+ * go through filtering and the outgoing tuple computation. This module remembers the tuple the
+ * first fragment was translated with, keyed by (addresses, fragment identification, protocol), so
+ * the rest of the fragments can borrow it.
+ *
+ * Fragments which arrive before their first fragment wait here (in bounded numbers) until it does.
+ * Entries die after the fragment timeout.
+ */
+
+#include "nat64/mod/common/packet.h"
+#include "nat64/mod/common/types.h"
+
+
+/**
+ * If "enable" is false, fragment forwarding is off and the remaining functions are not needed.
+ */
+int fragcache_init(bool enable);
+void fragcache_destroy(void);
+
+/** Returns whether fragment forwarding is on. */
+bool fragcache_is_enabled(void);
+
+/** Returns true if fragment forwarding is on and "pkt" is the first fragment of its packet. */
+bool fragcache_is_first(struct packet *pkt);
+/** Returns true if fragment forwarding is on and "pkt" is a fragment other than the first one. */
+bool fragcache_is_subsequent(struct packet *pkt);
+
+/**
+ * Decides whether first fragment "pkt" can be translated on its own.
+ * Fragmented ICMP messages and IPv4 UDP fragments lacking a checksum cannot, because the
+ * checksums they need cover the entire packet.
+ */
+verdict fragcache_validate(struct packet *pkt);
+
+/**
+ * Records "tuple_out" as the tuple first fragment "pkt"'s packet is being translated with.
+ * The fragments which were waiting for it are moved to "waiting"; the caller should translate
+ * and send them.
+ */
+void fragcache_add(struct packet *pkt, struct tuple *tuple_out, struct sk_buff_head *waiting);
+
+/**
+ * Finds the tuple subsequent fragment "pkt" should be translated with.
+ *
+ * Returns VERDICT_CONTINUE and copies the tuple to "tuple_out" if the first fragment has already
+ * been translated. Otherwise stores "pkt" and returns VERDICT_STOLEN; it will be handed over by
+ * fragcache_add() later. Returns VERDICT_DROP if there is no room to store "pkt".
+ */
+verdict fragcache_get(struct packet *pkt, struct tuple *tuple_out);
+
+
+#endif /* _JOOL_MOD_FRAGMENT_CACHE_H */
@@ -11,6 +11,11 @@
  *
  * This module queues these fragments in skb_shinfo(skb)->frag_list so the rest of Jool doesn't
  * have to worry about handling fragments differently depending on kernel version.
+ *
+ * Fragments are accepted in any order; a packet is released once its fragments cover it
+ * completely. Overlapping fragments get the whole packet dropped (RFC 5722).
+ * The memory the stored fragments can take up is capped, both globally (the oldest packets are
+ * evicted) and per source (the offending fragments are dropped).
  */
 
 #include "nat64/mod/common/packet.h"
@@ -34,6 +34,11 @@
  * handshake), otherwise a ICMP error containing the original IPv4 packet is generated (because
  * there's no Simultaneous Open going on).
  *
+ * Since SYN scans can make every one of these packets land here, the database only keeps the first
+ * bytes of each packet (which is all the ICMP error needs), is spread over several independently
+ * locked shards, and refuses packets once they would take up more than the configured memory
+ * budget (see global_config.so_max_mem).
+ *
  * @author Angel Cazares
  * @author Daniel Hernandez
  * @author Alberto Leiva
@@ -52,7 +57,10 @@ int pktqueue_init(void);
 void pktqueue_destroy(void);
 
 /**
- * Stores packet "skb", associating it with "session".
+ * Stores the headers of "pkt"'s original packet, associating them with "session".
+ * "pkt" itself is not kept; the caller still owns it.
+ * Returns -E2BIG if the memory budget is exhausted, in which case the caller should reply the
+ * error right away.
  */
 int pktqueue_add(struct session_entry *session, struct packet *pkt);
 /**
@@ -60,7 +68,7 @@ int pktqueue_add(struct session_entry *session, struct packet *pkt);
  */
 int pktqueue_send(struct session_entry *session);
 /**
- * Removes "session"'s skb from the storage. There will be no ICMP error.
+ * Removes "session"'s packet from the storage. There will be no ICMP error.
  */
 int pktqueue_remove(struct session_entry *session);
 
@@ -16,6 +16,7 @@
 #include "nat64/common/types.h"
 #include "nat64/common/session.h"
 #include "nat64/mod/stateful/bib_db.h"
+#include <linux/rcupdate.h>
 
 /** ---------------------------------- Session Entries -------------------------------- */
 
@@ -61,6 +62,11 @@ struct session_entry {
 
 	/** Jiffy (from the epoch) this session was last updated/used. */
 	unsigned long update_time;
+	/**
+	 * Jiffy at which this session was last reported to the standby NAT64 (see session_sync.h).
+	 * Zero if it never was.
+	 */
+	unsigned long sync_time;
 
 	/**
 	 * Owner bib of this session. Used for quick access during removal.
@@ -95,6 +101,16 @@ struct session_entry {
 	struct rb_node tree6_hook;
 	/** Appends this entry to the database's IPv4 index. */
 	struct rb_node tree4_hook;
+
+	/** Appends this entry to its table's snapshot list. See sessiondb_for_each(). */
+	struct list_head list_hook;
+	/**
+	 * Position of this entry in the snapshot list; bigger means newer.
+	 * Zero if the entry is not part of the database.
+	 */
+	unsigned long serial;
+	/** Defers the entry's release until the snapshot readers are done with it. */
+	struct rcu_head rcu;
 };
 
 /**
@@ -132,18 +148,12 @@ int session_return(struct session_entry *session);
 
 /** ------------------------------ Session Database ----------------------------- */
 
-enum session_timer_type {
-	SESSIONTIMER_UDP,
-	SESSIONTIMER_ICMP,
-	SESSIONTIMER_TRANS,
-	SESSIONTIMER_EST,
-	SESSIONTIMER_SYN,
-};
-
 /**
  * Call during initialization for the remaining functions to work properly.
+ * "fastpath_size" is the number of buckets of the fast path's indexes (rounded up to a power of
+ * two). Zero means default.
  */
-int sessiondb_init(void);
+int sessiondb_init(unsigned int fastpath_size);
 /**
  * Call during destruction to avoid memory leaks.
  */
@@ -169,6 +179,38 @@ void sessiondb_destroy(void);
  */
 int sessiondb_get(struct tuple *tuple, struct session_entry **result);
 
+/**
+ * Fast path version of sessiondb_get(), for callers which only need the translated addresses.
+ *
+ * Established UDP and TCP sessions are mirrored in RCU-protected hash tables, kept in sync as
+ * sessions are created, change state and die. If "in" belongs to one of them, this writes the
+ * other side of the session in "out" and returns true. Otherwise it returns false and the caller
+ * should fall back to sessiondb_get().
+ *
+ * Grabs no spinlocks and no references. O(1) on average.
+ */
+bool sessiondb_get_fast(struct tuple *in, struct tuple *out);
+
+/**
+ * First phase of a fast path lookup (sessiondb_get_fast() or sessiondb_refresh_fast()) of "tuple":
+ * computes the bucket the session would be in, and starts pulling it into the cache without
+ * waiting for it. See bibdb_prefetch().
+ */
+void sessiondb_prefetch(struct tuple *tuple);
+
+/**
+ * Fast path version of the filtering and updating of an established flow.
+ *
+ * If "tuple" belongs to an established UDP or TCP session and "pkt" does not carry a TCP SYN, FIN
+ * or RST, this refreshes the session's timer (and schedules its replication) exactly like the
+ * slow path would, and returns zero. The session is found through the fast path's hash, so neither
+ * the BIB nor the session trees are walked; only the session table's spinlock is taken, because
+ * the expiration list needs it.
+ *
+ * Returns -ESRCH if the caller should take the slow path instead.
+ */
+int sessiondb_refresh_fast(struct packet *pkt, struct tuple *tuple);
+
 /**
  * @{
  * An atomic way of saying something in the lines of
@@ -218,27 +260,75 @@ bool sessiondb_allow(struct tuple *tuple);
  * O(log n), where n is the number of entries in the table.
  */
 int sessiondb_add(struct session_entry *session, enum session_timer_type timer_type);
+/**
+ * Adds the "count" sessions from "sessions" to "l4_proto"'s table, taking its lock only once.
+ * This is meant for sessions which existed before (eg. in a previous instance of the module), so
+ * instead of starting their lives from scratch, "sessions[i]" is subscribed to the "timers[i]"
+ * timer with "ttls[i]" milliseconds left.
+ *
+ * If "update" is true, sessions which already exist are not an error; the existing entries adopt
+ * the state, timer and time to live of their counterparts from "sessions" instead. This is how
+ * the standby NAT64 keeps up with the active one (see session_sync.h). Only the sessions which
+ * actually get added are logged (as LOG_EVENT_SESSION_RESTORE); refreshes are not.
+ *
+ * NULL slots are skipped. The result of each insertion (same as sessiondb_add()'s) is written in
+ * the corresponding slot of "results"; the ones skipped are left alone.
+ *
+ * Returns error only if the batch could not be attempted at all.
+ */
+int sessiondb_add_batch(l4_protocol l4_proto, struct session_entry **sessions,
+		enum session_timer_type *timers, unsigned int *ttls, unsigned int count,
+		bool update, __s32 *results);
+/**
+ * Removes from "l4_proto"'s table the sessions which have the same IPv6 addresses as the "count"
+ * sessions from "keys", taking its lock only once. The keys themselves are not touched.
+ *
+ * NULL slots are skipped. The result of each removal (-ESRCH if the session did not exist) is
+ * written in the corresponding slot of "results"; the ones skipped are left alone.
+ *
+ * Returns error only if the batch could not be attempted at all.
+ */
+int sessiondb_remove_batch(l4_protocol l4_proto, struct session_entry **keys, unsigned int count,
+		__s32 *results);
 
 /**
  * Runs the "func" function for every session in the session table whose l4-protocol is "proto".
- * It sends each entry and "arg" to every call of "func".
+ * It sends each entry and "arg" to every call of "func". Iteration stops early if "func" returns
+ * nonzero.
+ *
+ * This does not lock the table, so it does not stall translation no matter how big the table is.
+ * The price is that it works on a loose snapshot: sessions added or removed during the iteration
+ * might or might not be visited, and only the const fields of the entries are guaranteed to hold
+ * still. "func" runs in an RCU-bh read-side critical section, so it cannot sleep.
  *
  * O(n), where n is the number of entries in the table.
- * Warning: This locks the table while you're iterating. You want to quit early if the tree is big.
  */
 int sessiondb_for_each(l4_protocol proto, int (*func)(struct session_entry *, void *), void *arg);
 
 /**
- * Similar to sessiondb_for_each(), except it only runs the function for sessions whose local IPv4
- * transport addresses are "addr".
+ * Remembers where a sessiondb_iterate() stopped, so the next one can continue from there.
+ * Initialize it with zeroes, and release it with sessiondb_cursor_release() when you're done.
+ */
+struct sessiondb_cursor {
+	/** The last session visited, or NULL. The cursor holds a reference to it. */
+	struct session_entry *session;
+	/** Serial of the last session visited, in case it leaves the database in the meantime. */
+	unsigned long serial;
+};
+
+/**
+ * Similar to sessiondb_for_each(), except it continues from wherever "cursor" was left, and moves
+ * it to the last session "func" accepted (returned zero for).
  *
- * O(n), where n is the number of entries in the table whose local IPv4 addresses are "addr".
- * Warning: This locks the table while you're iterating. You want to quit early if the tree is big.
+ * This is meant for iterations which span several calls (such as table dumps to userspace).
+ * The staleness of the snapshot is then bounded by the time the whole thing takes.
  */
-int sessiondb_iterate_by_ipv4(l4_protocol proto,
-		int (*func)(struct session_entry *, void *), void *arg,
-		struct ipv4_transport_addr *offset_remote,
-		struct ipv4_transport_addr *offset_local);
+int sessiondb_iterate(l4_protocol proto, int (*func)(struct session_entry *, void *), void *arg,
+		struct sessiondb_cursor *cursor);
+/**
+ * Drops "cursor"'s reference to its session.
+ */
+void sessiondb_cursor_release(struct sessiondb_cursor *cursor);
 
 /**
  * Returns in "result" the number of sessions in the table whose l4-protocol is "proto".
@@ -295,6 +385,10 @@ int sessiondb_tcp_state_machine(struct packet *pkt, struct session_entry *sessio
  * "session->update_time".
  */
 int sessiondb_get_timeout(struct session_entry *session, unsigned long *result);
+/**
+ * Returns in "result" the timer "session" is currently subscribed to.
+ */
+int sessiondb_get_timer_type(struct session_entry *session, enum session_timer_type *result);
 
 int sessiondb_update_timer(enum session_timer_type type);
 
@@ -0,0 +1,57 @@
+#ifndef _JOOL_MOD_SESSION_SYNC_H
+#define _JOOL_MOD_SESSION_SYNC_H
+
+/**
+ * @file
+ * The kernel half of the active/standby replication of the session tables.
+ *
+ * While global_config.session_sync is on, the session database reports the sessions it creates,
+ * updates and forgets here. The reports are queued in one ring per CPU (see event_ring.h), and sit
+ * there until the jool-sync daemon drains them (through MODE_SYNC) and ships them to the standby
+ * NAT64, which inserts them with the session OP_LOAD.
+ *
+ * The database already coalesces most of the noise: a session which is merely being refreshed is
+ * reported at most once every SESSION_SYNC_REFRESH seconds. Only creations, TCP state (or timer)
+ * changes and removals are reported immediately.
+ *
+ * If the daemon does not keep up, the rings overflow and the events are dropped; the next drain
+ * then asks the daemon to send the whole tables again (see SESSION_RECORD_RESYNC).
+ *
+ * The rings only keep order within each CPU, and a session's events often come from different
+ * ones (eg. each direction of the flow, or the expiration timer). That's why every record carries a
+ * global sequence number (session_record_usr.seq); the daemon orders and coalesces by it, never by
+ * the order in which the records were drained.
+ */
+
+#include "nat64/common/config.h"
+
+
+/**
+ * Call during initialization for the remaining functions to work properly.
+ */
+int sessionsync_init(void);
+/**
+ * Call during destruction to avoid memory leaks.
+ */
+void sessionsync_destroy(void);
+
+/**
+ * Queues "record" in the current CPU's ring. A copy is stored, not "record" itself.
+ *
+ * Never sleeps and never blocks. If the ring is full, the record is dropped.
+ */
+void sessionsync_add(struct session_record_usr *record);
+
+/**
+ * Hands the queued records to "func", one by one. Oldest first within each CPU, but the CPUs are
+ * visited one after the other; use the records' sequence numbers to order them.
+ *
+ * If "func" returns nonzero, the iteration stops and the record it was given stays queued, so it
+ * can be retried by the next call. The other queues are not visited in that case.
+ *
+ * Can sleep.
+ */
+int sessionsync_drain(int (*func)(struct session_record_usr *, void *), void *arg);
+
+
+#endif /* _JOOL_MOD_SESSION_SYNC_H */
@@ -19,6 +19,30 @@
  */
 int add_static_route(struct request_bib *req);
 
+/**
+ * Adds "count" static entries to "l4_proto"'s BIB, locking the table only once.
+ *
+ * @param entries descriptions of the BIBs to be added. Only the addresses are used.
+ * @param results the success status of each entry, as a unix error code, will be placed here.
+ * @return whether the batch could be attempted at all, as a unix error code.
+ */
+int add_static_routes(l4_protocol l4_proto, struct bib_entry_usr *entries, unsigned int count,
+		__s32 *results);
+
+/**
+ * Puts the "count" BIB entries and sessions described by "records" back into "l4_proto"'s tables.
+ * The sessions keep the state and time to live they had when they were saved, and are added in a
+ * single lock acquisition.
+ *
+ * @param sync whether the records are events from the active NAT64 (see session_sync.h). If so,
+ *		existing sessions are updated instead of rejected, and records flagged
+ *		SESSION_RECORD_REMOVED remove their sessions.
+ * @param results the success status of each record, as a unix error code, will be placed here.
+ * @return whether the batch could be attempted at all, as a unix error code.
+ */
+int restore_sessions(l4_protocol l4_proto, struct session_record_usr *records, unsigned int count,
+		bool sync, __s32 *results);
+
 /**
  * Mainly deletes static entries from the BIB. It can also remove dynamic entries, though.
  *
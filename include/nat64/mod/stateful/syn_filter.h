@@ -0,0 +1,45 @@
+#ifndef _JOOL_MOD_SYN_FILTER_H
+#define _JOOL_MOD_SYN_FILTER_H
+
+/**
+ * @file
+ * Memory of the IPv4 SYNs which were recently translated without creating a session (see
+ * global_config.stateless_external_tcp).
+ *
+ * When the IPv6 node answers one of these, Filtering needs to know the connection was opened from
+ * IPv4, so the new session can start as ESTABLISHED instead of V6_INIT. Keeping a session (or
+ * anything else) per SYN would defeat the point, so this is a Bloom filter instead. Its size is
+ * fixed during initialization (see the syn_filter_bits module parameter), and should grow with the
+ * number of SYNs expected per TCP_INCOMING_SYN period, or the false positives will pile up.
+ * It can give false positives (an unrelated IPv6 SYN seen as an answer) and false negatives (an
+ * answer which took too long); both only affect the initial state of the new session.
+ *
+ * The filter is split in two generations so it can forget: a SYN is remembered for somewhere
+ * between one and two TCP_INCOMING_SYN periods.
+ */
+
+#include "nat64/mod/common/types.h"
+
+
+/**
+ * Call during initialization for the remaining functions to work properly.
+ * "size" is the number of bits of each generation (rounded up to a power of two). Zero means
+ * default.
+ */
+int synfilter_init(unsigned int size);
+/**
+ * Call during destruction to avoid memory leaks.
+ */
+void synfilter_destroy(void);
+
+/**
+ * Remembers that an IPv4 SYN from "remote4" towards "local4" was just translated.
+ */
+void synfilter_add(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4);
+/**
+ * Returns whether an IPv4 SYN from "remote4" towards "local4" was translated recently.
+ */
+bool synfilter_contains(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4);
+
+
+#endif /* _JOOL_MOD_SYN_FILTER_H */
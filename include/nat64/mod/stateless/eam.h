@@ -9,6 +9,7 @@
  */
 
 #include <linux/rbtree.h>
+#include "nat64/common/config.h"
 #include "nat64/common/types.h"
 
 /**
@@ -21,10 +22,33 @@ struct eam_entry {
 	struct ipv4_prefix pref4;
 	/** The prefix address for the IPv6 network. */
 	struct ipv6_prefix pref6;
+
+	/**
+	 * Precomputed translation parameters, so mapping an address is a handful of word operations.
+	 * See eamt_create_entry().
+	 */
+	struct {
+		/** "pref6"'s address, as host-order halves. (See addr6_get_hi().) */
+		__u64 prefix6_hi;
+		__u64 prefix6_lo;
+		/** "pref4"'s address, host order. */
+		__u32 prefix4;
+		/** Mask of the IPv4 suffix, host order. */
+		__u64 suffix_mask;
+		/** Moves the suffix between its IPv4 position and the "hi" half of the IPv6 address. */
+		unsigned int hi_left;
+		unsigned int hi_right;
+		/** Moves the suffix between its IPv4 position and the "lo" half of the IPv6 address. */
+		unsigned int lo_shift;
+		__u64 lo_mask;
+	} xlat;
+
 	/** Appends this entry to the database's IPv6 index. */
 	struct rb_node tree6_hook;
 	/** Appends this entry to the database's IPv4 index. */
 	struct rb_node tree4_hook;
+	/** Defers the release of the entry until the packet path is done with it. */
+	struct rcu_head rcu;
 };
 
 int eamt_init(void);
@@ -37,6 +61,14 @@ void eamt_destroy(void);
  *	If the "ipX_pref" contains or is part of a prefix indexed in the databases, then returns error.
  */
 int eamt_add(struct ipv6_prefix *ip6_pref, struct ipv4_prefix *ip4_pref);
+/**
+ * Inserts the "count" entries from "entries" to the database, validating them first and taking the
+ * lock only once for the whole batch. The result of each insertion (same as eamt_add()'s) is
+ * written in the same slot of "results".
+ *
+ * Returns error only if the batch could not be attempted at all.
+ */
+int eamt_add_batch(struct eam_entry_usr *entries, unsigned int count, __s32 *results);
 int eamt_remove(struct ipv6_prefix *prefix6, struct ipv4_prefix *prefix4);
 
 /**
@@ -64,6 +96,13 @@ int eamt_get_ipv4_by_ipv6(struct in6_addr *addr6, struct in_addr *result);
  */
 int eamt_flush(void);
 
+/**
+ * Transactions; see pool6_txn_begin() and friends.
+ */
+void eamt_txn_begin(void);
+void eamt_txn_commit(void);
+void eamt_txn_abort(void);
+
 /**
  * Returns true if "addr" is in the eam database, otherwise return false.
  */
@@ -17,6 +17,18 @@ struct pool_entry {
 	struct list_head list_hook;
 };
 
+/**
+ * Changes to a pool which have been requested but not applied yet.
+ */
+struct pool_txn {
+	/** Whether changes are currently being staged instead of applied. */
+	bool open;
+	/** Whether "candidate" has been initialized as the pool's replacement. */
+	bool dirty;
+	/** The pool the transaction wants to end up with. Nobody else can see it. */
+	struct list_head candidate;
+};
+
 int pool_init(char *pref_strs[], int pref_count, struct list_head *pool);
 
 void pool_destroy(struct list_head *pool);
@@ -27,6 +39,17 @@ int pool_remove(struct list_head *pool, struct ipv4_prefix *prefix);
 
 int pool_flush(struct list_head *pool);
 
+void pool_txn_begin(struct pool_txn *txn);
+int pool_txn_add(struct list_head *pool, struct pool_txn *txn, struct ipv4_prefix *prefix);
+int pool_txn_remove(struct list_head *pool, struct pool_txn *txn, struct ipv4_prefix *prefix);
+int pool_txn_flush(struct pool_txn *txn);
+/**
+ * Replaces "pool" with "txn"'s candidate, if the transaction changed anything.
+ * Returns whether it did.
+ */
+bool pool_txn_commit(struct list_head *pool, struct pool_txn *txn);
+void pool_txn_abort(struct pool_txn *txn);
+
 int pool_for_each(struct list_head *pool, int (*func)(struct ipv4_prefix *, void *), void *arg,
 		struct ipv4_prefix *offset);
 
@@ -20,8 +20,19 @@ void pool4_destroy(void);
 int pool4_add(struct ipv4_prefix *prefix);
 int pool4_remove(struct ipv4_prefix *prefix);
 int pool4_flush(void);
+/**
+ * Returns true if "addr" belongs to the pool or to one of this node's interfaces.
+ * Called on every packet; it does not walk the pool nor the interfaces.
+ */
 bool pool4_contains(__be32 addr);
 
+/**
+ * Transactions; see pool6_txn_begin() and friends.
+ */
+void pool4_txn_begin(void);
+void pool4_txn_commit(void);
+void pool4_txn_abort(void);
+
 int pool4_for_each(int (*func)(struct ipv4_prefix *, void *), void *arg,
 		struct ipv4_prefix *offset);
 int pool4_count(__u64 *result);
@@ -26,6 +26,13 @@ int rfc6791_remove(struct ipv4_prefix *prefix);
 int rfc6791_flush(void);
 int rfc6791_get(struct packet *in, struct packet *out, struct in_addr *result);
 
+/**
+ * Transactions; see pool6_txn_begin() and friends.
+ */
+void rfc6791_txn_begin(void);
+void rfc6791_txn_commit(void);
+void rfc6791_txn_abort(void);
+
 int rfc6791_for_each(int (*func)(struct ipv4_prefix *, void *), void *arg,
 		struct ipv4_prefix *offset);
 int rfc6791_count(__u64 *result);
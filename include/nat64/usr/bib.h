@@ -13,6 +13,7 @@ int bib_add(bool use_tcp, bool use_udp, bool use_icmp,
 int bib_remove(bool use_tcp, bool use_udp, bool use_icmp,
 		bool addr6_set, struct ipv6_transport_addr *addr6,
 		bool addr4_set, struct ipv4_transport_addr *addr4);
+int bib_load(bool use_tcp, bool use_udp, bool use_icmp, char *file_name);
 
 
 #endif /* _JOOL_USR_BIB_H */
@@ -9,6 +9,7 @@ int eam_add(struct ipv6_prefix *prefix6, struct ipv4_prefix *prefix4);
 int eam_remove(bool pref6_set, struct ipv6_prefix *prefix6, bool pref4_set,
 		struct ipv4_prefix *prefix4);
 int eam_flush();
+int eam_load(char *file_name);
 
 
 #endif /* _JOOL_USR_EAM_H */
@@ -0,0 +1,53 @@
+#ifndef _JOOL_USR_EVENT_LOG_H
+#define _JOOL_USR_EVENT_LOG_H
+
+/**
+ * @file
+ * Userspace access to the binary BIB and session logs (see MODE_LOG and --logging-binary): draining
+ * them from the kernel, and the file format jool-log stores them in.
+ *
+ * A log file is a log_file_hdr followed by raw struct log_event_usrs, in the byte order of the
+ * machine which collected them.
+ */
+
+#include <stdio.h>
+#include "nat64/common/config.h"
+
+
+/** First bytes of every log file. */
+#define LOG_FILE_MAGIC "jlog"
+#define LOG_FILE_VERSION 1
+
+struct log_file_hdr {
+	char magic[4];
+	__u32 version;
+	/** sizeof(struct log_event_usr), so files from different builds are not misread. */
+	__u32 event_size;
+};
+
+/**
+ * Takes the events the kernel queued since the last call, and hands them to "cb", in as many
+ * batches as the kernel needed.
+ *
+ * The queues have only one reader; if two programs drain them, each gets part of the events.
+ * (That's why jool-ipfix can write the jool-log file by itself.)
+ */
+int eventlog_drain(int (*cb)(struct log_event_usr *events, unsigned int count, void *arg),
+		void *arg);
+
+/**
+ * Opens "path" for appending, and writes the file header if the file is new.
+ */
+FILE *eventlog_open_append(char *path);
+/**
+ * Appends the "count" events from "events" to "file", which eventlog_open_append() returned.
+ * The caller decides when to flush.
+ */
+int eventlog_write(FILE *file, struct log_event_usr *events, unsigned int count);
+/**
+ * Opens "path" ("-" means standard input) for reading, and skips the header.
+ * Fails if the file header is not the one this build would write.
+ */
+FILE *eventlog_open_read(char *path);
+
+#endif /* _JOOL_USR_EVENT_LOG_H */
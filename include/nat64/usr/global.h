@@ -11,6 +11,7 @@
 #define OPTNAME_OVERRIDE_TOS		"override-tos"
 #define OPTNAME_TOS					"tos"
 #define OPTNAME_MTU_PLATEAUS		"mtu-plateaus"
+#define OPTNAME_LATENCY_HISTOGRAMS	"latency-histograms"
 
 /* Atomic fragment flags (deprecated) */
 #define OPTNAME_ALLOW_ATOMIC_FRAGS	"allow-atomic-fragments"
@@ -27,15 +28,20 @@
 #define OPTNAME_DROP_BY_ADDR		"address-dependent-filtering"
 #define OPTNAME_DROP_ICMP6_INFO		"drop-icmpv6-info"
 #define OPTNAME_DROP_EXTERNAL_TCP	"drop-externally-initiated-tcp"
+#define OPTNAME_STATELESS_EXTERNAL_TCP	"stateless-externally-initiated-tcp"
 #define OPTNAME_UDP_TIMEOUT			"udp-timeout"
 #define OPTNAME_ICMP_TIMEOUT		"icmp-timeout"
 #define OPTNAME_TCPEST_TIMEOUT		"tcp-est-timeout"
 #define OPTNAME_TCPTRANS_TIMEOUT	"tcp-trans-timeout"
 #define OPTNAME_FRAG_TIMEOUT		"fragment-arrival-timeout"
+#define OPTNAME_SO_MAX_MEM			"simultaneous-open-memory"
+/* Deprecated; replaced by OPTNAME_SO_MAX_MEM. */
 #define OPTNAME_MAX_SO				"maximum-simultaneous-opens"
 #define OPTNAME_SRC_ICMP6E_BETTER	"source-icmpv6-errors-better"
 #define OPTNAME_BIB_LOGGING			"logging-bib"
 #define OPTNAME_SESSION_LOGGING		"logging-session"
+#define OPTNAME_LOGGING_BINARY		"logging-binary"
+#define OPTNAME_SESSION_SYNC		"session-sync"
 
 
 int global_display(void);
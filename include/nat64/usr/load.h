@@ -0,0 +1,59 @@
+#ifndef _JOOL_USR_LOAD_H
+#define _JOOL_USR_LOAD_H
+
+/**
+ * @file
+ * Reads tables from files and sends them to Jool in batches (see OP_LOAD), so large tables don't
+ * need one request (and one lock acquisition in the kernel) per entry.
+ *
+ * The files contain one entry per line; each entry is two whitespace-separated addresses, in the
+ * same format the --add operation takes them. Empty lines and lines starting with '#' are ignored.
+ */
+
+#include <netlink/msg.h>
+#include "nat64/common/types.h"
+
+
+/**
+ * Maximum number of entries sent per request.
+ * (Requests are limited to 64 KB; the largest entries are 32 bytes.)
+ */
+#define LOAD_BATCH_SIZE 1024
+
+struct load_batch {
+	/** Line of the file each of the entries from the current batch came from. */
+	unsigned int lines[LOAD_BATCH_SIZE];
+	/** Number of entries in the current batch. */
+	unsigned int count;
+	/** Name of the table the current batch is being sent to, for the error messages. */
+	const char *table;
+	/** What "lines" counts, for the error messages. NULL means "Line". */
+	const char *unit;
+
+	/** Number of entries Jool accepted so far. */
+	unsigned int loaded;
+	/** Number of entries which could not be parsed or were rejected so far. */
+	unsigned int failed;
+};
+
+/**
+ * Reads the entries from the "file_name" file ("-" stands for standard input) and sends them in
+ * batches.
+ *
+ * Each request is "request_len" bytes of headers (which "send" fills) followed by the batch's
+ * entries, which are "entry_size" bytes each and are written by "parse" out of the two addresses
+ * found in their line. "send" is supposed to hand the request to netlink_request() using
+ * load_response() as callback and "batch" as its argument.
+ */
+int load_file(char *file_name, size_t request_len, size_t entry_size,
+		int (*parse)(char *str1, char *str2, void *entry),
+		int (*send)(void *request, struct load_batch *batch, void *arg),
+		void *arg);
+
+/**
+ * Reports the entries Jool could not add. Use it as netlink_request()'s callback.
+ */
+int load_response(struct nl_msg *msg, void *arg);
+
+
+#endif /* _JOOL_USR_LOAD_H */
@@ -1,14 +1,12 @@
 #ifndef _JOOL_USR_LOG_TIME_H
 #define _JOOL_USR_LOG_TIME_H
-/*
- * log_time.h
- *
- *  Created on: Oct 3, 2014
- *      Author: dhernandez
- */
 
-#include <time.h>
+/**
+ * @file
+ * The userspace half of the latency histograms (MODE_LOGTIME).
+ */
 
-int logtime_display();
+int logtime_display(void);
+int logtime_flush(void);
 
 #endif /* _JOOL_USR_LOG_TIME_H */
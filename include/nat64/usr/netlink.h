@@ -21,8 +21,16 @@
 	#error "Unsupported LIBNL library version number (< 3.0)."
 #endif
 
+/**
+ * Sends "request" to Jool and hands every message of the response to "cb".
+ * The connection is opened the first time this is called, and kept until netlink_destroy().
+ */
 int netlink_request(void *request, __u16 request_len, int (*cb)(struct nl_msg *, void *),
 		void *cb_arg);
+/**
+ * Closes the connection netlink_request() opened, if any.
+ */
+void netlink_destroy(void);
 
 
 #endif /* _JOOL_USR_NETLINK_H_ */
@@ -2,11 +2,51 @@
 #define _JOOL_USR_SESSION_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include "nat64/common/config.h"
+#include "nat64/common/session.h"
 
 
+/** First bytes of every session file. */
+#define SESSION_FILE_MAGIC "jses"
+/** Bump this whenever "struct session_record_usr" changes. */
+#define SESSION_FILE_VERSION 2
+
+/**
+ * Beginning of the files session_save() writes. A sequence of "struct session_record_usr"s follows.
+ *
+ * Everything is written in the host's byte order, so the files are only meant to be read back by
+ * the machine which wrote them (eg. to survive a module reload).
+ */
+struct session_file_hdr {
+	char magic[4];
+	__u32 version;
+	/** Seconds since the epoch at which the file was written. */
+	__u64 save_time;
+};
+
+char *tcp_state_to_string(enum tcp_state state);
 int session_display(bool use_tcp, bool use_udp, bool use_icmpm, bool numeric_hostname,
 		bool csv_format);
 int session_count(bool use_tcp, bool use_udp, bool use_icmp);
+/**
+ * Writes the BIB entries and sessions Jool currently has to the "file_name" file, so they can be
+ * restored (by session_load()) after the module is reinserted.
+ */
+int session_save(bool use_tcp, bool use_udp, bool use_icmp, char *file_name);
+/**
+ * Returns in "result" the BIB entries and sessions Jool currently has in its "l4_proto" tables,
+ * in the order they should be restored. "skipped" is the number of sessions which cannot be.
+ *
+ * "result" is allocated dynamically; free() it when you're done.
+ */
+int session_fetch(l4_protocol l4_proto, struct session_record_usr **result, size_t *count,
+		unsigned int *skipped);
+/**
+ * Puts the BIB entries and sessions from the "file_name" file ("-" is standard input) back in
+ * Jool's tables, in batches.
+ */
+int session_load(char *file_name);
 
 
 #endif /* _JOOL_USR_SESSION_H */
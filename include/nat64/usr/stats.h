@@ -0,0 +1,12 @@
+#ifndef _JOOL_USR_STATS_H
+#define _JOOL_USR_STATS_H
+
+/**
+ * @file
+ * The userspace half of the packet counters (MODE_STATS).
+ */
+
+int stats_display(void);
+int stats_flush(void);
+
+#endif /* _JOOL_USR_STATS_H */
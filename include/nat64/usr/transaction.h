@@ -0,0 +1,11 @@
+#ifndef _JOOL_USR_TRANSACTION_H
+#define _JOOL_USR_TRANSACTION_H
+
+#include "nat64/common/config.h"
+
+
+int txn_display(void);
+int txn_update(enum transaction_action action);
+
+
+#endif /* _JOOL_USR_TRANSACTION_H */
@@ -65,3 +65,31 @@ bool is_blacklisted6(const struct in6_addr *addr)
 
 	return false;
 }
+
+int blacklist4_for_each(int (*func)(struct ipv4_prefix *, void *), void *arg)
+{
+	int i;
+	int error;
+
+	for (i = 0; i < ARRAY_SIZE(list4); i++) {
+		error = func(&list4[i], arg);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+int blacklist6_for_each(int (*func)(struct ipv6_prefix *, void *), void *arg)
+{
+	int i;
+	int error;
+
+	for (i = 0; i < ARRAY_SIZE(list6); i++) {
+		error = func(&list6[i], arg);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
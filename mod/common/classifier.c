@@ -0,0 +1,526 @@
+#include "nat64/mod/common/classifier.h"
+
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+
+#include "nat64/common/nat64.h"
+#include "nat64/mod/common/address.h"
+#include "nat64/mod/common/blacklist.h"
+#include "nat64/mod/common/pool6.h"
+#include "nat64/mod/common/types.h"
+#include "nat64/mod/stateful/pool4.h"
+
+/**
+ * An address, as a number. IPv4 addresses only use the least significant 32 bits of "lo".
+ */
+struct classifier_key {
+	__u64 hi;
+	__u64 lo;
+};
+
+/** The classes an address can belong to. Higher values take precedence when prefixes overlap. */
+enum classifier_class {
+	/** Nothing Jool cares about. */
+	CLASS_NONE = 0,
+	/** The address belongs to the pool (pool4 on IPv4, pool6 on IPv6). */
+	CLASS_POOL,
+	/** The address belongs to the blacklist. */
+	CLASS_BLACKLIST,
+};
+
+/**
+ * The addresses starting at "start", up to (and excluding) the next segment's start, belong to
+ * "class".
+ */
+struct classifier_segment {
+	struct classifier_key start;
+	enum classifier_class class;
+};
+
+/** The compiled form of one protocol's blacklist and pool. */
+struct classifier_table {
+	/**
+	 * Sorted by start. The first one always starts at zero, and no two contiguous segments have
+	 * the same class.
+	 */
+	struct classifier_segment *segments;
+	unsigned int count;
+};
+
+struct classifier {
+	struct classifier_table table4;
+	struct classifier_table table6;
+};
+
+/** NULL if the last rebuild failed. */
+static struct classifier __rcu *classifier;
+
+/** An inclusive range of addresses; the uncompiled form of a prefix. */
+struct classifier_range {
+	struct classifier_key first;
+	struct classifier_key last;
+};
+
+/**
+ * A growable list of ranges.
+ *
+ * The pools hand their prefixes over while holding their locks (pool4's spinlock, pool6's RCU
+ * read-side section), so the list cannot grow while it is being filled. list_fill() grows it in
+ * between attempts instead.
+ */
+struct range_list {
+	struct classifier_range *ranges;
+	unsigned int count;
+	unsigned int capacity;
+};
+
+static const struct classifier_key max4 = { .hi = 0, .lo = 0xFFFFFFFFULL };
+static const struct classifier_key max6 = { .hi = ~0ULL, .lo = ~0ULL };
+
+static int key_cmp(const struct classifier_key *k1, const struct classifier_key *k2)
+{
+	if (k1->hi != k2->hi)
+		return (k1->hi < k2->hi) ? -1 : 1;
+	if (k1->lo != k2->lo)
+		return (k1->lo < k2->lo) ? -1 : 1;
+	return 0;
+}
+
+static int key_sort_cmp(const void *k1, const void *k2)
+{
+	return key_cmp(k1, k2);
+}
+
+/** Returns the key that follows "key". The caller has to make sure "key" is not the maximum. */
+static struct classifier_key key_next(const struct classifier_key *key)
+{
+	struct classifier_key result = *key;
+
+	result.lo++;
+	if (!result.lo)
+		result.hi++;
+	return result;
+}
+
+static void key4_init(struct classifier_key *key, __be32 addr)
+{
+	key->hi = 0;
+	key->lo = be32_to_cpu(addr);
+}
+
+static void key6_init(struct classifier_key *key, const struct in6_addr *addr)
+{
+	key->hi = addr6_get_hi(addr);
+	key->lo = addr6_get_lo(addr);
+}
+
+static int list_add_range(struct range_list *list, struct classifier_key *first,
+		struct classifier_key *last)
+{
+	if (list->count == list->capacity)
+		return -ENOSPC; /* list_fill() will grow the list and try again. */
+
+	list->ranges[list->count].first = *first;
+	list->ranges[list->count].last = *last;
+	list->count++;
+	return 0;
+}
+
+static int add_prefix4(struct ipv4_prefix *prefix, void *arg)
+{
+	struct classifier_key first, last;
+	__u32 mask = prefix->len ? (~0U << (32 - prefix->len)) : 0;
+
+	key4_init(&first, prefix->address.s_addr);
+	first.lo &= mask;
+	last = first;
+	last.lo |= (__u32) ~mask;
+
+	return list_add_range(arg, &first, &last);
+}
+
+static int add_prefix6(struct ipv6_prefix *prefix, void *arg)
+{
+	struct classifier_key first, last;
+	__u64 mask_hi, mask_lo;
+
+	if (prefix->len == 0)
+		mask_hi = 0;
+	else if (prefix->len < 64)
+		mask_hi = ~0ULL << (64 - prefix->len);
+	else
+		mask_hi = ~0ULL;
+
+	if (prefix->len <= 64)
+		mask_lo = 0;
+	else if (prefix->len < 128)
+		mask_lo = ~0ULL << (128 - prefix->len);
+	else
+		mask_lo = ~0ULL;
+
+	key6_init(&first, &prefix->address);
+	first.hi &= mask_hi;
+	first.lo &= mask_lo;
+	last.hi = first.hi | ~mask_hi;
+	last.lo = first.lo | ~mask_lo;
+
+	return list_add_range(arg, &first, &last);
+}
+
+/**
+ * Doubles "list"'s capacity. Can sleep.
+ */
+static int list_grow(struct range_list *list)
+{
+	struct classifier_range *tmp;
+	unsigned int capacity;
+
+	capacity = list->capacity ? (2 * list->capacity) : 8;
+	tmp = krealloc(list->ranges, capacity * sizeof(*list->ranges), GFP_KERNEL);
+	if (!tmp)
+		return -ENOMEM;
+
+	list->ranges = tmp;
+	list->capacity = capacity;
+	return 0;
+}
+
+/**
+ * Empties "list" and fills it with the prefixes "fill" visits. Since the visits happen in atomic
+ * context, the list is grown (and the prefixes visited again) out here whenever it turns out to be
+ * too small.
+ */
+static int list_fill(struct range_list *list, int (*fill)(struct range_list *))
+{
+	int error;
+
+	while (true) {
+		list->count = 0;
+		error = fill(list);
+		if (error != -ENOSPC)
+			return error;
+
+		error = list_grow(list);
+		if (error)
+			return error;
+	}
+}
+
+static int fill_blacklist4(struct range_list *list)
+{
+	return blacklist4_for_each(add_prefix4, list);
+}
+
+static int fill_pool4(struct range_list *list)
+{
+	return pool4_for_each(add_prefix4, list, NULL);
+}
+
+static int fill_blacklist6(struct range_list *list)
+{
+	return blacklist6_for_each(add_prefix6, list);
+}
+
+static int fill_pool6(struct range_list *list)
+{
+	return pool6_for_each(add_prefix6, list, NULL);
+}
+
+static int range_sort_cmp(const void *r1, const void *r2)
+{
+	const struct classifier_range *range1 = r1;
+	const struct classifier_range *range2 = r2;
+	return key_cmp(&range1->first, &range2->first);
+}
+
+/**
+ * Sorts "list" and joins its overlapping or contiguous ranges, so they end up disjoint.
+ */
+static void list_normalize(struct range_list *list, const struct classifier_key *max)
+{
+	struct classifier_range *prev, *range;
+	struct classifier_key next;
+	unsigned int i, count = 0;
+
+	sort(list->ranges, list->count, sizeof(*list->ranges), range_sort_cmp, NULL);
+
+	for (i = 0; i < list->count; i++) {
+		range = &list->ranges[i];
+		if (count > 0) {
+			prev = &list->ranges[count - 1];
+			if (key_cmp(&prev->last, max) == 0)
+				break; /* prev reaches the end; everything else is inside of it. */
+			next = key_next(&prev->last);
+			if (key_cmp(&range->first, &next) <= 0) {
+				if (key_cmp(&range->last, &prev->last) > 0)
+					prev->last = range->last;
+				continue;
+			}
+		}
+		list->ranges[count++] = *range;
+	}
+
+	list->count = count;
+}
+
+/** Returns whether one of the ranges from "list" (which has to be normalized) contains "key". */
+static bool list_contains(struct range_list *list, struct classifier_key *key)
+{
+	unsigned int left = 0, right = list->count;
+	unsigned int middle;
+
+	/* Find the first range which starts after "key". */
+	while (left < right) {
+		middle = left + (right - left) / 2;
+		if (key_cmp(&list->ranges[middle].first, key) <= 0)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+
+	return left > 0 && key_cmp(key, &list->ranges[left - 1].last) <= 0;
+}
+
+static enum classifier_class classify_key(struct range_list *blacklist, struct range_list *pool,
+		struct classifier_key *key)
+{
+	if (list_contains(blacklist, key))
+		return CLASS_BLACKLIST;
+	if (list_contains(pool, key))
+		return CLASS_POOL;
+	return CLASS_NONE;
+}
+
+/**
+ * Compiles "blacklist" and "pool" (which have to be normalized) into "table".
+ */
+static int table_compile(struct classifier_table *table, struct range_list *blacklist,
+		struct range_list *pool, const struct classifier_key *max)
+{
+	struct classifier_key *bounds;
+	struct range_list *lists[] = { blacklist, pool };
+	struct classifier_range *range;
+	enum classifier_class class;
+	unsigned int bound_count = 0;
+	unsigned int i, j;
+
+	/* Every address where a class might change. */
+	bounds = kmalloc((1 + 2 * (blacklist->count + pool->count)) * sizeof(*bounds), GFP_KERNEL);
+	if (!bounds)
+		return -ENOMEM;
+
+	bounds[bound_count].hi = 0;
+	bounds[bound_count].lo = 0;
+	bound_count++;
+	for (i = 0; i < ARRAY_SIZE(lists); i++) {
+		for (j = 0; j < lists[i]->count; j++) {
+			range = &lists[i]->ranges[j];
+			bounds[bound_count++] = range->first;
+			if (key_cmp(&range->last, max) != 0)
+				bounds[bound_count++] = key_next(&range->last);
+		}
+	}
+	sort(bounds, bound_count, sizeof(*bounds), key_sort_cmp, NULL);
+
+	/* There are never more segments than bounds. */
+	table->segments = kmalloc(bound_count * sizeof(*table->segments), GFP_KERNEL);
+	if (!table->segments) {
+		kfree(bounds);
+		return -ENOMEM;
+	}
+
+	table->count = 0;
+	for (i = 0; i < bound_count; i++) {
+		class = classify_key(blacklist, pool, &bounds[i]);
+		if (table->count > 0 && table->segments[table->count - 1].class == class)
+			continue; /* Includes repeated bounds. */
+		table->segments[table->count].start = bounds[i];
+		table->segments[table->count].class = class;
+		table->count++;
+	}
+
+	kfree(bounds);
+	return 0;
+}
+
+static enum classifier_class table_lookup(struct classifier_table *table,
+		struct classifier_key *key)
+{
+	unsigned int left = 0, right = table->count;
+	unsigned int middle;
+
+	/* Find the first segment which starts after "key". */
+	while (left < right) {
+		middle = left + (right - left) / 2;
+		if (key_cmp(&table->segments[middle].start, key) <= 0)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+
+	/* "left" can't be zero because the first segment starts at zero. */
+	return table->segments[left - 1].class;
+}
+
+static void classifier_free(struct classifier *old)
+{
+	kfree(old->table4.segments);
+	kfree(old->table6.segments);
+	kfree(old);
+}
+
+static int compile4(struct classifier_table *table)
+{
+	struct range_list blacklist = { .ranges = NULL, .count = 0, .capacity = 0 };
+	struct range_list pool = { .ranges = NULL, .count = 0, .capacity = 0 };
+	int error;
+
+	error = list_fill(&blacklist, fill_blacklist4);
+	if (error)
+		goto end;
+	if (nat64_is_stateful()) {
+		error = list_fill(&pool, fill_pool4);
+		if (error)
+			goto end;
+	}
+
+	list_normalize(&blacklist, &max4);
+	list_normalize(&pool, &max4);
+	error = table_compile(table, &blacklist, &pool, &max4);
+	/* Fall through. */
+
+end:
+	kfree(blacklist.ranges);
+	kfree(pool.ranges);
+	return error;
+}
+
+static int compile6(struct classifier_table *table)
+{
+	struct range_list blacklist = { .ranges = NULL, .count = 0, .capacity = 0 };
+	struct range_list pool = { .ranges = NULL, .count = 0, .capacity = 0 };
+	int error;
+
+	error = list_fill(&blacklist, fill_blacklist6);
+	if (error)
+		goto end;
+	if (nat64_is_stateful()) {
+		error = list_fill(&pool, fill_pool6);
+		if (error)
+			goto end;
+	}
+
+	list_normalize(&blacklist, &max6);
+	list_normalize(&pool, &max6);
+	error = table_compile(table, &blacklist, &pool, &max6);
+	/* Fall through. */
+
+end:
+	kfree(blacklist.ranges);
+	kfree(pool.ranges);
+	return error;
+}
+
+int classifier_init(void)
+{
+	RCU_INIT_POINTER(classifier, NULL);
+	return classifier_rebuild();
+}
+
+void classifier_destroy(void)
+{
+	struct classifier *old = rcu_dereference_protected(classifier, true);
+
+	RCU_INIT_POINTER(classifier, NULL);
+	if (old)
+		classifier_free(old);
+}
+
+int classifier_rebuild(void)
+{
+	struct classifier *new, *old;
+	int error;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new) {
+		error = -ENOMEM;
+		goto fail;
+	}
+
+	error = compile4(&new->table4);
+	if (error)
+		goto fail;
+	error = compile6(&new->table6);
+	if (error)
+		goto fail;
+
+	old = rcu_dereference_protected(classifier, true);
+	rcu_assign_pointer(classifier, new);
+	if (old) {
+		synchronize_rcu_bh();
+		classifier_free(old);
+	}
+
+	log_debug("Classifier compiled: %u IPv4 segments, %u IPv6 segments.",
+			new->table4.count, new->table6.count);
+	return 0;
+
+fail:
+	if (new)
+		classifier_free(new);
+
+	log_err("Could not compile the classifier (errcode %d).", error);
+	log_err("Packets will be classified the slow way.");
+	old = rcu_dereference_protected(classifier, true);
+	RCU_INIT_POINTER(classifier, NULL);
+	if (old) {
+		synchronize_rcu_bh();
+		classifier_free(old);
+	}
+	return error;
+}
+
+bool classifier_translate4(__be32 saddr, __be32 daddr)
+{
+	struct classifier *current_classifier;
+	struct classifier_key key;
+	enum classifier_class class;
+
+	current_classifier = rcu_dereference_bh(classifier);
+	if (!current_classifier) {
+		if (is_blacklisted4(saddr) || is_blacklisted4(daddr))
+			return false;
+		return nat64_is_stateful() ? pool4_contains(daddr) : true;
+	}
+
+	key4_init(&key, daddr);
+	class = table_lookup(&current_classifier->table4, &key);
+	if (nat64_is_stateful() ? (class != CLASS_POOL) : (class == CLASS_BLACKLIST))
+		return false;
+
+	key4_init(&key, saddr);
+	return table_lookup(&current_classifier->table4, &key) != CLASS_BLACKLIST;
+}
+
+bool classifier_translate6(struct in6_addr *saddr, struct in6_addr *daddr)
+{
+	struct classifier *current_classifier;
+	struct classifier_key key;
+	enum classifier_class class;
+
+	current_classifier = rcu_dereference_bh(classifier);
+	if (!current_classifier) {
+		if (is_blacklisted6(saddr) || is_blacklisted6(daddr))
+			return false;
+		return nat64_is_stateful() ? pool6_contains(daddr) : true;
+	}
+
+	key6_init(&key, daddr);
+	class = table_lookup(&current_classifier->table6, &key);
+	if (nat64_is_stateful() ? (class != CLASS_POOL) : (class == CLASS_BLACKLIST))
+		return false;
+
+	key6_init(&key, saddr);
+	return table_lookup(&current_classifier->table6, &key) != CLASS_BLACKLIST;
+}
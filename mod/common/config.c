@@ -25,6 +25,7 @@ int config_init(bool is_disable)
 	config->atomic_frags.build_ipv6_fh = DEFAULT_BUILD_IPV6_FH;
 	config->atomic_frags.build_ipv4_id = DEFAULT_BUILD_IPV4_ID;
 	config->atomic_frags.lower_mtu_fail = DEFAULT_LOWER_MTU_FAIL;
+	config->latency_histograms = DEFAULT_LATENCY_HISTOGRAMS;
 
 #ifdef STATEFUL
 	config->ttl.udp = msecs_to_jiffies(1000 * UDP_DEFAULT);
@@ -32,13 +33,16 @@ int config_init(bool is_disable)
 	config->ttl.tcp_est = msecs_to_jiffies(1000 * TCP_EST);
 	config->ttl.tcp_trans = msecs_to_jiffies(1000 * TCP_TRANS);
 	config->ttl.frag = msecs_to_jiffies(1000 * FRAGMENT_MIN);
-	config->max_stored_pkts = DEFAULT_MAX_STORED_PKTS;
+	config->so_max_mem = DEFAULT_SO_MAX_MEM;
 	config->src_icmp6errs_better = DEFAULT_SRC_ICMP6ERRS_BETTER;
 	config->drop_by_addr = DEFAULT_ADDR_DEPENDENT_FILTERING;
 	config->drop_external_tcp = DEFAULT_DROP_EXTERNAL_CONNECTIONS;
+	config->stateless_external_tcp = DEFAULT_STATELESS_EXTERNAL_CONNECTIONS;
 	config->drop_icmp6_info = DEFAULT_FILTER_ICMPV6_INFO;
 	config->bib_logging = DEFAULT_BIB_LOGGING;
 	config->session_logging = DEFAULT_SESSION_LOGGING;
+	config->logging_binary = DEFAULT_LOGGING_BINARY;
+	config->session_sync = DEFAULT_SESSION_SYNC;
 #else
 	config->compute_udp_csum_zero = DEFAULT_COMPUTE_UDP_CSUM0;
 	config->randomize_error_addresses = DEFAULT_RANDOMIZE_RFC6791;
@@ -97,6 +101,17 @@ int config_set(struct global_config *new)
 	return 0;
 }
 
+/**
+ * Returns the current configuration, so the caller can read several fields out of a single
+ * consistent snapshot.
+ * You need to call rcu_read_lock_bh() before calling this function, and then rcu_read_unlock_bh()
+ * when you don't need the snapshot anymore.
+ */
+struct global_config *config_get(void)
+{
+	return rcu_dereference_bh(config);
+}
+
 #define RCU_THINGY(type, field) \
 	({ \
 		type result; \
@@ -128,21 +143,6 @@ unsigned long config_get_ttl_icmp(void)
 	return RCU_THINGY(unsigned long, ttl.icmp);
 }
 
-unsigned long config_get_ttl_frag(void)
-{
-	return RCU_THINGY(unsigned long, ttl.frag);
-}
-
-unsigned int config_get_max_pkts(void)
-{
-	return RCU_THINGY(unsigned int, max_stored_pkts);
-}
-
-bool config_get_src_icmp6errs_better(void)
-{
-	return RCU_THINGY(bool, src_icmp6errs_better);
-}
-
 bool config_get_bib_logging(void)
 {
 	return RCU_THINGY(bool, bib_logging);
@@ -153,59 +153,18 @@ bool config_get_session_logging(void)
 	return RCU_THINGY(bool, session_logging);
 }
 
-bool config_get_filter_icmpv6_info(void)
-{
-	return RCU_THINGY(bool, drop_icmp6_info);
-}
-
-bool config_get_addr_dependent_filtering(void)
-{
-	return RCU_THINGY(bool, drop_by_addr);
-}
-
-bool config_get_drop_external_connections(void)
-{
-	return RCU_THINGY(bool, drop_external_tcp);
-}
-
-#else
-
-bool config_get_compute_UDP_csum_zero(void)
+bool config_get_logging_binary(void)
 {
-	return RCU_THINGY(bool, compute_udp_csum_zero);
+	return RCU_THINGY(bool, logging_binary);
 }
 
-bool config_randomize_rfc6791_pool(void)
+bool config_get_session_sync(void)
 {
-	return RCU_THINGY(bool, randomize_error_addresses);
+	return RCU_THINGY(bool, session_sync);
 }
 
 #endif
 
-bool config_get_reset_traffic_class(void)
-{
-	return RCU_THINGY(bool, reset_traffic_class);
-}
-
-void config_get_hdr4_config(bool *reset_tos, __u8 *new_tos, bool *build_ipv4_id,
-		bool *df_always_on)
-{
-	struct global_config *tmp;
-
-	rcu_read_lock_bh();
-	tmp = rcu_dereference_bh(config);
-	*reset_tos = tmp->reset_tos;
-	*new_tos = tmp->new_tos;
-	*build_ipv4_id = tmp->atomic_frags.build_ipv4_id;
-	*df_always_on = tmp->atomic_frags.df_always_on;
-	rcu_read_unlock_bh();
-}
-
-bool config_get_build_ipv6_fh(void)
-{
-	return RCU_THINGY(bool, atomic_frags.build_ipv6_fh);
-}
-
 bool config_get_lower_mtu_fail(void)
 {
 	return RCU_THINGY(bool, atomic_frags.lower_mtu_fail);
@@ -1,7 +1,9 @@
 #include "nat64/mod/common/core.h"
-#include "nat64/mod/common/blacklist.h"
+#include "nat64/mod/common/classifier.h"
+#include "nat64/mod/common/log_time.h"
 #include "nat64/mod/common/packet.h"
 #include "nat64/mod/common/pool6.h"
+#include "nat64/mod/common/route.h"
 #include "nat64/mod/common/stats.h"
 #include "nat64/mod/common/types.h"
 #include "nat64/mod/common/rfc6145/core.h"
@@ -9,7 +11,10 @@
 #include "nat64/mod/common/config.h"
 
 #include "nat64/mod/stateful/pool4.h"
+#include "nat64/mod/stateful/bib_db.h"
+#include "nat64/mod/stateful/session_db.h"
 #include "nat64/mod/stateful/fragment_db.h"
+#include "nat64/mod/stateful/fragment_cache.h"
 #include "nat64/mod/stateful/determine_incoming_tuple.h"
 #include "nat64/mod/stateful/filtering_and_updating.h"
 #include "nat64/mod/stateful/compute_outgoing_tuple.h"
@@ -19,76 +24,235 @@
 #include <linux/module.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
+#include <linux/rcupdate.h>
+#include <net/dst.h>
 
 
 #ifdef STATEFUL
 
-static unsigned int core_common(struct packet *in)
+/**
+ * First phase of the pipeline: computes "in"'s tuple.
+ */
+static verdict core_classify(struct packet *in, struct tuple *tuple_in)
 {
-	struct packet out;
-	struct tuple tuple_in;
-	struct tuple tuple_out;
 	verdict result;
 
-	result = determine_in_tuple(in, &tuple_in);
+	/* These have no layer-4 header; they borrow their first fragment's tuple later. */
+	if (fragcache_is_subsequent(in))
+		return VERDICT_CONTINUE;
+
+	result = stats_verdict(STATS_STAGE_DETERMINE_IN_TUPLE, determine_in_tuple(in, tuple_in));
 	if (result != VERDICT_CONTINUE)
-		goto end;
-	result = filtering_and_updating(in, &tuple_in);
+		return result;
+
+	/*
+	 * First half of the lookups filtering is going to do; the buckets travel into the cache
+	 * while the fragment cache and the queue are being consulted.
+	 */
+	sessiondb_prefetch(tuple_in);
+	bibdb_prefetch(tuple_in);
+	return VERDICT_CONTINUE;
+}
+
+/**
+ * Translates "in", which is a fragment being forwarded (as opposed to reassembled), using
+ * "tuple_out" (its first fragment's outgoing tuple).
+ */
+static verdict translate_fragment(struct tuple *tuple_out, struct packet *in, struct packet *out)
+{
+	verdict result;
+
+	result = stats_verdict(STATS_STAGE_TRANSLATE, translating_the_packet(tuple_out, in, out));
 	if (result != VERDICT_CONTINUE)
-		goto end;
-	result = compute_out_tuple(&tuple_in, &tuple_out, in);
+		return result;
+
+	if (is_hairpin(out)) {
+		log_debug("Fragments cannot be hairpinned without reassembly.");
+		kfree_skb(out->skb);
+		out->skb = NULL;
+		return stats_verdict(STATS_STAGE_HAIRPINNING, VERDICT_DROP);
+	}
+
+	return VERDICT_CONTINUE;
+}
+
+/**
+ * Drops the fragments which were waiting for "burst"'s first fragment, because it could not be
+ * routed (and neither can they; they go to the same place).
+ */
+static void drop_burst(struct sk_buff_head *burst)
+{
+	struct sk_buff *skb;
+
+	while ((skb = __skb_dequeue(burst)) != NULL) {
+		stats_drop(DROP_ROUTE);
+		stats_verdict(STATS_STAGE_SEND, VERDICT_DROP);
+		kfree_skb(skb);
+	}
+}
+
+/**
+ * Translates and sends "burst", the fragments which were waiting for their first fragment to be
+ * translated (with "tuple_out"). "first" is that first fragment's translated version; it is left
+ * routed, for the caller to send.
+ *
+ * Netfilter hands the hooks one packet at a time, so this is the only burst the translator ever
+ * sees. All of its fragments belong to the same packet and go to the same place, so they are
+ * routed once, out of "first" (the only one which has a layer-4 header for the lookup), and share
+ * the resulting dst.
+ */
+static verdict send_burst(struct sk_buff_head *burst, struct tuple *tuple_out,
+		struct packet *first)
+{
+	struct dst_entry *dst;
+	struct sk_buff *skb;
+	struct packet in;
+	struct packet out;
+	int error;
+
+	if (skb_queue_empty(burst))
+		return VERDICT_CONTINUE;
+
+	if (route(first)) {
+		kfree_skb(first->skb);
+		first->skb = NULL;
+		drop_burst(burst);
+		return stats_verdict(STATS_STAGE_SEND, VERDICT_DROP);
+	}
+	dst = skb_dst(first->skb);
+
+	while ((skb = __skb_dequeue(burst)) != NULL) {
+		/* The fragments are of the protocol the tuple is going to be translated from. */
+		if (tuple_out->l3_proto == L3PROTO_IPV4)
+			error = pkt_init_ipv6(&in, skb);
+		else
+			error = pkt_init_ipv4(&in, skb);
+
+		if (!error && translate_fragment(tuple_out, &in, &out) == VERDICT_CONTINUE) {
+			if (dst && !skb_dst(out.skb)) {
+				skb_dst_set(out.skb, dst_clone(dst));
+				out.skb->dev = dst->dev;
+			}
+			/* send_pkt releases skb_out regardless of verdict. */
+			if (stats_verdict(STATS_STAGE_SEND, sendpkt_send(&in, &out))
+					== VERDICT_CONTINUE)
+				stats_translated();
+		}
+
+		kfree_skb(skb);
+	}
+
+	return VERDICT_CONTINUE;
+}
+
+/**
+ * Second phase of the pipeline: everything else, except for the sending step.
+ *
+ * If this returns VERDICT_CONTINUE and out->skb is not NULL, "out" is ready to be sent.
+ * If this returns VERDICT_CONTINUE and out->skb is NULL, the packet was hairpinned and there's
+ * nothing left to do.
+ */
+static verdict core_translate(struct packet *in, struct tuple *tuple_in, struct packet *out)
+{
+	struct tuple tuple_out;
+	struct sk_buff_head waiting;
+	verdict result;
+
+	if (fragcache_is_subsequent(in)) {
+		result = stats_verdict(STATS_STAGE_FRAGMENTS, fragcache_get(in, &tuple_out));
+		if (result != VERDICT_CONTINUE)
+			return result;
+		return translate_fragment(&tuple_out, in, out);
+	}
+
+	if (fragcache_is_first(in)) {
+		result = stats_verdict(STATS_STAGE_FRAGMENTS, fragcache_validate(in));
+		if (result != VERDICT_CONTINUE)
+			return result;
+	}
+
+	result = stats_verdict(STATS_STAGE_FILTERING, filtering_and_updating(in, tuple_in));
 	if (result != VERDICT_CONTINUE)
-		goto end;
-	result = translating_the_packet(&tuple_out, in, &out);
+		return result;
+	result = compute_out_tuple(tuple_in, &tuple_out, in);
+	stats_verdict(STATS_STAGE_COMPUTE_OUT_TUPLE, result);
 	if (result != VERDICT_CONTINUE)
-		goto end;
+		return result;
 
-	if (is_hairpin(&out)) {
-		result = handling_hairpinning(&out, &tuple_out);
-		kfree_skb(out.skb);
-	} else {
-		result = sendpkt_send(in, &out);
-		/* send_pkt releases skb_out regardless of verdict. */
+	if (fragcache_is_first(in)) {
+		result = translate_fragment(&tuple_out, in, out);
+		if (result != VERDICT_CONTINUE)
+			return result;
+
+		__skb_queue_head_init(&waiting);
+		fragcache_add(in, &tuple_out, &waiting);
+		return send_burst(&waiting, &tuple_out, out);
 	}
 
+	result = stats_verdict(STATS_STAGE_TRANSLATE, translating_the_packet(&tuple_out, in, out));
 	if (result != VERDICT_CONTINUE)
-		goto end;
+		return result;
+
+	if (is_hairpin(out)) {
+		result = handling_hairpinning(out, &tuple_out);
+		stats_verdict(STATS_STAGE_HAIRPINNING, result);
+		if (result == VERDICT_CONTINUE)
+			stats_hairpinned();
+		kfree_skb(out->skb);
+		out->skb = NULL;
+	}
 
-	log_debug("Success.");
-	/*
-	 * The new packet was sent, so the original one can die; drop it.
-	 *
-	 * NF_DROP translates into an error (see nf_hook_slow()).
-	 * Sending a replacing & translated version of the packet should not count as an error,
-	 * so we free the incoming packet ourselves and return NF_STOLEN on success.
-	 */
-	kfree_skb(in->skb);
-	result = VERDICT_STOLEN;
-	/* Fall through. */
+	return result;
+}
 
-end:
-	if (result == VERDICT_ACCEPT)
-		log_debug("Returning the packet to the kernel.");
+#else
 
-	return (unsigned int) result;
+static verdict core_classify(struct packet *in, struct tuple *tuple_in)
+{
+	return VERDICT_CONTINUE; /* SIIT doesn't need tuples. */
 }
 
-#else
+static verdict core_translate(struct packet *in, struct tuple *tuple_in, struct packet *out)
+{
+	return stats_verdict(STATS_STAGE_TRANSLATE, translating_the_packet(NULL, in, out));
+}
+
+#endif
 
 static unsigned int core_common(struct packet *in)
 {
 	struct packet out;
+	struct tuple tuple;
 	verdict result;
+	__u64 time;
 
-	result = translating_the_packet(NULL, in, &out);
+	result = core_classify(in, &tuple);
+	time = logtime(in, LOGTIME_STAGE_CLASSIFY, in->start_time);
 	if (result != VERDICT_CONTINUE)
 		goto end;
-	result = sendpkt_send(in, &out);
+	result = core_translate(in, &tuple, &out);
+	time = logtime(in, LOGTIME_STAGE_TRANSLATE, time);
 	if (result != VERDICT_CONTINUE)
 		goto end;
 
+	if (out.skb) {
+		result = stats_verdict(STATS_STAGE_SEND, sendpkt_send(in, &out));
+		logtime(in, LOGTIME_STAGE_SEND, time);
+		/* send_pkt releases skb_out regardless of verdict. */
+		if (result != VERDICT_CONTINUE)
+			goto end;
+		logtime(in, LOGTIME_STAGE_TOTAL, in->start_time);
+		stats_translated();
+	}
+
 	log_debug("Success.");
-	/* See the large comment above. */
+	/*
+	 * The new packet was sent, so the original one can die; drop it.
+	 *
+	 * NF_DROP translates into an error (see nf_hook_slow()).
+	 * Sending a replacing & translated version of the packet should not count as an error,
+	 * so we free the incoming packet ourselves and return NF_STOLEN on success.
+	 */
 	kfree_skb(in->skb);
 	result = VERDICT_STOLEN;
 	/* Fall through. */
@@ -100,76 +264,126 @@ end:
 	return (unsigned int) result;
 }
 
-#endif
-
-unsigned int core_4to6(struct sk_buff *skb)
+/**
+ * The per-packet half of the 4-to-6 entry checks. The per-translator ones (whether translation is
+ * enabled and whether the pools are populated) are the callers' responsibility.
+ */
+static verdict prepare_4to6(struct sk_buff *skb, struct packet *pkt)
 {
-	struct packet pkt;
 	struct iphdr *hdr = ip_hdr(skb);
 	int error;
 
-	if (config_get_is_disable())
-		return NF_ACCEPT; /* Translation is disabled; let the packet pass. */
-
-	if (is_blacklisted4(hdr->saddr) || is_blacklisted4(hdr->daddr))
-		return NF_ACCEPT;
-
-	if (nat64_is_stateful()) {
-		if (!pool4_contains(hdr->daddr) || pool6_is_empty())
-			return NF_ACCEPT; /* Not meant for translation; let the kernel handle it. */
-	}
+	if (!classifier_translate4(hdr->saddr, hdr->daddr))
+		return VERDICT_ACCEPT; /* Not meant for translation; let the kernel handle it. */
 
 	log_debug("===============================================");
 	log_debug("Catching IPv4 packet: %pI4->%pI4", &hdr->saddr, &hdr->daddr);
+	stats_received();
 
-	error = pkt_init_ipv4(&pkt, skb); /* Reminder: This function might change pointers. */
+	error = pkt_init_ipv4(pkt, skb); /* Reminder: This function might change pointers. */
 	if (error)
-		return NF_DROP;
+		return stats_verdict(STATS_STAGE_PREPARE, VERDICT_DROP);
 
-	error = validate_icmp4_csum(&pkt);
+	error = validate_icmp4_csum(pkt);
 	if (error) {
-		inc_stats(&pkt, IPSTATS_MIB_INHDRERRORS);
-		return NF_DROP;
+		inc_stats(pkt, IPSTATS_MIB_INHDRERRORS);
+		stats_drop(DROP_CHECKSUM);
+		return stats_verdict(STATS_STAGE_PREPARE, VERDICT_DROP);
 	}
 
-	return core_common(&pkt);
+	return VERDICT_CONTINUE;
 }
 
-unsigned int core_6to4(struct sk_buff *skb)
+/**
+ * The per-packet half of the 6-to-4 entry checks. See prepare_4to6().
+ */
+static verdict prepare_6to4(struct sk_buff *skb, struct packet *pkt)
 {
-	struct packet pkt;
 	struct ipv6hdr *hdr = ipv6_hdr(skb);
 	int error;
 
-	if (config_get_is_disable())
-		return NF_ACCEPT; /* Translation is disabled; let the packet pass. */
-
-	if (is_blacklisted6(&hdr->saddr) || is_blacklisted6(&hdr->daddr))
-		return NF_ACCEPT;
-
-	if (nat64_is_stateful()) {
-		if ((!pool6_contains(&hdr->daddr) || pool4_is_empty()))
-			return NF_ACCEPT; /* Not meant for translation; let the kernel handle it. */
-	}
+	if (!classifier_translate6(&hdr->saddr, &hdr->daddr))
+		return VERDICT_ACCEPT; /* Not meant for translation; let the kernel handle it. */
 
 	log_debug("===============================================");
 	log_debug("Catching IPv6 packet: %pI6c->%pI6c", &hdr->saddr, &hdr->daddr);
+	stats_received();
 
-	error = pkt_init_ipv6(&pkt, skb); /* Reminder: This function might change pointers. */
+	error = pkt_init_ipv6(pkt, skb); /* Reminder: This function might change pointers. */
 	if (error)
-		return NF_DROP;
+		return stats_verdict(STATS_STAGE_PREPARE, VERDICT_DROP);
 
-	if (nat64_is_stateful()) {
-		verdict result = fragdb_handle(&pkt);
+	/* In fragment forwarding mode, fragments are translated as they are. */
+	if (nat64_is_stateful() && !fragcache_is_enabled()) {
+		verdict result = fragdb_handle(pkt);
 		if (result != VERDICT_CONTINUE)
-			return (unsigned int) result;
+			return stats_verdict(STATS_STAGE_PREPARE, result);
 	}
 
-	error = validate_icmp6_csum(&pkt);
+	error = validate_icmp6_csum(pkt);
 	if (error) {
-		inc_stats(&pkt, IPSTATS_MIB_INHDRERRORS);
-		return NF_DROP;
+		inc_stats(pkt, IPSTATS_MIB_INHDRERRORS);
+		stats_drop(DROP_CHECKSUM);
+		return stats_verdict(STATS_STAGE_PREPARE, VERDICT_DROP);
+	}
+
+	return VERDICT_CONTINUE;
+}
+
+unsigned int core_4to6(struct sk_buff *skb)
+{
+	struct packet pkt;
+	verdict result;
+
+	/* pkt.config is only valid inside of this. */
+	rcu_read_lock_bh();
+
+	if (config_get()->is_disable) {
+		result = VERDICT_ACCEPT; /* Translation is disabled; let the packet pass. */
+		goto end;
+	}
+	if (nat64_is_stateful() && pool6_is_empty()) {
+		result = VERDICT_ACCEPT; /* Not meant for translation; let the kernel handle it. */
+		goto end;
+	}
+
+	result = prepare_4to6(skb, &pkt);
+	if (result != VERDICT_CONTINUE)
+		goto end;
+
+	result = core_common(&pkt);
+	/* Fall through. */
+
+end:
+	rcu_read_unlock_bh();
+	return (unsigned int) result;
+}
+
+unsigned int core_6to4(struct sk_buff *skb)
+{
+	struct packet pkt;
+	verdict result;
+
+	/* pkt.config is only valid inside of this. */
+	rcu_read_lock_bh();
+
+	if (config_get()->is_disable) {
+		result = VERDICT_ACCEPT; /* Translation is disabled; let the packet pass. */
+		goto end;
 	}
+	if (nat64_is_stateful() && pool4_is_empty()) {
+		result = VERDICT_ACCEPT; /* Not meant for translation; let the kernel handle it. */
+		goto end;
+	}
+
+	result = prepare_6to4(skb, &pkt);
+	if (result != VERDICT_CONTINUE)
+		goto end;
 
-	return core_common(&pkt);
+	result = core_common(&pkt);
+	/* Fall through. */
+
+end:
+	rcu_read_unlock_bh();
+	return (unsigned int) result;
 }
@@ -0,0 +1,143 @@
+#include "nat64/mod/common/event_ring.h"
+#include "nat64/mod/common/types.h"
+
+#include <linux/bottom_half.h>
+#include <linux/cpumask.h>
+#include <linux/log2.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+/**
+ * The events one CPU has queued and nobody has drained yet.
+ */
+struct event_ring_cpu {
+	void *events;
+	/** Number of events ever added. Only the producer writes it. */
+	unsigned int head;
+	/** Number of events ever drained. Only the consumer writes it. */
+	unsigned int tail;
+	/** Number of events that could not be queued because the ring was full. */
+	unsigned long dropped;
+	/** Value "dropped" had the last time the consumer reported it. */
+	unsigned long dropped_seen;
+};
+
+int evring_init(struct event_ring *ring, size_t event_size, unsigned int capacity)
+{
+	struct event_ring_cpu *cpu_ring;
+	unsigned int cpu;
+
+	if (WARN(!is_power_of_2(capacity), "Ring capacity %u is not a power of two.", capacity))
+		return -EINVAL;
+
+	ring->cpus = alloc_percpu(struct event_ring_cpu);
+	if (!ring->cpus)
+		return -ENOMEM;
+	ring->event_size = event_size;
+	ring->capacity = capacity;
+	mutex_init(&ring->drain_mutex);
+
+	for_each_possible_cpu(cpu) {
+		cpu_ring = per_cpu_ptr(ring->cpus, cpu);
+		/* alloc_percpu() zeroes the rest. */
+		cpu_ring->events = vzalloc(capacity * event_size);
+		if (!cpu_ring->events) {
+			evring_destroy(ring);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+void evring_destroy(struct event_ring *ring)
+{
+	unsigned int cpu;
+
+	if (!ring->cpus)
+		return;
+
+	for_each_possible_cpu(cpu)
+		vfree(per_cpu_ptr(ring->cpus, cpu)->events); /* vfree(NULL) is fine. */
+
+	free_percpu(ring->cpus);
+	ring->cpus = NULL;
+}
+
+static void *get_slot(struct event_ring *ring, struct event_ring_cpu *cpu_ring,
+		unsigned int index)
+{
+	return cpu_ring->events + (index & (ring->capacity - 1)) * ring->event_size;
+}
+
+void evring_add(struct event_ring *ring, const void *event)
+{
+	struct event_ring_cpu *cpu_ring;
+	unsigned int head;
+
+	/* Most callers already did this; it keeps softirqs from producing in the middle of us. */
+	local_bh_disable();
+
+	cpu_ring = this_cpu_ptr(ring->cpus);
+	head = cpu_ring->head;
+
+	if (head - ACCESS_ONCE(cpu_ring->tail) >= ring->capacity) {
+		cpu_ring->dropped++;
+		goto end;
+	}
+
+	memcpy(get_slot(ring, cpu_ring, head), event, ring->event_size);
+	/* The event has to be complete before the consumer can see it. */
+	smp_wmb();
+	ACCESS_ONCE(cpu_ring->head) = head + 1;
+	/* Fall through. */
+
+end:
+	local_bh_enable();
+}
+
+int evring_drain(struct event_ring *ring,
+		int (*lost)(unsigned int cpu, unsigned long count, void *arg),
+		int (*func)(void *event, void *arg),
+		void *arg)
+{
+	struct event_ring_cpu *cpu_ring;
+	unsigned int cpu;
+	unsigned int head, tail;
+	unsigned long dropped;
+	int error = 0;
+
+	mutex_lock(&ring->drain_mutex);
+
+	for_each_possible_cpu(cpu) {
+		cpu_ring = per_cpu_ptr(ring->cpus, cpu);
+
+		dropped = ACCESS_ONCE(cpu_ring->dropped);
+		if (dropped != cpu_ring->dropped_seen) {
+			error = lost(cpu, dropped - cpu_ring->dropped_seen, arg);
+			if (error)
+				break;
+			cpu_ring->dropped_seen = dropped;
+		}
+
+		head = ACCESS_ONCE(cpu_ring->head);
+		/* Pairs with evring_add()'s smp_wmb(). */
+		smp_rmb();
+
+		for (tail = cpu_ring->tail; tail != head; tail++) {
+			error = func(get_slot(ring, cpu_ring, tail), arg);
+			if (error)
+				break;
+		}
+
+		/* Do not let the producer overwrite the events until we're done reading them. */
+		smp_mb();
+		ACCESS_ONCE(cpu_ring->tail) = tail;
+
+		if (error)
+			break;
+	}
+
+	mutex_unlock(&ring->drain_mutex);
+	return error;
+}
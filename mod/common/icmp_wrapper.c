@@ -133,10 +133,13 @@ void icmp64_send(struct packet *pkt, icmp_error_code error, __u32 info)
 	/* Send the error. */
 	switch (ntohs(skb->protocol)) {
 	case ETH_P_IP:
-		err = route4_input(pkt);
-		if (err) {
-			log_debug("Can't send an ICMPv4 Error: %d", err);
-			return;
+		/* Packets whose input device is gone (see pktqueue) arrive already routed. */
+		if (!skb_dst(skb)) {
+			err = route4_input(pkt);
+			if (err) {
+				log_debug("Can't send an ICMPv4 Error: %d", err);
+				return;
+			}
 		}
 		icmp4_send(skb, error, info);
 		break;
@@ -1,197 +1,150 @@
 #include "nat64/mod/common/log_time.h"
+#include "nat64/mod/common/types.h"
 
-static struct log_time_db logs_ipv6_tcp;
-static struct log_time_db logs_ipv6_udp;
-static struct log_time_db logs_ipv6_icmp;
-static struct log_time_db logs_ipv4_tcp;
-static struct log_time_db logs_ipv4_udp;
-static struct log_time_db logs_ipv4_icmp;
+#include <linux/bitops.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
 
-/** Cache for struct log_node, for efficient allocation. */
-static struct kmem_cache *entry_cache;
+/** Number of layer-4 protocols (see enum l4_protocol). */
+#define L4_PROTO_COUNT (L4PROTO_OTHER + 1)
 
-#ifndef NSEC_PER_SEC
-#define NSEC_PER_SEC 1000000000L
-#endif
+/**
+ * The kernel's version of struct logtime_histogram_usr. "count" is implicit (the sum of the
+ * buckets), which spares the packet path one increment.
+ */
+struct logtime_histogram {
+	__u64 sum;
+	__u64 max;
+	__u64 buckets[LOGTIME_BUCKETS];
+};
 
 /**
- * Init the struct of log_node.
+ * One CPU's histograms.
  */
-static int logtime_create_node(struct log_node **node)
-{
-	struct log_node *tmp_node;
+struct logtime_table {
+	struct logtime_histogram histograms[2][L4_PROTO_COUNT][LOGTIME_STAGE_COUNT];
+};
 
-	tmp_node = kmem_cache_alloc(entry_cache, GFP_ATOMIC);
-	if (!tmp_node) {
-		log_err("Allocation of IPv6 pool node failed.");
-		return -ENOMEM;
-	}
+/**
+ * The tables are far too big for the per-CPU allocator, so each CPU only gets a pointer to its
+ * own.
+ */
+static struct logtime_table * __percpu *tables;
 
-	INIT_LIST_HEAD(&tmp_node->list_hook);
-	*node = tmp_node;
-	return 0;
-}
 
 /**
- * An spinlock must be hold.
+ * Returns the index of the bucket "value" belongs to.
  */
-static void logtime_delete_node(struct log_node *node) {
-	list_del(&node->list_hook);
-	kmem_cache_free(entry_cache, node);
-}
-
-static void logtime_get_db(struct log_time_db **log_db, l3_protocol l3_proto, l4_protocol l4_proto)
+static unsigned int get_bucket(__u64 value)
 {
-	switch (l3_proto) {
-	case L3PROTO_IPV6:
-		switch (l4_proto) {
-		case L4PROTO_TCP:
-			*log_db = &logs_ipv6_tcp;
-			return;
-		case L4PROTO_UDP:
-			*log_db = &logs_ipv6_udp;
-			return;
-		case L4PROTO_ICMP:
-			*log_db = &logs_ipv6_icmp;
-			return;
-		case L4PROTO_OTHER:
-			break;
-		}
-		break;
-	case L3PROTO_IPV4:
-		switch (l4_proto) {
-		case L4PROTO_TCP:
-			*log_db = &logs_ipv4_tcp;
-			return;
-		case L4PROTO_UDP:
-			*log_db = &logs_ipv4_udp;
-			return;
-		case L4PROTO_ICMP:
-			*log_db = &logs_ipv4_icmp;
-			return;
-		case L4PROTO_OTHER:
-			break;
-		}
-		break;
-	}
-	*log_db = NULL;
-}
+	unsigned int shift;
 
-static void subtract_timespec(struct timespec *start, struct timespec *end,
-		struct log_node *node)
-{
-	if (start->tv_nsec > end->tv_nsec) {
-		end->tv_nsec += NSEC_PER_SEC; /* Add one second (in ns 1,000,000,000) to the minuend. */
-		start->tv_sec += 1L; /* Add one second to the subtrahend. */
-	}
-	node->time.tv_sec = end->tv_sec - start->tv_sec;
-	node->time.tv_nsec = end->tv_nsec - start->tv_nsec;
-	log_debug("Translation time: %ld.%9ld", node->time.tv_sec, node->time.tv_nsec);
+	if (value >> LOGTIME_VALUE_BITS)
+		return LOGTIME_BUCKETS - 1;
 
+	shift = fls((__u32) value);
+	shift = (shift > LOGTIME_SUB_BUCKET_BITS + 1) ? (shift - LOGTIME_SUB_BUCKET_BITS - 1) : 0;
+
+	return (shift << LOGTIME_SUB_BUCKET_BITS) + (unsigned int) (value >> shift);
 }
 
-static void logtime_db_add(struct log_time_db *log_db, struct log_node *node)
+static bool is_valid(l3_protocol l3_proto, l4_protocol l4_proto, enum logtime_stage stage)
 {
-	spin_lock_bh(&log_db->lock);
-	list_add_tail(&node->list_hook, &log_db->list);
-	spin_unlock_bh(&log_db->lock);
+	return l3_proto <= L3PROTO_IPV4 && l4_proto <= L4PROTO_OTHER
+			&& stage < LOGTIME_STAGE_COUNT;
 }
 
-/**
- * Increases the counter of the structure and add to the sum delta time registered.
- */
-int logtime(struct packet *pkt)
+__u64 __logtime(struct packet *pkt, enum logtime_stage stage, __u64 since)
 {
-	struct log_time_db *log_db;
-	struct log_node *log_node;
-	struct timespec end_time;
+	struct logtime_table *table;
+	struct logtime_histogram *histogram;
+	__u64 now;
+	__u64 delta;
+
+	now = logtime_now();
+	/* The clock is monotonic, but "since" might come from another CPU. */
+	delta = (now > since) ? (now - since) : 0;
+
+	table = *this_cpu_ptr(tables);
+	histogram = &table->histograms[pkt_l3_proto(pkt)][pkt_l4_proto(pkt)][stage];
+	histogram->buckets[get_bucket(delta)]++;
+	histogram->sum += delta;
+	if (delta > histogram->max)
+		histogram->max = delta;
+
+	return now;
+}
 
-	getnstimeofday(&end_time);
+int logtime_get(l3_protocol l3_proto, l4_protocol l4_proto, enum logtime_stage stage,
+		struct logtime_histogram_usr *result)
+{
+	struct logtime_histogram *histogram;
+	unsigned int cpu;
+	unsigned int i;
 
-	logtime_get_db(&log_db, pkt_l3_proto(pkt), pkt_l4_proto(pkt));
-	if (!log_db) {
-		log_err("Invalid L3 or L4 protocol.");
+	if (!is_valid(l3_proto, l4_proto, stage)) {
+		log_err("Invalid histogram: %u %u %u", l3_proto, l4_proto, stage);
 		return -EINVAL;
 	}
 
-	if (logtime_create_node(&log_node))
-		return -ENOMEM; /* Error message already printed. */
+	memset(result, 0, sizeof(*result));
 
-	subtract_timespec(&pkt->start_time, &end_time, log_node);
-	logtime_db_add(log_db, log_node);
+	for_each_possible_cpu(cpu) {
+		histogram = &(*per_cpu_ptr(tables, cpu))->histograms[l3_proto][l4_proto][stage];
+		result->sum += histogram->sum;
+		if (histogram->max > result->max)
+			result->max = histogram->max;
+		for (i = 0; i < LOGTIME_BUCKETS; i++) {
+			result->buckets[i] += histogram->buckets[i];
+			result->count += histogram->buckets[i];
+		}
+	}
 
 	return 0;
 }
 
-int logtime_iterate_and_delete(l3_protocol l3_proto, l4_protocol l4_proto,
-		int (*func)(struct log_node *, void *), void *arg)
+void logtime_flush(void)
 {
-	struct list_head *current_hook, *next_hook;
-	struct log_node *node;
-	struct log_time_db *log_db;
-	int error;
-
-	logtime_get_db(&log_db, l3_proto, l4_proto);
-	if (!log_db) {
-		log_err("Invalid L3 or L4 protocol.");
-		return -EINVAL;
-	}
-
-	spin_lock_bh(&log_db->lock);
-	list_for_each_safe(current_hook, next_hook, &log_db->list) {
-		node = list_entry(current_hook, struct log_node, list_hook);
-		error = func(node, arg);
-		if (error) {
-			spin_unlock_bh(&log_db->lock);
-			return error;
-		}
-		logtime_delete_node(node);
-	}
-	spin_unlock_bh(&log_db->lock);
+	unsigned int cpu;
 
-	return 0;
+	for_each_possible_cpu(cpu)
+		memset(*per_cpu_ptr(tables, cpu), 0, sizeof(struct logtime_table));
 }
 
 int logtime_init(void)
 {
-	int i;
-	struct log_time_db *logs_db[] = { &logs_ipv6_tcp, &logs_ipv6_udp, &logs_ipv6_icmp,
-			&logs_ipv4_tcp, &logs_ipv4_udp, &logs_ipv4_icmp	};
+	unsigned int cpu;
 
-	for (i = 0; i < ARRAY_SIZE(logs_db); i++) {
-		spin_lock_init(&logs_db[i]->lock);
-		INIT_LIST_HEAD(&logs_db[i]->list);
-	}
+	tables = alloc_percpu(struct logtime_table *);
+	if (!tables)
+		goto fail;
 
-	entry_cache = kmem_cache_create("jool_logtime_nodes", sizeof(struct log_node), 0, 0, NULL);
-	if (!entry_cache) {
-		log_err("Could not allocate the BIB entry cache.");
-		return -ENOMEM;
+	for_each_possible_cpu(cpu) {
+		*per_cpu_ptr(tables, cpu) = vzalloc(sizeof(struct logtime_table));
+		if (!*per_cpu_ptr(tables, cpu))
+			goto fail;
 	}
 
 	return 0;
-}
 
-static void destroy_aux(struct log_time_db *db)
-{
-	struct list_head *current_hook, *next_hook;
-	struct log_node *node;
-
-	list_for_each_safe(current_hook, next_hook, &db->list) {
-		node = list_entry(current_hook, struct log_node, list_hook);
-		logtime_delete_node(node);
-	}
+fail:
+	logtime_destroy();
+	log_err("Could not allocate the latency histograms.");
+	return -ENOMEM;
 }
 
 void logtime_destroy(void)
 {
-	int i;
-	struct log_time_db *logs_db[] = { &logs_ipv6_tcp, &logs_ipv6_udp, &logs_ipv6_icmp,
-			&logs_ipv4_tcp, &logs_ipv4_udp, &logs_ipv4_icmp	};
+	unsigned int cpu;
 
-	for (i = 0; i < ARRAY_SIZE(logs_db); i++) {
-		destroy_aux(logs_db[i]);
-	}
+	if (!tables)
+		return;
+
+	for_each_possible_cpu(cpu)
+		vfree(*per_cpu_ptr(tables, cpu)); /* vfree(NULL) is fine. */
 
-	kmem_cache_destroy(entry_cache);
+	free_percpu(tables);
+	tables = NULL;
 }
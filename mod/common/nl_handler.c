@@ -9,12 +9,17 @@
 
 #include "nat64/common/config.h"
 #include "nat64/common/constants.h"
+#include "nat64/mod/common/classifier.h"
 #include "nat64/mod/common/config.h"
+#include "nat64/mod/common/log_time.h"
 #include "nat64/mod/common/nl_buffer.h"
 #include "nat64/mod/common/pool6.h"
+#include "nat64/mod/common/stats.h"
 #include "nat64/mod/common/types.h"
 #include "nat64/mod/stateful/bib_db.h"
+#include "nat64/mod/stateful/event_log.h"
 #include "nat64/mod/stateful/session_db.h"
+#include "nat64/mod/stateful/session_sync.h"
 #include "nat64/mod/stateful/static_routes.h"
 #ifdef STATEFUL
 	#include "nat64/mod/stateful/pool4.h"
@@ -23,9 +28,6 @@
 #endif
 #include "nat64/mod/stateless/rfc6791.h"
 #include "nat64/mod/stateless/eam.h"
-#ifdef BENCHMARK
-#include "nat64/mod/common/log_time.h"
-#endif
 
 
 
@@ -39,6 +41,28 @@ static struct sock *nl_socket;
  */
 static DEFINE_MUTEX(config_mutex);
 
+/**
+ * Whether a configuration transaction is in progress. Protected by config_mutex.
+ */
+static bool txn_open;
+
+/**
+ * A pool6 prefix removed (without --quick) during the transaction in progress. Its sessions need
+ * to be deleted, but only once the commit makes the removal visible.
+ */
+struct txn_prefix6 {
+	struct ipv6_prefix prefix;
+	struct list_head list_hook;
+};
+
+/** The txn_prefix6s of the transaction in progress. Protected by config_mutex. */
+static LIST_HEAD(txn_removed6);
+/**
+ * Whether pool6 was flushed (without --quick) during the transaction in progress. If so, the
+ * commit empties the whole session database. Protected by config_mutex.
+ */
+static bool txn_flushed6;
+
 
 /**
  * Use this when data_len is known to be smaller than NLBUFFER_SIZE. When this might not be the
@@ -184,6 +208,7 @@ static int handle_pool6_display(struct nlmsghdr *nl_hdr, union request_pool6 *re
 static int handle_pool6_config(struct nlmsghdr *nl_hdr, struct request_hdr *jool_hdr,
 		union request_pool6 *request)
 {
+	struct txn_prefix6 *removed = NULL;
 	__u64 count;
 	int error;
 
@@ -211,12 +236,24 @@ static int handle_pool6_config(struct nlmsghdr *nl_hdr, struct request_hdr *jool
 		if (verify_superpriv())
 			return respond_error(nl_hdr, -EPERM);
 
+		/* The prefix is still in use until the transaction is committed. */
+		if (nat64_is_stateful() && !request->remove.quick && txn_open) {
+			removed = kmalloc(sizeof(*removed), GFP_KERNEL);
+			if (!removed)
+				return respond_error(nl_hdr, -ENOMEM);
+			removed->prefix = request->remove.prefix;
+		}
+
 		log_debug("Removing a prefix from the IPv6 pool.");
 		error = pool6_remove(&request->remove.prefix);
-		if (error)
+		if (error) {
+			kfree(removed);
 			return respond_error(nl_hdr, error);
+		}
 
-		if (nat64_is_stateful() && !request->flush.quick)
+		if (removed)
+			list_add_tail(&removed->list_hook, &txn_removed6);
+		else if (nat64_is_stateful() && !request->remove.quick)
 			error = sessiondb_delete_by_prefix6(&request->remove.prefix);
 
 		return respond_error(nl_hdr, error);
@@ -230,8 +267,12 @@ static int handle_pool6_config(struct nlmsghdr *nl_hdr, struct request_hdr *jool
 		if (error)
 			return respond_error(nl_hdr, error);
 
-		if (nat64_is_stateful() && !request->flush.quick)
-			error = sessiondb_flush();
+		if (nat64_is_stateful() && !request->flush.quick) {
+			if (txn_open)
+				txn_flushed6 = true;
+			else
+				error = sessiondb_flush();
+		}
 
 		return respond_error(nl_hdr, error);
 
@@ -272,6 +313,16 @@ static int handle_pool4_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat6
 	__u64 count;
 	int error;
 
+	/*
+	 * NAT64's pool4 is tied to the ports the BIBs are holding, so it cannot be swapped as a
+	 * whole.
+	 */
+	if (nat64_is_stateful() && txn_open
+			&& (nat64_hdr->operation & (OP_ADD | OP_REMOVE | OP_FLUSH))) {
+		log_err("The IPv4 pool cannot be edited during a transaction.");
+		return respond_error(nl_hdr, -EBUSY);
+	}
+
 	switch (nat64_hdr->operation) {
 	case OP_DISPLAY:
 		return handle_pool4_display(nl_hdr, request);
@@ -334,40 +385,198 @@ static int handle_pool4_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat6
 	}
 }
 
+/**
+ * Size of the skbs the BIB and session tables are dumped in.
+ */
+#define DUMP_SKB_SIZE (32 * 1024)
+
+/**
+ * Starts sending one of the tables to userspace. From now on, Netlink will call "dump" every time
+ * the userspace application is ready to receive another skb, until it returns zero.
+ *
+ * Every call resumes the iteration from the cursor left in cb->args, so the application does
+ * not need to send any more requests. "done" is called when the dump ends, so it can release
+ * the cursor.
+ *
+ * @return -EINTR on success, which is what tells netlink_rcv_skb() not to ACK the request.
+ */
+static int start_dump(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr,
+		int (*dump)(struct sk_buff *, struct netlink_callback *),
+		int (*done)(struct netlink_callback *))
+{
+	/* Like netlink_kernel_create() (see nlhandler_init()), this one changed in 3.1 and 3.4. */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3, 1, 0)
+	/* These kernels cannot be asked for large skbs; NLMSG_GOODSIZE will have to do. */
+	return netlink_dump_start(nl_socket, skb_in, nl_hdr, dump, done);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(3, 4, 0)
+	return netlink_dump_start(nl_socket, skb_in, nl_hdr, dump, done, DUMP_SKB_SIZE);
+#else
+	struct netlink_dump_control control = {
+		.dump = dump,
+		.done = done,
+		.min_dump_alloc = DUMP_SKB_SIZE,
+	};
+	return netlink_dump_start(nl_socket, skb_in, nl_hdr, &control);
+#endif
+}
+
+/**
+ * Opens the Netlink message all the entries of the "skb" dump skb will be written in.
+ */
+static struct nlmsghdr *dump_begin(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	return nlmsg_put(skb, 0, cb->nlh->nlmsg_seq, MSG_SETCFG, 0, NLM_F_MULTI);
+}
+
+/**
+ * Appends "entry" to the dump skb "skb".
+ *
+ * @return 0 on success, 1 if the entry does not fit (ie. the iteration should stop and wait for
+ *		the next skb).
+ */
+static int dump_write(struct sk_buff *skb, void *entry, int entry_len)
+{
+	/* Leave room for dump_end()'s padding. */
+	if (skb_tailroom(skb) < entry_len + NLMSG_ALIGNTO)
+		return 1;
+
+	memcpy(skb_put(skb, entry_len), entry, entry_len);
+	return 0;
+}
+
+/**
+ * Closes the message dump_begin() opened, given "error" is the result of the table iteration.
+ * Returns what the dump function should return to Netlink.
+ */
+static int dump_end(struct sk_buff *skb, struct nlmsghdr *nl_hdr, int error)
+{
+	int padding;
+
+	if (error < 0) {
+		nlmsg_cancel(skb, nl_hdr);
+		return error;
+	}
+
+	nlmsg_end(skb, nl_hdr);
+	if (nlmsg_len(nl_hdr) == 0) {
+		/* The previous skb reached the end of the table; Netlink will send NLMSG_DONE. */
+		nlmsg_cancel(skb, nl_hdr);
+		return 0;
+	}
+
+	padding = NLMSG_ALIGN(nl_hdr->nlmsg_len) - nl_hdr->nlmsg_len;
+	if (padding)
+		memset(skb_put(skb, padding), 0, padding);
+
+	return skb->len;
+}
+
 static int bib_entry_to_userspace(struct bib_entry *entry, void *arg)
 {
-	struct nl_buffer *buffer = (struct nl_buffer *) arg;
 	struct bib_entry_usr entry_usr;
 
 	entry_usr.addr4 = entry->ipv4;
 	entry_usr.addr6 = entry->ipv6;
 	entry_usr.is_static = entry->is_static;
 
-	return nlbuffer_write(buffer, &entry_usr, sizeof(entry_usr));
+	return dump_write(arg, &entry_usr, sizeof(entry_usr));
 }
 
-static int handle_bib_display(struct nlmsghdr *nl_hdr, struct request_bib *request)
+static int bib_dump(struct sk_buff *skb, struct netlink_callback *cb)
 {
-	struct nl_buffer *buffer;
-	struct ipv4_transport_addr *addr4;
+	struct request_hdr *jool_hdr = nlmsg_data(cb->nlh);
+	struct request_bib *request = (struct request_bib *) (jool_hdr + 1);
+	struct nlmsghdr *nl_hdr;
 	int error;
 
+	BUILD_BUG_ON(sizeof(struct bibdb_cursor) > sizeof(cb->args));
+
+	nl_hdr = dump_begin(skb, cb);
+	if (!nl_hdr)
+		return -EMSGSIZE;
+
+	error = bibdb_iterate(request->l4_proto, bib_entry_to_userspace, skb,
+			(struct bibdb_cursor *) cb->args);
+	return dump_end(skb, nl_hdr, error);
+}
+
+static int bib_dump_done(struct netlink_callback *cb)
+{
+	bibdb_cursor_release((struct bibdb_cursor *) cb->args);
+	return 0;
+}
+
+static int handle_bib_display(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr)
+{
 	log_debug("Sending BIB to userspace.");
+	return start_dump(skb_in, nl_hdr, bib_dump, bib_dump_done);
+}
 
-	buffer = nlbuffer_create(nl_socket, nl_hdr);
-	if (!buffer)
+/**
+ * Finds the array of "count" entries of "entry_size" bytes each which follows "request" (which is
+ * "request_size" bytes long), making sure they were really sent.
+ */
+static int get_batch(struct nlmsghdr *nl_hdr, struct request_hdr *jool_hdr, void *request,
+		size_t request_size, __u32 count, size_t entry_size, void **result)
+{
+	size_t available = min_t(size_t, nlmsg_len(nl_hdr), jool_hdr->length);
+
+	if (count == 0) {
+		log_err("The batch is empty.");
+		return -EINVAL;
+	}
+	if (available < sizeof(*jool_hdr) + request_size
+			|| count > (available - sizeof(*jool_hdr) - request_size) / entry_size) {
+		log_err("The message is too short to contain %u entries.", count);
+		return -EINVAL;
+	}
+
+	*result = ((unsigned char *) request) + request_size;
+	return 0;
+}
+
+/**
+ * Answers a batch request with the result of each of its entries.
+ */
+static int respond_batch(struct nlmsghdr *nl_hdr, __s32 *results, __u32 count)
+{
+	__u32 i;
+	__u32 failures = 0;
+
+	for (i = 0; i < count; i++)
+		if (results[i])
+			failures++;
+	log_debug("%u out of %u entries could not be added.", failures, count);
+
+	return respond_setcfg(nl_hdr, results, count * sizeof(*results));
+}
+
+static int handle_bib_load(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
+		struct request_bib *request)
+{
+	struct bib_entry_usr *entries;
+	__s32 *results;
+	__u32 count = request->load.count;
+	int error;
+
+	error = get_batch(nl_hdr, nat64_hdr, request, sizeof(*request), count, sizeof(*entries),
+			(void **) &entries);
+	if (error)
+		return respond_error(nl_hdr, error);
+
+	results = kmalloc(count * sizeof(*results), GFP_KERNEL);
+	if (!results)
 		return respond_error(nl_hdr, -ENOMEM);
 
-	addr4 = request->display.addr4_set ? &request->display.addr4 : NULL;
-	error = bibdb_iterate_by_ipv4(request->l4_proto, bib_entry_to_userspace, buffer, addr4);
-	error = (error >= 0) ? nlbuffer_close(buffer, error) : respond_error(nl_hdr, error);
+	error = add_static_routes(request->l4_proto, entries, count, results);
+	error = error ? respond_error(nl_hdr, error) : respond_batch(nl_hdr, results, count);
 
-	kfree(buffer);
+	kfree(results);
 	return error;
 }
 
-static int handle_bib_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
-		struct request_bib *request)
+static int handle_bib_config(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr,
+		struct request_hdr *nat64_hdr, struct request_bib *request)
 {
 	__u64 count;
 	int error;
@@ -379,7 +588,7 @@ static int handle_bib_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_
 
 	switch (nat64_hdr->operation) {
 	case OP_DISPLAY:
-		return handle_bib_display(nl_hdr, request);
+		return handle_bib_display(skb_in, nl_hdr);
 
 	case OP_COUNT:
 		log_debug("Returning BIB count.");
@@ -395,6 +604,13 @@ static int handle_bib_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_
 		log_debug("Adding BIB entry.");
 		return respond_error(nl_hdr, add_static_route(request));
 
+	case OP_LOAD:
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		log_debug("Adding a batch of BIB entries.");
+		return handle_bib_load(nl_hdr, nat64_hdr, request);
+
 	case OP_REMOVE:
 		if (verify_superpriv())
 			return respond_error(nl_hdr, -EPERM);
@@ -410,14 +626,12 @@ static int handle_bib_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_
 
 static int session_entry_to_userspace(struct session_entry *entry, void *arg)
 {
-	struct nl_buffer *buffer = (struct nl_buffer *) arg;
 	struct session_entry_usr entry_usr;
 	unsigned long dying_time;
-	int error;
+	enum session_timer_type timer;
 
-	error = sessiondb_get_timeout(entry, &dying_time);
-	if (error)
-		return error;
+	if (sessiondb_get_timeout(entry, &dying_time) || sessiondb_get_timer_type(entry, &timer))
+		return 0; /* It died while we were looking; skip it. */
 	dying_time += entry->update_time;
 
 	entry_usr.remote6 = entry->remote6;
@@ -425,38 +639,68 @@ static int session_entry_to_userspace(struct session_entry *entry, void *arg)
 	entry_usr.local4 = entry->local4;
 	entry_usr.remote4 = entry->remote4;
 	entry_usr.state = entry->state;
+	entry_usr.timer = timer;
 	entry_usr.dying_time = (dying_time > jiffies) ? jiffies_to_msecs(dying_time - jiffies) : 0;
 
-	return nlbuffer_write(buffer, &entry_usr, sizeof(entry_usr));
+	return dump_write(arg, &entry_usr, sizeof(entry_usr));
 }
 
-static int handle_session_display(struct nlmsghdr *nl_hdr, struct request_session *request)
+static int session_dump(struct sk_buff *skb, struct netlink_callback *cb)
 {
-	struct nl_buffer *buffer;
-	struct ipv4_transport_addr *remote4 = NULL;
-	struct ipv4_transport_addr *local4 = NULL;
+	struct request_hdr *jool_hdr = nlmsg_data(cb->nlh);
+	struct request_session *request = (struct request_session *) (jool_hdr + 1);
+	struct nlmsghdr *nl_hdr;
 	int error;
 
+	BUILD_BUG_ON(sizeof(struct sessiondb_cursor) > sizeof(cb->args));
+
+	nl_hdr = dump_begin(skb, cb);
+	if (!nl_hdr)
+		return -EMSGSIZE;
+
+	error = sessiondb_iterate(request->l4_proto, session_entry_to_userspace, skb,
+			(struct sessiondb_cursor *) cb->args);
+	return dump_end(skb, nl_hdr, error);
+}
+
+static int session_dump_done(struct netlink_callback *cb)
+{
+	sessiondb_cursor_release((struct sessiondb_cursor *) cb->args);
+	return 0;
+}
+
+static int handle_session_display(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr)
+{
 	log_debug("Sending session table to userspace.");
+	return start_dump(skb_in, nl_hdr, session_dump, session_dump_done);
+}
 
-	buffer = nlbuffer_create(nl_socket, nl_hdr);
-	if (!buffer)
+static int handle_session_load(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
+		struct request_session *request)
+{
+	struct session_record_usr *records;
+	__s32 *results;
+	__u32 count = request->load.count;
+	int error;
+
+	error = get_batch(nl_hdr, nat64_hdr, request, sizeof(*request), count, sizeof(*records),
+			(void **) &records);
+	if (error)
+		return respond_error(nl_hdr, error);
+
+	results = kmalloc(count * sizeof(*results), GFP_KERNEL);
+	if (!results)
 		return respond_error(nl_hdr, -ENOMEM);
 
-	if (request->display.connection_set) {
-		remote4 = &request->display.remote4;
-		local4 = &request->display.local4;
-	}
-	error = sessiondb_iterate_by_ipv4(request->l4_proto, session_entry_to_userspace, buffer,
-			remote4, local4);
-	error = (error >= 0) ? nlbuffer_close(buffer, error) : respond_error(nl_hdr, error);
+	error = restore_sessions(request->l4_proto, records, count, request->load.sync, results);
+	error = error ? respond_error(nl_hdr, error) : respond_batch(nl_hdr, results, count);
 
-	kfree(buffer);
+	kfree(results);
 	return error;
 }
 
-static int handle_session_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
-		struct request_session *request)
+static int handle_session_config(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr,
+		struct request_hdr *nat64_hdr, struct request_session *request)
 {
 	__u64 count;
 	int error;
@@ -468,7 +712,7 @@ static int handle_session_config(struct nlmsghdr *nl_hdr, struct request_hdr *na
 
 	switch (nat64_hdr->operation) {
 	case OP_DISPLAY:
-		return handle_session_display(nl_hdr, request);
+		return handle_session_display(skb_in, nl_hdr);
 
 	case OP_COUNT:
 		log_debug("Returning session count.");
@@ -477,6 +721,114 @@ static int handle_session_config(struct nlmsghdr *nl_hdr, struct request_hdr *na
 			return respond_error(nl_hdr, error);
 		return respond_setcfg(nl_hdr, &count, sizeof(count));
 
+	case OP_LOAD:
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		log_debug("Restoring a batch of sessions.");
+		return handle_session_load(nl_hdr, nat64_hdr, request);
+
+	default:
+		log_err("Unknown operation: %d", nat64_hdr->operation);
+		return respond_error(nl_hdr, -EINVAL);
+	}
+}
+
+/**
+ * Maximum number of skbs a single MODE_SYNC or MODE_LOG dump can span. Otherwise, a busy
+ * translator could keep the daemon reading the same dump forever.
+ */
+#define EVENT_DUMP_MAX_SKBS 64
+
+/**
+ * Fills "skb" with whatever "drain" takes out of one of the event queues.
+ */
+static int event_dump(struct sk_buff *skb, struct netlink_callback *cb,
+		int (*drain)(struct sk_buff *))
+{
+	struct nlmsghdr *nl_hdr;
+
+	/* cb->args[0] is the number of skbs sent so far. */
+	if (cb->args[0]++ >= EVENT_DUMP_MAX_SKBS)
+		return 0;
+
+	nl_hdr = dump_begin(skb, cb);
+	if (!nl_hdr)
+		return -EMSGSIZE;
+
+	return dump_end(skb, nl_hdr, drain(skb));
+}
+
+static int sync_record_to_userspace(struct session_record_usr *record, void *arg)
+{
+	return dump_write(arg, record, sizeof(*record));
+}
+
+static int sync_drain(struct sk_buff *skb)
+{
+	return sessionsync_drain(sync_record_to_userspace, skb);
+}
+
+static int sync_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	return event_dump(skb, cb, sync_drain);
+}
+
+static int handle_sync_config(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr,
+		struct request_hdr *nat64_hdr)
+{
+	if (nat64_is_stateless()) {
+		log_err("SIIT doesn't have session tables.");
+		return respond_error(nl_hdr, -EINVAL);
+	}
+
+	switch (nat64_hdr->operation) {
+	case OP_DISPLAY:
+		/* The events are consumed as they are read. */
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		log_debug("Sending the queued session events to userspace.");
+		return start_dump(skb_in, nl_hdr, sync_dump, NULL);
+
+	default:
+		log_err("Unknown operation: %d", nat64_hdr->operation);
+		return respond_error(nl_hdr, -EINVAL);
+	}
+}
+
+static int log_event_to_userspace(struct log_event_usr *event, void *arg)
+{
+	return dump_write(arg, event, sizeof(*event));
+}
+
+static int log_drain(struct sk_buff *skb)
+{
+	return eventlog_drain(log_event_to_userspace, skb);
+}
+
+static int log_dump(struct sk_buff *skb, struct netlink_callback *cb)
+{
+	return event_dump(skb, cb, log_drain);
+}
+
+static int handle_log_config(struct sk_buff *skb_in, struct nlmsghdr *nl_hdr,
+		struct request_hdr *nat64_hdr)
+{
+	if (nat64_is_stateless()) {
+		log_err("SIIT doesn't have BIB or session tables.");
+		return respond_error(nl_hdr, -EINVAL);
+	}
+
+	switch (nat64_hdr->operation) {
+	case OP_DISPLAY:
+		/* The events are consumed as they are read. */
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		log_debug("Sending the queued BIB and session logs to userspace.");
+		return start_dump(skb_in, nl_hdr, log_dump, NULL);
+
 	default:
 		log_err("Unknown operation: %d", nat64_hdr->operation);
 		return respond_error(nl_hdr, -EINVAL);
@@ -514,6 +866,30 @@ static int handle_eamt_display(struct nlmsghdr *nl_hdr, union request_eamt *requ
 	return error;
 }
 
+static int handle_eamt_load(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
+		union request_eamt *request)
+{
+	struct eam_entry_usr *entries;
+	__s32 *results;
+	__u32 count = request->load.count;
+	int error;
+
+	error = get_batch(nl_hdr, nat64_hdr, request, sizeof(*request), count, sizeof(*entries),
+			(void **) &entries);
+	if (error)
+		return respond_error(nl_hdr, error);
+
+	results = kmalloc(count * sizeof(*results), GFP_KERNEL);
+	if (!results)
+		return respond_error(nl_hdr, -ENOMEM);
+
+	error = eamt_add_batch(entries, count, results);
+	error = error ? respond_error(nl_hdr, error) : respond_batch(nl_hdr, results, count);
+
+	kfree(results);
+	return error;
+}
+
 static int handle_eamt_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
 		union request_eamt *request)
 {
@@ -543,6 +919,13 @@ static int handle_eamt_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64
 		log_debug("Adding EAMT entry.");
 		return respond_error(nl_hdr, eamt_add(&request->add.prefix6, &request->add.prefix4));
 
+	case OP_LOAD:
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		log_debug("Adding a batch of EAMT entries.");
+		return handle_eamt_load(nl_hdr, nat64_hdr, request);
+
 	case OP_REMOVE:
 		if (verify_superpriv())
 			return respond_error(nl_hdr, -EPERM);
@@ -642,48 +1025,69 @@ static int handle_rfc6791_config(struct nlmsghdr *nl_hdr, struct request_hdr *na
 	}
 }
 
-#ifdef BENCHMARK
-static int logtime_entry_to_userspace(struct log_node *node, void *arg)
+static int handle_logtime_display(struct nlmsghdr *nl_hdr, struct request_logtime *request)
 {
-	struct nl_buffer *buffer = (struct nl_buffer *) arg;
-	struct logtime_entry_usr entry_usr;
+	struct logtime_histogram_usr *histogram;
+	int error;
 
-	entry_usr.time = node->time;
+	log_debug("Sending a latency histogram to userspace.");
 
-	return nlbuffer_write(buffer, &entry_usr, sizeof(entry_usr));
-}
+	/* Too big for the stack. */
+	histogram = kmalloc(sizeof(*histogram), GFP_KERNEL);
+	if (!histogram)
+		return respond_error(nl_hdr, -ENOMEM);
 
-#endif
+	error = logtime_get(request->l3_proto, request->l4_proto, request->stage, histogram);
+	error = error ? respond_error(nl_hdr, error)
+			: respond_setcfg(nl_hdr, histogram, sizeof(*histogram));
+
+	kfree(histogram);
+	return error;
+}
 
 static int handle_logtime_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
 		struct request_logtime *request)
 {
-#ifdef BENCHMARK
-	struct nl_buffer *buffer;
-	int error;
+	switch (nat64_hdr->operation) {
+	case OP_DISPLAY:
+		return handle_logtime_display(nl_hdr, request);
+
+	case OP_FLUSH:
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		log_debug("Resetting the latency histograms.");
+		logtime_flush();
+		return respond_error(nl_hdr, 0);
+
+	default:
+		log_err("Unknown operation: %d", nat64_hdr->operation);
+		return respond_error(nl_hdr, -EINVAL);
+	}
+}
+
+static int handle_stats_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr)
+{
+	struct stats_usr stats;
 
 	switch (nat64_hdr->operation) {
 	case OP_DISPLAY:
-		log_debug("Sending logs time to userspace.");
+		log_debug("Sending the packet counters to userspace.");
+		stats_get(&stats);
+		return respond_setcfg(nl_hdr, &stats, sizeof(stats));
 
-		buffer = nlbuffer_create(nl_socket, nl_hdr);
-		if (!buffer)
-			return respond_error(nl_hdr, -ENOMEM);
+	case OP_FLUSH:
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
 
-		error = logtime_iterate_and_delete(request->l3_proto, request->l4_proto,
-				logtime_entry_to_userspace, buffer);
-		error = (error >= 0) ? nlbuffer_close(buffer, error) : respond_error(nl_hdr, error);
+		log_debug("Resetting the packet counters.");
+		stats_flush();
+		return respond_error(nl_hdr, 0);
 
-		kfree(buffer);
-		return error;
 	default:
 		log_err("Unknown operation: %d", nat64_hdr->operation);
 		return respond_error(nl_hdr, -EINVAL);
 	}
-#else
-	log_err("Benchmark was not enabled during compilation.");
-	return -EINVAL;
-#endif
 }
 
 static bool ensure_bytes(size_t actual, size_t expected)
@@ -799,10 +1203,10 @@ static int handle_global_update(enum global_type type, size_t size, unsigned cha
 
 	switch (type) {
 #ifdef STATEFUL
-	case MAX_PKTS:
+	case SO_MAX_MEM:
 		if (!ensure_bytes(size, 8))
 			goto einval;
-		config->max_stored_pkts = *((__u64 *) value);
+		config->so_max_mem = *((__u64 *) value);
 		break;
 	case SRC_ICMP6ERRS_BETTER:
 		if (!ensure_bytes(size, 1))
@@ -819,6 +1223,16 @@ static int handle_global_update(enum global_type type, size_t size, unsigned cha
 			goto einval;
 		config->session_logging = *((__u8 *) value);
 		break;
+	case LOGGING_BINARY:
+		if (!ensure_bytes(size, 1))
+			goto einval;
+		config->logging_binary = *((__u8 *) value);
+		break;
+	case SESSION_SYNC:
+		if (!ensure_bytes(size, 1))
+			goto einval;
+		config->session_sync = *((__u8 *) value);
+		break;
 
 	case UDP_TIMEOUT:
 		if (!ensure_bytes(size, 8))
@@ -873,6 +1287,11 @@ static int handle_global_update(enum global_type type, size_t size, unsigned cha
 			goto einval;
 		config->drop_external_tcp = *((__u8 *) value);
 		break;
+	case STATELESS_EXTERNAL_TCP:
+		if (!ensure_bytes(size, 1))
+			goto einval;
+		config->stateless_external_tcp = *((__u8 *) value);
+		break;
 #else
 	case COMPUTE_UDP_CSUM_ZERO:
 		if (!ensure_bytes(size, 1))
@@ -938,6 +1357,11 @@ static int handle_global_update(enum global_type type, size_t size, unsigned cha
 		config->atomic_frags.build_ipv4_id = !(*((__u8 *) value));
 		config->atomic_frags.lower_mtu_fail = !(*((__u8 *) value));
 		break;
+	case LATENCY_HISTOGRAMS:
+		if (!ensure_bytes(size, 1))
+			goto einval;
+		config->latency_histograms = *((__u8 *) value);
+		break;
 	default:
 		log_err("Unknown config type: %u", type);
 		goto einval;
@@ -1007,6 +1431,173 @@ end:
 	return respond_error(nl_hdr, error);
 }
 
+/**
+ * Forgets the session cleanups the transaction in progress staged.
+ */
+static void txn_forget_cleanups(void)
+{
+	struct txn_prefix6 *removed, *tmp;
+
+	list_for_each_entry_safe(removed, tmp, &txn_removed6, list_hook) {
+		list_del(&removed->list_hook);
+		kfree(removed);
+	}
+	txn_flushed6 = false;
+}
+
+/**
+ * Deletes the sessions which the pool6 removals and flushes of the transaction being committed
+ * orphaned, then forgets about them. Works as if the operations had been applied outside of the
+ * transaction, so the sessions of a prefix which was removed and then added back are deleted too.
+ */
+static int txn_apply_cleanups(void)
+{
+	struct txn_prefix6 *removed;
+	int error;
+	int result = 0;
+
+	if (!nat64_is_stateful())
+		return 0;
+
+	if (txn_flushed6) {
+		result = sessiondb_flush();
+	} else {
+		list_for_each_entry(removed, &txn_removed6, list_hook) {
+			error = sessiondb_delete_by_prefix6(&removed->prefix);
+			if (error && !result)
+				result = error;
+		}
+	}
+
+	txn_forget_cleanups();
+	return result;
+}
+
+static int txn_begin(void)
+{
+	if (txn_open) {
+		log_err("There is already a transaction in progress.");
+		return -EBUSY;
+	}
+
+	log_debug("Starting a configuration transaction.");
+
+	pool6_txn_begin();
+	if (nat64_is_stateless()) {
+#ifndef STATEFUL
+		pool4_txn_begin();
+#endif
+		rfc6791_txn_begin();
+		eamt_txn_begin();
+	}
+
+	txn_open = true;
+	return 0;
+}
+
+static int txn_commit(void)
+{
+	if (!txn_open) {
+		log_err("There is no transaction in progress.");
+		return -EINVAL;
+	}
+
+	log_debug("Committing the configuration transaction.");
+
+	/*
+	 * The new tables were built while the changes were being staged; this only swaps pointers
+	 * and waits for the readers of the old tables before releasing them.
+	 */
+	pool6_txn_commit();
+	if (nat64_is_stateless()) {
+#ifndef STATEFUL
+		pool4_txn_commit();
+#endif
+		rfc6791_txn_commit();
+		eamt_txn_commit();
+	}
+
+	txn_open = false;
+	classifier_rebuild();
+	/* The prefixes are gone now, so their sessions can go too. */
+	return txn_apply_cleanups();
+}
+
+static int txn_abort(void)
+{
+	if (!txn_open) {
+		log_err("There is no transaction in progress.");
+		return -EINVAL;
+	}
+
+	log_debug("Aborting the configuration transaction.");
+
+	pool6_txn_abort();
+	if (nat64_is_stateless()) {
+#ifndef STATEFUL
+		pool4_txn_abort();
+#endif
+		rfc6791_txn_abort();
+		eamt_txn_abort();
+	}
+
+	txn_forget_cleanups();
+	txn_open = false;
+	return 0;
+}
+
+static int handle_transaction_config(struct nlmsghdr *nl_hdr, struct request_hdr *nat64_hdr,
+		struct request_transaction *request)
+{
+	__u8 open;
+
+	switch (nat64_hdr->operation) {
+	case OP_DISPLAY:
+		log_debug("Returning the transaction's state.");
+		open = txn_open;
+		return respond_setcfg(nl_hdr, &open, sizeof(open));
+
+	case OP_UPDATE:
+		if (verify_superpriv())
+			return respond_error(nl_hdr, -EPERM);
+
+		switch (request->action) {
+		case TXN_BEGIN:
+			return respond_error(nl_hdr, txn_begin());
+		case TXN_COMMIT:
+			return respond_error(nl_hdr, txn_commit());
+		case TXN_ABORT:
+			return respond_error(nl_hdr, txn_abort());
+		}
+
+		log_err("Unknown transaction action: %u", request->action);
+		return respond_error(nl_hdr, -EINVAL);
+
+	default:
+		log_err("Unknown operation: %d", nat64_hdr->operation);
+		return respond_error(nl_hdr, -EINVAL);
+	}
+}
+
+/**
+ * The classifier is compiled out of the pools, so it has to be rebuilt whenever they change.
+ * (Even if the request failed, since it might have been applied partially.)
+ * Changes staged by a transaction are not visible until the commit, which rebuilds it itself.
+ */
+static void update_classifier(struct request_hdr *nat64_hdr)
+{
+	if (txn_open)
+		return;
+
+	switch (nat64_hdr->operation) {
+	case OP_ADD:
+	case OP_UPDATE:
+	case OP_REMOVE:
+	case OP_FLUSH:
+		classifier_rebuild();
+	}
+}
+
 /**
  * Gets called by "netlink_rcv_skb" when the userspace application wants to interact with us.
  *
@@ -1034,22 +1625,34 @@ static int handle_netlink_message(struct sk_buff *skb_in, struct nlmsghdr *nl_hd
 
 	switch (nat64_hdr->mode) {
 	case MODE_POOL6:
-		return handle_pool6_config(nl_hdr, nat64_hdr, request);
+		error = handle_pool6_config(nl_hdr, nat64_hdr, request);
+		update_classifier(nat64_hdr);
+		return error;
 	case MODE_POOL4:
 	case MODE_BLACKLIST:
-		return handle_pool4_config(nl_hdr, nat64_hdr, request);
+		error = handle_pool4_config(nl_hdr, nat64_hdr, request);
+		update_classifier(nat64_hdr);
+		return error;
 	case MODE_BIB:
-		return handle_bib_config(nl_hdr, nat64_hdr, request);
+		return handle_bib_config(skb_in, nl_hdr, nat64_hdr, request);
 	case MODE_SESSION:
-		return handle_session_config(nl_hdr, nat64_hdr, request);
+		return handle_session_config(skb_in, nl_hdr, nat64_hdr, request);
 	case MODE_EAMT:
 		return handle_eamt_config(nl_hdr, nat64_hdr, request);
 	case MODE_RFC6791:
 		return handle_rfc6791_config(nl_hdr, nat64_hdr, request);
 	case MODE_LOGTIME:
 		return handle_logtime_config(nl_hdr, nat64_hdr, request);
+	case MODE_STATS:
+		return handle_stats_config(nl_hdr, nat64_hdr);
 	case MODE_GLOBAL:
 		return handle_global_config(nl_hdr, nat64_hdr, request);
+	case MODE_TRANSACTION:
+		return handle_transaction_config(nl_hdr, nat64_hdr, request);
+	case MODE_SYNC:
+		return handle_sync_config(skb_in, nl_hdr, nat64_hdr);
+	case MODE_LOG:
+		return handle_log_config(skb_in, nl_hdr, nat64_hdr);
 	}
 
 	log_err("Unknown configuration mode: %d", nat64_hdr->mode);
@@ -1101,6 +1704,7 @@ int nlhandler_init(void)
 void nlhandler_destroy(void)
 {
 	netlink_kernel_release(nl_socket);
+	txn_forget_cleanups();
 }
 
 int serialize_global_config(struct global_config *config, unsigned char **buffer_out,
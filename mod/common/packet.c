@@ -9,6 +9,7 @@
 #include "nat64/mod/common/config.h"
 #include "nat64/mod/common/types.h"
 #include "nat64/mod/common/icmp_wrapper.h"
+#include "nat64/mod/common/log_time.h"
 #include "nat64/mod/common/stats.h"
 
 struct pkt_metadata {
@@ -38,6 +39,7 @@ static int truncated6(struct sk_buff *skb, const char *what)
 {
 	log_debug("The %s seems truncated.", what);
 	inc_stats_skb6(skb, IPSTATS_MIB_INTRUNCATEDPKTS);
+	stats_drop(DROP_MALFORMED);
 	return -EINVAL;
 }
 
@@ -45,6 +47,7 @@ static int truncated4(struct sk_buff *skb, const char *what)
 {
 	log_debug("The %s seems truncated.", what);
 	inc_stats_skb4(skb, IPSTATS_MIB_INTRUNCATEDPKTS);
+	stats_drop(DROP_MALFORMED);
 	return -EINVAL;
 }
 
@@ -52,6 +55,7 @@ static int inhdr6(struct sk_buff *skb, const char *msg)
 {
 	log_debug("%s", msg);
 	inc_stats_skb6(skb, IPSTATS_MIB_INHDRERRORS);
+	stats_drop(DROP_MALFORMED);
 	return -EINVAL;
 }
 
@@ -59,6 +63,7 @@ static int inhdr4(struct sk_buff *skb, const char *msg)
 {
 	log_debug("%s", msg);
 	inc_stats_skb4(skb, IPSTATS_MIB_INHDRERRORS);
+	stats_drop(DROP_MALFORMED);
 	return -EINVAL;
 }
 
@@ -277,9 +282,8 @@ int pkt_init_ipv6(struct packet *pkt, struct sk_buff *skb)
 	 * so you generally don't want to store them.
 	 */
 
-#ifdef BENCHMARK
-	getnstimeofday(&pkt->start_time);
-#endif
+	pkt->config = config_get();
+	pkt->start_time = pkt->config->latency_histograms ? logtime_now() : 0;
 
 	error = fail_if_shared(skb);
 	if (error)
@@ -429,7 +433,8 @@ static int summarize_skb4(struct sk_buff *skb, struct pkt_metadata *meta)
 	return 0;
 }
 
-static int handle_udp4(struct sk_buff *skb, struct pkt_metadata *meta)
+static int handle_udp4(struct sk_buff *skb, struct pkt_metadata *meta,
+		struct global_config *config)
 {
 	struct iphdr *hdr4;
 	struct udphdr buffer, *ptr;
@@ -454,7 +459,7 @@ static int handle_udp4(struct sk_buff *skb, struct pkt_metadata *meta)
 	 * Dropping the packet or Calculating an IPv6 checksum and forwarding the packet.
 	 */
 	if (ptr->check == 0 && (is_more_fragments_set_ipv4(hdr4)
-			|| !config_get_compute_UDP_csum_zero())) {
+			|| !config->compute_udp_csum_zero)) {
 		log_debug("Dropping IPv4 packet, UDP Packet has checksum 0:");
 		log_debug("%pI4#%u->%pI4#%u", &hdr4->saddr, ntohs(ptr->source),
 				&hdr4->daddr, ntohs(ptr->dest));
@@ -474,9 +479,8 @@ int pkt_init_ipv4(struct packet *pkt, struct sk_buff *skb)
 	 * so you generally don't want to store them.
 	 */
 
-#ifdef BENCHMARK
-	getnstimeofday(&pkt->start_time);
-#endif
+	pkt->config = config_get();
+	pkt->start_time = pkt->config->latency_histograms ? logtime_now() : 0;
 
 	error = fail_if_shared(skb);
 	if (error)
@@ -487,7 +491,7 @@ int pkt_init_ipv4(struct packet *pkt, struct sk_buff *skb)
 		return error;
 
 	if (meta.l4_proto == L4PROTO_UDP) {
-		error = handle_udp4(skb, &meta);
+		error = handle_udp4(skb, &meta, pkt->config);
 		if (error)
 			return error;
 	}
@@ -3,7 +3,9 @@
 #include "nat64/common/str_utils.h"
 #include "nat64/mod/common/types.h"
 
+#include <linux/jhash.h>
 #include <linux/rculist.h>
+#include <linux/vmalloc.h>
 #include <net/ipv6.h>
 
 
@@ -15,14 +17,83 @@ struct pool_node {
 	struct ipv6_prefix prefix;
 	/** The thing that connects this object to the "pool" list. */
 	struct list_head list_hook;
+	/** The thing that connects this object to its bucket in "tables". */
+	struct hlist_node hash_hook;
+};
+
+/** The prefix lengths RFC 6052 allows, longest first. */
+static const __u8 lengths[] = { 96, 64, 56, 48, 40, 32 };
+#define LENGTH_COUNT ARRAY_SIZE(lengths)
+
+#define POOL6_HASH_BITS 10
+#define POOL6_HASH_SIZE (1 << POOL6_HASH_BITS)
+
+/**
+ * One hash table per prefix length, so addresses can be looked up by hashing their first bits once
+ * per length, however many prefixes the pool has.
+ */
+struct pool_table {
+	struct hlist_head buckets[POOL6_HASH_SIZE];
+	/** Number of prefixes in the table. Lets lookups skip the lengths nobody is using. */
+	unsigned int count;
+};
+
+/**
+ * A complete instance of the pool.
+ */
+struct pool6_db {
+	/**
+	 * The prefixes, in insertion order.
+	 * Used by the control plane and pool6_peek(); lookups go through "tables" instead.
+	 * The list contains nodes of type pool_node.
+	 */
+	struct list_head list;
+	struct pool_table tables[LENGTH_COUNT];
 };
 
 /**
- * The global container of the entire pool.
- * It can be a linked list because we're assuming we won't be holding too many prefixes.
- * The list contains nodes of type pool_node.
+ * The pool the packet path is using. Writers are serialized by module initialization or the
+ * configuration mutex.
  */
-static LIST_HEAD(pool);
+static struct pool6_db __rcu *pool;
+
+/**
+ * While a transaction is open, the changes go to "candidate" instead of "pool". It is a private
+ * copy, so nobody has to wait for readers when editing it.
+ * It is only created once the transaction actually changes something.
+ */
+static bool txn_open;
+static struct pool6_db *candidate;
+
+static struct pool_table *get_table(struct pool6_db *db, __u8 len)
+{
+	unsigned int i;
+
+	for (i = 0; i < LENGTH_COUNT; i++)
+		if (lengths[i] == len)
+			return &db->tables[i];
+
+	return NULL;
+}
+
+/**
+ * Returns the bucket index of the first "len" bits of "addr".
+ * "len" has to be a multiple of 8, which is true for every RFC 6052 length.
+ */
+static u32 hash_prefix(const struct in6_addr *addr, __u8 len)
+{
+	return jhash(addr->s6_addr, len >> 3, 0) & (POOL6_HASH_SIZE - 1);
+}
+
+/**
+ * Unhooks "node" from the pool. The caller must wait for a grace period before releasing it.
+ */
+static void node_unlink(struct pool6_db *db, struct pool_node *node)
+{
+	list_del_rcu(&node->list_hook);
+	hlist_del_rcu(&node->hash_hook);
+	get_table(db, node->prefix.len)->count--;
+}
 
 static int verify_prefix(int start, struct ipv6_prefix *prefix)
 {
@@ -60,13 +131,147 @@ static int validate_prefix(struct ipv6_prefix *prefix)
 	}
 }
 
+static struct pool6_db *db_alloc(void)
+{
+	struct pool6_db *db;
+
+	/* The hash tables amount to several pages, and nothing needs them to be contiguous. */
+	db = vzalloc(sizeof(*db));
+	if (!db) {
+		log_err("Allocation of IPv6 pool failed.");
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&db->list);
+	return db;
+}
+
+/**
+ * Releases "db" and its prefixes. Nobody can be reading it anymore.
+ */
+static void db_free(struct pool6_db *db)
+{
+	struct pool_node *node, *tmp;
+
+	if (!db)
+		return;
+
+	list_for_each_entry_safe(node, tmp, &db->list, list_hook)
+		kfree(node);
+	vfree(db);
+}
+
+/**
+ * The pool the control plane should see. Assumes writers are serialized.
+ */
+static struct pool6_db *live_db(void)
+{
+	return rcu_dereference_protected(pool, true);
+}
+
+static int db_add(struct pool6_db *db, struct ipv6_prefix *prefix)
+{
+	struct pool_node *node;
+	struct pool_table *table;
+	struct hlist_head *bucket;
+	struct hlist_node *hnode;
+
+	if (nat64_is_stateless() && !list_empty(&db->list)) {
+		log_err("SIIT Jool only supports one pool6 prefix at a time.");
+		return -EINVAL;
+	}
+
+	/*
+	 * I'm not using the RCU iterators here because this is a writer (as usual,
+	 * protected by module initialization or the configuration mutex).
+	 * tomoyo_get_group() is an example of a kernel function that iterates like this
+	 * before calling list_add_tail_rcu(), so I'm assuming this is correct.
+	 */
+
+	table = get_table(db, prefix->len);
+	bucket = &table->buckets[hash_prefix(&prefix->address, prefix->len)];
+	hlist_for_each(hnode, bucket) {
+		node = hlist_entry(hnode, struct pool_node, hash_hook);
+		if (prefix6_equals(&node->prefix, prefix)) {
+			log_err("The prefix already belongs to the pool.");
+			return -EEXIST;
+		}
+	}
+
+	node = kmalloc(sizeof(struct pool_node), GFP_ATOMIC);
+	if (!node) {
+		log_err("Allocation of IPv6 pool node failed.");
+		return -ENOMEM;
+	}
+	node->prefix = *prefix;
+
+	list_add_tail_rcu(&node->list_hook, &db->list);
+	hlist_add_head_rcu(&node->hash_hook, bucket);
+	table->count++;
+	return 0;
+}
+
+/**
+ * Returns the pool writers should edit: "candidate" if there's a transaction, "pool" otherwise.
+ */
+static int get_writable_db(struct pool6_db **result)
+{
+	struct pool_node *node;
+	int error;
+
+	if (!txn_open) {
+		*result = live_db();
+		return 0;
+	}
+
+	if (!candidate) {
+		candidate = db_alloc();
+		if (!candidate)
+			return -ENOMEM;
+		list_for_each_entry(node, &live_db()->list, list_hook) {
+			error = db_add(candidate, &node->prefix);
+			if (error) {
+				db_free(candidate);
+				candidate = NULL;
+				return error;
+			}
+		}
+	}
+
+	*result = candidate;
+	return 0;
+}
+
+/**
+ * Makes "new" the pool the packet path sees, and releases the old one.
+ */
+static void db_replace(struct pool6_db *new)
+{
+	struct pool6_db *old = live_db();
+
+	rcu_assign_pointer(pool, new);
+	if (old) {
+		synchronize_rcu_bh();
+		db_free(old);
+	}
+}
+
 int pool6_init(char *pref_strs[], int pref_count)
 {
+	struct pool6_db *db;
 	struct ipv6_prefix prefix;
 	int i;
 	int error;
 
-	if (!pref_strs || pref_count == 0)
+	txn_open = false;
+	candidate = NULL;
+
+	db = db_alloc();
+	if (!db)
+		return -ENOMEM;
+	RCU_INIT_POINTER(pool, db);
+
+	if (!pref_strs)
 		return 0;
 
 	for (i = 0; i < pref_count; i++) {
@@ -87,42 +292,66 @@ fail:
 
 void pool6_destroy(void)
 {
-	struct pool_node *node;
+	db_free(candidate);
+	candidate = NULL;
+	txn_open = false;
 
-	while (!list_empty(&pool)) {
-		node = list_first_entry(&pool, struct pool_node, list_hook);
-		list_del_rcu(&node->list_hook);
-		synchronize_rcu_bh();
-		kfree(node);
-	}
+	db_replace(NULL);
 }
 
 int pool6_flush(void)
 {
-	pool6_destroy();
+	struct pool6_db *new;
+
+	new = db_alloc();
+	if (!new)
+		return -ENOMEM;
+
+	/* Readers see either the whole old pool or an empty one; never anything in between. */
+	if (txn_open) {
+		db_free(candidate);
+		candidate = new;
+	} else {
+		db_replace(new);
+	}
+
 	return 0;
 }
 
 int pool6_get(struct in6_addr *addr, struct ipv6_prefix *result)
 {
+	struct pool6_db *db;
 	struct pool_node *node;
+	struct hlist_head *bucket;
+	struct hlist_node *hnode;
+	unsigned int i;
 
 	if (WARN(!addr, "NULL is not a valid address."))
 		return -EINVAL;
 
 	rcu_read_lock_bh();
+	db = rcu_dereference_bh(pool);
 
-	if (list_empty(&pool)) {
+	if (list_empty(&db->list)) {
 		rcu_read_unlock_bh();
 		log_warn_once("The IPv6 pool is empty.");
 		return -ESRCH;
 	}
 
-	list_for_each_entry_rcu(node, &pool, list_hook) {
-		if (ipv6_prefix_equal(&node->prefix.address, addr, node->prefix.len)) {
-			*result = node->prefix;
-			rcu_read_unlock_bh();
-			return 0;
+	/* Longest prefix match. */
+	for (i = 0; i < LENGTH_COUNT; i++) {
+		if (!ACCESS_ONCE(db->tables[i].count))
+			continue;
+
+		bucket = &db->tables[i].buckets[hash_prefix(addr, lengths[i])];
+		for (hnode = rcu_dereference_bh(bucket->first); hnode;
+				hnode = rcu_dereference_bh(hnode->next)) {
+			node = hlist_entry(hnode, struct pool_node, hash_hook);
+			if (ipv6_prefix_equal(&node->prefix.address, addr, lengths[i])) {
+				*result = node->prefix;
+				rcu_read_unlock_bh();
+				return 0;
+			}
 		}
 	}
 
@@ -132,18 +361,20 @@ int pool6_get(struct in6_addr *addr, struct ipv6_prefix *result)
 
 int pool6_peek(struct ipv6_prefix *result)
 {
+	struct pool6_db *db;
 	struct pool_node *node;
 
 	rcu_read_lock_bh();
+	db = rcu_dereference_bh(pool);
 
-	if (list_empty(&pool)) {
+	if (list_empty(&db->list)) {
 		rcu_read_unlock_bh();
 		log_warn_once("The IPv6 pool is empty.");
 		return -ESRCH;
 	}
 
 	/* Just return the first one. */
-	node = list_entry_rcu(pool.next, struct pool_node, list_hook);
+	node = list_entry_rcu(db->list.next, struct pool_node, list_hook);
 	*result = node->prefix;
 
 	rcu_read_unlock_bh();
@@ -158,59 +389,44 @@ bool pool6_contains(struct in6_addr *addr)
 
 int pool6_add(struct ipv6_prefix *prefix)
 {
-	struct pool_node *node;
+	struct pool6_db *db;
 	int error;
 
-	log_debug("Inserting prefix to the IPv6 pool: %pI6c/%u.", &prefix->address, prefix->len);
-
 	if (WARN(!prefix, "NULL is not a valid prefix."))
 		return -EINVAL;
 
+	log_debug("Inserting prefix to the IPv6 pool: %pI6c/%u.", &prefix->address, prefix->len);
+
 	error = validate_prefix(prefix);
 	if (error)
 		return error; /* Error msg already printed. */
 
-	if (nat64_is_stateless() && !list_empty(&pool)) {
-		log_err("SIIT Jool only supports one pool6 prefix at a time.");
-		return -EINVAL;
-	}
-
-	/*
-	 * I'm not using list_for_each_entry_rcu() here because this is a writer (as usual,
-	 * protected by module initialization or the configuration mutex).
-	 * tomoyo_get_group() is an example of a kernel function that iterates like this
-	 * before calling list_add_tail_rcu(), so I'm assuming this is correct.
-	 */
-
-	list_for_each_entry(node, &pool, list_hook) {
-		if (prefix6_equals(&node->prefix, prefix)) {
-			log_err("The prefix already belongs to the pool.");
-			return -EEXIST;
-		}
-	}
-
-	node = kmalloc(sizeof(struct pool_node), GFP_ATOMIC);
-	if (!node) {
-		log_err("Allocation of IPv6 pool node failed.");
-		return -ENOMEM;
-	}
-	node->prefix = *prefix;
+	error = get_writable_db(&db);
+	if (error)
+		return error;
 
-	list_add_tail_rcu(&node->list_hook, &pool);
-	return 0;
+	return db_add(db, prefix);
 }
 
 int pool6_remove(struct ipv6_prefix *prefix)
 {
+	struct pool6_db *db;
 	struct pool_node *node;
+	int error;
 
 	if (WARN(!prefix, "NULL is not a valid prefix."))
 		return -EINVAL;
 
-	list_for_each_entry(node, &pool, list_hook) {
+	error = get_writable_db(&db);
+	if (error)
+		return error;
+
+	list_for_each_entry(node, &db->list, list_hook) {
 		if (prefix6_equals(&node->prefix, prefix)) {
-			list_del_rcu(&node->list_hook);
-			synchronize_rcu_bh();
+			node_unlink(db, node);
+			/* The candidate is private, so there's nobody to wait for. */
+			if (db != candidate)
+				synchronize_rcu_bh();
 			kfree(node);
 			return 0;
 		}
@@ -220,6 +436,27 @@ int pool6_remove(struct ipv6_prefix *prefix)
 	return -ESRCH;
 }
 
+void pool6_txn_begin(void)
+{
+	txn_open = true;
+}
+
+void pool6_txn_commit(void)
+{
+	if (candidate)
+		db_replace(candidate);
+
+	candidate = NULL;
+	txn_open = false;
+}
+
+void pool6_txn_abort(void)
+{
+	db_free(candidate);
+	candidate = NULL;
+	txn_open = false;
+}
+
 /**
  * pool6_for_each - run func() for every prefix in this pool.
  * @func: routine you want to run on every node in the pool.
@@ -232,11 +469,13 @@ int pool6_remove(struct ipv6_prefix *prefix)
 int pool6_for_each(int (*func)(struct ipv6_prefix *, void *), void *arg,
 		struct ipv6_prefix *offset)
 {
+	struct pool6_db *db;
 	struct pool_node *node;
 	int error = 0;
 	rcu_read_lock_bh();
 
-	list_for_each_entry_rcu(node, &pool, list_hook) {
+	db = rcu_dereference_bh(pool);
+	list_for_each_entry_rcu(node, &db->list, list_hook) {
 		if (!offset) {
 			error = func(&node->prefix, arg);
 			if (error)
@@ -252,11 +491,13 @@ int pool6_for_each(int (*func)(struct ipv6_prefix *, void *), void *arg,
 
 int pool6_count(__u64 *result)
 {
+	struct pool6_db *db;
 	struct pool_node *node;
 	unsigned int count = 0;
 
 	rcu_read_lock_bh();
-	list_for_each_entry_rcu(node, &pool, list_hook) {
+	db = rcu_dereference_bh(pool);
+	list_for_each_entry_rcu(node, &db->list, list_hook) {
 		count++;
 	}
 	rcu_read_unlock_bh();
@@ -269,7 +510,7 @@ bool pool6_is_empty(void)
 {
 	bool result;
 	rcu_read_lock_bh();
-	result = list_empty(&pool);
+	result = list_empty(&rcu_dereference_bh(pool)->list);
 	rcu_read_unlock_bh();
 	return result;
 }
@@ -40,7 +40,7 @@ verdict ttp46_create_skb(struct packet *in, struct packet *out)
 	 * packet's responsibility).
 	 */
 	l3_hdr_len = sizeof(struct ipv6hdr);
-	if (will_need_frag_hdr(pkt_ip4_hdr(in)))
+	if (will_need_frag_hdr(in->config, pkt_ip4_hdr(in)))
 		l3_hdr_len += sizeof(struct frag_hdr);
 	else
 		reserve += sizeof(struct frag_hdr);
@@ -48,7 +48,7 @@ verdict ttp46_create_skb(struct packet *in, struct packet *out)
 	total_len = l3_hdr_len + pkt_l3payload_len(in);
 	if (is_first && pkt_is_icmp4_error(in)) {
 		total_len += sizeof(struct ipv6hdr) - sizeof(struct iphdr);
-		if (will_need_frag_hdr(pkt_payload(in)))
+		if (will_need_frag_hdr(in->config, pkt_payload(in)))
 			total_len += sizeof(struct frag_hdr);
 
 		/* All errors from RFC 4443 share this. */
@@ -59,6 +59,7 @@ verdict ttp46_create_skb(struct packet *in, struct packet *out)
 	skb = alloc_skb(reserve + total_len, GFP_ATOMIC);
 	if (!skb) {
 		inc_stats(in, IPSTATS_MIB_INDISCARDS);
+		stats_drop(DROP_ENOMEM);
 		return VERDICT_DROP;
 	}
 
@@ -69,7 +70,9 @@ verdict ttp46_create_skb(struct packet *in, struct packet *out)
 	skb_set_transport_header(skb, l3_hdr_len);
 
 	pkt_fill(out, skb, L3PROTO_IPV6, pkt_l4_proto(in),
-			will_need_frag_hdr(pkt_ip4_hdr(in)) ? ((struct frag_hdr *) (ipv6_hdr(skb) + 1)) : NULL,
+			will_need_frag_hdr(in->config, pkt_ip4_hdr(in))
+					? ((struct frag_hdr *) (ipv6_hdr(skb) + 1))
+					: NULL,
 			skb_transport_header(skb) + pkt_l4hdr_len(in),
 			pkt_original_pkt(in));
 
@@ -113,7 +116,7 @@ static int generate_saddr6_nat64(struct tuple *tuple6, struct packet *in, struct
 	struct in_addr tmp;
 	int error;
 
-	if (config_get_src_icmp6errs_better() && pkt_is_icmp4_error(in)) {
+	if (in->config->src_icmp6errs_better && pkt_is_icmp4_error(in)) {
 		/* Issue #132 behaviour. */
 		error = pool6_get(&tuple6->src.addr6.l3, &prefix6);
 		if (error)
@@ -243,7 +246,7 @@ verdict ttp46_ipv6(struct tuple *tuple6, struct packet *in, struct packet *out)
 	}
 
 	ip6_hdr->version = 6;
-	if (config_get_reset_traffic_class()) {
+	if (in->config->reset_traffic_class) {
 		ip6_hdr->priority = 0;
 		ip6_hdr->flow_lbl[0] = 0;
 	} else {
@@ -258,6 +261,7 @@ verdict ttp46_ipv6(struct tuple *tuple6, struct packet *in, struct packet *out)
 		if (ip4_hdr->ttl <= 1) {
 			icmp64_send(in, ICMPERR_HOP_LIMIT, 0);
 			inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_TTL);
 			return VERDICT_DROP;
 		}
 		ip6_hdr->hop_limit = ip4_hdr->ttl - 1;
@@ -275,10 +279,11 @@ verdict ttp46_ipv6(struct tuple *tuple6, struct packet *in, struct packet *out)
 		log_debug("Packet has an unexpired source route.");
 		icmp64_send(in, ICMPERR_SRC_ROUTE, 0);
 		inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+		stats_drop(DROP_MALFORMED);
 		return VERDICT_DROP;
 	}
 
-	if (will_need_frag_hdr(pkt_ip4_hdr(in))) {
+	if (will_need_frag_hdr(in->config, pkt_ip4_hdr(in))) {
 		struct frag_hdr *frag_header = (struct frag_hdr *) (ip6_hdr + 1);
 
 		/* Override some fixed header fields... */
@@ -442,6 +447,7 @@ static int icmp4_to_icmp6_dest_unreach(struct packet *in, struct packet *out)
 		log_debug("ICMPv4 messages type %u code %u do not exist in ICMPv6.",
 				icmpv4_hdr->type, icmpv4_hdr->code);
 		inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+		stats_drop(DROP_MALFORMED);
 		return -EINVAL; /* No ICMP error. */
 	}
 
@@ -599,6 +605,7 @@ verdict ttp46_icmp(struct tuple* tuple6, struct packet *in, struct packet *out)
 		error = icmp4_to_icmp6_param_prob(icmpv4_hdr, icmpv6_hdr);
 		if (error) {
 			inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_MALFORMED);
 			return VERDICT_DROP;
 		}
 		return post_icmp6error(tuple6, in, out);
@@ -614,6 +621,7 @@ verdict ttp46_icmp(struct tuple* tuple6, struct packet *in, struct packet *out)
 		 */
 		log_debug("ICMPv4 messages type %u do not exist in ICMPv6.", icmpv4_hdr->type);
 		inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+		stats_drop(DROP_MALFORMED);
 		return VERDICT_DROP;
 	}
 
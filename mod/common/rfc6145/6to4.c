@@ -53,6 +53,7 @@ verdict ttp64_create_skb(struct packet *in, struct packet *out)
 	skb = alloc_skb(LL_MAX_HEADER + total_len, GFP_ATOMIC);
 	if (!skb) {
 		inc_stats(in, IPSTATS_MIB_INDISCARDS);
+		stats_drop(DROP_ENOMEM);
 		return VERDICT_DROP;
 	}
 
@@ -259,10 +260,10 @@ verdict ttp64_ipv4(struct tuple *tuple4, struct packet *in, struct packet *out)
 	struct ipv6hdr *ip6_hdr = pkt_ip6_hdr(in);
 	struct frag_hdr *ip6_frag_hdr;
 	struct iphdr *ip4_hdr = pkt_ip4_hdr(out);
+	struct global_config *config = in->config;
 	verdict result;
 
-	bool reset_tos, build_ipv4_id, df_always_on;
-	__u8 dont_fragment, new_tos;
+	__u8 dont_fragment;
 
 	/* Translate the address first because of issue #167. */
 	if (nat64_is_stateful()) {
@@ -274,19 +275,18 @@ verdict ttp64_ipv4(struct tuple *tuple4, struct packet *in, struct packet *out)
 			return result;
 	}
 
-	config_get_hdr4_config(&reset_tos, &new_tos, &build_ipv4_id, &df_always_on);
-
 	ip4_hdr->version = 4;
 	ip4_hdr->ihl = 5;
-	ip4_hdr->tos = reset_tos ? new_tos : get_traffic_class(ip6_hdr);
+	ip4_hdr->tos = config->reset_tos ? config->new_tos : get_traffic_class(ip6_hdr);
 	ip4_hdr->tot_len = build_tot_len(in, out);
-	ip4_hdr->id = build_ipv4_id ? generate_ipv4_id_nofrag(out) : 0;
-	dont_fragment = df_always_on ? 1 : generate_df_flag(out);
+	ip4_hdr->id = config->atomic_frags.build_ipv4_id ? generate_ipv4_id_nofrag(out) : 0;
+	dont_fragment = config->atomic_frags.df_always_on ? 1 : generate_df_flag(out);
 	ip4_hdr->frag_off = build_ipv4_frag_off_field(dont_fragment, 0, 0);
 	if (pkt_is_outer(in)) {
 		if (ip6_hdr->hop_limit <= 1) {
 			icmp64_send(in, ICMPERR_HOP_LIMIT, 0);
 			inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_TTL);
 			return VERDICT_DROP;
 		}
 		ip4_hdr->ttl = ip6_hdr->hop_limit - 1;
@@ -302,6 +302,7 @@ verdict ttp64_ipv4(struct tuple *tuple4, struct packet *in, struct packet *out)
 			log_debug("Packet's segments left field is nonzero.");
 			icmp64_send(in, ICMPERR_HDR_FIELD, nonzero_location);
 			inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_MALFORMED);
 			return VERDICT_DROP;
 		}
 	}
@@ -615,6 +616,7 @@ verdict ttp64_icmp(struct tuple* tuple4, struct packet *in, struct packet *out)
 		error = icmp6_to_icmp4_dest_unreach(icmpv6_hdr, icmpv4_hdr);
 		if (error) {
 			inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_MALFORMED);
 			return VERDICT_DROP;
 		}
 		return post_icmp4error(tuple4, in, out);
@@ -643,6 +645,7 @@ verdict ttp64_icmp(struct tuple* tuple4, struct packet *in, struct packet *out)
 		error = icmp6_to_icmp4_param_prob(icmpv6_hdr, icmpv4_hdr);
 		if (error) {
 			inc_stats(in, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_MALFORMED);
 			return VERDICT_DROP;
 		}
 		return post_icmp4error(tuple4, in, out);
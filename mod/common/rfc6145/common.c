@@ -81,22 +81,22 @@ int copy_payload(struct packet *in, struct packet *out)
 	return error;
 }
 
-static bool build_ipv6_frag_hdr(struct iphdr *in_hdr)
+static bool build_ipv6_frag_hdr(struct global_config *config, struct iphdr *in_hdr)
 {
 	if (is_dont_fragment_set(in_hdr))
 		return false;
 
-	return config_get_build_ipv6_fh();
+	return config->atomic_frags.build_ipv6_fh;
 }
 
-bool will_need_frag_hdr(struct iphdr *in_hdr)
+bool will_need_frag_hdr(struct global_config *config, struct iphdr *in_hdr)
 {
 	/*
 	 * Note, build_ipv6_frag_hdr(in_hdr) should remain disabled.
 	 * See www.jool.mx/usr-flags-atomic.html.
 	 * (if that's down, try doc/usr/usr-flags-atomic.md in Jool's source.)
 	 */
-	return build_ipv6_frag_hdr(in_hdr) || is_more_fragments_set_ipv4(in_hdr)
+	return build_ipv6_frag_hdr(config, in_hdr) || is_more_fragments_set_ipv4(in_hdr)
 			|| get_fragment_offset_ipv4(in_hdr);
 }
 
@@ -158,7 +158,7 @@ static int move_pointers4(struct packet *in, struct packet *out)
 		return error;
 
 	l3hdr_len = sizeof(struct ipv6hdr);
-	if (will_need_frag_hdr(hdr4))
+	if (will_need_frag_hdr(in->config, hdr4))
 		l3hdr_len += sizeof(struct frag_hdr);
 	return move_pointers_out(in, out, l3hdr_len);
 }
@@ -220,6 +220,7 @@ verdict ttpcomm_translate_inner_packet(struct tuple *outer_tuple, struct packet
 		break;
 	default:
 		inc_stats(in, IPSTATS_MIB_INUNKNOWNPROTOS);
+		stats_drop(DROP_UNKNOWN_PROTO);
 		return VERDICT_DROP;
 	}
 
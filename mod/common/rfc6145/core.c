@@ -16,7 +16,11 @@ static verdict translate_first(struct tuple *tuple, struct packet *in, struct pa
 	result = steps->l3_hdr_fn(tuple, in, out);
 	if (result != VERDICT_CONTINUE)
 		goto revert;
-	result = steps->l3_payload_fn(tuple, in, out);
+	/* Fragments other than the first one carry no layer-4 header; only payload. */
+	if (pkt_has_l4_hdr(in))
+		result = steps->l3_payload_fn(tuple, in, out);
+	else
+		result = copy_payload(in, out) ? VERDICT_DROP : VERDICT_CONTINUE;
 	if (result != VERDICT_CONTINUE)
 		goto revert;
 
@@ -49,6 +53,7 @@ static verdict translate_subsequent(struct packet *pkt_in, struct sk_buff *in,
 	result = alloc_skb(LL_MAX_HEADER + hdrs_len + in->len, GFP_ATOMIC);
 	if (!result) {
 		inc_stats(pkt_in, IPSTATS_MIB_INDISCARDS);
+		stats_drop(DROP_ENOMEM);
 		return VERDICT_DROP;
 	}
 
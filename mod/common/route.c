@@ -79,18 +79,21 @@ int __route4(struct packet *in, struct packet *out)
 		error = abs(PTR_ERR(table));
 		log_debug("__ip_route_output_key() returned %d. Cannot route packet.", error);
 		inc_stats(out, IPSTATS_MIB_OUTNOROUTES);
+		stats_drop(DROP_ROUTE);
 		return -error;
 	}
 	if (table->dst.error) {
 		error = abs(table->dst.error);
 		log_debug("__ip_route_output_key() returned error %d. Cannot route packet.", error);
 		inc_stats(out, IPSTATS_MIB_OUTNOROUTES);
+		stats_drop(DROP_ROUTE);
 		return -error;
 	}
 	if (!table->dst.dev) {
 		dst_release(&table->dst);
 		log_debug("I found a dst entry with no dev. I don't know what to do; failing...");
 		inc_stats(out, IPSTATS_MIB_OUTNOROUTES);
+		stats_drop(DROP_ROUTE);
 		return -EINVAL;
 	}
 
@@ -162,12 +165,14 @@ int route6(struct packet *pkt)
 	if (!dst) {
 		log_debug("ip6_route_output() returned NULL. Cannot route packet.");
 		inc_stats(pkt, IPSTATS_MIB_OUTNOROUTES);
+		stats_drop(DROP_ROUTE);
 		return -EINVAL;
 	}
 	if (dst->error) {
 		int error = abs(dst->error);
 		log_debug("ip6_route_output() returned error %d. Cannot route packet.", error);
 		inc_stats(pkt, IPSTATS_MIB_OUTNOROUTES);
+		stats_drop(DROP_ROUTE);
 		return -error;
 	}
 
@@ -218,6 +223,10 @@ int route4_input(struct packet *pkt)
 	if (error) {
 		log_debug("ip_route_input failed: %d", error);
 		inc_stats(pkt, IPSTATS_MIB_INNOROUTES);
+		/*
+		 * No stats_drop(); this only happens while sending an ICMP error, and the packet
+		 * the error is about was already counted under the reason it was dropped for.
+		 */
 	}
 
 	return error;
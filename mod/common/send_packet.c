@@ -5,7 +5,7 @@
 #include "nat64/mod/common/icmp_wrapper.h"
 #include "nat64/mod/common/packet.h"
 #include "nat64/mod/common/route.h"
-#include "nat64/mod/common/log_time.h"
+#include "nat64/mod/common/stats.h"
 
 static unsigned int get_nexthop_mtu(struct packet *pkt)
 {
@@ -42,6 +42,7 @@ static int whine_if_too_big(struct packet *in, struct packet *out)
 			break;
 		}
 		icmp64_send(out, ICMPERR_FRAG_NEEDED, mtu);
+		stats_drop(DROP_PMTU);
 
 		return -EINVAL;
 	}
@@ -53,10 +54,6 @@ verdict sendpkt_send(struct packet *in, struct packet *out)
 {
 	int error;
 
-#ifdef BENCHMARK
-	logtime(out);
-#endif
-
 	if (!out->skb->dev) {
 		error = route(out);
 		if (error) {
@@ -83,6 +80,7 @@ verdict sendpkt_send(struct packet *in, struct packet *out)
 	error = dst_output(out->skb); /* Implicit kfree_skb(out->skb) goes here. */
 	if (error) {
 		log_debug("dst_output() returned errcode %d.", error);
+		stats_drop(DROP_XMIT);
 		return VERDICT_DROP;
 	}
 
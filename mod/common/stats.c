@@ -4,10 +4,15 @@
 #include <net/ip.h>
 #include <net/ipv6.h>
 #include <net/addrconf.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
 #include "nat64/mod/common/packet.h"
 #include "nat64/mod/common/types.h"
 
 
+/** Jool's own counters. Each CPU only ever touches its own. */
+static DEFINE_PER_CPU(struct stats_usr, counters);
+
 static int validate_skb(struct sk_buff *skb)
 {
 	if (unlikely(!skb))
@@ -90,3 +95,71 @@ void inc_stats(struct packet *pkt, int field)
 		break;
 	}
 }
+
+void stats_received(void)
+{
+	this_cpu_inc(counters.received);
+}
+
+void stats_translated(void)
+{
+	this_cpu_inc(counters.translated);
+}
+
+void stats_hairpinned(void)
+{
+	this_cpu_inc(counters.hairpinned);
+}
+
+void stats_drop(enum drop_reason reason)
+{
+	if (WARN(reason >= DROP_REASON_COUNT, "Unknown drop reason: %u", reason))
+		return;
+	this_cpu_inc(counters.drops[reason]);
+}
+
+void __stats_verdict(enum stats_stage stage, verdict result)
+{
+	switch (result) {
+	case VERDICT_ACCEPT:
+		this_cpu_inc(counters.stages[stage][STATS_ACCEPTED]);
+		return;
+	case VERDICT_DROP:
+		this_cpu_inc(counters.stages[stage][STATS_DROPPED]);
+		return;
+	case VERDICT_STOLEN:
+		this_cpu_inc(counters.stages[stage][STATS_STOLEN]);
+		return;
+	case VERDICT_CONTINUE:
+		return;
+	}
+}
+
+void stats_get(struct stats_usr *result)
+{
+	struct stats_usr *cpu_counters;
+	unsigned int cpu;
+	unsigned int i, j;
+
+	memset(result, 0, sizeof(*result));
+
+	for_each_possible_cpu(cpu) {
+		cpu_counters = per_cpu_ptr(&counters, cpu);
+		result->received += cpu_counters->received;
+		result->translated += cpu_counters->translated;
+		result->hairpinned += cpu_counters->hairpinned;
+		for (i = 0; i < STATS_STAGE_COUNT; i++)
+			for (j = 0; j < STATS_VERDICT_COUNT; j++)
+				result->stages[i][j] += cpu_counters->stages[i][j];
+		for (i = 0; i < DROP_REASON_COUNT; i++)
+			result->drops[i] += cpu_counters->drops[i];
+	}
+}
+
+void stats_flush(void)
+{
+	unsigned int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(&counters, cpu), 0, sizeof(struct stats_usr));
+}
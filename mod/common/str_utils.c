@@ -1,4 +1,5 @@
 #include "nat64/common/str_utils.h"
+#include "nat64/common/config.h"
 #include <linux/inet.h>
 
 int str_to_addr4(const char *str, struct in_addr *result)
@@ -38,3 +39,23 @@ const char *l4proto_to_string(l4_protocol l4_proto)
 
 	return NULL;
 }
+
+const char *log_event_to_string(__u8 type)
+{
+	switch (type) {
+	case LOG_EVENT_BIB_ADD:
+		return "Mapped";
+	case LOG_EVENT_BIB_REMOVE:
+		return "Forgot";
+	case LOG_EVENT_SESSION_ADD:
+		return "Added session";
+	case LOG_EVENT_SESSION_REMOVE:
+		return "Forgot session";
+	case LOG_EVENT_SESSION_RESTORE:
+		return "Restored session";
+	case LOG_EVENT_LOST:
+		return "Lost events";
+	}
+
+	return "Unknown event";
+}
@@ -0,0 +1,290 @@
+#include "nat64/mod/common/trie.h"
+
+#include <linux/bitops.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "nat64/mod/common/types.h"
+
+/** Longest key the trie can store, in bytes (IPv6 addresses). */
+#define TRIE_MAX_KEY_LEN 16
+
+/**
+ * Links which point to leaves (as opposed to branching nodes) have this bit set.
+ * Both structures come from kmalloc(), so it is always free.
+ */
+#define TRIE_LEAF 1UL
+
+/**
+ * A bit in which the prefixes below it differ.
+ *
+ * Every prefix below a node has the same bits before "bit", and is longer than "bit". Bits in
+ * which none of the prefixes differ do not get a node, which is what keeps the trie short.
+ */
+struct trie_node {
+	/** Index of the key bit this node branches on, counting from the most significant one. */
+	unsigned int bit;
+	/** children[0] leads to the prefixes whose "bit" is zero, children[1] to the other ones. */
+	void __rcu *children[2];
+	struct rcu_head rcu;
+};
+
+/** A prefix stored in the trie. */
+struct trie_leaf {
+	void *value;
+	__u8 prefix_len;
+	struct rcu_head rcu;
+	/** The prefix. trie.key_len bytes long; only the first "prefix_len" bits matter. */
+	__u8 key[];
+};
+
+static bool is_leaf(void *link)
+{
+	return ((unsigned long) link) & TRIE_LEAF;
+}
+
+static struct trie_leaf *link_to_leaf(void *link)
+{
+	return (struct trie_leaf *) (((unsigned long) link) & ~TRIE_LEAF);
+}
+
+static void *leaf_to_link(struct trie_leaf *leaf)
+{
+	return (void *) (((unsigned long) leaf) | TRIE_LEAF);
+}
+
+/**
+ * Returns the link "link" points to, writer side.
+ * (Writers are serialized by the caller, so the reader barriers are unnecessary.)
+ */
+static void *link_get(void __rcu **link)
+{
+	return rcu_dereference_protected(*link, true);
+}
+
+static unsigned int get_bit(const __u8 *key, unsigned int bit)
+{
+	return (key[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+/**
+ * Returns the index of the first bit in which "a" and "b" differ, or "limit" if their first
+ * "limit" bits are the same.
+ */
+static unsigned int first_diff(const __u8 *a, const __u8 *b, unsigned int limit)
+{
+	unsigned int i;
+	__u8 diff;
+
+	for (i = 0; 8 * i < limit; i++) {
+		diff = a[i] ^ b[i];
+		if (diff)
+			return min(8 * i + 7 - (unsigned int) __fls(diff), limit);
+	}
+
+	return limit;
+}
+
+static void free_leaf_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct trie_leaf, rcu));
+}
+
+static void free_node_rcu(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct trie_node, rcu));
+}
+
+/**
+ * Releases "link" and everything below it.
+ * Iterative (rotates left children up as it goes) because tries can be 128 levels deep.
+ */
+static void free_subtree(void *link)
+{
+	struct trie_node *node, *left;
+
+	while (link) {
+		if (is_leaf(link)) {
+			kfree(link_to_leaf(link));
+			return;
+		}
+
+		node = link;
+		link = link_get(&node->children[0]);
+		if (is_leaf(link)) {
+			kfree(link_to_leaf(link));
+			link = link_get(&node->children[1]);
+			kfree(node);
+		} else {
+			left = link;
+			RCU_INIT_POINTER(node->children[0], link_get(&left->children[1]));
+			RCU_INIT_POINTER(left->children[1], node);
+		}
+	}
+}
+
+static void free_subtree_rcu(struct rcu_head *rcu)
+{
+	free_subtree(container_of(rcu, struct trie_node, rcu));
+}
+
+void trie_init(struct trie *trie, unsigned int key_len)
+{
+	WARN(key_len > TRIE_MAX_KEY_LEN, "Keys can only be %u bytes long.", TRIE_MAX_KEY_LEN);
+	RCU_INIT_POINTER(trie->root, NULL);
+	trie->key_len = key_len;
+}
+
+void trie_destroy(struct trie *trie)
+{
+	free_subtree(link_get(&trie->root));
+	RCU_INIT_POINTER(trie->root, NULL);
+}
+
+int trie_add(struct trie *trie, const void *key, __u8 prefix_len, void *value)
+{
+	const __u8 *bytes = key;
+	struct trie_leaf *leaf, *neighbor;
+	struct trie_node *node;
+	void __rcu **link;
+	void *child;
+	unsigned int diff, limit;
+	unsigned int bit;
+
+	if (WARN(prefix_len > 8 * trie->key_len, "Prefix length %u is too long.", prefix_len))
+		return -EINVAL;
+
+	leaf = kmalloc(sizeof(*leaf) + trie->key_len, GFP_KERNEL);
+	if (!leaf)
+		return -ENOMEM;
+	leaf->value = value;
+	leaf->prefix_len = prefix_len;
+	memcpy(leaf->key, bytes, trie->key_len);
+
+	child = link_get(&trie->root);
+	if (!child) {
+		rcu_assign_pointer(trie->root, leaf_to_link(leaf));
+		return 0;
+	}
+
+	/*
+	 * Find the prefix that most resembles the new one.
+	 * Past the new prefix's length, any child will do; everything below contains the same bits.
+	 */
+	while (!is_leaf(child)) {
+		node = child;
+		bit = (node->bit < prefix_len) ? get_bit(bytes, node->bit) : 0;
+		child = link_get(&node->children[bit]);
+	}
+	neighbor = link_to_leaf(child);
+
+	limit = min(prefix_len, neighbor->prefix_len);
+	diff = first_diff(bytes, neighbor->key, limit);
+	if (diff == limit) {
+		kfree(leaf);
+		return -EEXIST; /* One of them contains the other. */
+	}
+
+	/* The new prefix branches off right before the first node which tests a later bit. */
+	link = &trie->root;
+	child = link_get(link);
+	while (!is_leaf(child) && ((struct trie_node *) child)->bit < diff) {
+		node = child;
+		link = &node->children[get_bit(bytes, node->bit)];
+		child = link_get(link);
+	}
+
+	node = kmalloc(sizeof(*node), GFP_KERNEL);
+	if (!node) {
+		kfree(leaf);
+		return -ENOMEM;
+	}
+	node->bit = diff;
+	bit = get_bit(bytes, diff);
+	RCU_INIT_POINTER(node->children[bit], leaf_to_link(leaf));
+	RCU_INIT_POINTER(node->children[!bit], child);
+
+	rcu_assign_pointer(*link, node);
+	return 0;
+}
+
+int trie_remove(struct trie *trie, const void *key, __u8 prefix_len, void *value)
+{
+	const __u8 *bytes = key;
+	struct trie_node *node = NULL;
+	struct trie_leaf *leaf;
+	void __rcu **link, **node_link = NULL;
+	void *child;
+
+	if (WARN(prefix_len > 8 * trie->key_len, "Prefix length %u is too long.", prefix_len))
+		return -EINVAL;
+
+	link = &trie->root;
+	child = link_get(link);
+	if (!child)
+		return -ESRCH;
+
+	while (!is_leaf(child)) {
+		node = child;
+		if (node->bit >= prefix_len)
+			return -ESRCH;
+		node_link = link;
+		link = &node->children[get_bit(bytes, node->bit)];
+		child = link_get(link);
+	}
+
+	leaf = link_to_leaf(child);
+	if (leaf->value != value || leaf->prefix_len != prefix_len
+			|| first_diff(leaf->key, bytes, prefix_len) != prefix_len)
+		return -ESRCH;
+
+	if (node) {
+		/* The leaf's sibling takes the place of their parent. */
+		child = link_get(&node->children[!get_bit(bytes, node->bit)]);
+		rcu_assign_pointer(*node_link, child);
+		call_rcu_bh(&node->rcu, free_node_rcu);
+	} else {
+		RCU_INIT_POINTER(trie->root, NULL);
+	}
+
+	call_rcu_bh(&leaf->rcu, free_leaf_rcu);
+	return 0;
+}
+
+void trie_flush(struct trie *trie)
+{
+	void *root = link_get(&trie->root);
+
+	if (!root)
+		return;
+
+	RCU_INIT_POINTER(trie->root, NULL);
+	if (is_leaf(root))
+		call_rcu_bh(&link_to_leaf(root)->rcu, free_leaf_rcu);
+	else
+		call_rcu_bh(&((struct trie_node *) root)->rcu, free_subtree_rcu);
+}
+
+void *trie_find(struct trie *trie, const void *key)
+{
+	const __u8 *bytes = key;
+	struct trie_node *node;
+	struct trie_leaf *leaf;
+	void *child;
+
+	child = rcu_dereference_bh(trie->root);
+	if (!child)
+		return NULL;
+
+	while (!is_leaf(child)) {
+		node = child;
+		child = rcu_dereference_bh(node->children[get_bit(bytes, node->bit)]);
+	}
+
+	/* The branching bits matched; now make sure the ones that were skipped did too. */
+	leaf = link_to_leaf(child);
+	if (first_diff(leaf->key, bytes, leaf->prefix_len) != leaf->prefix_len)
+		return NULL;
+
+	return leaf->value;
+}
@@ -1,11 +1,19 @@
 #include "nat64/mod/stateful/bib_db.h"
 
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/prefetch.h>
+#include <linux/random.h>
+#include <linux/rculist.h>
+#include <linux/vmalloc.h>
 #include <net/ipv6.h>
 #include "nat64/common/str_utils.h"
 #include "nat64/mod/common/config.h"
 #include "nat64/mod/common/rbtree.h"
 #include "nat64/mod/common/packet.h"
 #include "nat64/mod/common/icmp_wrapper.h"
+#include "nat64/mod/common/stats.h"
+#include "nat64/mod/stateful/event_log.h"
 #include "nat64/mod/stateful/pool4.h"
 #include "nat64/mod/stateful/host6_node.h"
 
@@ -20,6 +28,13 @@ struct bib_table {
 	struct rb_root tree4;
 	/* Number of entries in this table. */
 	u64 count;
+	/**
+	 * The entries again, sorted by insertion. This is the one lockless readers walk; see
+	 * bibdb_for_each(). Writers need "lock", readers need rcu_read_lock_bh().
+	 */
+	struct list_head list;
+	/** Serial number of the newest entry in "list". */
+	unsigned long serial;
 	/**
 	 * Lock to sync access.
 	 * Note, this protects the structure of the trees, not the entries.
@@ -39,6 +54,29 @@ static struct bib_table bib_icmp;
 /** Cache for struct bib_entrys, for efficient allocation. */
 static struct kmem_cache *entry_cache;
 
+/** Default number of buckets of each hash index. 512 KB per index on 64-bit machines. */
+#define HASH_DEFAULT_BUCKETS (1 << 16)
+/** Upper limit to the number of buckets the user can request. 128 MB per index on 64 bits. */
+#define HASH_MAX_BUCKETS (1 << 24)
+
+/**
+ * The entries once more, this time hashed by their IPv6 transport address (and protocol).
+ *
+ * The trees stay, because pool4 removals and flushes need the entries sorted. The hashes are what
+ * point lookups use; their buckets can be found (and prefetched) without touching any entries, and
+ * a lookup visits a handful of entries instead of a full branch of a tree.
+ *
+ * The three tables share the buckets, so their locks cannot protect them. Writers need "hash_lock"
+ * (which nests inside the table locks); readers need rcu_read_lock_bh(), which the table locks
+ * imply.
+ */
+static struct hlist_head *hash6;
+/** Same as "hash6", except indexed by IPv4 transport address. */
+static struct hlist_head *hash4;
+static DEFINE_SPINLOCK(hash_lock);
+static u32 hash_rnd;
+static unsigned int hash_buckets;
+
 /**
  * Removes the BIB entry from the database and kfrees it.
  *
@@ -92,11 +130,20 @@ struct bib_entry *bib_create(struct ipv4_transport_addr *addr4, struct ipv6_tran
 	kref_init(&result->refcounter);
 	RB_CLEAR_NODE(&result->tree6_hook);
 	RB_CLEAR_NODE(&result->tree4_hook);
+	INIT_HLIST_NODE(&result->hash6_hook);
+	INIT_HLIST_NODE(&result->hash4_hook);
 	result->host4_addr = NULL;
+	INIT_LIST_HEAD(&result->list_hook);
+	result->serial = 0;
 
 	return result;
 }
 
+static void bib_free(struct rcu_head *rcu)
+{
+	kmem_cache_free(entry_cache, container_of(rcu, struct bib_entry, rcu));
+}
+
 void bib_kfree(struct bib_entry *bib)
 {
 	/*
@@ -104,7 +151,8 @@ void bib_kfree(struct bib_entry *bib)
 	 * because the user might have removed the address from the pool with --quick.
 	 */
 	pool4_return(bib->l4_proto, &bib->ipv4);
-	kmem_cache_free(entry_cache, bib);
+	/* A snapshot reader might still be looking at it. */
+	call_rcu_bh(&bib->rcu, bib_free);
 }
 
 void bib_get(struct bib_entry *bib)
@@ -122,7 +170,7 @@ int bib_return_lockless(struct bib_entry *bib)
 	return kref_put(&bib->refcounter, bib_release_lockless);
 }
 
-static void bib_log(const struct bib_entry *bib, const char *action)
+static void bib_log(const struct bib_entry *bib, enum log_event_type type)
 {
 	struct timeval tval;
 	struct tm t;
@@ -130,11 +178,16 @@ static void bib_log(const struct bib_entry *bib, const char *action)
 	if (!config_get_bib_logging())
 		return;
 
+	if (config_get_logging_binary()) {
+		eventlog_bib(bib, type);
+		return;
+	}
+
 	do_gettimeofday(&tval);
 	time_to_tm(tval.tv_sec, 0, &t);
 	log_info("%ld/%d/%d %d:%d:%d (GMT) - %s %pI6c#%u to %pI4#%u (%s)",
 			1900 + t.tm_year, t.tm_mon + 1, t.tm_mday,
-			t.tm_hour, t.tm_min, t.tm_sec, action,
+			t.tm_hour, t.tm_min, t.tm_sec, log_event_to_string(type),
 			&bib->ipv6.l3, bib->ipv6.l4,
 			&bib->ipv4.l3, bib->ipv4.l4,
 			l4proto_to_string(bib->l4_proto));
@@ -217,6 +270,97 @@ static int compare_full4(const struct bib_entry *bib, const struct ipv4_transpor
 	return gap;
 }
 
+static unsigned int hash_addr6(l4_protocol l4_proto, const struct ipv6_transport_addr *addr)
+{
+	u32 hash = jhash2(addr->l3.s6_addr32, 4, hash_rnd);
+	return jhash_2words(hash, (l4_proto << 16) | addr->l4, hash_rnd) & (hash_buckets - 1);
+}
+
+static unsigned int hash_addr4(l4_protocol l4_proto, const struct ipv4_transport_addr *addr)
+{
+	return jhash_2words(addr->l3.s_addr, (l4_proto << 16) | addr->l4, hash_rnd)
+			& (hash_buckets - 1);
+}
+
+/**
+ * Returns the entry from "l4_proto"'s table whose IPv6 transport address is "addr", or NULL.
+ *
+ * The table's spinlock must already be held.
+ */
+static struct bib_entry *find6(const struct ipv6_transport_addr *addr, l4_protocol l4_proto)
+{
+	struct hlist_node *node;
+	struct bib_entry *bib;
+
+	for (node = rcu_dereference_bh(hash6[hash_addr6(l4_proto, addr)].first); node;
+			node = rcu_dereference_bh(node->next)) {
+		bib = hlist_entry(node, struct bib_entry, hash6_hook);
+		if (bib->l4_proto == l4_proto && compare_full6(bib, addr) == 0)
+			return bib;
+	}
+
+	return NULL;
+}
+
+/**
+ * Returns the entry from "l4_proto"'s table whose IPv4 transport address is "addr", or NULL.
+ *
+ * The table's spinlock must already be held.
+ */
+static struct bib_entry *find4(const struct ipv4_transport_addr *addr, l4_protocol l4_proto)
+{
+	struct hlist_node *node;
+	struct bib_entry *bib;
+
+	for (node = rcu_dereference_bh(hash4[hash_addr4(l4_proto, addr)].first); node;
+			node = rcu_dereference_bh(node->next)) {
+		bib = hlist_entry(node, struct bib_entry, hash4_hook);
+		if (bib->l4_proto == l4_proto && compare_full4(bib, addr) == 0)
+			return bib;
+	}
+
+	return NULL;
+}
+
+/**
+ * Adds "bib" to the hash indexes. It must already be in both trees.
+ *
+ * "bib"'s table's spinlock must already be held.
+ */
+static void hash_add(struct bib_entry *bib)
+{
+	spin_lock(&hash_lock);
+	hlist_add_head_rcu(&bib->hash6_hook, &hash6[hash_addr6(bib->l4_proto, &bib->ipv6)]);
+	hlist_add_head_rcu(&bib->hash4_hook, &hash4[hash_addr4(bib->l4_proto, &bib->ipv4)]);
+	spin_unlock(&hash_lock);
+}
+
+/**
+ * Reverts hash_add(). "bib" is released through call_rcu_bh(), so the readers that might still be
+ * walking past it are safe.
+ *
+ * "bib"'s table's spinlock must already be held.
+ */
+static void hash_del(struct bib_entry *bib)
+{
+	spin_lock(&hash_lock);
+	hlist_del_init_rcu(&bib->hash6_hook);
+	hlist_del_init_rcu(&bib->hash4_hook);
+	spin_unlock(&hash_lock);
+}
+
+void bibdb_prefetch(struct tuple *tuple)
+{
+	switch (tuple->l3_proto) {
+	case L3PROTO_IPV6:
+		prefetch(&hash6[hash_addr6(tuple->l4_proto, &tuple->src.addr6)]);
+		break;
+	case L3PROTO_IPV4:
+		prefetch(&hash4[hash_addr4(tuple->l4_proto, &tuple->dst.addr4)]);
+		break;
+	}
+}
+
 struct iteration_args {
 	struct tuple *tuple6;
 	struct ipv4_transport_addr *result;
@@ -308,7 +452,59 @@ static int allocate_transport_address(struct host6_node *host_node, struct tuple
 	return pool4_get_any_addr(tuple6->l4_proto, tuple6->src.addr6.l4, result);
 }
 
-int bibdb_init(void)
+/**
+ * Appends "bib" to "table"'s snapshot list.
+ *
+ * "table"'s spinlock must already be held.
+ */
+static void list_add_snapshot(struct bib_entry *bib, struct bib_table *table)
+{
+	table->serial++;
+	if (!table->serial) /* Zero means "not in the database". */
+		table->serial++;
+
+	bib->serial = table->serial;
+	list_add_tail_rcu(&bib->list_hook, &table->list);
+}
+
+/**
+ * "buckets" is the user's requested size of the hash indexes. Zero means default.
+ */
+static int hash_init(unsigned int buckets)
+{
+	unsigned int i;
+
+	if (!buckets)
+		buckets = HASH_DEFAULT_BUCKETS;
+	if (buckets > HASH_MAX_BUCKETS) {
+		log_err("The BIB hash indexes cannot have more than %u buckets.", HASH_MAX_BUCKETS);
+		return -EINVAL;
+	}
+	hash_buckets = roundup_pow_of_two(buckets);
+
+	hash6 = vmalloc(hash_buckets * sizeof(*hash6));
+	if (!hash6)
+		goto fail6;
+	hash4 = vmalloc(hash_buckets * sizeof(*hash4));
+	if (!hash4)
+		goto fail4;
+
+	get_random_bytes(&hash_rnd, sizeof(hash_rnd));
+	for (i = 0; i < hash_buckets; i++) {
+		INIT_HLIST_HEAD(&hash6[i]);
+		INIT_HLIST_HEAD(&hash4[i]);
+	}
+
+	return 0;
+
+fail4:
+	vfree(hash6);
+fail6:
+	log_err("Could not allocate the BIB's hash indexes.");
+	return -ENOMEM;
+}
+
+int bibdb_init(unsigned int hash_size)
 {
 	struct bib_table *tables[] = { &bib_udp, &bib_tcp, &bib_icmp };
 	int i, error;
@@ -325,10 +521,19 @@ int bibdb_init(void)
 		return -ENOMEM;
 	}
 
+	error = hash_init(hash_size);
+	if (error) {
+		kmem_cache_destroy(entry_cache);
+		host6_node_destroy();
+		return error;
+	}
+
 	for (i = 0; i < ARRAY_SIZE(tables); i++) {
 		tables[i]->tree6 = RB_ROOT;
 		tables[i]->tree4 = RB_ROOT;
 		tables[i]->count = 0;
+		INIT_LIST_HEAD(&tables[i]->list);
+		tables[i]->serial = 0;
 		spin_lock_init(&tables[i]->lock);
 	}
 
@@ -354,7 +559,12 @@ void bibdb_destroy(void)
 	for (i = 0; i < ARRAY_SIZE(tables); i++)
 		rbtree_clear(&tables[i]->tree6, bibdb_destroy_aux);
 
+	/* Wait for bib_free(). */
+	rcu_barrier_bh();
 	kmem_cache_destroy(entry_cache);
+	/* The entries were the only thing hanging from the buckets. */
+	vfree(hash4);
+	vfree(hash6);
 
 	host6_node_destroy();
 }
@@ -391,7 +601,7 @@ int bibdb_get_by_ipv4(const struct ipv4_transport_addr *addr, l4_protocol l4_pro
 	/* Find it */
 	spin_lock_bh(&table->lock);
 
-	*result = rbtree_find(addr, &table->tree4, compare_full4, struct bib_entry, tree4_hook);
+	*result = find4(addr, l4_proto);
 	if (*result)
 		bib_get(*result);
 
@@ -416,7 +626,7 @@ int bibdb_get_by_ipv6(const struct ipv6_transport_addr *addr, l4_protocol l4_pro
 	/* Find it */
 	spin_lock_bh(&table->lock);
 
-	*result = rbtree_find(addr, &table->tree6, compare_full6, struct bib_entry, tree6_hook);
+	*result = find6(addr, l4_proto);
 	if (*result)
 		bib_get(*result);
 
@@ -425,27 +635,25 @@ int bibdb_get_by_ipv6(const struct ipv6_transport_addr *addr, l4_protocol l4_pro
 	return (*result) ? 0 : -ESRCH;
 }
 
-int bibdb_add(struct bib_entry *entry)
+/**
+ * Indexes "entry" in "table". Assumes "table"'s lock is held.
+ */
+static int add_locked(struct bib_entry *entry, struct bib_table *table)
 {
-	struct bib_table *table;
 	struct host6_node *host6;
 	struct in6_addr addr6;
 	int error;
 
-	/* Sanity */
-	if (WARN(!entry, "NULL is not a valid BIB entry."))
-		return -EINVAL;
-	error = get_bibdb_table(entry->l4_proto, &table);
-	if (error)
-		return error;
-
-	/* Index */
-	spin_lock_bh(&table->lock);
+	/* Collisions are settled by the hashes; they are the part bibdb_add_batch() prefetched. */
+	if (find6(&entry->ipv6, entry->l4_proto) || find4(&entry->ipv4, entry->l4_proto)) {
+		log_debug("The BIB entry collides with an existing one.");
+		return -EEXIST;
+	}
 
 	addr6 = entry->ipv6.l3;
 	error = host6_node_get_or_create(&addr6, &host6);
 	if (error)
-		goto spin_exit;
+		return error;
 
 	error = rbtree_add(entry, &entry->ipv6, &table->tree6, compare_full6, struct bib_entry,
 			tree6_hook);
@@ -467,22 +675,76 @@ int bibdb_add(struct bib_entry *entry)
 		goto host6_exit;
 	}
 
+	hash_add(entry);
+	list_add_snapshot(entry, table);
 	table->count++;
 
 	error = host6_node_add_or_increment_addr4(host6, entry);
 	if (error)
 		bibdb_remove(entry, false);
 
-	bib_log(entry, "Mapped");
+	bib_log(entry, LOG_EVENT_BIB_ADD);
 	/* Fall through. */
 
 host6_exit:
 	host6_node_return(host6);
-spin_exit:
+	return error;
+}
+
+int bibdb_add(struct bib_entry *entry)
+{
+	struct bib_table *table;
+	int error;
+
+	/* Sanity */
+	if (WARN(!entry, "NULL is not a valid BIB entry."))
+		return -EINVAL;
+	error = get_bibdb_table(entry->l4_proto, &table);
+	if (error)
+		return error;
+
+	/* Index */
+	spin_lock_bh(&table->lock);
+	error = add_locked(entry, table);
 	spin_unlock_bh(&table->lock);
+
 	return error;
 }
 
+int bibdb_add_batch(l4_protocol l4_proto, struct bib_entry **entries, unsigned int count,
+		__s32 *results)
+{
+	struct bib_table *table;
+	unsigned int i;
+	int error;
+
+	error = get_bibdb_table(l4_proto, &table);
+	if (error)
+		return error;
+
+	/* First phase: get every bucket the batch is going to look at moving towards the cache. */
+	for (i = 0; i < count; i++) {
+		if (!entries[i])
+			continue;
+		prefetch(&hash6[hash_addr6(l4_proto, &entries[i]->ipv6)]);
+		prefetch(&hash4[hash_addr4(l4_proto, &entries[i]->ipv4)]);
+	}
+
+	/* Second phase: resolve them. */
+	spin_lock_bh(&table->lock);
+	for (i = 0; i < count; i++) {
+		if (!entries[i])
+			continue;
+		if (WARN(entries[i]->l4_proto != l4_proto, "BIB entry is in the wrong batch."))
+			results[i] = -EINVAL;
+		else
+			results[i] = add_locked(entries[i], table);
+	}
+	spin_unlock_bh(&table->lock);
+
+	return 0;
+}
+
 int bibdb_remove(struct bib_entry *entry, const bool lock)
 {
 	struct bib_table *table;
@@ -498,19 +760,20 @@ int bibdb_remove(struct bib_entry *entry, const bool lock)
 	if (error)
 		return error;
 
-	if (lock) {
+	if (lock)
 		spin_lock_bh(&table->lock);
-		rb_erase(&entry->tree6_hook, &table->tree6);
-		rb_erase(&entry->tree4_hook, &table->tree4);
-		table->count--;
+
+	rb_erase(&entry->tree6_hook, &table->tree6);
+	rb_erase(&entry->tree4_hook, &table->tree4);
+	hash_del(entry);
+	ACCESS_ONCE(entry->serial) = 0;
+	list_del_rcu(&entry->list_hook);
+	table->count--;
+
+	if (lock)
 		spin_unlock_bh(&table->lock);
-	} else {
-		rb_erase(&entry->tree6_hook, &table->tree6);
-		rb_erase(&entry->tree4_hook, &table->tree4);
-		table->count--;
-	}
 
-	bib_log(entry, "Forgot");
+	bib_log(entry, LOG_EVENT_BIB_REMOVE);
 
 	return 0;
 }
@@ -518,73 +781,105 @@ int bibdb_remove(struct bib_entry *entry, const bool lock)
 int bibdb_for_each(l4_protocol l4_proto, int (*func)(struct bib_entry *, void *), void *arg)
 {
 	struct bib_table *table;
-	struct rb_node *node;
+	struct bib_entry *bib;
 	int error;
 
 	error = get_bibdb_table(l4_proto, &table);
 	if (error)
 		return error;
 
-	spin_lock_bh(&table->lock);
-
-	for (node = rb_first(&table->tree4); node && !error; node = rb_next(node)) {
-		error = func(rb_entry(node, struct bib_entry, tree4_hook), arg);
+	rcu_read_lock_bh();
+	list_for_each_entry_rcu(bib, &table->list, list_hook) {
+		if (!ACCESS_ONCE(bib->serial))
+			continue; /* It was removed while we were looking. */
+		error = func(bib, arg);
+		if (error)
+			break;
 	}
+	rcu_read_unlock_bh();
 
-	spin_unlock_bh(&table->lock);
 	return error;
 }
 
 /**
- * Tries to find the BIB entry whose local IPv4 address is "addr".
- * If such an entry cannot be found, it returns the one right next to it if it existed.
+ * Returns the node of "table"'s snapshot list bibdb_iterate() should continue from.
+ * See the function of the same name from the session DB module for comments on this.
  *
- * Why?
- * When the user requests the table to be displayed, the kernel module sends it in chunks because
- * it might be too big for a single Netlink message.
- * This is the function that finds the next chunk where iteration should continue. The quirk of
- * choosing the next entry if it doesn't exist is because the first entry of the next chunk
- * could have died while the previous chunk was transmitted... so the iteration should just ignore
- * it and continue with the next entry peacefully.
+ * Must be called in an RCU-bh read-side critical section.
  */
-static struct rb_node *find_next_chunk(struct bib_table *table, struct ipv4_transport_addr *offset)
+static struct list_head *find_next_chunk(struct bib_table *table, struct bibdb_cursor *cursor)
 {
 	struct bib_entry *bib;
-	struct rb_node **node;
-	struct rb_node *parent;
+	struct list_head *node;
 
-	if (!offset)
-		return rb_first(&table->tree4);
+	if (cursor->bib && ACCESS_ONCE(cursor->bib->serial))
+		return rcu_dereference_bh(list_next_rcu(&cursor->bib->list_hook));
 
-	rbtree_find_node(offset, &table->tree4, compare_full4, struct bib_entry, tree4_hook, parent,
-			node);
-	if (*node)
-		return rb_next(*node);
+	node = rcu_dereference_bh(list_next_rcu(&table->list));
+	if (!cursor->serial)
+		return node;
 
-	bib = rb_entry(parent, struct bib_entry, tree4_hook);
-	return (compare_full4(bib, offset) < 0) ? parent : rb_next(parent);
+	for (; node != &table->list; node = rcu_dereference_bh(list_next_rcu(node))) {
+		bib = list_entry(node, struct bib_entry, list_hook);
+		if ((long) (ACCESS_ONCE(bib->serial) - cursor->serial) > 0)
+			break;
+	}
+
+	return node;
 }
 
-int bibdb_iterate_by_ipv4(l4_protocol l4_proto, int (*func)(struct bib_entry *, void *), void *arg,
-		struct ipv4_transport_addr *offset)
+int bibdb_iterate(l4_protocol l4_proto, int (*func)(struct bib_entry *, void *), void *arg,
+		struct bibdb_cursor *cursor)
 {
 	struct bib_table *table;
-	struct rb_node *node;
+	struct bib_entry *bib;
+	struct bib_entry *last = NULL;
+	struct bib_entry *old_cursor = cursor->bib;
+	struct list_head *node;
+	unsigned long serial, last_serial = 0;
 	int error;
 
 	error = get_bibdb_table(l4_proto, &table);
 	if (error)
 		return error;
 
-	spin_lock_bh(&table->lock);
-	for (node = find_next_chunk(table, offset); node && !error; node = rb_next(node)) {
-		error = func(rb_entry(node, struct bib_entry, tree4_hook), arg);
+	rcu_read_lock_bh();
+
+	node = find_next_chunk(table, cursor);
+	for (; node != &table->list; node = rcu_dereference_bh(list_next_rcu(node))) {
+		bib = list_entry(node, struct bib_entry, list_hook);
+		serial = ACCESS_ONCE(bib->serial);
+		if (!serial)
+			continue; /* It was removed while we were looking. */
+
+		error = func(bib, arg);
+		if (error)
+			break;
+
+		last = bib;
+		last_serial = serial;
 	}
 
-	spin_unlock_bh(&table->lock);
+	if (last) {
+		/* If the entry is dying, the serial alone will have to do. */
+		cursor->bib = kref_get_unless_zero_compat(&last->refcounter) ? last : NULL;
+		cursor->serial = last_serial;
+	}
+
+	rcu_read_unlock_bh();
+
+	if (last && old_cursor)
+		bib_return(old_cursor);
 	return error;
 }
 
+void bibdb_cursor_release(struct bibdb_cursor *cursor)
+{
+	if (cursor->bib)
+		bib_return(cursor->bib);
+	cursor->bib = NULL;
+}
+
 int bibdb_count(l4_protocol proto, u64 *result)
 {
 	struct bib_table *table;
@@ -619,10 +914,8 @@ int bibdb_get_or_create_ipv6(struct packet *pkt, struct tuple *tuple6, struct bi
 	/* Find it */
 	spin_lock_bh(&table->lock);
 
-	rbtree_find_node(&tuple6->src.addr6, &table->tree6, compare_full6, struct bib_entry,
-			tree6_hook, parent, node);
-	if (*node) {
-		*bib = rb_entry(*node, struct bib_entry, tree6_hook);
+	*bib = find6(&tuple6->src.addr6, tuple6->l4_proto);
+	if (*bib) {
 		bib_get(*bib);
 		goto end;
 	}
@@ -638,6 +931,7 @@ int bibdb_get_or_create_ipv6(struct packet *pkt, struct tuple *tuple6, struct bi
 	if (error) {
 		host6_node_return(host_node);
 		log_debug("Error code %d while 'allocating' an address for a BIB entry.", error);
+		stats_drop((error == -ENOMEM) ? DROP_ENOMEM : DROP_POOL4_EXHAUSTED);
 		spin_unlock_bh(&table->lock);
 		if (tuple6->l4_proto != L4PROTO_ICMP) {
 			/* I don't know why this is not supposed to happen with ICMP, but the RFC says so... */
@@ -649,11 +943,14 @@ int bibdb_get_or_create_ipv6(struct packet *pkt, struct tuple *tuple6, struct bi
 	*bib = bib_create(&addr4, &tuple6->src.addr6, false, tuple6->l4_proto);
 	if (!(*bib)) {
 		log_debug("Failed to allocate a BIB entry.");
+		stats_drop(DROP_ENOMEM);
 		error = -ENOMEM;
 		goto host_end;
 	}
 
-	/* Index it by IPv6. We already have the slot, so we don't need to do another rbtree_find(). */
+	/* Index it by IPv6. The hash already said it's not there, so only the slot is missing. */
+	rbtree_find_node(&tuple6->src.addr6, &table->tree6, compare_full6, struct bib_entry,
+			tree6_hook, parent, node);
 	rb_link_node(&(*bib)->tree6_hook, parent, node);
 	rb_insert_color(&(*bib)->tree6_hook, &table->tree6);
 
@@ -666,13 +963,15 @@ int bibdb_get_or_create_ipv6(struct packet *pkt, struct tuple *tuple6, struct bi
 		goto host_end;
 	}
 
+	hash_add(*bib);
+	list_add_snapshot(*bib, table);
 	table->count++;
 
 	error = host6_node_add_or_increment_addr4(host_node, *bib);
 	if (error)
 		bibdb_remove(*bib, false);
 
-	bib_log(*bib, "Mapped");
+	bib_log(*bib, LOG_EVENT_BIB_ADD);
 	/* Fall through. */
 
 host_end:
@@ -1,7 +1,62 @@
 #include "nat64/mod/stateful/compute_outgoing_tuple.h"
+#include "nat64/mod/common/pool6.h"
+#include "nat64/mod/common/rfc6052.h"
 #include "nat64/mod/common/stats.h"
+#include "nat64/mod/stateful/bib_db.h"
 #include "nat64/mod/stateful/session_db.h"
 
+/**
+ * Returns whether "pkt" is an IPv4 SYN Filtering let through without creating a session.
+ * See global_config.stateless_external_tcp.
+ */
+static bool is_stateless_syn(struct tuple *in, struct packet *pkt)
+{
+	return pkt->config->stateless_external_tcp
+			&& in->l3_proto == L3PROTO_IPV4
+			&& pkt_l4_proto(pkt) == L4PROTO_TCP
+			&& pkt_tcp_hdr(pkt)->syn;
+}
+
+/**
+ * Computes the outgoing tuple of a stateless IPv4 SYN. It is the same the session would have
+ * yielded; see create_session_ipv4().
+ */
+static verdict compute_out_tuple_stateless(struct tuple *in, struct tuple *out,
+		struct packet *pkt_in)
+{
+	struct bib_entry *bib;
+	struct ipv6_prefix prefix;
+	int error;
+
+	error = bibdb_get(in, &bib);
+	if (error) {
+		log_debug("Error code %d while trying to find the SYN's BIB entry.", error);
+		inc_stats(pkt_in, IPSTATS_MIB_INNOROUTES);
+		stats_drop(DROP_NO_BIB);
+		return VERDICT_DROP;
+	}
+
+	error = pool6_peek(&prefix);
+	if (!error)
+		error = addr_4to6(&in->src.addr4.l3, &prefix, &out->src.addr6.l3);
+	if (error) {
+		log_debug("Error code %d while translating the SYN's source address.", error);
+		inc_stats(pkt_in, IPSTATS_MIB_INDISCARDS);
+		bib_return(bib);
+		return VERDICT_DROP;
+	}
+
+	out->l3_proto = L3PROTO_IPV6;
+	out->l4_proto = in->l4_proto;
+	out->src.addr6.l4 = in->src.addr4.l4;
+	out->dst.addr6 = bib->ipv6;
+
+	bib_return(bib);
+	log_tuple(out);
+	log_debug("Done step 3.");
+	return VERDICT_CONTINUE;
+}
+
 verdict compute_out_tuple(struct tuple *in, struct tuple *out, struct packet *pkt_in)
 {
 	struct session_entry *session;
@@ -9,7 +64,13 @@ verdict compute_out_tuple(struct tuple *in, struct tuple *out, struct packet *pk
 
 	log_debug("Step 3: Computing the Outgoing Tuple");
 
+	/* Established flows do not need to bother the trees; see below for why this is enough. */
+	if (sessiondb_get_fast(in, out))
+		goto end;
+
 	error = sessiondb_get(in, &session);
+	if (error == -ESRCH && is_stateless_syn(in, pkt_in))
+		return compute_out_tuple_stateless(in, out, pkt_in);
 	if (error) {
 		/*
 		 * Bogus ICMP errors might cause this because Filtering never cares for them,
@@ -17,6 +78,7 @@ verdict compute_out_tuple(struct tuple *in, struct tuple *out, struct packet *pk
 		 */
 		log_debug("Error code %d while trying to find the packet's session entry.", error);
 		inc_stats(pkt_in, IPSTATS_MIB_INNOROUTES);
+		stats_drop(DROP_NO_BIB);
 		return VERDICT_DROP;
 	}
 
@@ -60,6 +122,9 @@ verdict compute_out_tuple(struct tuple *in, struct tuple *out, struct packet *pk
 	}
 
 	session_return(session);
+	/* Fall through. */
+
+end:
 	log_tuple(out);
 
 	log_debug("Done step 3.");
@@ -90,6 +90,7 @@ static verdict ipv4_icmp_err(struct packet *pkt, struct tuple *tuple4)
 		if (is_icmp4_error(inner_icmp->type)) {
 			log_debug("Packet is a ICMP error containing a ICMP error.");
 			inc_stats(pkt, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_MALFORMED);
 			return VERDICT_DROP;
 		}
 
@@ -101,6 +102,7 @@ static verdict ipv4_icmp_err(struct packet *pkt, struct tuple *tuple4)
 	default:
 		log_debug("Packet's inner packet is not UDP, TCP or ICMP (%d)", inner_ipv4->protocol);
 		inc_stats(pkt, IPSTATS_MIB_INUNKNOWNPROTOS);
+		stats_drop(DROP_UNKNOWN_PROTO);
 		return VERDICT_DROP;
 	}
 
@@ -175,6 +177,7 @@ static verdict ipv6_icmp_err(struct packet *pkt, struct tuple *tuple6)
 		if (is_icmp6_error(inner_icmp->icmp6_type)) {
 			log_debug("Packet is a ICMP error containing a ICMP error.");
 			inc_stats(pkt, IPSTATS_MIB_INHDRERRORS);
+			stats_drop(DROP_MALFORMED);
 			return VERDICT_DROP;
 		}
 
@@ -186,6 +189,7 @@ static verdict ipv6_icmp_err(struct packet *pkt, struct tuple *tuple6)
 	default:
 		log_debug("Packet's inner packet is not UDP, TCP or ICMPv6 (%d).", iterator.hdr_type);
 		inc_stats(pkt, IPSTATS_MIB_INUNKNOWNPROTOS);
+		stats_drop(DROP_UNKNOWN_PROTO);
 		return VERDICT_DROP;
 	}
 
@@ -230,6 +234,7 @@ verdict determine_in_tuple(struct packet *pkt, struct tuple *in_tuple)
 			} else {
 				log_debug("Unknown ICMPv4 type: %u. Dropping packet...", icmp4->type);
 				inc_stats(pkt, IPSTATS_MIB_INHDRERRORS);
+				stats_drop(DROP_MALFORMED);
 				result = VERDICT_DROP;
 			}
 			break;
@@ -255,6 +260,7 @@ verdict determine_in_tuple(struct packet *pkt, struct tuple *in_tuple)
 			} else {
 				log_debug("Unknown ICMPv6 type: %u. Dropping packet...", icmp6->icmp6_type);
 				inc_stats(pkt, IPSTATS_MIB_INHDRERRORS);
+				stats_drop(DROP_MALFORMED);
 				result = VERDICT_DROP;
 			}
 			break;
@@ -272,5 +278,6 @@ unknown_proto:
 	log_debug("Stateful NAT64 doesn't support unknown transport protocols.");
 	icmp64_send(pkt, ICMPERR_PROTO_UNREACHABLE, 0);
 	inc_stats(pkt, IPSTATS_MIB_INUNKNOWNPROTOS);
+	stats_drop(DROP_UNKNOWN_PROTO);
 	return VERDICT_DROP;
 }
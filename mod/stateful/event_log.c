@@ -0,0 +1,92 @@
+#include "nat64/mod/stateful/event_log.h"
+#include "nat64/mod/common/event_ring.h"
+#include "nat64/mod/common/types.h"
+#include "nat64/mod/stateful/bib_db.h"
+#include "nat64/mod/stateful/session_db.h"
+
+#include <linux/ktime.h>
+
+/**
+ * Number of events each CPU can queue. 576 kilobytes per CPU; with the daemon's default interval,
+ * enough for a CPU to log some 80 thousand events per second.
+ */
+#define RING_CAPACITY (1 << 13)
+
+static struct event_ring ring;
+
+/** What eventlog_drain() was asked to do. */
+struct drain_args {
+	int (*func)(struct log_event_usr *, void *);
+	void *arg;
+};
+
+
+int eventlog_init(void)
+{
+	int error;
+
+	error = evring_init(&ring, sizeof(struct log_event_usr), RING_CAPACITY);
+	if (error)
+		log_err("Could not allocate the event log rings.");
+
+	return error;
+}
+
+void eventlog_destroy(void)
+{
+	evring_destroy(&ring);
+}
+
+static void event_init(struct log_event_usr *event, enum log_event_type type, l4_protocol proto)
+{
+	memset(event, 0, sizeof(*event));
+	event->time = ktime_to_ns(ktime_get_real());
+	event->l4_proto = proto;
+	event->type = type;
+}
+
+void eventlog_bib(const struct bib_entry *bib, enum log_event_type type)
+{
+	struct log_event_usr event;
+
+	event_init(&event, type, bib->l4_proto);
+	event.remote6 = bib->ipv6;
+	event.local4 = bib->ipv4;
+
+	evring_add(&ring, &event);
+}
+
+void eventlog_session(const struct session_entry *session, enum log_event_type type)
+{
+	struct log_event_usr event;
+
+	event_init(&event, type, session->l4_proto);
+	event.remote6 = session->remote6;
+	event.local6 = session->local6;
+	event.local4 = session->local4;
+	event.remote4 = session->remote4;
+
+	evring_add(&ring, &event);
+}
+
+static int report_drops(unsigned int cpu, unsigned long count, void *void_args)
+{
+	struct drain_args *args = void_args;
+	struct log_event_usr event;
+
+	event_init(&event, LOG_EVENT_LOST, L4PROTO_OTHER);
+	event.lost = min_t(unsigned long, count, 0xFFFFFFFFU);
+	return args->func(&event, args->arg);
+}
+
+static int report_event(void *event, void *void_args)
+{
+	struct drain_args *args = void_args;
+	return args->func(event, args->arg);
+}
+
+int eventlog_drain(int (*func)(struct log_event_usr *, void *), void *arg)
+{
+	struct drain_args args = { .func = func, .arg = arg };
+	return evring_drain(&ring, report_drops, report_event, &args);
+}
@@ -8,6 +8,7 @@
 #include "nat64/mod/stateful/pkt_queue.h"
 #include "nat64/mod/stateful/pool4.h"
 #include "nat64/mod/stateful/session_db.h"
+#include "nat64/mod/stateful/syn_filter.h"
 
 #include <linux/skbuff.h>
 #include <linux/ip.h>
@@ -61,6 +62,7 @@ static int get_bib_ipv4(struct packet *pkt, struct tuple *tuple4, struct bib_ent
 		if (error == -ESRCH) {
 			log_debug("There is no BIB entry for the incoming IPv4 packet.");
 			inc_stats(pkt, IPSTATS_MIB_INNOROUTES);
+			stats_drop(DROP_NO_BIB);
 		} else {
 			log_debug("Error code %d while finding a BIB entry for the incoming packet.", error);
 			inc_stats(pkt, IPSTATS_MIB_INDISCARDS);
@@ -69,10 +71,11 @@ static int get_bib_ipv4(struct packet *pkt, struct tuple *tuple4, struct bib_ent
 		return error;
 	}
 
-	if (config_get_addr_dependent_filtering() && !sessiondb_allow(tuple4)) {
+	if (pkt->config->drop_by_addr && !sessiondb_allow(tuple4)) {
 		log_debug("Packet was blocked by address-dependent filtering.");
 		icmp64_send(pkt, ICMPERR_FILTER, 0);
 		inc_stats(pkt, IPSTATS_MIB_INDISCARDS);
+		stats_drop(DROP_FILTERED);
 		bib_return(*bib);
 		return -EPERM;
 	}
@@ -82,11 +85,11 @@ static int get_bib_ipv4(struct packet *pkt, struct tuple *tuple4, struct bib_ent
 
 /**
  * Assumes that "tuple" and "bib"'s session doesn't exist, and creates it. Returns the resulting
- * entry in "session".
+ * entry in "session". The session is not added to the database.
  * Assumes that "tuple" represents a IPv6 packet.
  */
 static int create_session_ipv6(struct tuple *tuple6, struct bib_entry *bib,
-		struct session_entry **session, enum session_timer_type timer_type, enum tcp_state state)
+		struct session_entry **session)
 {
 	struct ipv6_prefix prefix;
 	struct in_addr ipv4_dst;
@@ -119,20 +122,12 @@ static int create_session_ipv6(struct tuple *tuple6, struct bib_entry *bib,
 			&bib->ipv4, &addr4, tuple6->l4_proto, bib);
 	if (!(*session)) {
 		log_debug("Failed to allocate a session entry.");
+		stats_drop(DROP_ENOMEM);
 		return -ENOMEM;
 	}
-	(*session)->state = state;
 
 	apply_policies();
 
-	/* Add it to the table. */
-	error = sessiondb_add(*session, timer_type);
-	if (error) {
-		session_return(*session);
-		log_debug("Error code %d while adding the session to the DB.", error);
-		return error;
-	}
-
 	return 0;
 }
 
@@ -169,6 +164,7 @@ static int create_session_ipv4(struct tuple *tuple4, struct bib_entry *bib,
 			&tuple4->dst.addr4, &tuple4->src.addr4, tuple4->l4_proto, bib);
 	if (!(*session)) {
 		log_debug("Failed to allocate a session entry.");
+		stats_drop(DROP_ENOMEM);
 		return -ENOMEM;
 	}
 
@@ -258,6 +254,7 @@ static int tcp_closed_v6_syn(struct packet *pkt, struct tuple *tuple6)
 {
 	struct bib_entry *bib;
 	struct session_entry *session;
+	enum session_timer_type timer_type;
 	int error;
 
 	error = bibdb_get_or_create_ipv6(pkt, tuple6, &bib);
@@ -265,17 +262,37 @@ static int tcp_closed_v6_syn(struct packet *pkt, struct tuple *tuple6)
 		return error;
 	log_bib(bib);
 
-	error = create_session_ipv6(tuple6, bib, &session, SESSIONTIMER_TRANS, V6_INIT);
+	error = create_session_ipv6(tuple6, bib, &session);
 	if (error) {
 		bib_return(bib);
 		return error;
 	}
+
+	if (pkt->config->stateless_external_tcp && pkt_tcp_hdr(pkt)->ack
+			&& synfilter_contains(&session->remote4, &session->local4)) {
+		/*
+		 * The IPv4 node opened the connection, and its SYN was let through without state.
+		 * So this is actually V4 INIT + V6 SYN.
+		 * Only a SYN+ACK can be the answer, so a plain SYN which happens to hit the filter
+		 * (a false positive, or a simultaneous open) still goes through V6 INIT.
+		 */
+		log_debug("This SYN answers a stateless IPv4 SYN.");
+		session->state = ESTABLISHED;
+		timer_type = SESSIONTIMER_EST;
+	} else {
+		session->state = V6_INIT;
+		timer_type = SESSIONTIMER_TRANS;
+	}
 	log_session(session);
 
+	error = sessiondb_add(session, timer_type);
+	if (error)
+		log_debug("Error code %d while adding the session to the DB.", error);
+
 	session_return(session);
 	bib_return(bib);
 
-	return 0;
+	return error;
 }
 
 /**
@@ -290,8 +307,9 @@ static verdict tcp_closed_v4_syn(struct packet *pkt, struct tuple *tuple4)
 	int error;
 	verdict result = VERDICT_DROP;
 
-	if (config_get_drop_external_connections()) {
+	if (pkt->config->drop_external_tcp) {
 		log_debug("Applying policy: Dropping externally initiated TCP connections.");
+		stats_drop(DROP_FILTERED);
 		return VERDICT_DROP;
 	}
 
@@ -303,6 +321,17 @@ static verdict tcp_closed_v4_syn(struct packet *pkt, struct tuple *tuple4)
 	}
 	log_bib(bib);
 
+	if (bib && !pkt->config->drop_by_addr && pkt->config->stateless_external_tcp) {
+		/*
+		 * Don't commit any memory until the IPv6 node answers; tcp_closed_v6_syn() will
+		 * create the session then. The outgoing tuple is computed from the BIB entry instead.
+		 */
+		log_debug("Letting the SYN through without state.");
+		synfilter_add(&tuple4->src.addr4, &tuple4->dst.addr4);
+		bib_return(bib);
+		return VERDICT_CONTINUE;
+	}
+
 	error = create_session_ipv4(tuple4, bib, &session);
 	if (error)
 		goto end_bib;
@@ -310,7 +339,7 @@ static verdict tcp_closed_v4_syn(struct packet *pkt, struct tuple *tuple4)
 
 	session->state = V4_INIT;
 
-	if (!bib || config_get_addr_dependent_filtering()) {
+	if (!bib || pkt->config->drop_by_addr) {
 		error = pktqueue_add(session, pkt);
 		if (error) {
 			if (error == -E2BIG) {
@@ -320,7 +349,11 @@ static verdict tcp_closed_v4_syn(struct packet *pkt, struct tuple *tuple4)
 			goto end_session;
 		}
 
-		/* At this point, skb's original skb completely belongs to pktqueue. */
+		/*
+		 * pktqueue kept the bits of the packet the ICMP error will need, so the original skb
+		 * is no longer needed.
+		 */
+		kfree_skb(pkt_original_pkt(pkt)->skb);
 		result = VERDICT_STOLEN;
 
 		error = sessiondb_add(session, SESSIONTIMER_SYN);
@@ -383,6 +416,7 @@ static verdict tcp_closed_state_handle(struct packet *pkt, struct tuple *tuple)
 		log_debug("Closed state: Packet is not SYN and there is no BIB entry, so discarding. "
 				"ERRcode %d", error);
 		inc_stats(pkt, IPSTATS_MIB_INNOROUTES);
+		stats_drop(DROP_NO_BIB);
 		return VERDICT_DROP;
 	}
 
@@ -454,11 +488,13 @@ verdict filtering_and_updating(struct packet *pkt, struct tuple *in_tuple)
 		if (pool6_contains(&hdr_ip6->saddr)) {
 			log_debug("Hairpinning loop. Dropping...");
 			inc_stats(pkt, IPSTATS_MIB_INADDRERRORS);
+			stats_drop(DROP_ADDRESS);
 			return VERDICT_DROP;
 		}
 		if (!pool6_contains(&hdr_ip6->daddr)) {
 			log_debug("Packet was rejected by pool6; dropping...");
 			inc_stats(pkt, IPSTATS_MIB_INADDRERRORS);
+			stats_drop(DROP_ADDRESS);
 			return VERDICT_DROP;
 		}
 		break;
@@ -472,11 +508,22 @@ verdict filtering_and_updating(struct packet *pkt, struct tuple *in_tuple)
 		if (!pool4_contains(pkt_ip4_hdr(pkt)->daddr)) {
 			log_debug("Packet was rejected by pool4; dropping...");
 			inc_stats(pkt, IPSTATS_MIB_INADDRERRORS);
+			stats_drop(DROP_ADDRESS);
 			return VERDICT_DROP;
 		}
 		break;
 	}
 
+	/*
+	 * Established flows already have their BIB and session entries, so they skip the tree
+	 * lookups. Address-dependent filtering and the drop policies only concern new flows, so
+	 * they have nothing to say about these either.
+	 */
+	if (sessiondb_refresh_fast(pkt, in_tuple) == 0) {
+		log_debug("Established session; refreshed through the fast path.");
+		goto end;
+	}
+
 	/* Process packet, according to its protocol. */
 
 	switch (pkt_l4_proto(pkt)) {
@@ -498,9 +545,10 @@ verdict filtering_and_updating(struct packet *pkt, struct tuple *in_tuple)
 	case L4PROTO_ICMP:
 		switch (pkt_l3_proto(pkt)) {
 		case L3PROTO_IPV6:
-			if (config_get_filter_icmpv6_info()) {
+			if (pkt->config->drop_icmp6_info) {
 				log_debug("Packet is ICMPv6 info (ping); dropping due to policy.");
 				inc_stats(pkt, IPSTATS_MIB_INDISCARDS);
+				stats_drop(DROP_FILTERED);
 				return VERDICT_DROP;
 			}
 
@@ -517,6 +565,7 @@ verdict filtering_and_updating(struct packet *pkt, struct tuple *in_tuple)
 		break;
 	}
 
+end:
 	log_debug("Done: Step 2.");
 	return result;
 }
@@ -0,0 +1,393 @@
+#include "nat64/mod/stateful/fragment_cache.h"
+#include "nat64/common/constants.h"
+#include "nat64/mod/common/config.h"
+#include "nat64/mod/common/random.h"
+
+#include <linux/ip.h>
+#include <linux/ipv6.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/udp.h>
+#include <net/ipv6.h>
+
+#define FRAGCACHE_BUCKETS 1024
+
+/**
+ * Identifies a fragmented packet.
+ * Always memset to zero before filling, since it is hashed and compared as a blob.
+ */
+struct fragcache_key {
+	l3_protocol l3_proto;
+	l4_protocol l4_proto;
+	union {
+		struct {
+			struct in6_addr src;
+			struct in6_addr dst;
+		} ipv6;
+		struct {
+			struct in_addr src;
+			struct in_addr dst;
+		} ipv4;
+	} addrs;
+	/** The fragment identification. IPv4's is 16 bits long, but it's stored here anyway. */
+	__be32 id;
+};
+
+struct fragcache_entry {
+	struct fragcache_key key;
+
+	/** Whether the first fragment has been translated already (ie. "tuple_out" is valid). */
+	bool has_tuple;
+	/** The tuple the first fragment was translated with. */
+	struct tuple tuple_out;
+	/** Fragments which arrived before the first one. */
+	struct sk_buff_head waiting;
+
+	/* Jiffy at which the timer will delete this entry. */
+	unsigned long dying_time;
+
+	struct hlist_node hash_hook;
+	struct list_head list_hook;
+};
+
+static bool enabled;
+
+/** Cache for struct fragcache_entries, for efficient allocation. */
+static struct kmem_cache *entry_cache;
+
+/** Random hash seed; see fragment_db.c. */
+static u32 rnd;
+
+/** The entries, indexed by key. */
+static struct hlist_head table[FRAGCACHE_BUCKETS];
+/** The entries, sorted by age (which is also their expiration order). */
+static LIST_HEAD(expire_list);
+/** Protects everything above, and the counters below. */
+static DEFINE_SPINLOCK(cache_lock);
+
+static unsigned int entry_count;
+/** Sum of the lengths of every entry's "waiting" queue. */
+static unsigned int waiting_count;
+
+static struct timer_list expire_timer;
+
+
+static void key_init(struct packet *pkt, struct fragcache_key *key)
+{
+	memset(key, 0, sizeof(*key));
+
+	key->l3_proto = pkt_l3_proto(pkt);
+	key->l4_proto = pkt_l4_proto(pkt);
+
+	switch (pkt_l3_proto(pkt)) {
+	case L3PROTO_IPV6:
+		key->addrs.ipv6.src = pkt_ip6_hdr(pkt)->saddr;
+		key->addrs.ipv6.dst = pkt_ip6_hdr(pkt)->daddr;
+		key->id = pkt_frag_hdr(pkt)->identification;
+		break;
+	case L3PROTO_IPV4:
+		key->addrs.ipv4.src.s_addr = pkt_ip4_hdr(pkt)->saddr;
+		key->addrs.ipv4.dst.s_addr = pkt_ip4_hdr(pkt)->daddr;
+		key->id = (__force __be32) pkt_ip4_hdr(pkt)->id;
+		break;
+	}
+}
+
+static struct hlist_head *key_bucket(struct fragcache_key *key)
+{
+	return &table[jhash(key, sizeof(*key), rnd) & (FRAGCACHE_BUCKETS - 1)];
+}
+
+/**
+ * The caller must hold cache_lock.
+ */
+static struct fragcache_entry *entry_find(struct fragcache_key *key)
+{
+	struct fragcache_entry *entry;
+	struct hlist_node *node;
+
+	hlist_for_each(node, key_bucket(key)) {
+		entry = hlist_entry(node, struct fragcache_entry, hash_hook);
+		if (memcmp(&entry->key, key, sizeof(*key)) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * Removes "entry" from the cache, drops its waiting fragments and frees it.
+ * The caller must hold cache_lock.
+ */
+static void entry_destroy(struct fragcache_entry *entry)
+{
+	hlist_del(&entry->hash_hook);
+	list_del(&entry->list_hook);
+	entry_count--;
+
+	waiting_count -= skb_queue_len(&entry->waiting);
+	__skb_queue_purge(&entry->waiting);
+
+	kmem_cache_free(entry_cache, entry);
+}
+
+/**
+ * Creates and indexes an entry for "key". If the cache is full, the oldest entry is dropped to make
+ * room.
+ * The caller must hold cache_lock.
+ */
+static struct fragcache_entry *entry_create(struct fragcache_key *key, struct packet *pkt)
+{
+	struct fragcache_entry *entry;
+
+	if (entry_count >= FRAGMENT_FWD_MAX_PACKETS) {
+		log_debug("The fragment cache is full; forgetting the oldest packet.");
+		entry_destroy(list_entry(expire_list.next, struct fragcache_entry, list_hook));
+	}
+
+	entry = kmem_cache_alloc(entry_cache, GFP_ATOMIC);
+	if (!entry)
+		return NULL;
+
+	entry->key = *key;
+	entry->has_tuple = false;
+	__skb_queue_head_init(&entry->waiting);
+	entry->dying_time = jiffies + pkt->config->ttl.frag;
+
+	hlist_add_head(&entry->hash_hook, key_bucket(key));
+	list_add_tail(&entry->list_hook, &expire_list);
+	entry_count++;
+
+	if (!timer_pending(&expire_timer)) {
+		mod_timer(&expire_timer, entry->dying_time);
+		log_debug("The fragment cache timer will awake in %u msecs.",
+				jiffies_to_msecs(expire_timer.expires - jiffies));
+	}
+
+	return entry;
+}
+
+/**
+ * Core of the cleaner_timer() function, intended to actually clean the cache from obsolete
+ * entries.
+ */
+static void clean_expired_entries(void)
+{
+	struct fragcache_entry *entry;
+	unsigned int e = 0;
+
+	log_debug("Deleting expired fragment cache entries...");
+
+	spin_lock_bh(&cache_lock);
+
+	while (!list_empty(&expire_list)) {
+		entry = list_entry(expire_list.next, struct fragcache_entry, list_hook);
+		if (time_after(entry->dying_time, jiffies))
+			break;
+
+		entry_destroy(entry);
+		e++;
+	}
+
+	spin_unlock_bh(&cache_lock);
+	log_debug("Deleted %u fragment cache entries.", e);
+}
+
+/**
+ * Executed by the kernel every once in a while to exterminate expired entries.
+ */
+static void cleaner_timer(unsigned long param)
+{
+	struct fragcache_entry *entry;
+	unsigned long next_expire;
+	unsigned long min_time = jiffies + MIN_TIMER_SLEEP;
+
+	clean_expired_entries();
+
+	spin_lock_bh(&cache_lock);
+
+	if (list_empty(&expire_list)) {
+		spin_unlock_bh(&cache_lock);
+		/* No need to re-schedule the timer. */
+		return;
+	}
+
+	/* Restart the timer. */
+	entry = list_entry(expire_list.next, struct fragcache_entry, list_hook);
+	next_expire = entry->dying_time;
+	spin_unlock_bh(&cache_lock);
+
+	if (next_expire < min_time)
+		next_expire = min_time;
+
+	mod_timer(&expire_timer, next_expire);
+}
+
+int fragcache_init(bool enable)
+{
+	unsigned int i;
+
+	enabled = enable;
+	if (!enabled)
+		return 0;
+
+	entry_cache = kmem_cache_create("jool_fragment_cache", sizeof(struct fragcache_entry),
+			0, 0, NULL);
+	if (!entry_cache) {
+		log_err("Could not allocate the fragment cache.");
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < FRAGCACHE_BUCKETS; i++)
+		INIT_HLIST_HEAD(&table[i]);
+	entry_count = 0;
+	waiting_count = 0;
+
+	init_timer(&expire_timer);
+	expire_timer.function = cleaner_timer;
+	expire_timer.expires = 0;
+	expire_timer.data = 0;
+
+	rnd = get_random_u32();
+
+	log_info("Fragments will be translated individually instead of being reassembled.");
+	return 0;
+}
+
+void fragcache_destroy(void)
+{
+	if (!enabled)
+		return;
+
+	del_timer_sync(&expire_timer);
+
+	spin_lock_bh(&cache_lock);
+	while (!list_empty(&expire_list))
+		entry_destroy(list_entry(expire_list.next, struct fragcache_entry, list_hook));
+	spin_unlock_bh(&cache_lock);
+
+	kmem_cache_destroy(entry_cache);
+}
+
+bool fragcache_is_enabled(void)
+{
+	return enabled;
+}
+
+bool fragcache_is_first(struct packet *pkt)
+{
+	struct frag_hdr *hdr_frag;
+	struct iphdr *hdr4;
+
+	if (!enabled)
+		return false;
+
+	switch (pkt_l3_proto(pkt)) {
+	case L3PROTO_IPV6:
+		hdr_frag = pkt_frag_hdr(pkt);
+		return hdr_frag && is_first_frag6(hdr_frag) && is_more_fragments_set_ipv6(hdr_frag);
+	case L3PROTO_IPV4:
+		hdr4 = pkt_ip4_hdr(pkt);
+		return is_first_frag4(hdr4) && is_more_fragments_set_ipv4(hdr4);
+	}
+
+	return false;
+}
+
+bool fragcache_is_subsequent(struct packet *pkt)
+{
+	if (!enabled)
+		return false;
+
+	switch (pkt_l3_proto(pkt)) {
+	case L3PROTO_IPV6:
+		return !is_first_frag6(pkt_frag_hdr(pkt));
+	case L3PROTO_IPV4:
+		return !is_first_frag4(pkt_ip4_hdr(pkt));
+	}
+
+	return false;
+}
+
+verdict fragcache_validate(struct packet *pkt)
+{
+	if (pkt_l4_proto(pkt) == L4PROTO_ICMP) {
+		log_debug("Fragmented ICMP packets cannot be translated without reassembly.");
+		return VERDICT_DROP;
+	}
+
+	if (pkt_l3_proto(pkt) == L3PROTO_IPV4 && pkt_l4_proto(pkt) == L4PROTO_UDP
+			&& pkt_udp_hdr(pkt)->check == 0) {
+		log_debug("Fragmented UDP packet has no checksum, "
+				"and it cannot be computed without reassembly.");
+		return VERDICT_DROP;
+	}
+
+	return VERDICT_CONTINUE;
+}
+
+void fragcache_add(struct packet *pkt, struct tuple *tuple_out, struct sk_buff_head *waiting)
+{
+	struct fragcache_key key;
+	struct fragcache_entry *entry;
+
+	key_init(pkt, &key);
+
+	spin_lock_bh(&cache_lock);
+
+	entry = entry_find(&key);
+	if (!entry) {
+		entry = entry_create(&key, pkt);
+		if (!entry) {
+			/* The rest of the fragments will wait until they expire. */
+			spin_unlock_bh(&cache_lock);
+			return;
+		}
+	}
+
+	entry->tuple_out = *tuple_out;
+	entry->has_tuple = true;
+
+	waiting_count -= skb_queue_len(&entry->waiting);
+	skb_queue_splice_tail_init(&entry->waiting, waiting);
+
+	spin_unlock_bh(&cache_lock);
+}
+
+verdict fragcache_get(struct packet *pkt, struct tuple *tuple_out)
+{
+	struct fragcache_key key;
+	struct fragcache_entry *entry;
+
+	key_init(pkt, &key);
+
+	spin_lock_bh(&cache_lock);
+
+	entry = entry_find(&key);
+	if (entry && entry->has_tuple) {
+		*tuple_out = entry->tuple_out;
+		spin_unlock_bh(&cache_lock);
+		return VERDICT_CONTINUE;
+	}
+
+	if (waiting_count >= FRAGMENT_FWD_MAX_WAITING) {
+		spin_unlock_bh(&cache_lock);
+		log_debug("Too many fragments are waiting for their first fragment; dropping.");
+		return VERDICT_DROP;
+	}
+
+	if (!entry) {
+		entry = entry_create(&key, pkt);
+		if (!entry) {
+			spin_unlock_bh(&cache_lock);
+			return VERDICT_DROP;
+		}
+	}
+
+	__skb_queue_tail(&entry->waiting, pkt->skb);
+	waiting_count++;
+
+	spin_unlock_bh(&cache_lock);
+	log_debug("The first fragment hasn't arrived yet; storing.");
+	return VERDICT_STOLEN;
+}
@@ -8,27 +8,92 @@
 #include <linux/version.h>
 #include <linux/ip.h>
 #include <linux/ipv6.h>
+#include <linux/jhash.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 
+/** Number of slots the table starts with. */
+#define FRAGDB_MIN_BUCKETS 256
+/** The table stops growing once it reaches this many slots. */
+#define FRAGDB_MAX_BUCKETS (64 * 1024)
+/** Number of counters the memory used by the different sources is spread among. */
+#define FRAGDB_SOURCE_SLOTS 1024
+
+/** A fragment waiting for the rest of its packet. */
+struct fragment {
+	struct sk_buff *skb;
+	/** Position of the fragment's data within the fragmentable part of the packet, in bytes. */
+	unsigned int offset;
+	/** Length of the fragment's data, in bytes. */
+	unsigned int len;
+	/** Bytes to pull from the skb before it is queued in the first fragment's list. */
+	unsigned int hdrs_len;
+	/** Bytes the fragment adds to the first fragment once it is queued in its list. */
+	unsigned int payload_len;
+
+	struct list_head list_hook;
+};
+
+struct frag_bucket {
+	spinlock_t lock;
+	struct hlist_head chain;
+	/**
+	 * Whether the buffers from this bucket have been moved to the table's "future" table.
+	 * Whoever finds this set has to go look there instead.
+	 */
+	bool moved;
+};
+
+struct frag_table {
+	/** Number of buckets. Always a power of two. */
+	unsigned int size;
+	/** The table this one is being migrated to, if a resize is taking place. */
+	struct frag_table __rcu *future;
+	struct frag_bucket buckets[];
+};
+
 struct reassembly_buffer {
-	/** first fragment (fragment offset zero) of the packet. */
+	/* The key. */
+	struct in6_addr saddr;
+	struct in6_addr daddr;
+	__be32 identification;
+	l4_protocol l4_proto;
+	/** hash_key() of the key. */
+	u32 hash;
+
+	/**
+	 * First fragment (fragment offset zero) of the packet.
+	 * Its skb is NULL until the fragment arrives.
+	 */
 	struct packet pkt;
-	/** This points to the place the next frament should be queued. */
-	struct sk_buff **next_slot;
+	/** The fragments that have arrived so far (including the first one), sorted by offset. */
+	struct list_head frags;
+	/** Length of the packet's fragmentable part. Zero until the last fragment arrives. */
+	unsigned int total_len;
+	/** Sum of the lengths of the fragments from "frags". */
+	unsigned int received_len;
+
+	/** Bytes this buffer is accounted for. */
+	unsigned int mem;
+	/** Index of the source_mem counter this buffer's memory is charged to. */
+	unsigned int source_slot;
+
 	/* Jiffy at which the fragment timer will delete this buffer. */
 	unsigned long dying_time;
 
+	/** The bucket this buffer is hashed in. Protected by that bucket's lock. */
+	struct frag_bucket *bucket;
+	struct hlist_node hash_hook;
+	/** Protected by lru_lock. */
 	struct list_head list_hook;
 };
 
 /** Cache for struct reassembly_buffers, for efficient allocation. */
 static struct kmem_cache *buffer_cache;
-
-#define HTABLE_NAME fragdb_table
-#define KEY_TYPE struct packet
-#define VALUE_TYPE struct reassembly_buffer
-#define HASH_TABLE_SIZE 256
-#include "../common/hash_table.c"
+/** Cache for struct fragments. */
+static struct kmem_cache *fragment_cache;
 
 /**
  * Just a random number, initialized at startup.
@@ -38,183 +103,449 @@ static struct kmem_cache *buffer_cache;
  */
 static u32 rnd;
 
-static struct fragdb_table table;
-static DEFINE_SPINLOCK(table_lock);
+/**
+ * The buffers, indexed by key.
+ * There is no table-wide lock; each bucket guards itself. The table itself is only replaced by
+ * table_resize(), and is freed after a grace period.
+ */
+static struct frag_table __rcu *table;
+/** Number of buffers in the table. */
+static atomic_t buffer_count;
+static void table_resize(struct work_struct *work);
+static DECLARE_WORK(resize_work, table_resize);
 
-static struct timer_list expire_timer;
+/**
+ * The buffers, sorted by age (which is also their expiration order).
+ * Lock order is bucket first, lru_lock second; see reap().
+ */
 static LIST_HEAD(expire_list);
+static DEFINE_SPINLOCK(lru_lock);
+static struct timer_list expire_timer;
 
+/** Bytes the database is currently holding. */
+static atomic_t mem;
+/** Bytes held by each group of sources. */
+static atomic_t source_mem[FRAGDB_SOURCE_SLOTS];
+/* Variables rather than constants only so the unit tests can tweak them. */
+static int high_thresh;
+static int low_thresh;
+static int source_thresh;
 
-/**
- * As specified above, the database is (mostly) a hash table. This is one of two functions used
- * internally by the table to search for values.
- */
-static bool equals_function(const struct packet *key1, const struct packet *key2)
+
+static struct frag_table *table_alloc(unsigned int size)
 {
-	struct ipv6hdr *hdr1 = pkt_ip6_hdr(key1);
-	struct ipv6hdr *hdr2 = pkt_ip6_hdr(key2);
-
-	if (key1 == key2)
-		return true;
-	if (key1 == NULL || key2 == NULL)
-		return false;
-
-	if (!addr6_equals(&hdr1->saddr, &hdr2->saddr))
-		return false;
-	if (!addr6_equals(&hdr1->daddr, &hdr2->daddr))
-		return false;
-	if (pkt_frag_hdr(key1)->identification != pkt_frag_hdr(key2)->identification)
-		return false;
-	if (pkt_l4_proto(key1) != pkt_l4_proto(key2))
-		return false;
-
-	return true;
+	struct frag_table *result;
+	unsigned int i;
+
+	result = vmalloc(sizeof(*result) + size * sizeof(result->buckets[0]));
+	if (!result)
+		return NULL;
+
+	result->size = size;
+	RCU_INIT_POINTER(result->future, NULL);
+	for (i = 0; i < size; i++) {
+		spin_lock_init(&result->buckets[i].lock);
+		INIT_HLIST_HEAD(&result->buckets[i].chain);
+		result->buckets[i].moved = false;
+	}
+
+	return result;
 }
 
-#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0)
-/**
- * Hash function for IPv6 keys from reassembly.c
- */
-static unsigned int inet6_hash_frag(__be32 id, const struct in6_addr *saddr,
-		const struct in6_addr *daddr, u32 rnd)
+static u32 hash_key(struct in6_addr *saddr, struct in6_addr *daddr, __be32 identification)
 {
-	u32 c;
-	c = jhash_3words(ipv6_addr_hash(saddr), ipv6_addr_hash(daddr), (__force u32)id, rnd);
-	return c & (INETFRAGS_HASHSZ - 1);
+	return jhash_3words(jhash2(saddr->s6_addr32, 4, rnd), jhash2(daddr->s6_addr32, 4, rnd),
+			(__force u32) identification, rnd);
+}
+
+static unsigned int source_slot(struct in6_addr *saddr)
+{
+	return jhash2(saddr->s6_addr32, 4, rnd) & (FRAGDB_SOURCE_SLOTS - 1);
 }
-#endif
 
 /**
- * As specified above, the database is a hash table. This is one of two functions used internally
- * by the table to search for values.
+ * Locks and returns the bucket the buffers whose key hashes to "hash" belong to.
+ * The caller must hold rcu_read_lock_bh().
  */
-static unsigned int hash_function(const struct packet *key)
+static struct frag_bucket *lock_bucket(u32 hash)
 {
-	struct ipv6hdr *hdr = pkt_ip6_hdr(key);
-	return inet6_hash_frag(pkt_frag_hdr(key)->identification, &hdr->saddr, &hdr->daddr, rnd);
+	struct frag_table *current_table = rcu_dereference_bh(table);
+	struct frag_bucket *bucket;
+
+	while (true) {
+		bucket = &current_table->buckets[hash & (current_table->size - 1)];
+		spin_lock_bh(&bucket->lock);
+		if (!bucket->moved)
+			return bucket;
+		spin_unlock_bh(&bucket->lock);
+		current_table = rcu_dereference_bh(current_table->future);
+	}
 }
 
-#define COMMON_MSG " Looks like nf_defrag_ipv6 is not sorting the fragments, " \
-		"or something's shuffling them later. Please report."
-static struct reassembly_buffer *add_pkt(struct packet *pkt)
+/**
+ * Doubles the number of buckets in the table.
+ * Buckets are migrated one at a time, so the packet path never has to wait for the whole table.
+ */
+static void table_resize(struct work_struct *work)
 {
+	struct frag_table *old, *new;
+	struct frag_bucket *bucket, *target;
 	struct reassembly_buffer *buffer;
-	struct frag_hdr *hdr_frag = pkt_frag_hdr(pkt);
-	unsigned int payload_len;
+	struct hlist_node *node, *tmp;
+	unsigned int i;
 
-	/* Does it already exist? If so, add to and return existing buffer */
-	buffer = fragdb_table_get(&table, pkt);
-	if (buffer) {
-		if (WARN(is_first_frag6(hdr_frag), "Non-first fragment's offset is zero." COMMON_MSG))
-			return NULL;
+	old = rcu_dereference_protected(table, true);
+	if (old->size >= FRAGDB_MAX_BUCKETS)
+		return;
 
-		*buffer->next_slot = pkt->skb;
-		buffer->next_slot = &pkt->skb->next;
+	new = table_alloc(2 * old->size);
+	if (!new) {
+		log_debug("Could not allocate a bigger fragment table. Keeping the old one.");
+		return;
+	}
+	rcu_assign_pointer(old->future, new);
+
+	for (i = 0; i < old->size; i++) {
+		bucket = &old->buckets[i];
+		spin_lock_bh(&bucket->lock);
+		hlist_for_each_safe(node, tmp, &bucket->chain) {
+			buffer = hlist_entry(node, struct reassembly_buffer, hash_hook);
+			target = &new->buckets[buffer->hash & (new->size - 1)];
+
+			spin_lock_nested(&target->lock, SINGLE_DEPTH_NESTING);
+			hlist_del(&buffer->hash_hook);
+			hlist_add_head(&buffer->hash_hook, &target->chain);
+			buffer->bucket = target;
+			spin_unlock(&target->lock);
+		}
+		bucket->moved = true;
+		spin_unlock_bh(&bucket->lock);
+	}
 
-		/* Why this? Dunno, both defrags do it when they support frag_list. */
-		/*
-		 * Note, since we're in the middle of its sort of initialization, pkt is illegal at this
-		 * point. It looks like we should call pkt_payload_len_frag() instead of
-		 * pkt_payload_len_pkt(), but that's not the case because it represents a subsequent
-		 * fragment. Be careful with the calculation of this length.
-		 */
-		payload_len = pkt_payload_len_pkt(pkt);
-		buffer->pkt.skb->len += payload_len;
-		buffer->pkt.skb->data_len += payload_len;
-		buffer->pkt.skb->truesize += pkt->skb->truesize;
-		skb_pull(pkt->skb, pkt_hdrs_len(pkt));
+	rcu_assign_pointer(table, new);
+	synchronize_rcu_bh();
+	vfree(old);
 
-		return buffer;
+	log_debug("The fragment table now has %u buckets.", new->size);
+}
+
+static void buffer_charge(struct reassembly_buffer *buffer, unsigned int bytes)
+{
+	buffer->mem += bytes;
+	atomic_add(bytes, &mem);
+	atomic_add(bytes, &source_mem[buffer->source_slot]);
+}
+
+/**
+ * Releases "buffer" and whatever fragments it still holds.
+ * "buffer" must no longer be listed anywhere.
+ */
+static void buffer_free(struct reassembly_buffer *buffer)
+{
+	struct fragment *frag, *tmp;
+
+	list_for_each_entry_safe(frag, tmp, &buffer->frags, list_hook) {
+		kfree_skb(frag->skb);
+		kmem_cache_free(fragment_cache, frag);
 	}
 
-	if (WARN(!is_first_frag6(hdr_frag), "First fragment's offset is nonzero." COMMON_MSG))
-		return NULL;
+	atomic_sub(buffer->mem, &mem);
+	atomic_sub(buffer->mem, &source_mem[buffer->source_slot]);
+	kmem_cache_free(buffer_cache, buffer);
+}
 
-	/*
-	 * TODO (3.3.1) I'm not exactly sure pskb_expand_head() can be applied here.
-	 * I decided to leave it out of milestone 3.3.0 because it seems like such a ridiculous
-	 * corner case scenario and we have too many variables to test as it is.
-	 * I learned about pskb_expand_head() in the defrag modules.
-	 */
-	if (skb_cloned(pkt->skb)) {
-		log_debug("Packet is cloned, so I can't edit its shared area. Canceling translation.");
-		return NULL;
+/**
+ * Removes "buffer" from the table and the expiration list.
+ * The caller must hold "buffer"'s bucket's lock.
+ */
+static void buffer_unlist(struct reassembly_buffer *buffer)
+{
+	hlist_del(&buffer->hash_hook);
+	atomic_dec(&buffer_count);
+
+	spin_lock_bh(&lru_lock);
+	list_del(&buffer->list_hook);
+	spin_unlock_bh(&lru_lock);
+}
+
+static struct reassembly_buffer *bucket_find(struct frag_bucket *bucket, u32 hash,
+		struct packet *pkt)
+{
+	struct ipv6hdr *hdr6 = pkt_ip6_hdr(pkt);
+	__be32 identification = pkt_frag_hdr(pkt)->identification;
+	struct reassembly_buffer *buffer;
+	struct hlist_node *node;
+
+	hlist_for_each(node, &bucket->chain) {
+		buffer = hlist_entry(node, struct reassembly_buffer, hash_hook);
+		if (buffer->hash == hash
+				&& buffer->identification == identification
+				&& buffer->l4_proto == pkt_l4_proto(pkt)
+				&& addr6_equals(&buffer->saddr, &hdr6->saddr)
+				&& addr6_equals(&buffer->daddr, &hdr6->daddr))
+			return buffer;
 	}
 
-	/* Create buffer, add the packet to it, index */
+	return NULL;
+}
+
+/**
+ * Creates an empty buffer for "pkt"'s packet and indexes it in "bucket".
+ * The caller must hold "bucket"'s lock.
+ */
+static struct reassembly_buffer *buffer_create(struct packet *pkt, u32 hash,
+		struct frag_bucket *bucket)
+{
+	struct reassembly_buffer *buffer;
+	struct ipv6hdr *hdr6 = pkt_ip6_hdr(pkt);
+	unsigned int size;
+
 	buffer = kmem_cache_alloc(buffer_cache, GFP_ATOMIC);
 	if (!buffer)
 		return NULL;
 
-	buffer->pkt = *pkt;
-	buffer->pkt.original_pkt = &buffer->pkt;
-	buffer->next_slot = &skb_shinfo(pkt->skb)->frag_list;
-	buffer->dying_time = jiffies + config_get_ttl_frag();
-
-	if (is_error(fragdb_table_put(&table, pkt, buffer))) {
-		kmem_cache_free(buffer_cache, buffer);
-		return NULL;
-	}
+	buffer->saddr = hdr6->saddr;
+	buffer->daddr = hdr6->daddr;
+	buffer->identification = pkt_frag_hdr(pkt)->identification;
+	buffer->l4_proto = pkt_l4_proto(pkt);
+	buffer->hash = hash;
+	memset(&buffer->pkt, 0, sizeof(buffer->pkt));
+	INIT_LIST_HEAD(&buffer->frags);
+	buffer->total_len = 0;
+	buffer->received_len = 0;
+	buffer->mem = 0;
+	buffer->source_slot = source_slot(&hdr6->saddr);
+	buffer->dying_time = jiffies + pkt->config->ttl.frag;
+	buffer->bucket = bucket;
+
+	buffer_charge(buffer, sizeof(*buffer));
+	hlist_add_head(&buffer->hash_hook, &bucket->chain);
 
 	/* Schedule for automatic deletion */
-	list_add(&buffer->list_hook, expire_list.prev);
+	spin_lock_bh(&lru_lock);
+	list_add_tail(&buffer->list_hook, &expire_list);
 	if (!timer_pending(&expire_timer)) {
 		mod_timer(&expire_timer, buffer->dying_time);
 		log_debug("The fragment cleaning timer will awake in %u msecs.",
 				jiffies_to_msecs(expire_timer.expires - jiffies));
 	}
+	spin_unlock_bh(&lru_lock);
+
+	size = rcu_dereference_bh(table)->size;
+	if (atomic_inc_return(&buffer_count) > 2 * size && size < FRAGDB_MAX_BUCKETS)
+		schedule_work(&resize_work);
 
 	return buffer;
 }
-#undef COMMON_MSG
 
-static void buffer_dealloc(struct reassembly_buffer *buffer)
+/**
+ * Queues "pkt" in "buffer", keeping the fragments sorted by offset.
+ *
+ * Returns
+ * - 0 if "pkt" was queued.
+ * - -EEXIST if "pkt" is a copy of a fragment "buffer" already has.
+ * - -EINVAL if "pkt" cannot be part of the same packet as the rest of "buffer"'s fragments, which
+ *   means the whole packet has to go (RFC 5722).
+ * - Some other error code if "pkt" could not be queued for some other reason.
+ * Only "pkt" has to be dropped in the cases other than -EINVAL.
+ *
+ * The caller must hold "buffer"'s bucket's lock.
+ */
+static int buffer_add(struct reassembly_buffer *buffer, struct packet *pkt)
 {
-	kfree_skb(buffer->pkt.skb);
-	kmem_cache_free(buffer_cache, buffer);
+	struct ipv6hdr *hdr6 = pkt_ip6_hdr(pkt);
+	struct frag_hdr *hdr_frag = pkt_frag_hdr(pkt);
+	struct fragment *frag, *prev = NULL, *next = NULL;
+	struct list_head *node;
+	unsigned int data_start, offset, len, end, charge;
+	bool is_last = !is_more_fragments_set_ipv6(hdr_frag);
+
+	/* The fragment's data is everything after the fragment header. */
+	data_start = (void *) (hdr_frag + 1) - (void *) hdr6;
+	if (be16_to_cpu(hdr6->payload_len) + sizeof(*hdr6) < data_start)
+		return -EINVAL;
+	offset = get_fragment_offset_ipv6(hdr_frag);
+	len = be16_to_cpu(hdr6->payload_len) + sizeof(*hdr6) - data_start;
+	end = offset + len;
+	if (end > IPV6_MAXPLEN)
+		return -EINVAL;
+
+	/* Fragments tend to arrive in order, so start looking from the end. */
+	list_for_each_prev(node, &buffer->frags) {
+		frag = list_entry(node, struct fragment, list_hook);
+		if (frag->offset <= offset) {
+			prev = frag;
+			break;
+		}
+		next = frag;
+	}
+
+	if (prev && prev->offset == offset && prev->len == len)
+		return -EEXIST;
+	if (prev && prev->offset + prev->len > offset)
+		return -EINVAL;
+	if (next && end > next->offset)
+		return -EINVAL;
+
+	if (is_last) {
+		if (buffer->total_len && buffer->total_len != end)
+			return -EINVAL;
+		if (!list_empty(&buffer->frags)) {
+			frag = list_entry(buffer->frags.prev, struct fragment, list_hook);
+			if (frag->offset + frag->len > end)
+				return -EINVAL;
+		}
+	} else if (buffer->total_len && end > buffer->total_len) {
+		return -EINVAL;
+	}
+
+	charge = pkt->skb->truesize + sizeof(*frag);
+	if (atomic_read(&source_mem[buffer->source_slot]) + charge > source_thresh) {
+		log_debug("The fragments from this source are taking up too much memory.");
+		return -ENOSPC;
+	}
+
+	frag = kmem_cache_alloc(fragment_cache, GFP_ATOMIC);
+	if (!frag)
+		return -ENOMEM;
+
+	frag->skb = pkt->skb;
+	frag->offset = offset;
+	frag->len = len;
+	if (offset == 0) {
+		frag->hdrs_len = 0;
+		frag->payload_len = 0;
+		buffer->pkt = *pkt;
+		buffer->pkt.original_pkt = &buffer->pkt;
+		/* Stale by the time the packet is resumed; see fragdb_handle(). */
+		buffer->pkt.config = NULL;
+	} else {
+		/*
+		 * Note, pkt is a subsequent fragment, so it looks like we should call
+		 * pkt_payload_len_frag() instead of pkt_payload_len_pkt(), but that's not the case.
+		 * Be careful with the calculation of this length.
+		 */
+		frag->hdrs_len = pkt_hdrs_len(pkt);
+		frag->payload_len = pkt_payload_len_pkt(pkt);
+	}
+	list_add(&frag->list_hook, prev ? &prev->list_hook : &buffer->frags);
+
+	buffer->received_len += len;
+	if (is_last)
+		buffer->total_len = end;
+	buffer_charge(buffer, charge);
+
+	return 0;
 }
 
 /**
- * Removes "buffer" from the database and destroys it.
+ * Since the fragments don't overlap, the packet is complete once they add up to its length.
  */
-static void buffer_destroy(struct reassembly_buffer *buffer, struct packet *pkt)
+static bool buffer_is_complete(struct reassembly_buffer *buffer)
 {
-	if (WARN(!fragdb_table_remove(&table, pkt, NULL),
-			"Something is attempting to delete a buffer that wasn't stored in the database."))
-		return;
+	return buffer->total_len && buffer->received_len == buffer->total_len;
+}
 
-	list_del(&buffer->list_hook);
-	buffer_dealloc(buffer);
+/**
+ * Queues the rest of "buffer"'s fragments in the first one's frag_list, in order.
+ * Once this is done, the skbs no longer belong to "buffer".
+ */
+static void buffer_assemble(struct reassembly_buffer *buffer)
+{
+	struct sk_buff *first = buffer->pkt.skb;
+	struct sk_buff **next_slot = &skb_shinfo(first)->frag_list;
+	struct fragment *frag, *tmp;
+
+	list_for_each_entry_safe(frag, tmp, &buffer->frags, list_hook) {
+		if (frag->skb != first) {
+			*next_slot = frag->skb;
+			next_slot = &frag->skb->next;
+
+			/* Why this? Dunno, both defrags do it when they support frag_list. */
+			first->len += frag->payload_len;
+			first->data_len += frag->payload_len;
+			first->truesize += frag->skb->truesize;
+			skb_pull(frag->skb, frag->hdrs_len);
+		}
+
+		list_del(&frag->list_hook);
+		kmem_cache_free(fragment_cache, frag);
+	}
+}
+
+static bool is_expired(struct reassembly_buffer *buffer)
+{
+	return !time_after(buffer->dying_time, jiffies);
+}
+
+static bool is_over_low_thresh(struct reassembly_buffer *buffer)
+{
+	return atomic_read(&mem) > low_thresh;
 }
 
 /**
- * Core of the cleaner_timer() function, intended to actually clean the database from obsolete
- * fragments.
+ * Destroys buffers, oldest first, for as long as "should_reap" agrees.
+ * Returns the number of buffers that were destroyed.
  */
-static void clean_expired_buffers(void)
+static unsigned int reap(bool (*should_reap)(struct reassembly_buffer *))
 {
-	unsigned int b = 0;
 	struct reassembly_buffer *buffer;
+	struct frag_bucket *bucket;
+	unsigned int b = 0;
 
-	log_debug("Deleting expired reassembly buffers...");
-
-	spin_lock_bh(&table_lock);
+	rcu_read_lock_bh();
+	spin_lock_bh(&lru_lock);
 
 	while (!list_empty(&expire_list)) {
 		buffer = list_entry(expire_list.next, struct reassembly_buffer, list_hook);
+		if (!should_reap(buffer))
+			break;
 
-		if (time_after(buffer->dying_time, jiffies)) {
-			spin_unlock_bh(&table_lock);
-			log_debug("Deleted %u reassembly buffers.", b);
-			return;
+		/*
+		 * The packet path locks the bucket before lru_lock, so this cannot wait for the
+		 * bucket. If somebody is using it, leave the rest for later.
+		 */
+		bucket = ACCESS_ONCE(buffer->bucket);
+		if (!spin_trylock(&bucket->lock))
+			break;
+		if (bucket != buffer->bucket) {
+			/* table_resize() moved it while we weren't looking. */
+			spin_unlock(&bucket->lock);
+			continue;
 		}
 
-		buffer_destroy(buffer, &buffer->pkt);
+		hlist_del(&buffer->hash_hook);
+		atomic_dec(&buffer_count);
+		list_del(&buffer->list_hook);
+		spin_unlock(&bucket->lock);
+
+		buffer_free(buffer);
 		b++;
 	}
 
-	spin_unlock_bh(&table_lock);
-	log_debug("Deleted %u reassembly buffers. The database is now empty.", b);
+	spin_unlock_bh(&lru_lock);
+	rcu_read_unlock_bh();
+
+	return b;
+}
+
+/**
+ * Core of the cleaner_timer() function, intended to actually clean the database from obsolete
+ * fragments.
+ */
+static void clean_expired_buffers(void)
+{
+	log_debug("Deleting expired reassembly buffers...");
+	log_debug("Deleted %u reassembly buffers.", reap(is_expired));
+}
+
+/**
+ * Discards the oldest packets until the database is back under the low threshold.
+ */
+static void evict(void)
+{
+	log_debug("The fragment database is full. Evicting...");
+	log_debug("Evicted %u reassembly buffers.", reap(is_over_low_thresh));
 }
 
 /**
@@ -228,10 +559,10 @@ static void cleaner_timer(unsigned long param)
 
 	clean_expired_buffers();
 
-	spin_lock_bh(&table_lock);
+	spin_lock_bh(&lru_lock);
 
 	if (list_empty(&expire_list)) {
-		spin_unlock_bh(&table_lock);
+		spin_unlock_bh(&lru_lock);
 		/* No need to re-schedule the timer. */
 		return;
 	}
@@ -239,7 +570,7 @@ static void cleaner_timer(unsigned long param)
 	/* Restart the timer. */
 	buffer = list_entry(expire_list.next, struct reassembly_buffer, list_hook);
 	next_expire = buffer->dying_time;
-	spin_unlock_bh(&table_lock);
+	spin_unlock_bh(&lru_lock);
 
 	if (next_expire < min_time)
 		next_expire = min_time;
@@ -252,7 +583,8 @@ static void cleaner_timer(unsigned long param)
  */
 int fragdb_init(void)
 {
-	int error;
+	struct frag_table *new;
+	unsigned int i;
 
 	buffer_cache = kmem_cache_create("jool_reassembly_buffers", sizeof(struct reassembly_buffer),
 			0, 0, NULL);
@@ -261,11 +593,26 @@ int fragdb_init(void)
 		return -ENOMEM;
 	}
 
-	error = fragdb_table_init(&table, equals_function, hash_function);
-	if (error) {
-		kmem_cache_destroy(buffer_cache);
-		return error;
+	fragment_cache = kmem_cache_create("jool_fragments", sizeof(struct fragment), 0, 0, NULL);
+	if (!fragment_cache) {
+		log_err("Could not allocate the fragment cache.");
+		goto buffer_cache_fail;
+	}
+
+	new = table_alloc(FRAGDB_MIN_BUCKETS);
+	if (!new) {
+		log_err("Could not allocate the fragment table.");
+		goto fragment_cache_fail;
 	}
+	RCU_INIT_POINTER(table, new);
+	atomic_set(&buffer_count, 0);
+
+	atomic_set(&mem, 0);
+	for (i = 0; i < FRAGDB_SOURCE_SLOTS; i++)
+		atomic_set(&source_mem[i], 0);
+	high_thresh = FRAGMENT_HIGH_THRESH;
+	low_thresh = FRAGMENT_LOW_THRESH;
+	source_thresh = FRAGMENT_SOURCE_THRESH;
 
 	init_timer(&expire_timer);
 	expire_timer.function = cleaner_timer;
@@ -275,6 +622,13 @@ int fragdb_init(void)
 	rnd = get_random_u32();
 
 	return 0;
+
+fragment_cache_fail:
+	kmem_cache_destroy(fragment_cache);
+	/* Fall through. */
+buffer_cache_fail:
+	kmem_cache_destroy(buffer_cache);
+	return -ENOMEM;
 }
 
 #define COMMON_MSG " I will not be able to translate; aborting.\n" \
@@ -309,7 +663,11 @@ verdict fragdb_handle(struct packet *pkt)
 {
 	/* The fragment collector skb belongs to. */
 	struct reassembly_buffer *buffer;
+	struct frag_bucket *bucket;
+	struct ipv6hdr *hdr6 = pkt_ip6_hdr(pkt);
 	struct frag_hdr *hdr_frag = pkt_frag_hdr(pkt);
+	struct global_config *config;
+	u32 hash;
 	int error;
 
 	if (!is_fragmented_ipv6(hdr_frag))
@@ -332,32 +690,63 @@ verdict fragdb_handle(struct packet *pkt)
 	if (error)
 		return VERDICT_DROP;
 
-	spin_lock_bh(&table_lock);
+	/*
+	 * TODO (3.3.1) I'm not exactly sure pskb_expand_head() can be applied here.
+	 * I decided to leave it out of milestone 3.3.0 because it seems like such a ridiculous
+	 * corner case scenario and we have too many variables to test as it is.
+	 * I learned about pskb_expand_head() in the defrag modules.
+	 */
+	if (is_first_frag6(hdr_frag) && skb_cloned(pkt->skb)) {
+		log_debug("Packet is cloned, so I can't edit its shared area. Canceling translation.");
+		return VERDICT_DROP;
+	}
+
+	hash = hash_key(&hdr6->saddr, &hdr6->daddr, hdr_frag->identification);
+
+	rcu_read_lock_bh();
+	bucket = lock_bucket(hash);
 
-	buffer = add_pkt(pkt);
+	buffer = bucket_find(bucket, hash, pkt);
 	if (!buffer) {
-		spin_unlock_bh(&table_lock);
-		return VERDICT_DROP;
+		buffer = buffer_create(pkt, hash, bucket);
+		if (!buffer)
+			goto drop;
 	}
 
 	/*
-	 * nf_defrag_ipv6 is supposed to sort the fragments, so this condition should be all we need
-	 * to figure out whether we have all the fragments.
-	 * Otherwise we'd need to keep track of holes. If you ever find yourself needing to add hole
-	 * logic, keep in mind that this module used to do that in Jool 3.2, so you might be able
-	 * to reuse it.
+	 * nf_defrag_ipv6 is supposed to sort the fragments, but nothing guarantees they reach us in
+	 * that order, so buffer_add() keeps track of the holes.
 	 */
-	if (is_more_fragments_set_ipv6(hdr_frag)) {
-		spin_unlock_bh(&table_lock);
+	error = buffer_add(buffer, pkt);
+	if (error) {
+		if (error == -EINVAL)
+			log_debug("Fragment overlaps or contradicts its siblings. Dropping the packet.");
+		if (error == -EINVAL || list_empty(&buffer->frags)) {
+			buffer_unlist(buffer);
+			buffer_free(buffer);
+		}
+		goto drop;
+	}
+
+	if (!buffer_is_complete(buffer)) {
+		spin_unlock_bh(&bucket->lock);
+		rcu_read_unlock_bh();
+		if (atomic_read(&mem) > high_thresh)
+			evict();
 		return VERDICT_STOLEN;
 	}
 
+	buffer_unlist(buffer);
+	spin_unlock_bh(&bucket->lock);
+	rcu_read_unlock_bh();
+
+	buffer_assemble(buffer);
+	config = pkt->config;
 	*pkt = buffer->pkt;
 	pkt->original_pkt = pkt;
-	buffer->pkt.skb = NULL;
-	/* Note, at this point, buffer->pkt is invalid. Do not use. */
-	buffer_destroy(buffer, pkt);
-	spin_unlock_bh(&table_lock);
+	pkt->config = config;
+	/* The skbs belong to pkt now; this only releases the buffer. */
+	buffer_free(buffer);
 
 	if (!skb_make_writable(pkt->skb, pkt_l3hdr_len(pkt)))
 		return VERDICT_DROP;
@@ -372,6 +761,11 @@ verdict fragdb_handle(struct packet *pkt)
 
 	log_debug("All the fragments are now available. Resuming translation...");
 	return VERDICT_CONTINUE;
+
+drop:
+	spin_unlock_bh(&bucket->lock);
+	rcu_read_unlock_bh();
+	return VERDICT_DROP;
 }
 
 /**
@@ -379,7 +773,26 @@ verdict fragdb_handle(struct packet *pkt)
  */
 void fragdb_destroy(void)
 {
+	struct frag_table *old;
+	struct reassembly_buffer *buffer;
+	struct hlist_node *node, *tmp;
+	unsigned int i;
+
+	cancel_work_sync(&resize_work);
 	del_timer_sync(&expire_timer);
-	fragdb_table_empty(&table, buffer_dealloc);
+
+	old = rcu_dereference_protected(table, true);
+	for (i = 0; i < old->size; i++) {
+		hlist_for_each_safe(node, tmp, &old->buckets[i].chain) {
+			buffer = hlist_entry(node, struct reassembly_buffer, hash_hook);
+			hlist_del(&buffer->hash_hook);
+			list_del(&buffer->list_hook);
+			buffer_free(buffer);
+		}
+	}
+	RCU_INIT_POINTER(table, NULL);
+	vfree(old);
+
+	kmem_cache_destroy(fragment_cache);
 	kmem_cache_destroy(buffer_cache);
 }
@@ -1,16 +1,19 @@
 #include "nat64/common/nat64.h"
+#include "nat64/mod/common/classifier.h"
 #include "nat64/mod/common/config.h"
 #include "nat64/mod/common/core.h"
 #include "nat64/mod/common/nl_handler.h"
 #include "nat64/mod/common/pool6.h"
 #include "nat64/mod/stateful/pool4.h"
 #include "nat64/mod/stateful/pkt_queue.h"
+#include "nat64/mod/stateful/event_log.h"
 #include "nat64/mod/stateful/bib_db.h"
 #include "nat64/mod/stateful/session_db.h"
+#include "nat64/mod/stateful/session_sync.h"
+#include "nat64/mod/stateful/syn_filter.h"
 #include "nat64/mod/stateful/fragment_db.h"
-#ifdef BENCHMARK
+#include "nat64/mod/stateful/fragment_cache.h"
 #include "nat64/mod/common/log_time.h"
-#endif
 
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -35,6 +38,18 @@ MODULE_PARM_DESC(pool4, "The IPv4 pool's addresses.");
 static bool disabled;
 module_param(disabled, bool, 0);
 MODULE_PARM_DESC(disabled, "Disable the translation at the beginning of the module insertion.");
+static bool forward_fragments;
+module_param(forward_fragments, bool, 0);
+MODULE_PARM_DESC(forward_fragments, "Translate fragments as they arrive instead of reassembling "
+		"them first.");
+static unsigned int session_buckets;
+module_param(session_buckets, uint, 0);
+MODULE_PARM_DESC(session_buckets, "Size of the session fast path's and the BIB's hash tables. "
+		"Rounded up to a power of two.");
+static unsigned int syn_filter_bits;
+module_param(syn_filter_bits, uint, 0);
+MODULE_PARM_DESC(syn_filter_bits, "Size of each generation of the stateless SYN filter, in bits. "
+		"Rounded up to a power of two.");
 
 
 static char *banner = "\n"
@@ -99,8 +114,11 @@ static int __init nat64_init(void)
 	log_debug("%s", banner);
 	log_debug("Inserting the module...");
 
-	nf_defrag_ipv6_enable();
-	nf_defrag_ipv4_enable();
+	/* Fragment forwarding mode wants to see the fragments. */
+	if (!forward_fragments) {
+		nf_defrag_ipv6_enable();
+		nf_defrag_ipv4_enable();
+	}
 
 	/* Init Jool's submodules. */
 	error = config_init(disabled);
@@ -115,23 +133,36 @@ static int __init nat64_init(void)
 	error = pool4_init(pool4, pool4_size);
 	if (error)
 		goto pool4_failure;
+	error = classifier_init();
+	if (error)
+		goto classifier_failure;
 	error = pktqueue_init();
 	if (error)
 		goto pktqueue_failure;
-	error = bibdb_init();
+	error = eventlog_init();
+	if (error)
+		goto eventlog_failure;
+	error = bibdb_init(session_buckets);
 	if (error)
 		goto bib_failure;
-	error = sessiondb_init();
+	error = sessionsync_init();
+	if (error)
+		goto sessionsync_failure;
+	error = sessiondb_init(session_buckets);
 	if (error)
 		goto session_failure;
+	error = synfilter_init(syn_filter_bits);
+	if (error)
+		goto synfilter_failure;
 	error = fragdb_init();
 	if (error)
 		goto fragdb_failure;
-#ifdef BENCHMARK
+	error = fragcache_init(forward_fragments);
+	if (error)
+		goto fragcache_failure;
 	error = logtime_init();
 	if (error)
 		goto log_time_failure;
-#endif
 
 	/* Hook Jool to Netfilter. */
 	error = nf_register_hooks(nfho, ARRAY_SIZE(nfho));
@@ -143,23 +174,36 @@ static int __init nat64_init(void)
 	return error;
 
 nf_register_hooks_failure:
-#ifdef BENCHMARK
 	logtime_destroy();
 
 log_time_failure:
-#endif
+	fragcache_destroy();
+
+fragcache_failure:
 	fragdb_destroy();
 
 fragdb_failure:
+	synfilter_destroy();
+
+synfilter_failure:
 	sessiondb_destroy();
 
 session_failure:
+	sessionsync_destroy();
+
+sessionsync_failure:
 	bibdb_destroy();
 
 bib_failure:
+	eventlog_destroy();
+
+eventlog_failure:
 	pktqueue_destroy();
 
 pktqueue_failure:
+	classifier_destroy();
+
+classifier_failure:
 	pool4_destroy();
 
 pool4_failure:
@@ -181,13 +225,16 @@ static void __exit nat64_exit(void)
 	nf_unregister_hooks(nfho, ARRAY_SIZE(nfho));
 
 	/* Deinitialize the submodules. */
-#ifdef BENCHMARK
 	logtime_destroy();
-#endif
+	fragcache_destroy();
 	fragdb_destroy();
+	synfilter_destroy();
 	sessiondb_destroy();
+	sessionsync_destroy();
 	bibdb_destroy();
+	eventlog_destroy();
 	pktqueue_destroy();
+	classifier_destroy();
 	pool4_destroy();
 	pool6_destroy();
 	nlhandler_destroy();
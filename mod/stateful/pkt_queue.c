@@ -2,68 +2,270 @@
 #include "nat64/common/constants.h"
 #include "nat64/mod/common/config.h"
 #include "nat64/mod/common/icmp_wrapper.h"
-#include "nat64/mod/common/rbtree.h"
+#include "nat64/mod/common/random.h"
+#include "nat64/mod/common/route.h"
 
+#include <linux/cpumask.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/netdevice.h>
 #include <linux/printk.h>
+#include <linux/slab.h>
 #include <linux/timer.h>
 
-
+/** Number of hash buckets each shard has. */
+#define SHARD_BUCKETS 64
+/**
+ * Maximum number of bytes stored from each packet. This is enough to hold an IPv4 header and a TCP
+ * header (including both their options), and more than RFC 792 and 4443 ask ICMP errors to carry.
+ */
+#define MAX_STORED_HDRS 120
+/**
+ * Milliseconds a packet is kept before the queue sends its error on its own.
+ * Normally, the packet's session expires first (TCP_INCOMING_SYN) and triggers the error; this is
+ * only meant to catch the packets whose sessions died some other way.
+ */
+#define NODE_LIFETIME (2 * TCP_INCOMING_SYN * 1000)
 
 /**
- * A stored packet.
+ * A stored packet. Only its first bytes are kept, since those are all the ICMP error needs.
  */
 struct packet_node {
-	/** The packet's session entry. */
-	struct session_entry *session;
-	/** The packet. */
-	struct packet pkt;
-
-	/** Links this packet to the tree. See "packets". */
-	struct rb_node tree_hook;
+	/** The addresses of the packet's session, as seen from IPv4. They identify the node. */
+	struct ipv4_transport_addr remote4;
+	struct ipv4_transport_addr local4;
+
+	/** Index of the interface the packet came from. */
+	int ifindex;
+	/** Protocol of the packet's layer-3 header. */
+	l3_protocol l3_proto;
+	/** Length of the packet's layer-3 header, as stored in "hdrs". */
+	unsigned int l3hdr_len;
+	/** Number of bytes that are actually being used in "hdrs". */
+	unsigned int hdrs_len;
+	/** The packet's first bytes. */
+	unsigned char hdrs[MAX_STORED_HDRS];
+
+	/** Jiffy at which the timer will send this node's ICMP error, if nobody does it first. */
+	unsigned long dying_time;
+
+	/** Links this packet to its shard's table. */
+	struct hlist_node hash_hook;
+	/** Links this packet to its shard's expire_list. */
+	struct list_head list_hook;
 };
 
-/** The same packets, sorted by IPv4 identifiers. */
-static struct rb_root packets;
-/** Current number of packets in the database. */
-static int packet_count = 0;
-/** Protects "packets" and "packet_count". */
-static DEFINE_SPINLOCK(packets_lock);
+/**
+ * A portion of the database. Packets are spread evenly between the shards by hash, so contention
+ * does not pile up on a single lock during SYN floods.
+ */
+struct pktqueue_shard {
+	/** Protects this shard's "table" and "expire_list". */
+	spinlock_t lock;
+	/** The shard's packets, indexed by their sessions' IPv4 addresses. */
+	struct hlist_head table[SHARD_BUCKETS];
+	/** The shard's packets, sorted by expiration date. */
+	struct list_head expire_list;
+} ____cacheline_aligned_in_smp;
+
+/** The database. */
+static struct pktqueue_shard *shards;
+/** Length of "shards". Always a power of two. */
+static unsigned int shard_count;
+
+/** Number of bytes the packet nodes are currently taking up. */
+static atomic_t mem;
 
 /** Cache for struct packet_nodes, for efficient allocation. */
 static struct kmem_cache *node_cache;
 
+/** Random hash seed; see fragment_db.c. */
+static u32 rnd;
+
+static struct timer_list expire_timer;
+
+
+static u32 hash_addrs(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4)
+{
+	return jhash_3words(remote4->l3.s_addr, local4->l3.s_addr,
+			(((u32) remote4->l4) << 16) | local4->l4, rnd);
+}
+
+static struct pktqueue_shard *get_shard(u32 hash)
+{
+	return &shards[hash & (shard_count - 1)];
+}
+
+static struct hlist_head *get_bucket(struct pktqueue_shard *shard, u32 hash)
+{
+	return &shard->table[(hash >> 16) & (SHARD_BUCKETS - 1)];
+}
+
+/**
+ * Returns the node whose addresses are "session"'s. "shard" has to be the one "hash" belongs to.
+ * The caller must hold shard->lock.
+ */
+static struct packet_node *node_find(struct pktqueue_shard *shard, u32 hash,
+		struct session_entry *session)
+{
+	struct packet_node *node;
+	struct hlist_node *hook;
+
+	hlist_for_each(hook, get_bucket(shard, hash)) {
+		node = hlist_entry(hook, struct packet_node, hash_hook);
+		if (ipv4_transport_addr_equals(&node->remote4, &session->remote4)
+				&& ipv4_transport_addr_equals(&node->local4, &session->local4))
+			return node;
+	}
+
+	return NULL;
+}
+
+/**
+ * Unlinks "node" from the database. The caller must hold its shard's lock.
+ */
+static void node_detach(struct packet_node *node)
+{
+	hlist_del(&node->hash_hook);
+	list_del(&node->list_hook);
+}
+
+static void node_free(struct packet_node *node)
+{
+	atomic_sub(sizeof(*node), &mem);
+	kmem_cache_free(node_cache, node);
+}
 
 /**
- * Returns > 0 if node.session.*4 > session.*4.
- * Returns < 0 if node.session.*4 < session.*4.
- * Returns 0 if node.session.*4 == session.*4.
+ * Sends "node"'s ICMP error, by rebuilding as much of the original packet as was stored.
  *
- * Doesn't care about spinlocks.
+ * This runs from the cleaner timer, long after the packet's configuration snapshot was returned,
+ * so the rebuilt packet's "config" is NULL. Nothing on this path (routing and icmp64_send()
+ * included) may read it.
+ */
+static void node_send(struct packet_node *node)
+{
+	struct net_device *dev;
+	struct sk_buff *skb;
+	struct packet pkt;
+
+	dev = dev_get_by_index(&init_net, node->ifindex);
+
+	skb = alloc_skb(LL_MAX_HEADER + node->hdrs_len, GFP_ATOMIC);
+	if (!skb) {
+		log_debug("Could not allocate the skb the ICMP error is based on.");
+		goto end;
+	}
+
+	skb_reserve(skb, LL_MAX_HEADER);
+	skb_put(skb, node->hdrs_len);
+	skb_reset_network_header(skb);
+	skb_set_transport_header(skb, node->l3hdr_len);
+	memcpy(skb_network_header(skb), node->hdrs, node->hdrs_len);
+	skb->protocol = htons((node->l3_proto == L3PROTO_IPV6) ? ETH_P_IPV6 : ETH_P_IP);
+	skb->dev = dev;
+
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.skb = skb;
+	pkt.l3_proto = node->l3_proto;
+	pkt.l4_proto = L4PROTO_TCP;
+	pkt.payload = skb_tail_pointer(skb);
+	pkt.original_pkt = &pkt;
+
+	if (!dev) {
+		/*
+		 * The interface the packet came from is unknown or gone, so it cannot be routed as
+		 * input. Routing it by destination (ie. towards us) gives the kernel the device and
+		 * source address selection it needs; the error itself is routed back to the sender
+		 * either way. If this fails, route() counts it as a DROP_ROUTE.
+		 */
+		if (route(&pkt)) {
+			log_debug("Could not route the stored packet; its ICMP error is lost.");
+			kfree_skb(skb);
+			goto end;
+		}
+	}
+
+	icmp64_send(&pkt, ICMPERR_PORT_UNREACHABLE, 0);
+	kfree_skb(skb);
+	/* Fall through. */
+
+end:
+	if (dev)
+		dev_put(dev);
+}
+
+/**
+ * Removes the nodes whose time has come from the database, and sends their errors.
+ * Returns the dying time of the oldest surviving node. "found" is set to whether there is one.
  */
-static int compare_fn(const struct packet_node *node, struct session_entry *session)
+static unsigned long clean_expired_nodes(bool *found)
 {
-	int gap;
+	struct pktqueue_shard *shard;
+	struct packet_node *node, *tmp;
+	LIST_HEAD(expired);
+	unsigned long next_expire = 0;
+	unsigned int i;
+	unsigned int n = 0;
+
+	*found = false;
+
+	for (i = 0; i < shard_count; i++) {
+		shard = &shards[i];
+
+		spin_lock_bh(&shard->lock);
+		while (!list_empty(&shard->expire_list)) {
+			node = list_entry(shard->expire_list.next, struct packet_node, list_hook);
+			if (time_after(node->dying_time, jiffies)) {
+				if (!*found || time_before(node->dying_time, next_expire))
+					next_expire = node->dying_time;
+				*found = true;
+				break;
+			}
+
+			hlist_del(&node->hash_hook);
+			list_move_tail(&node->list_hook, &expired);
+		}
+		spin_unlock_bh(&shard->lock);
+	}
 
-	gap = ipv4_addr_cmp(&node->session->remote4.l3, &session->remote4.l3);
-	if (gap)
-		return gap;
+	list_for_each_entry_safe(node, tmp, &expired, list_hook) {
+		node_send(node);
+		node_free(node);
+		n++;
+	}
 
-	gap = node->session->remote4.l4 - session->remote4.l4;
-	if (gap)
-		return gap;
+	log_debug("Sent %u stored packets' ICMP errors because their time ran out.", n);
+	return next_expire;
+}
 
-	gap = ipv4_addr_cmp(&node->session->local4.l3, &session->local4.l3);
-	if (gap)
-		return gap;
+/**
+ * Executed by the kernel every once in a while. Sends the errors of the packets whose sessions
+ * have somehow been lost, so they don't linger.
+ */
+static void cleaner_timer(unsigned long param)
+{
+	unsigned long next_expire;
+	unsigned long min_time = jiffies + MIN_TIMER_SLEEP;
+	bool found;
 
-	gap = node->session->local4.l4 - session->local4.l4;
-	return gap;
+	next_expire = clean_expired_nodes(&found);
+	if (!found)
+		return; /* No need to re-schedule the timer. */
+
+	if (time_before(next_expire, min_time))
+		next_expire = min_time;
+
+	mod_timer(&expire_timer, next_expire);
 }
 
 int pktqueue_add(struct session_entry *session, struct packet *pkt)
 {
+	struct pktqueue_shard *shard;
 	struct packet_node *node;
-	unsigned int max_pkts;
+	struct packet *original;
+	struct sk_buff *skb;
+	u32 hash;
 	int error;
 
 	if (WARN(!session, "Cannot insert a packet with a NULL session."))
@@ -71,44 +273,81 @@ int pktqueue_add(struct session_entry *session, struct packet *pkt)
 	if (WARN(!pkt, "Cannot insert NULL as a packet."))
 		return -EINVAL;
 
-	max_pkts = config_get_max_pkts();
+	if (atomic_add_return(sizeof(*node), &mem) > pkt->config->so_max_mem) {
+		atomic_sub(sizeof(*node), &mem);
+		log_debug("Someone is trying to force lots of IPv4-TCP connections.");
+		return -E2BIG;
+	}
 
 	node = kmem_cache_alloc(node_cache, GFP_ATOMIC);
 	if (!node) {
+		atomic_sub(sizeof(*node), &mem);
 		log_debug("Allocation of packet node failed.");
 		return -ENOMEM;
 	}
 
-	node->session = session;
-	node->pkt = *pkt_original_pkt(pkt);
-	node->pkt.original_pkt = &node->pkt;
-	RB_CLEAR_NODE(&node->tree_hook);
+	/* The error has to be sent to whoever started all this, so store the original packet. */
+	original = pkt_original_pkt(pkt);
+	skb = original->skb;
+
+	node->remote4 = session->remote4;
+	node->local4 = session->local4;
+	node->ifindex = skb->dev ? skb->dev->ifindex : 0;
+	node->l3_proto = pkt_l3_proto(original);
+	node->hdrs_len = min_t(unsigned int, pkt_hdrs_len(original), MAX_STORED_HDRS);
+	node->l3hdr_len = min_t(unsigned int, pkt_l3hdr_len(original), node->hdrs_len);
+	error = skb_copy_bits(skb, skb_network_offset(skb), node->hdrs, node->hdrs_len);
+	if (error) {
+		log_debug("Could not copy the packet's headers: %d", error);
+		node_free(node);
+		return error;
+	}
+	/* All nodes live the same, so dying times are rounded to batch the timer's work. */
+	node->dying_time = round_jiffies_up(jiffies + msecs_to_jiffies(NODE_LIFETIME));
 
-	spin_lock_bh(&packets_lock);
+	hash = hash_addrs(&node->remote4, &node->local4);
+	shard = get_shard(hash);
 
-	if (packet_count + 1 >= max_pkts) {
-		error = -E2BIG;
-		log_debug("Someone is trying to force lots of IPv4-TCP connections.");
-		goto fail;
-	}
+	spin_lock_bh(&shard->lock);
 
-	error = rbtree_add(node, session, &packets, compare_fn, struct packet_node, tree_hook);
-	if (error) {
+	if (node_find(shard, hash, session)) {
+		spin_unlock_bh(&shard->lock);
+		node_free(node);
 		log_debug("Simultaneous Open is already taking place; ignoring packet.");
-		goto fail;
+		return -EEXIST;
 	}
-	packet_count++;
 
-	spin_unlock_bh(&packets_lock);
+	hlist_add_head(&node->hash_hook, get_bucket(shard, hash));
+	list_add_tail(&node->list_hook, &shard->expire_list);
+
+	spin_unlock_bh(&shard->lock);
+
+	if (!timer_pending(&expire_timer))
+		mod_timer(&expire_timer, node->dying_time);
 
-	session_get(session);
 	log_debug("Pkt queue - I just stored a packet.");
 	return 0;
+}
 
-fail:
-	spin_unlock_bh(&packets_lock);
-	kmem_cache_free(node_cache, node);
-	return error;
+/**
+ * Removes "session"'s node from the database, and returns it.
+ */
+static struct packet_node *node_extract(struct session_entry *session)
+{
+	struct pktqueue_shard *shard;
+	struct packet_node *node;
+	u32 hash;
+
+	hash = hash_addrs(&session->remote4, &session->local4);
+	shard = get_shard(hash);
+
+	spin_lock_bh(&shard->lock);
+	node = node_find(shard, hash, session);
+	if (node)
+		node_detach(node);
+	spin_unlock_bh(&shard->lock);
+
+	return node;
 }
 
 int pktqueue_send(struct session_entry *session)
@@ -118,80 +357,90 @@ int pktqueue_send(struct session_entry *session)
 	if (WARN(!session, "Cannot remove a packet with a NULL session."))
 		return -EINVAL;
 
-	spin_lock_bh(&packets_lock);
-
-	node = rbtree_find(session, &packets, compare_fn, struct packet_node, tree_hook);
+	node = node_extract(session);
 	if (!node) {
-		spin_unlock_bh(&packets_lock);
 		log_debug("I've been asked to send a packet I don't know.");
 		return -ESRCH;
 	}
 
-	rb_erase(&node->tree_hook, &packets);
-	packet_count--;
+	node_send(node);
+	node_free(node);
 
-	spin_unlock_bh(&packets_lock);
+	log_debug("Pkt queue - I just sent a ICMP error.");
+	return 0;
+}
 
-	icmp64_send(&node->pkt, ICMPERR_PORT_UNREACHABLE, 0);
-	kfree_skb(node->pkt.skb);
-	session_return(node->session);
-	kmem_cache_free(node_cache, node);
+int pktqueue_remove(struct session_entry *session)
+{
+	struct packet_node *node;
 
-	log_debug("Pkt queue - I just sent a ICMP error.");
+	if (WARN(!session, "The packet table cannot contain NULL."))
+		return -EINVAL;
+
+	node = node_extract(session);
+	if (!node)
+		return -ESRCH;
+
+	node_free(node);
+
+	log_debug("Pkt queue - I just cancelled a ICMP error.");
 	return 0;
 }
 
 int pktqueue_init(void)
 {
+	unsigned int i, j;
+
 	node_cache = kmem_cache_create("jool_pkt_queue", sizeof(struct packet_node), 0, 0, NULL);
 	if (!node_cache) {
 		log_err("Could not allocate the packet queue's node cache.");
 		return -ENOMEM;
 	}
 
-	packets = RB_ROOT;
+	shard_count = roundup_pow_of_two(num_possible_cpus());
+	shards = kmalloc(shard_count * sizeof(*shards), GFP_KERNEL);
+	if (!shards) {
+		log_err("Could not allocate the packet queue.");
+		kmem_cache_destroy(node_cache);
+		return -ENOMEM;
+	}
 
-	return 0;
-}
+	for (i = 0; i < shard_count; i++) {
+		spin_lock_init(&shards[i].lock);
+		for (j = 0; j < SHARD_BUCKETS; j++)
+			INIT_HLIST_HEAD(&shards[i].table[j]);
+		INIT_LIST_HEAD(&shards[i].expire_list);
+	}
 
-static void pktqueue_destroy_aux(struct rb_node *hook)
-{
-	struct packet_node *node;
-	node = rb_entry(hook, struct packet_node, tree_hook);
+	atomic_set(&mem, 0);
+	rnd = get_random_u32();
 
-	icmp64_send(&node->pkt, ICMPERR_PORT_UNREACHABLE, 0);
-	kfree_skb(node->pkt.skb);
-	kmem_cache_free(node_cache, node);
-}
+	init_timer(&expire_timer);
+	expire_timer.function = cleaner_timer;
+	expire_timer.expires = 0;
+	expire_timer.data = 0;
 
-void pktqueue_destroy(void)
-{
-	rbtree_clear(&packets, pktqueue_destroy_aux);
-	packets.rb_node = NULL;
-	kmem_cache_destroy(node_cache);
+	return 0;
 }
 
-int pktqueue_remove(struct session_entry *session)
+void pktqueue_destroy(void)
 {
+	struct list_head *list;
 	struct packet_node *node;
-
-	if (WARN(!session, "The packet table cannot contain NULL."))
-		return -EINVAL;
-
-	spin_lock_bh(&packets_lock);
-	node = rbtree_find(session, &packets, compare_fn, struct packet_node, tree_hook);
-	if (!node) {
-		spin_unlock_bh(&packets_lock);
-		return -ESRCH;
+	unsigned int i;
+
+	del_timer_sync(&expire_timer);
+
+	for (i = 0; i < shard_count; i++) {
+		list = &shards[i].expire_list;
+		while (!list_empty(list)) {
+			node = list_entry(list->next, struct packet_node, list_hook);
+			node_detach(node);
+			node_send(node);
+			node_free(node);
+		}
 	}
 
-	rb_erase(&node->tree_hook, &packets);
-	packet_count--;
-	spin_unlock_bh(&packets_lock);
-	kfree_skb(node->pkt.skb);
-	session_return(node->session);
-	kmem_cache_free(node_cache, node);
-
-	log_debug("Pkt queue - I just cancelled a ICMP error.");
-	return 0;
+	kfree(shards);
+	kmem_cache_destroy(node_cache);
 }
@@ -1,5 +1,13 @@
 #include "nat64/mod/stateful/session_db.h"
 
+#include <linux/atomic.h>
+#include <linux/bitmap.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/prefetch.h>
+#include <linux/random.h>
+#include <linux/rculist.h>
+#include <linux/vmalloc.h>
 #include <net/ipv6.h>
 #include "nat64/common/constants.h"
 #include "nat64/common/str_utils.h"
@@ -9,7 +17,9 @@
 #include "nat64/mod/common/rfc6052.h"
 #include "nat64/mod/common/route.h"
 #include "nat64/mod/stateful/bib_db.h"
+#include "nat64/mod/stateful/event_log.h"
 #include "nat64/mod/stateful/pkt_queue.h"
+#include "nat64/mod/stateful/session_sync.h"
 
 /**
  * Session table definition.
@@ -22,6 +32,13 @@ struct session_table {
 	struct rb_root tree4;
 	/** Number of session entries in this table. */
 	u64 count;
+	/**
+	 * The entries again, sorted by insertion. This is the one lockless readers walk; see
+	 * sessiondb_for_each(). Writers need "lock", readers need rcu_read_lock_bh().
+	 */
+	struct list_head list;
+	/** Serial number of the newest entry in "list". */
+	unsigned long serial;
 	/**
 	 * Lock to sync access. This protects both the trees and the entries, but if you only need to
 	 * read the const portion of the entries, you can get away with only incresing their reference
@@ -62,6 +79,8 @@ struct expire_timer {
 
 	unsigned long (*get_timeout)(void);
 	char *name;
+	/** Identifier of this timer, for the outside world. */
+	enum session_timer_type type;
 };
 
 /** Killer of sessions whose expiration date was initialized using "config".ttl.udp. */
@@ -75,11 +94,74 @@ static struct expire_timer expirer_icmp;
 /** Killer of sessions whose expiration date was initialized using "TCP_INCOMING_SYN". */
 static struct expire_timer expirer_syn;
 
-static char* EXPIRER_NAMES[] = { "UDP", "ICMP", "TCP_EST", "TCP_TRANS", "TCP_SYN" };
+/** Indexed by enum session_timer_type. */
+static char* EXPIRER_NAMES[] = { "UDP", "ICMP", "TCP_TRANS", "TCP_EST", "TCP_SYN" };
 
 /** Cache for struct session_entrys, for efficient allocation. */
 static struct kmem_cache *entry_cache;
 
+/**
+ * Last sequence number handed to a synchronization record (see sync_record_init()).
+ * The per-CPU rings do not order records queued by different CPUs; this does.
+ */
+static atomic64_t sync_seq = ATOMIC64_INIT(0);
+
+/**
+ * Default number of buckets of each of the fast path's indexes.
+ * Sized for millions of sessions; 2 MB per index on 64-bit machines.
+ */
+#define FASTPATH_DEFAULT_BUCKETS (1 << 18)
+/** Upper limit to the number of buckets the user can request. 128 MB per index on 64 bits. */
+#define FASTPATH_MAX_BUCKETS (1 << 24)
+
+/**
+ * A lightweight copy of an established UDP or TCP session, as seen by the fast path.
+ *
+ * The fast path is a mirror of the hot portion of the database (established UDP and TCP flows).
+ * It is indexed by hash and read under RCU, so finding the translated version of a tuple does not
+ * need to grab the table spinlocks, walk the trees or touch the session's refcounter.
+ * Anything that cannot be found here (new flows, ICMP, TCP handshakes and teardowns) falls back to
+ * the trees.
+ */
+struct fastpath_entry {
+	/**
+	 * The session this entry mirrors. Sessions are released after an RCU-bh grace period (see
+	 * session_release()), so readers can dereference this until they leave their read-side
+	 * critical section, even if the session dies in the meantime.
+	 */
+	struct session_entry *session;
+	l4_protocol l4_proto;
+	struct ipv6_transport_addr remote6;
+	struct ipv6_transport_addr local6;
+	struct ipv4_transport_addr local4;
+	struct ipv4_transport_addr remote4;
+
+	/** Appends this entry to the fast path's IPv6 index. */
+	struct hlist_node hook6;
+	/** Appends this entry to the fast path's IPv4 index. */
+	struct hlist_node hook4;
+	struct rcu_head rcu;
+};
+
+/** The fast path's IPv6 index. Readers need rcu_read_lock_bh(), writers need fastpath_lock. */
+static struct hlist_head *fastpath6;
+/** The fast path's IPv4 index. Readers need rcu_read_lock_bh(), writers need fastpath_lock. */
+static struct hlist_head *fastpath4;
+/**
+ * Serializes writers of the fast path.
+ * Always taken while holding a table spinlock (never the other way around).
+ */
+static DEFINE_SPINLOCK(fastpath_lock);
+/** Hash seed, so the buckets cannot be predicted from outside. */
+static u32 fastpath_rnd;
+/** Number of buckets of each of the fast path's indexes. Always a power of two. */
+static unsigned int fastpath_buckets;
+
+static void session_free(struct rcu_head *rcu)
+{
+	kmem_cache_free(entry_cache, container_of(rcu, struct session_entry, rcu));
+}
+
 static void session_release(struct kref *ref)
 {
 	struct session_entry *session;
@@ -87,7 +169,8 @@ static void session_release(struct kref *ref)
 
 	if (session->bib)
 		bib_return(session->bib);
-	kmem_cache_free(entry_cache, session);
+	/* A snapshot reader might still be looking at it. */
+	call_rcu_bh(&session->rcu, session_free);
 }
 
 static int session_init(void)
@@ -104,6 +187,8 @@ static int session_init(void)
 
 static void session_destroy(void)
 {
+	/* Wait for session_free(). */
+	rcu_barrier_bh();
 	kmem_cache_destroy(entry_cache);
 }
 
@@ -133,6 +218,8 @@ static struct session_entry *session_clone(struct session_entry *session)
 	INIT_LIST_HEAD(&result->expire_list_hook);
 	RB_CLEAR_NODE(&result->tree6_hook);
 	RB_CLEAR_NODE(&result->tree4_hook);
+	INIT_LIST_HEAD(&result->list_hook);
+	result->serial = 0;
 
 	if (session->bib)
 		bib_get(session->bib);
@@ -160,7 +247,7 @@ struct session_entry *session_create(const struct ipv6_transport_addr *remote6,
 	return session_clone(&tmp);
 }
 
-static void session_log(const struct session_entry *session, const char *action)
+static void session_log(const struct session_entry *session, enum log_event_type type)
 {
 	struct timeval tval;
 	struct tm t;
@@ -168,12 +255,17 @@ static void session_log(const struct session_entry *session, const char *action)
 	if (!config_get_session_logging())
 		return;
 
+	if (config_get_logging_binary()) {
+		eventlog_session(session, type);
+		return;
+	}
+
 	do_gettimeofday(&tval);
 	time_to_tm(tval.tv_sec, 0, &t);
 	log_info("%ld/%d/%d %d:%d:%d (GMT) - %s %pI6c#%u|%pI6c#%u|"
 			"%pI4#%u|%pI4#%u|%s",
 			1900 + t.tm_year, t.tm_mon + 1, t.tm_mday,
-			t.tm_hour, t.tm_min, t.tm_sec, action,
+			t.tm_hour, t.tm_min, t.tm_sec, log_event_to_string(type),
 			&session->remote6.l3, session->remote6.l4,
 			&session->local6.l3, session->local6.l4,
 			&session->local4.l3, session->local4.l4,
@@ -181,6 +273,73 @@ static void session_log(const struct session_entry *session, const char *action)
 			l4proto_to_string(session->l4_proto));
 }
 
+/**
+ * Fills "record" with "session"'s addresses, and stamps it with the next sequence number.
+ */
+static void sync_record_init(const struct session_entry *session, __u8 flags,
+		struct session_record_usr *record)
+{
+	memset(record, 0, sizeof(*record));
+	record->seq = atomic64_inc_return(&sync_seq);
+	record->remote6 = session->remote6;
+	record->local6 = session->local6;
+	record->local4 = session->local4;
+	record->remote4 = session->remote4;
+	record->l4_proto = session->l4_proto;
+	record->flags = flags;
+}
+
+/**
+ * Reports "session" to the standby NAT64, unless nothing interesting happened to it ("changed" is
+ * false) and it was already reported recently.
+ *
+ * "session" has to be subscribed to a timer, and its table's spinlock must already be held.
+ */
+static void sync_session(struct session_entry *session, bool changed)
+{
+	struct expire_timer *expirer = session->expirer;
+	struct session_record_usr record;
+	unsigned long now = jiffies;
+	unsigned long timeout, idle;
+
+	if (!changed && session->sync_time && time_before(now,
+			session->sync_time + msecs_to_jiffies(1000 * SESSION_SYNC_REFRESH)))
+		return;
+	if (!config_get_session_sync())
+		return;
+	/* Same as restore_sessions(): SYN sessions and BIB-less dummies cannot be restored. */
+	if (!session->bib || !expirer || expirer->type == SESSIONTIMER_SYN)
+		return;
+
+	timeout = expirer->get_timeout();
+	idle = now - session->update_time;
+
+	sync_record_init(session, session->bib->is_static ? SESSION_RECORD_STATIC_BIB : 0, &record);
+	record.ttl = (idle < timeout) ? jiffies_to_msecs(timeout - idle) : 0;
+	record.state = session->state;
+	record.timer = expirer->type;
+	sessionsync_add(&record);
+
+	/* Zero is reserved, and one jiffy of difference is not going to hurt anyone. */
+	session->sync_time = now ? now : 1;
+}
+
+/**
+ * Tells the standby NAT64 "session" died, if it ever learned about it.
+ *
+ * "session"'s table's spinlock must already be held.
+ */
+static void sync_removal(struct session_entry *session)
+{
+	struct session_record_usr record;
+
+	if (!session->sync_time || !config_get_session_sync())
+		return;
+
+	sync_record_init(session, SESSION_RECORD_REMOVED, &record);
+	sessionsync_add(&record);
+}
+
 /**
  * One-liner to get the session table corresponding to the "l4_proto" protocol.
  *
@@ -326,6 +485,301 @@ static int compare_full4(const struct session_entry *session, const struct tuple
 	return gap;
 }
 
+static unsigned int fastpath_hash6(l4_protocol l4_proto, const struct ipv6_transport_addr *remote,
+		const struct ipv6_transport_addr *local)
+{
+	u32 hash;
+
+	hash = jhash2(local->l3.s6_addr32, 4, fastpath_rnd);
+	hash = jhash2(remote->l3.s6_addr32, 4, hash);
+	hash = jhash_3words((remote->l4 << 16) | local->l4, l4_proto, 0, hash);
+	return hash & (fastpath_buckets - 1);
+}
+
+static unsigned int fastpath_hash4(l4_protocol l4_proto, const struct ipv4_transport_addr *remote,
+		const struct ipv4_transport_addr *local)
+{
+	u32 hash;
+
+	hash = jhash_3words((__force u32) remote->l3.s_addr, (__force u32) local->l3.s_addr,
+			(remote->l4 << 16) | local->l4, fastpath_rnd);
+	return jhash_1word(l4_proto, hash) & (fastpath_buckets - 1);
+}
+
+/**
+ * Returns true if "session" is supposed to be mirrored by the fast path.
+ *
+ * Simultaneous Open debris (see sessiondb_get()) never reaches the ESTABLISHED state, so it is
+ * excluded implicitly.
+ */
+static bool is_fast(const struct session_entry *session)
+{
+	switch (session->l4_proto) {
+	case L4PROTO_UDP:
+		return true;
+	case L4PROTO_TCP:
+		return session->state == ESTABLISHED;
+	case L4PROTO_ICMP:
+	case L4PROTO_OTHER:
+		break;
+	}
+
+	return false;
+}
+
+/**
+ * Returns the fast path's copy of "session", or NULL if it doesn't have one.
+ *
+ * fastpath_lock must already be held.
+ */
+static struct fastpath_entry *fastpath_find(const struct session_entry *session)
+{
+	struct hlist_node *node;
+	struct fastpath_entry *entry;
+	unsigned int hash;
+
+	hash = fastpath_hash6(session->l4_proto, &session->remote6, &session->local6);
+	hlist_for_each(node, &fastpath6[hash]) {
+		entry = hlist_entry(node, struct fastpath_entry, hook6);
+		if (entry->l4_proto == session->l4_proto
+				&& compare_addr6(&entry->remote6, &session->remote6) == 0
+				&& compare_addr6(&entry->local6, &session->local6) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+/**
+ * Publishes "session" in the fast path.
+ * Failure is not fatal (the packets will simply take the slow path), so callers are free to
+ * ignore the result.
+ *
+ * "session"'s table's spinlock must already be held.
+ */
+static int fastpath_add(const struct session_entry *session)
+{
+	struct fastpath_entry *entry;
+	int error = 0;
+
+	spin_lock_bh(&fastpath_lock);
+
+	if (fastpath_find(session))
+		goto end;
+
+	entry = kmalloc(sizeof(*entry), GFP_ATOMIC);
+	if (!entry) {
+		log_debug("Could not allocate a fast path entry; the session will take the slow path.");
+		error = -ENOMEM;
+		goto end;
+	}
+
+	entry->session = (struct session_entry *) session;
+	entry->l4_proto = session->l4_proto;
+	entry->remote6 = session->remote6;
+	entry->local6 = session->local6;
+	entry->local4 = session->local4;
+	entry->remote4 = session->remote4;
+
+	hlist_add_head_rcu(&entry->hook6, &fastpath6[fastpath_hash6(entry->l4_proto,
+			&entry->remote6, &entry->local6)]);
+	hlist_add_head_rcu(&entry->hook4, &fastpath4[fastpath_hash4(entry->l4_proto,
+			&entry->remote4, &entry->local4)]);
+	/* Fall through. */
+
+end:
+	spin_unlock_bh(&fastpath_lock);
+	return error;
+}
+
+static void fastpath_entry_free(struct rcu_head *rcu)
+{
+	kfree(container_of(rcu, struct fastpath_entry, rcu));
+}
+
+/**
+ * Withdraws "session" from the fast path. Readers might still be looking at the entry, so it is
+ * released after a grace period.
+ *
+ * "session"'s table's spinlock must already be held.
+ */
+static void fastpath_remove(const struct session_entry *session)
+{
+	struct fastpath_entry *entry;
+
+	spin_lock_bh(&fastpath_lock);
+	entry = fastpath_find(session);
+	if (entry) {
+		hlist_del_rcu(&entry->hook6);
+		hlist_del_rcu(&entry->hook4);
+		/* Readers use rcu_read_lock_bh(), so a plain kfree_rcu() would not wait for them. */
+		call_rcu_bh(&entry->rcu, fastpath_entry_free);
+	}
+	spin_unlock_bh(&fastpath_lock);
+}
+
+/**
+ * Changes "session"'s TCP state, keeping the fast path in sync.
+ *
+ * "session"'s table's spinlock must already be held.
+ */
+static void set_state(struct session_entry *session, u_int8_t state)
+{
+	bool was_fast = is_fast(session);
+
+	session->state = state;
+
+	if (!was_fast && is_fast(session))
+		fastpath_add(session);
+	else if (was_fast && !is_fast(session))
+		fastpath_remove(session);
+}
+
+/**
+ * "buckets" is the user's requested size of the indexes. Zero means default.
+ */
+static int fastpath_init(unsigned int buckets)
+{
+	unsigned int i;
+
+	if (!buckets)
+		buckets = FASTPATH_DEFAULT_BUCKETS;
+	if (buckets > FASTPATH_MAX_BUCKETS) {
+		log_err("The session fast path cannot have more than %u buckets.",
+				FASTPATH_MAX_BUCKETS);
+		return -EINVAL;
+	}
+	fastpath_buckets = roundup_pow_of_two(buckets);
+
+	fastpath6 = vmalloc(fastpath_buckets * sizeof(*fastpath6));
+	if (!fastpath6)
+		goto fail6;
+	fastpath4 = vmalloc(fastpath_buckets * sizeof(*fastpath4));
+	if (!fastpath4)
+		goto fail4;
+
+	get_random_bytes(&fastpath_rnd, sizeof(fastpath_rnd));
+	for (i = 0; i < fastpath_buckets; i++) {
+		INIT_HLIST_HEAD(&fastpath6[i]);
+		INIT_HLIST_HEAD(&fastpath4[i]);
+	}
+
+	return 0;
+
+fail4:
+	vfree(fastpath6);
+fail6:
+	log_err("Could not allocate the session fast path's indexes.");
+	return -ENOMEM;
+}
+
+/**
+ * Releases every entry from the fast path. Assumes nobody else is looking at it anymore.
+ */
+static void fastpath_destroy(void)
+{
+	struct hlist_node *node, *tmp;
+	unsigned int i;
+
+	/* Wait for fastpath_remove()'s callbacks; they live in this module. */
+	rcu_barrier_bh();
+
+	for (i = 0; i < fastpath_buckets; i++) {
+		hlist_for_each_safe(node, tmp, &fastpath6[i])
+			kfree(hlist_entry(node, struct fastpath_entry, hook6));
+	}
+
+	vfree(fastpath4);
+	vfree(fastpath6);
+}
+
+/**
+ * Returns the fast path's entry for "in", or NULL if it doesn't have one.
+ *
+ * The caller must hold rcu_read_lock_bh().
+ */
+static struct fastpath_entry *fastpath_lookup(struct tuple *in)
+{
+	struct hlist_node *node;
+	struct fastpath_entry *entry;
+	unsigned int hash;
+
+	switch (in->l3_proto) {
+	case L3PROTO_IPV6:
+		hash = fastpath_hash6(in->l4_proto, &in->src.addr6, &in->dst.addr6);
+		for (node = rcu_dereference_bh(fastpath6[hash].first); node;
+				node = rcu_dereference_bh(node->next)) {
+			entry = hlist_entry(node, struct fastpath_entry, hook6);
+			if (entry->l4_proto == in->l4_proto
+					&& compare_addr6(&entry->remote6, &in->src.addr6) == 0
+					&& compare_addr6(&entry->local6, &in->dst.addr6) == 0)
+				return entry;
+		}
+		break;
+
+	case L3PROTO_IPV4:
+		hash = fastpath_hash4(in->l4_proto, &in->src.addr4, &in->dst.addr4);
+		for (node = rcu_dereference_bh(fastpath4[hash].first); node;
+				node = rcu_dereference_bh(node->next)) {
+			entry = hlist_entry(node, struct fastpath_entry, hook4);
+			if (entry->l4_proto == in->l4_proto
+					&& compare_addr4(&entry->remote4, &in->src.addr4) == 0
+					&& compare_addr4(&entry->local4, &in->dst.addr4) == 0)
+				return entry;
+		}
+		break;
+	}
+
+	return NULL;
+}
+
+bool sessiondb_get_fast(struct tuple *in, struct tuple *out)
+{
+	struct fastpath_entry *entry;
+
+	if (in->l4_proto != L4PROTO_UDP && in->l4_proto != L4PROTO_TCP)
+		return false;
+
+	rcu_read_lock_bh();
+
+	entry = fastpath_lookup(in);
+	if (entry) {
+		switch (in->l3_proto) {
+		case L3PROTO_IPV6:
+			out->l3_proto = L3PROTO_IPV4;
+			out->src.addr4 = entry->local4;
+			out->dst.addr4 = entry->remote4;
+			break;
+		case L3PROTO_IPV4:
+			out->l3_proto = L3PROTO_IPV6;
+			out->src.addr6 = entry->local6;
+			out->dst.addr6 = entry->remote6;
+			break;
+		}
+		out->l4_proto = in->l4_proto;
+	}
+
+	rcu_read_unlock_bh();
+	return entry != NULL;
+}
+
+void sessiondb_prefetch(struct tuple *tuple)
+{
+	if (tuple->l4_proto != L4PROTO_UDP && tuple->l4_proto != L4PROTO_TCP)
+		return;
+
+	switch (tuple->l3_proto) {
+	case L3PROTO_IPV6:
+		prefetch(&fastpath6[fastpath_hash6(tuple->l4_proto, &tuple->src.addr6,
+				&tuple->dst.addr6)]);
+		break;
+	case L3PROTO_IPV4:
+		prefetch(&fastpath4[fastpath_hash4(tuple->l4_proto, &tuple->src.addr4,
+				&tuple->dst.addr4)]);
+		break;
+	}
+}
+
 /**
  * Sends a probe packet to "session"'s IPv6 endpoint, to trigger a confirmation ACK if the
  * connection is still alive.
@@ -414,6 +868,21 @@ fail:
 	log_debug("Looks like a TCP connection will break or remain idle forever somewhere...");
 }
 
+/**
+ * Appends "session" to "table"'s snapshot list.
+ *
+ * "table"'s spinlock must already be held.
+ */
+static void list_add_snapshot(struct session_entry *session, struct session_table *table)
+{
+	table->serial++;
+	if (!table->serial) /* Zero means "not in the database". */
+		table->serial++;
+
+	session->serial = table->serial;
+	list_add_tail_rcu(&session->list_hook, &table->list);
+}
+
 /**
  * Removes all of this database's references towards "session", and drops its refcount accordingly.
  *
@@ -432,7 +901,12 @@ static int remove(struct session_entry *session, struct session_table *table)
 	if (!RB_EMPTY_NODE(&session->tree4_hook))
 		rb_erase(&session->tree4_hook, &table->tree4);
 
-	session_log(session, "Forgot session");
+	if (is_fast(session))
+		fastpath_remove(session);
+	ACCESS_ONCE(session->serial) = 0;
+	list_del_rcu(&session->list_hook);
+	session_log(session, LOG_EVENT_SESSION_REMOVE);
+	sync_removal(session);
 
 	list_del(&session->expire_list_hook);
 	session->expirer = NULL;
@@ -459,12 +933,28 @@ static void schedule_timer(struct expire_timer *expirer, unsigned long next_time
 
 int sessiondb_get_timeout(struct session_entry *session, unsigned long *result)
 {
-	if (!session->expirer) {
+	/* Snapshot readers call this without the lock, so the session might be dying. */
+	struct expire_timer *expirer = ACCESS_ONCE(session->expirer);
+
+	if (!expirer) {
 		log_debug("The session entry doesn't have an expirer");
 		return -EINVAL;
 	}
 
-	*result = session->expirer->get_timeout();
+	*result = expirer->get_timeout();
+	return 0;
+}
+
+int sessiondb_get_timer_type(struct session_entry *session, enum session_timer_type *result)
+{
+	struct expire_timer *expirer = ACCESS_ONCE(session->expirer);
+
+	if (!expirer) {
+		log_debug("The session entry doesn't have an expirer");
+		return -EINVAL;
+	}
+
+	*result = expirer->type;
 	return 0;
 }
 
@@ -497,6 +987,37 @@ static void commit_timer(struct expire_timer *expirer)
 		schedule_timer(expirer, jiffies + expirer->get_timeout());
 }
 
+/**
+ * Version of set_timer() for sessions which are coming back to life (see sessiondb_add_batch()).
+ * "session" had "ttl" milliseconds left, so it goes wherever that places it in "expirer"'s list
+ * instead of the end.
+ *
+ * The list is walked backwards, so this is cheap as long as the sessions are restored in
+ * increasing order of "ttl".
+ */
+static void set_timer_restored(struct session_entry *session, struct expire_timer *expirer,
+		unsigned int ttl)
+{
+	unsigned long timeout = expirer->get_timeout();
+	unsigned long remaining = msecs_to_jiffies(ttl);
+	struct list_head *prev;
+
+	if (remaining > timeout)
+		remaining = timeout;
+	session->update_time = jiffies - (timeout - remaining);
+
+	for (prev = expirer->sessions.prev; prev != &expirer->sessions; prev = prev->prev) {
+		struct session_entry *other;
+		other = list_entry(prev, struct session_entry, expire_list_hook);
+		if (!time_after(other->update_time, session->update_time))
+			break;
+	}
+
+	list_del(&session->expire_list_hook);
+	list_add(&session->expire_list_hook, prev);
+	session->expirer = expirer;
+}
+
 /**
  * Handles "session"'s expiration, assuming it's a TCP session.
  *
@@ -527,12 +1048,13 @@ static int session_tcp_expire(struct session_entry *session, struct list_head *t
 		if (clone)
 			list_add(&clone->expire_list_hook, probes);
 
-		session->state = TRANS;
+		set_state(session, TRANS);
 		session->update_time = jiffies;
 
 		list_del(&session->expire_list_hook);
 		list_add_tail(&session->expire_list_hook, &expirer_tcp_trans.sessions);
 		session->expirer = &expirer_tcp_trans;
+		sync_session(session, true);
 
 		return 0;
 
@@ -680,7 +1202,7 @@ static unsigned long get_syn_timeout(void)
  * Doesn't care about spinlocks (initialization code doesn't share threads).
  */
 static void init_expire_timer(struct expire_timer *expirer, struct session_table *table,
-		unsigned long (*get_timeout)(void), char *expirer_name)
+		unsigned long (*get_timeout)(void), enum session_timer_type type)
 {
 	init_timer(&expirer->timer);
 	expirer->timer.function = cleaner_timer;
@@ -690,10 +1212,11 @@ static void init_expire_timer(struct expire_timer *expirer, struct session_table
 	INIT_LIST_HEAD(&expirer->sessions);
 	expirer->table = table;
 	expirer->get_timeout = get_timeout;
-	expirer->name = expirer_name;
+	expirer->name = EXPIRER_NAMES[type];
+	expirer->type = type;
 }
 
-int sessiondb_init(void)
+int sessiondb_init(unsigned int fastpath_size)
 {
 	struct session_table *tables[] = { &session_table_udp, &session_table_tcp,
 			&session_table_icmp };
@@ -703,21 +1226,29 @@ int sessiondb_init(void)
 	error = session_init();
 	if (error)
 		return error;
+	error = fastpath_init(fastpath_size);
+	if (error) {
+		session_destroy();
+		return error;
+	}
 
 	for (i = 0; i < ARRAY_SIZE(tables); i++) {
 		tables[i]->tree6 = RB_ROOT;
 		tables[i]->tree4 = RB_ROOT;
 		tables[i]->count = 0;
+		INIT_LIST_HEAD(&tables[i]->list);
+		tables[i]->serial = 0;
 		spin_lock_init(&tables[i]->lock);
 	}
 
-	init_expire_timer(&expirer_udp, &session_table_udp, config_get_ttl_udp, EXPIRER_NAMES[0]);
-	init_expire_timer(&expirer_icmp, &session_table_icmp, config_get_ttl_icmp, EXPIRER_NAMES[1]);
+	init_expire_timer(&expirer_udp, &session_table_udp, config_get_ttl_udp, SESSIONTIMER_UDP);
+	init_expire_timer(&expirer_icmp, &session_table_icmp, config_get_ttl_icmp,
+			SESSIONTIMER_ICMP);
 	init_expire_timer(&expirer_tcp_est, &session_table_tcp, config_get_ttl_tcpest,
-			EXPIRER_NAMES[2]);
+			SESSIONTIMER_EST);
 	init_expire_timer(&expirer_tcp_trans, &session_table_tcp, config_get_ttl_tcptrans,
-			EXPIRER_NAMES[3]);
-	init_expire_timer(&expirer_syn, &session_table_tcp, get_syn_timeout, EXPIRER_NAMES[4]);
+			SESSIONTIMER_TRANS);
+	init_expire_timer(&expirer_syn, &session_table_tcp, get_syn_timeout, SESSIONTIMER_SYN);
 
 	return 0;
 }
@@ -752,6 +1283,7 @@ void sessiondb_destroy(void)
 	 */
 	for (i = 0; i < ARRAY_SIZE(tables); i++)
 		rbtree_clear(&tables[i]->tree6, session_destroy_aux);
+	fastpath_destroy();
 
 	session_destroy();
 }
@@ -766,6 +1298,54 @@ static struct session_entry *get_by_ipv4(struct session_table *table, struct tup
 	return rbtree_find(tuple, &table->tree4, compare_full4, struct session_entry, tree4_hook);
 }
 
+int sessiondb_refresh_fast(struct packet *pkt, struct tuple *tuple)
+{
+	struct fastpath_entry *entry;
+	struct session_entry *session;
+	struct session_table *table;
+	struct expire_timer *expirer = NULL;
+	int error = -ESRCH;
+
+	switch (tuple->l4_proto) {
+	case L4PROTO_UDP:
+		table = &session_table_udp;
+		break;
+	case L4PROTO_TCP:
+		/* Handshakes and teardowns need the state machine. */
+		if (pkt_tcp_hdr(pkt)->syn || pkt_tcp_hdr(pkt)->fin || pkt_tcp_hdr(pkt)->rst)
+			return -ESRCH;
+		table = &session_table_tcp;
+		break;
+	default:
+		return -ESRCH;
+	}
+
+	rcu_read_lock_bh();
+
+	entry = fastpath_lookup(tuple);
+	if (!entry)
+		goto end;
+	session = entry->session;
+
+	spin_lock(&table->lock);
+	/* The session might have died or left the established state since the lookup. */
+	if (session->expirer && is_fast(session)) {
+		/* Same as sessiondb_get_or_create_ipv*() and tcp_established_state_handle(). */
+		expirer = set_timer(session, (tuple->l4_proto == L4PROTO_UDP)
+				? &expirer_udp
+				: &expirer_tcp_est);
+		sync_session(session, false);
+		error = 0;
+	}
+	spin_unlock(&table->lock);
+	/* Fall through. */
+
+end:
+	rcu_read_unlock_bh();
+	commit_timer(expirer);
+	return error;
+}
+
 int sessiondb_get(struct tuple *tuple, struct session_entry **result)
 {
 	struct in6_addr any = IN6ADDR_ANY_INIT;
@@ -850,29 +1430,20 @@ static bool is_set(const struct ipv6_transport_addr *addr)
 			|| addr->l4;
 }
 
-int sessiondb_add(struct session_entry *session, enum session_timer_type timer_type)
+/**
+ * Indexes "session" in "table". The caller is expected to subscribe it to a timer.
+ *
+ * "table"'s spinlock must already be held.
+ */
+static int add_locked(struct session_entry *session, struct session_table *table)
 {
-	struct session_table *table;
 	struct rb_node *parent, **node;
-	struct expire_timer *expirer;
 	int error;
 
-	/* Sanity */
-	if (WARN(!session, "Cannot insert NULL to a session table."))
-		return -EINVAL;
-	error = get_session_table(session->l4_proto, &table);
-	if (error)
-		return error;
-
-	/* Action */
-	spin_lock_bh(&table->lock);
-
 	error = rbtree_add(session, session, &table->tree6, compare_session6, struct session_entry,
 			tree6_hook);
-	if (error) {
-		spin_unlock_bh(&table->lock);
+	if (error)
 		return -EEXIST;
-	}
 
 	rbtree_find_node(session, &table->tree4, compare_session4, struct session_entry,
 			tree4_hook, parent, node);
@@ -901,31 +1472,146 @@ int sessiondb_add(struct session_entry *session, enum session_timer_type timer_t
 		rb_insert_color(&session->tree4_hook, &table->tree4);
 	}
 
+	if (is_fast(session))
+		fastpath_add(session);
+
+	session_get(session); /* We have 3 indexes, but really they count as one. */
+	list_add_snapshot(session, table);
+	table->count++;
+	return 0;
+
+index_trainwreck:
+	rb_erase(&session->tree6_hook, &table->tree6);
+	return -EEXIST;
+}
+
+int sessiondb_add(struct session_entry *session, enum session_timer_type timer_type)
+{
+	struct session_table *table;
+	struct expire_timer *expirer;
+	int error;
+
+	/* Sanity */
+	if (WARN(!session, "Cannot insert NULL to a session table."))
+		return -EINVAL;
+	error = get_session_table(session->l4_proto, &table);
+	if (error)
+		return error;
 	expirer = get_expirer(timer_type);
 	if (WARN(!expirer, "tymer_type is unknown: %d", timer_type))
 		return -EINVAL;
 
+	/* Action */
+	spin_lock_bh(&table->lock);
+
+	error = add_locked(session, table);
+	if (error) {
+		spin_unlock_bh(&table->lock);
+		return error;
+	}
 	expirer = set_timer(session, expirer);
+	sync_session(session, true);
 
-	session_get(session); /* We have 3 indexes, but really they count as one. */
-	table->count++;
 	spin_unlock_bh(&table->lock);
 
-	session_log(session, "Added session");
+	session_log(session, LOG_EVENT_SESSION_ADD);
 	commit_timer(expirer);
 
 	return 0;
+}
+
+int sessiondb_add_batch(l4_protocol l4_proto, struct session_entry **sessions,
+		enum session_timer_type *timers, unsigned int *ttls, unsigned int count,
+		bool update, __s32 *results)
+{
+	struct expire_timer *expirers[] = { &expirer_udp, &expirer_icmp, &expirer_tcp_trans,
+			&expirer_tcp_est, &expirer_syn };
+	/* Jiffy at which each timer's first session is going to die. Zero means "untouched". */
+	unsigned long next_death[ARRAY_SIZE(expirers)];
+	/* The sessions from "sessions" which were added (as opposed to updated). */
+	unsigned long *inserted;
+	struct session_table *table;
+	struct expire_timer *expirer;
+	struct session_entry *first, *existing;
+	unsigned int i;
+	int error;
+
+	error = get_session_table(l4_proto, &table);
+	if (error)
+		return error;
+
+	inserted = kcalloc(BITS_TO_LONGS(count), sizeof(*inserted), GFP_KERNEL);
+	if (!inserted)
+		return -ENOMEM;
+	memset(next_death, 0, sizeof(next_death));
+
+	spin_lock_bh(&table->lock);
+
+	for (i = 0; i < count; i++) {
+		if (!sessions[i])
+			continue;
+
+		expirer = (timers[i] < ARRAY_SIZE(expirers)) ? expirers[timers[i]] : NULL;
+		if (sessions[i]->l4_proto != l4_proto || !expirer || expirer->table != table) {
+			results[i] = -EINVAL;
+			continue;
+		}
+
+		results[i] = add_locked(sessions[i], table);
+		if (results[i] == -EEXIST && update) {
+			existing = rbtree_find(sessions[i], &table->tree6, compare_session6,
+					struct session_entry, tree6_hook);
+			if (existing) {
+				if (l4_proto == L4PROTO_TCP)
+					set_state(existing, sessions[i]->state);
+				set_timer_restored(existing, expirer, ttls[i]);
+				next_death[timers[i]] = 1;
+				results[i] = 0;
+			}
+			continue;
+		}
+		if (results[i])
+			continue;
+
+		set_timer_restored(sessions[i], expirer, ttls[i]);
+		next_death[timers[i]] = 1;
+		__set_bit(i, inserted);
+		/* The standby is not supposed to have anyone to sync to; don't bounce them back. */
+		if (!update)
+			sync_session(sessions[i], true);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(expirers); i++) {
+		if (!next_death[i])
+			continue;
+		first = list_first_entry(&expirers[i]->sessions, struct session_entry,
+				expire_list_hook);
+		next_death[i] = first->update_time + expirers[i]->get_timeout();
+		/* Zero is reserved, and one jiffy of difference is not going to hurt anyone. */
+		if (!next_death[i])
+			next_death[i] = 1;
+	}
 
-index_trainwreck:
-	rb_erase(&session->tree6_hook, &table->tree6);
 	spin_unlock_bh(&table->lock);
-	return -EEXIST;
+
+	/* Refreshed sessions were already logged when they were created. */
+	for (i = 0; i < count; i++)
+		if (test_bit(i, inserted))
+			session_log(sessions[i], LOG_EVENT_SESSION_RESTORE);
+	for (i = 0; i < ARRAY_SIZE(expirers); i++)
+		if (next_death[i])
+			schedule_timer(expirers[i], next_death[i]);
+
+	kfree(inserted);
+	return 0;
 }
 
-int sessiondb_for_each(l4_protocol l4_proto, int (*func)(struct session_entry *, void *), void *arg)
+int sessiondb_remove_batch(l4_protocol l4_proto, struct session_entry **keys, unsigned int count,
+		__s32 *results)
 {
 	struct session_table *table;
-	struct rb_node *node;
+	struct session_entry *session;
+	unsigned int i;
 	int error;
 
 	error = get_session_table(l4_proto, &table);
@@ -933,67 +1619,136 @@ int sessiondb_for_each(l4_protocol l4_proto, int (*func)(struct session_entry *,
 		return error;
 
 	spin_lock_bh(&table->lock);
-	for (node = rb_first(&table->tree4); node && !error; node = rb_next(node)) {
-		error = func(rb_entry(node, struct session_entry, tree4_hook), arg);
+
+	for (i = 0; i < count; i++) {
+		if (!keys[i])
+			continue;
+
+		session = rbtree_find(keys[i], &table->tree6, compare_session6,
+				struct session_entry, tree6_hook);
+		if (!session) {
+			results[i] = -ESRCH;
+			continue;
+		}
+
+		table->count -= remove(session, table);
+		results[i] = 0;
 	}
 
 	spin_unlock_bh(&table->lock);
+	return 0;
+}
+
+int sessiondb_for_each(l4_protocol l4_proto, int (*func)(struct session_entry *, void *), void *arg)
+{
+	struct session_table *table;
+	struct session_entry *session;
+	int error;
+
+	error = get_session_table(l4_proto, &table);
+	if (error)
+		return error;
+
+	rcu_read_lock_bh();
+	list_for_each_entry_rcu(session, &table->list, list_hook) {
+		if (!ACCESS_ONCE(session->serial))
+			continue; /* It was removed while we were looking. */
+		error = func(session, arg);
+		if (error)
+			break;
+	}
+	rcu_read_unlock_bh();
+
 	return error;
 }
 
 /**
- * See the function of the same name from the BIB DB module for comments on this.
+ * Returns the node of "table"'s snapshot list sessiondb_iterate() should continue from.
  *
- * Requires "table"'s spinlock to already be held.
+ * Must be called in an RCU-bh read-side critical section.
  */
-static struct rb_node *find_next_chunk(struct session_table *table,
-		struct ipv4_transport_addr *offset_remote,
-		struct ipv4_transport_addr *offset_local)
+static struct list_head *find_next_chunk(struct session_table *table,
+		struct sessiondb_cursor *cursor)
 {
-	struct rb_node **node, *parent;
 	struct session_entry *session;
-	struct tuple tmp;
+	struct list_head *node;
 
-	if (!offset_remote || !offset_local)
-		return rb_first(&table->tree4);
+	/*
+	 * If the session is still listed, its successor is too, or at least it was when this
+	 * critical section started. Either way, it's safe to continue from there.
+	 */
+	if (cursor->session && ACCESS_ONCE(cursor->session->serial))
+		return rcu_dereference_bh(list_next_rcu(&cursor->session->list_hook));
 
-	tmp.src.addr4 = *offset_remote;
-	tmp.dst.addr4 = *offset_local;
-	/* the protos are not needed. */
-	rbtree_find_node(&tmp, &table->tree4, compare_full4,
-			struct session_entry, tree4_hook, parent, node);
-	if (*node)
-		return rb_next(*node);
+	node = rcu_dereference_bh(list_next_rcu(&table->list));
+	if (!cursor->serial)
+		return node;
 
-	session = rb_entry(parent, struct session_entry, tree4_hook);
-	return (compare_full4(session, &tmp) < 0) ? parent : rb_next(parent);
+	/*
+	 * The session left the database between chunks, so its successor might be gone for good.
+	 * Look for the first session which was added after it. This is slow, but rare.
+	 */
+	for (; node != &table->list; node = rcu_dereference_bh(list_next_rcu(node))) {
+		session = list_entry(node, struct session_entry, list_hook);
+		if ((long) (ACCESS_ONCE(session->serial) - cursor->serial) > 0)
+			break;
+	}
+
+	return node;
 }
 
-int sessiondb_iterate_by_ipv4(l4_protocol l4_proto,
-		int (*func)(struct session_entry *, void *), void *arg,
-		struct ipv4_transport_addr *offset_remote,
-		struct ipv4_transport_addr *offset_local)
+int sessiondb_iterate(l4_protocol l4_proto, int (*func)(struct session_entry *, void *), void *arg,
+		struct sessiondb_cursor *cursor)
 {
 	struct session_table *table;
-	struct rb_node *node;
 	struct session_entry *session;
+	struct session_entry *last = NULL;
+	struct session_entry *old_cursor = cursor->session;
+	struct list_head *node;
+	unsigned long serial, last_serial = 0;
 	int error;
 
 	error = get_session_table(l4_proto, &table);
 	if (error)
 		return error;
 
-	spin_lock_bh(&table->lock);
-	node = find_next_chunk(table, offset_remote, offset_local);
-	for (; node && !error; node = rb_next(node)) {
-		session = rb_entry(node, struct session_entry, tree4_hook);
+	rcu_read_lock_bh();
+
+	node = find_next_chunk(table, cursor);
+	for (; node != &table->list; node = rcu_dereference_bh(list_next_rcu(node))) {
+		session = list_entry(node, struct session_entry, list_hook);
+		serial = ACCESS_ONCE(session->serial);
+		if (!serial)
+			continue; /* It was removed while we were looking. */
+
 		error = func(session, arg);
+		if (error)
+			break;
+
+		last = session;
+		last_serial = serial;
 	}
 
-	spin_unlock_bh(&table->lock);
+	if (last) {
+		/* If the session is dying, the serial alone will have to do. */
+		cursor->session = kref_get_unless_zero_compat(&last->refcounter) ? last : NULL;
+		cursor->serial = last_serial;
+	}
+
+	rcu_read_unlock_bh();
+
+	if (last && old_cursor)
+		session_return(old_cursor);
 	return error;
 }
 
+void sessiondb_cursor_release(struct sessiondb_cursor *cursor)
+{
+	if (cursor->session)
+		session_return(cursor->session);
+	cursor->session = NULL;
+}
+
 int sessiondb_count(l4_protocol proto, __u64 *result)
 {
 	struct session_table *table;
@@ -1079,8 +1834,12 @@ int sessiondb_get_or_create_ipv6(struct tuple *tuple6, struct bib_entry *bib,
 		goto fail;
 	}
 
+	if (is_fast(*session))
+		fastpath_add(*session);
+
+	list_add_snapshot(*session, table);
 	table->count++;
-	session_log(*session, "Added session");
+	session_log(*session, LOG_EVENT_SESSION_ADD);
 	/* Fall through. */
 
 success:
@@ -1098,6 +1857,7 @@ success:
 	}
 
 	expirer = set_timer(*session, expirer);
+	sync_session(*session, false);
 	/* We gotta do this for our caller, because it has to be done before the unlock. */
 	session_get(*session);
 
@@ -1180,8 +1940,12 @@ int sessiondb_get_or_create_ipv4(struct tuple *tuple4, struct bib_entry *bib,
 		goto fail;
 	}
 
+	if (is_fast(*session))
+		fastpath_add(*session);
+
+	list_add_snapshot(*session, table);
 	table->count++;
-	session_log(*session, "Added session");
+	session_log(*session, LOG_EVENT_SESSION_ADD);
 	/* Fall through. */
 
 success:
@@ -1199,6 +1963,7 @@ success:
 	}
 
 	expirer = set_timer(*session, expirer);
+	sync_session(*session, false);
 	/* We gotta do this for our caller, because it has to be done before the unlock. */
 	session_get(*session);
 
@@ -1346,7 +2111,7 @@ static int tcp_v4_init_state_handle(struct packet *pkt, struct session_entry *se
 {
 	if (pkt_l3_proto(pkt) == L3PROTO_IPV6 && pkt_tcp_hdr(pkt)->syn) {
 		*expirer = set_timer(session, &expirer_tcp_est);
-		session->state = ESTABLISHED;
+		set_state(session, ESTABLISHED);
 	} /* else, the state remains unchanged. */
 
 	return 0;
@@ -1363,7 +2128,7 @@ static int tcp_v6_init_state_handle(struct packet *pkt, struct session_entry *se
 		switch (pkt_l3_proto(pkt)) {
 		case L3PROTO_IPV4:
 			*expirer = set_timer(session, &expirer_tcp_est);
-			session->state = ESTABLISHED;
+			set_state(session, ESTABLISHED);
 			break;
 		case L3PROTO_IPV6:
 			*expirer = set_timer(session, &expirer_tcp_trans);
@@ -1384,16 +2149,16 @@ static int tcp_established_state_handle(struct packet *pkt, struct session_entry
 	if (pkt_tcp_hdr(pkt)->fin) {
 		switch (pkt_l3_proto(pkt)) {
 		case L3PROTO_IPV4:
-			session->state = V4_FIN_RCV;
+			set_state(session, V4_FIN_RCV);
 			break;
 		case L3PROTO_IPV6:
-			session->state = V6_FIN_RCV;
+			set_state(session, V6_FIN_RCV);
 			break;
 		}
 
 	} else if (pkt_tcp_hdr(pkt)->rst) {
 		*expirer = set_timer(session, &expirer_tcp_trans);
-		session->state = TRANS;
+		set_state(session, TRANS);
 	} else {
 		*expirer = set_timer(session, &expirer_tcp_est);
 	}
@@ -1452,7 +2217,7 @@ static int tcp_trans_state_handle(struct packet *pkt, struct session_entry *sess
 {
 	if (!pkt_tcp_hdr(pkt)->rst) {
 		*expirer = set_timer(session, &expirer_tcp_est);
-		session->state = ESTABLISHED;
+		set_state(session, ESTABLISHED);
 	}
 
 	return 0;
@@ -1461,10 +2226,15 @@ static int tcp_trans_state_handle(struct packet *pkt, struct session_entry *sess
 int sessiondb_tcp_state_machine(struct packet *pkt, struct session_entry *session)
 {
 	struct expire_timer *expirer = NULL;
+	struct expire_timer *old_expirer;
+	u_int8_t old_state;
 	int error;
 
 	spin_lock(&session_table_tcp.lock);
 
+	old_expirer = session->expirer;
+	old_state = session->state;
+
 	switch (session->state) {
 	case V4_INIT:
 		error = tcp_v4_init_state_handle(pkt, session, &expirer);
@@ -1496,6 +2266,10 @@ int sessiondb_tcp_state_machine(struct packet *pkt, struct session_entry *sessio
 		error = -EINVAL;
 	}
 
+	if (!error && session->expirer)
+		sync_session(session, session->state != old_state
+				|| session->expirer != old_expirer);
+
 	spin_unlock(&session_table_tcp.lock);
 
 	commit_timer(expirer);
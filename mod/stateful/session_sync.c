@@ -0,0 +1,68 @@
+#include "nat64/mod/stateful/session_sync.h"
+#include "nat64/mod/common/event_ring.h"
+#include "nat64/mod/common/types.h"
+
+/** Number of records each CPU can queue. 128 kilobytes per CPU. */
+#define RING_CAPACITY (1 << 11)
+
+static struct event_ring ring;
+
+/** What sessionsync_drain() was asked to do. */
+struct drain_args {
+	int (*func)(struct session_record_usr *, void *);
+	void *arg;
+};
+
+
+int sessionsync_init(void)
+{
+	int error;
+
+	error = evring_init(&ring, sizeof(struct session_record_usr), RING_CAPACITY);
+	if (error)
+		log_err("Could not allocate the session synchronization rings.");
+
+	return error;
+}
+
+void sessionsync_destroy(void)
+{
+	evring_destroy(&ring);
+}
+
+void sessionsync_add(struct session_record_usr *record)
+{
+	evring_add(&ring, record);
+}
+
+/**
+ * Some events were lost, so tells the daemon the peer needs the full tables.
+ */
+static int report_drops(unsigned int cpu, unsigned long count, void *void_args)
+{
+	struct drain_args *args = void_args;
+	struct session_record_usr resync;
+	int error;
+
+	memset(&resync, 0, sizeof(resync));
+	resync.flags = SESSION_RECORD_RESYNC;
+	error = args->func(&resync, args->arg);
+	if (error)
+		return error;
+
+	log_info("CPU %u dropped %lu session sync events; the standby needs a full resync.", cpu,
+			count);
+	return 0;
+}
+
+static int report_record(void *record, void *void_args)
+{
+	struct drain_args *args = void_args;
+	return args->func(record, args->arg);
+}
+
+int sessionsync_drain(int (*func)(struct session_record_usr *, void *), void *arg)
+{
+	struct drain_args args = { .func = func, .arg = arg };
+	return evring_drain(&ring, report_drops, report_record, &args);
+}
@@ -54,6 +54,269 @@ bib_error:
 	return error;
 }
 
+int add_static_routes(l4_protocol l4_proto, struct bib_entry_usr *entries, unsigned int count,
+		__s32 *results)
+{
+	struct bib_entry **bibs;
+	unsigned int i;
+	int error;
+
+	bibs = kcalloc(count, sizeof(*bibs), GFP_KERNEL);
+	if (!bibs)
+		return -ENOMEM;
+
+	/* Reserve the IPv4 transport addresses and allocate the entries outside of the BIB lock. */
+	for (i = 0; i < count; i++) {
+		error = pool4_get(l4_proto, &entries[i].addr4);
+		if (error) {
+			results[i] = error;
+			continue;
+		}
+
+		bibs[i] = bib_create(&entries[i].addr4, &entries[i].addr6, true, l4_proto);
+		if (!bibs[i]) {
+			pool4_return(l4_proto, &entries[i].addr4);
+			results[i] = -ENOMEM;
+			continue;
+		}
+
+		results[i] = 0;
+	}
+
+	error = bibdb_add_batch(l4_proto, bibs, count, results);
+
+	/* As in add_static_route(), the successful ones keep their fake user. */
+	for (i = 0; i < count; i++) {
+		if (bibs[i] && error)
+			results[i] = error;
+		if (bibs[i] && results[i]) {
+			bib_kfree(bibs[i]);
+			pool4_return(l4_proto, &entries[i].addr4);
+		}
+	}
+
+	kfree(bibs);
+	return error;
+}
+
+/**
+ * Returns in "result" the BIB entry "record" belongs to, creating it if it doesn't exist.
+ * The caller gets a reference to it.
+ */
+static int restore_bib(l4_protocol l4_proto, struct session_record_usr *record,
+		struct bib_entry **result)
+{
+	struct bib_entry *bib;
+	bool is_static = record->flags & SESSION_RECORD_STATIC_BIB;
+	int error;
+
+	error = bibdb_get_by_ipv6(&record->remote6, l4_proto, &bib);
+	if (!error) {
+		if (!ipv4_transport_addr_equals(&bib->ipv4, &record->local4)) {
+			bib_return(bib);
+			return -EEXIST;
+		}
+		if (is_static && !bib->is_static) {
+			bib_get(bib); /* The fake user; see add_static_route(). */
+			bib->is_static = true;
+		}
+		*result = bib;
+		return 0;
+	}
+	if (error != -ESRCH)
+		return error;
+
+	error = pool4_get(l4_proto, &record->local4);
+	if (error)
+		return error;
+
+	bib = bib_create(&record->local4, &record->remote6, is_static, l4_proto);
+	if (!bib) {
+		pool4_return(l4_proto, &record->local4);
+		return -ENOMEM;
+	}
+
+	error = bibdb_add(bib);
+	if (error) {
+		bib_kfree(bib);
+		return error;
+	}
+
+	/* If it's static, bib_create()'s reference is the fake user, so the caller needs another. */
+	if (is_static)
+		bib_get(bib);
+
+	*result = bib;
+	return 0;
+}
+
+/**
+ * Returns whether "record" is a session which can be subscribed to its timer.
+ */
+static bool is_restorable(l4_protocol l4_proto, struct session_record_usr *record)
+{
+	switch (l4_proto) {
+	case L4PROTO_UDP:
+		return record->timer == SESSIONTIMER_UDP;
+	case L4PROTO_ICMP:
+		return record->timer == SESSIONTIMER_ICMP;
+	case L4PROTO_TCP:
+		/*
+		 * SYN sessions exist to send an ICMP error when they die, and the packet the error
+		 * is based on cannot be restored.
+		 */
+		return (record->timer == SESSIONTIMER_EST || record->timer == SESSIONTIMER_TRANS)
+				&& record->state != CLOSED && record->state <= TRANS;
+	case L4PROTO_OTHER:
+		break;
+	}
+
+	return false;
+}
+
+/**
+ * Adds (or, if "update" is true, also refreshes) the sessions from "records".
+ */
+static int restore_run(l4_protocol l4_proto, struct session_record_usr *records,
+		unsigned int count, bool update, __s32 *results)
+{
+	struct bib_entry **bibs;
+	struct session_entry **sessions;
+	enum session_timer_type *timers;
+	unsigned int *ttls;
+	unsigned int i;
+	int error = -ENOMEM;
+
+	bibs = kcalloc(count, sizeof(*bibs), GFP_KERNEL);
+	sessions = kcalloc(count, sizeof(*sessions), GFP_KERNEL);
+	timers = kcalloc(count, sizeof(*timers), GFP_KERNEL);
+	ttls = kcalloc(count, sizeof(*ttls), GFP_KERNEL);
+	if (!bibs || !sessions || !timers || !ttls)
+		goto end;
+
+	/* The BIB entries are few compared to the sessions, so they go one by one. */
+	for (i = 0; i < count; i++) {
+		struct session_record_usr *record = &records[i];
+
+		if (record->l4_proto != l4_proto) {
+			results[i] = -EINVAL;
+			continue;
+		}
+		if (!(record->flags & SESSION_RECORD_BIB_ONLY) && !is_restorable(l4_proto, record)) {
+			results[i] = -EINVAL;
+			continue;
+		}
+
+		results[i] = restore_bib(l4_proto, record, &bibs[i]);
+		if (results[i] || (record->flags & SESSION_RECORD_BIB_ONLY))
+			continue;
+
+		sessions[i] = session_create(&record->remote6, &record->local6, &record->local4,
+				&record->remote4, l4_proto, bibs[i]);
+		if (!sessions[i]) {
+			results[i] = -ENOMEM;
+			continue;
+		}
+		sessions[i]->state = record->state;
+		timers[i] = record->timer;
+		ttls[i] = record->ttl;
+	}
+
+	/* The sessions, on the other hand, are locked in. */
+	error = sessiondb_add_batch(l4_proto, sessions, timers, ttls, count, update, results);
+
+	for (i = 0; i < count; i++) {
+		if (sessions[i]) {
+			if (error)
+				results[i] = error;
+			session_return(sessions[i]);
+		}
+		/* Dynamic BIB entries whose sessions could not be added die here. */
+		if (bibs[i])
+			bib_return(bibs[i]);
+	}
+	/* Fall through. */
+
+end:
+	kfree(ttls);
+	kfree(timers);
+	kfree(sessions);
+	kfree(bibs);
+	return error;
+}
+
+/**
+ * Removes the sessions from "records". Their BIB entries die with their last session, as usual.
+ */
+static int forget_run(l4_protocol l4_proto, struct session_record_usr *records,
+		unsigned int count, __s32 *results)
+{
+	struct session_entry **keys;
+	unsigned int i;
+	int error;
+
+	keys = kcalloc(count, sizeof(*keys), GFP_KERNEL);
+	if (!keys)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		struct session_record_usr *record = &records[i];
+
+		if (record->l4_proto != l4_proto) {
+			results[i] = -EINVAL;
+			continue;
+		}
+
+		keys[i] = session_create(&record->remote6, &record->local6, &record->local4,
+				&record->remote4, l4_proto, NULL);
+		if (!keys[i])
+			results[i] = -ENOMEM;
+	}
+
+	error = sessiondb_remove_batch(l4_proto, keys, count, results);
+
+	for (i = 0; i < count; i++) {
+		if (keys[i]) {
+			if (error)
+				results[i] = error;
+			session_return(keys[i]);
+		}
+	}
+
+	kfree(keys);
+	return error;
+}
+
+int restore_sessions(l4_protocol l4_proto, struct session_record_usr *records, unsigned int count,
+		bool sync, __s32 *results)
+{
+	unsigned int start, end;
+	bool removed;
+	int error;
+
+	if (!sync)
+		return restore_run(l4_proto, records, count, false, results);
+
+	/* Additions and removals have to be applied in the order they happened. */
+	for (start = 0; start < count; start = end) {
+		removed = records[start].flags & SESSION_RECORD_REMOVED;
+		for (end = start + 1; end < count; end++)
+			if (!!(records[end].flags & SESSION_RECORD_REMOVED) != removed)
+				break;
+
+		if (removed)
+			error = forget_run(l4_proto, &records[start], end - start,
+					&results[start]);
+		else
+			error = restore_run(l4_proto, &records[start], end - start, true,
+					&results[start]);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
 int delete_static_route(struct request_bib *req)
 {
 	struct bib_entry *bib;
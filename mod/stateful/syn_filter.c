@@ -0,0 +1,164 @@
+#include "nat64/mod/stateful/syn_filter.h"
+#include "nat64/common/constants.h"
+#include "nat64/mod/common/random.h"
+
+#include <linux/bitmap.h>
+#include <linux/jhash.h>
+#include <linux/jiffies.h>
+#include <linux/log2.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+
+/** Default size of each generation, in bits. 8 kilobytes each. */
+#define GENERATION_DEFAULT_BITS (1 << 16)
+/** Upper limit to the size the user can request. 32 megabytes each. */
+#define GENERATION_MAX_BITS (1 << 28)
+/** Number of bits each SYN sets. */
+#define HASH_COUNT 3
+
+/**
+ * The filter. One of the generations receives the new SYNs, the other one only remembers the ones
+ * from the previous period.
+ */
+static unsigned long *generations[2];
+/** Size of each generation, in bits. Always a power of two. */
+static unsigned int generation_bits;
+/** Index of the generation that is currently receiving new SYNs. */
+static unsigned int current_gen;
+/** Jiffy at which the oldest generation will be forgotten. */
+static unsigned long rotation_time;
+/** Serializes rotations. Additions and queries do not need it. */
+static DEFINE_SPINLOCK(rotation_lock);
+
+/** Random hash seed; see fragment_db.c. */
+static u32 rnd;
+
+
+static unsigned long get_period(void)
+{
+	return msecs_to_jiffies(1000 * TCP_INCOMING_SYN);
+}
+
+/**
+ * Computes the indexes of the bits that represent "remote4" and "local4" in each generation.
+ */
+static void compute_bits(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4,
+		unsigned int *bits)
+{
+	u32 ports = (((u32) remote4->l4) << 16) | local4->l4;
+	u32 hash1, hash2;
+	unsigned int i;
+
+	/* Kirsch and Mitzenmacher: two hashes are enough to simulate any number of them. */
+	hash1 = jhash_3words(remote4->l3.s_addr, local4->l3.s_addr, ports, rnd);
+	hash2 = jhash_3words(remote4->l3.s_addr, local4->l3.s_addr, ports, hash1);
+
+	for (i = 0; i < HASH_COUNT; i++)
+		bits[i] = (hash1 + i * hash2) & (generation_bits - 1);
+}
+
+/**
+ * Forgets the oldest generation if its time has come.
+ */
+static void rotate(void)
+{
+	unsigned long now = jiffies;
+	unsigned int old_gen;
+
+	if (time_before(now, ACCESS_ONCE(rotation_time)))
+		return;
+
+	spin_lock_bh(&rotation_lock);
+
+	if (time_before(now, rotation_time)) {
+		/* Somebody else did it while we were waiting. */
+		spin_unlock_bh(&rotation_lock);
+		return;
+	}
+
+	old_gen = !current_gen;
+	bitmap_zero(generations[old_gen], generation_bits);
+	/* If nothing happened during a whole period, the current generation is stale as well. */
+	if (!time_before(now, rotation_time + get_period()))
+		bitmap_zero(generations[current_gen], generation_bits);
+
+	/* The new generation has to look empty before anyone starts adding to it. */
+	smp_wmb();
+	ACCESS_ONCE(current_gen) = old_gen;
+	ACCESS_ONCE(rotation_time) = now + get_period();
+
+	spin_unlock_bh(&rotation_lock);
+}
+
+static bool generation_contains(unsigned int gen, unsigned int *bits)
+{
+	unsigned int i;
+
+	for (i = 0; i < HASH_COUNT; i++)
+		if (!test_bit(bits[i], generations[gen]))
+			return false;
+
+	return true;
+}
+
+int synfilter_init(unsigned int size)
+{
+	unsigned int i;
+
+	if (!size)
+		size = GENERATION_DEFAULT_BITS;
+	if (size > GENERATION_MAX_BITS) {
+		log_err("The SYN filter cannot have more than %u bits.", GENERATION_MAX_BITS);
+		return -EINVAL;
+	}
+	generation_bits = roundup_pow_of_two(size);
+
+	for (i = 0; i < ARRAY_SIZE(generations); i++) {
+		generations[i] = vmalloc(BITS_TO_LONGS(generation_bits) * sizeof(unsigned long));
+		if (!generations[i]) {
+			synfilter_destroy();
+			log_err("Could not allocate the SYN filter.");
+			return -ENOMEM;
+		}
+		bitmap_zero(generations[i], generation_bits);
+	}
+
+	current_gen = 0;
+	rotation_time = jiffies + get_period();
+	rnd = get_random_u32();
+	return 0;
+}
+
+void synfilter_destroy(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(generations); i++) {
+		vfree(generations[i]);
+		generations[i] = NULL;
+	}
+}
+
+void synfilter_add(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4)
+{
+	unsigned int bits[HASH_COUNT];
+	unsigned int gen;
+	unsigned int i;
+
+	rotate();
+	compute_bits(remote4, local4, bits);
+
+	gen = ACCESS_ONCE(current_gen);
+	for (i = 0; i < HASH_COUNT; i++)
+		set_bit(bits[i], generations[gen]);
+}
+
+bool synfilter_contains(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4)
+{
+	unsigned int bits[HASH_COUNT];
+
+	rotate();
+	compute_bits(remote4, local4, bits);
+
+	return generation_contains(0, bits) || generation_contains(1, bits);
+}
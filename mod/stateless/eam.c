@@ -1,17 +1,22 @@
 #include "nat64/mod/stateless/eam.h"
 
+#include <linux/kernel.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
 #include <net/ipv6.h>
 
+#include "nat64/mod/common/address.h"
 #include "nat64/mod/common/rbtree.h"
+#include "nat64/mod/common/trie.h"
 #include "nat64/mod/common/types.h"
 
 /**
  * @author Daniel Hdz Felix
  * @author Alberto Leiva
  *
- * TODO (performance) This data structure doesn't receive updates constantly so RCU should perform
- * much better than the spinlock.
- * Also review the tree... a hash table might be better.
+ * The entries are indexed twice per protocol. The trees keep them sorted and are used by the
+ * control plane (adding, removing, listing). The tries are what the packet path uses to find the
+ * entry an address belongs to; they can be read without locking.
  */
 
 struct eam_db {
@@ -19,11 +24,25 @@ struct eam_db {
 	struct rb_root EAMT_tree6;
 	/** Indexes the entries using their IPv4 identifiers. */
 	struct rb_root EAMT_tree4;
+	/** Indexes the entries using their IPv6 prefixes, for address lookups. */
+	struct trie trie6;
+	/** Indexes the entries using their IPv4 prefixes, for address lookups. */
+	struct trie trie4;
 	/* Number of entries in this table. */
 	u64 count;
 };
 
-static struct eam_db eam_table;
+/**
+ * The table the packet path is using.
+ */
+static struct eam_db __rcu *eam_table;
+
+/**
+ * While a configuration transaction is open, changes go to "candidate" instead of "eam_table".
+ * "candidate" is only created once the transaction actually changes something.
+ */
+static bool txn_open;
+static struct eam_db *candidate;
 
 /* The maximum network length for IPv4. */
 static const __u8 IPV4_PREFIX = 32;
@@ -34,9 +53,11 @@ static const __u8 IPV6_PREFIX = 128;
 static const __u32 IN_ADDR_FULL = INADDR_BROADCAST;
 
 /**
- * Lock to sync access. This protects both the trees and the entries.
+ * Lock to sync writers, and readers of the trees. This protects the trees, the tries' structure,
+ * the count and the table pointers.
+ * Readers of the tries only need rcu_read_lock_bh().
  */
-static DEFINE_SPINLOCK(eam_lock);
+static DEFINE_MUTEX(eam_mutex);
 
 /** Cache for struct eam_entries, for efficient allocation. */
 static struct kmem_cache *entry_cache;
@@ -46,6 +67,20 @@ static void eam_kfree(struct eam_entry *entry)
 	kmem_cache_free(entry_cache, entry);
 }
 
+static void eam_free_rcu(struct rcu_head *rcu)
+{
+	eam_kfree(container_of(rcu, struct eam_entry, rcu));
+}
+
+/**
+ * Releases "entry" once the packet path can no longer be looking at it. Use this instead of
+ * eam_kfree() for entries which might have reached a published trie.
+ */
+static void eam_kfree_rcu(struct eam_entry *entry)
+{
+	call_rcu_bh(&entry->rcu, eam_free_rcu);
+}
+
 /**
  *	Verify if the IPv4 prefix and the IPv6 prefix have the same network length.
  */
@@ -69,16 +104,54 @@ static int validate_prefixes(struct ipv6_prefix *pref6, struct ipv4_prefix *pref
 	return 0;
 }
 
+/**
+ * Precomputes the parameters that translate addresses through "entry".
+ *
+ * The IPv4 suffix (the last 32 - pref4.len bits of the IPv4 address) is copied right after
+ * pref6, so its least significant bit lands "shift" bits away from the end of the IPv6 address.
+ * Depending on "shift", the suffix lands on the "hi" half, the "lo" half, or straddles them.
+ * Rather than branching on that for every packet, the shifts are chosen so the half which doesn't
+ * receive anything gets zero:
+ *
+ * - Suffixes are 32 bits wide at most, so right-shifting them 32 positions yields zero, and
+ *   left-shifting an IPv6 half 32 positions leaves nothing under the suffix mask.
+ * - "lo_mask" cancels the "lo" half out when the suffix lies entirely on "hi".
+ */
+static void compute_xlat(struct eam_entry *entry)
+{
+	unsigned int suffix_len = IPV4_PREFIX - entry->pref4.len;
+	unsigned int shift = IPV6_PREFIX - entry->pref6.len - suffix_len;
+
+	entry->xlat.prefix6_hi = addr6_get_hi(&entry->pref6.address);
+	entry->xlat.prefix6_lo = addr6_get_lo(&entry->pref6.address);
+	entry->xlat.prefix4 = be32_to_cpu(entry->pref4.address.s_addr);
+	entry->xlat.suffix_mask = (1ULL << suffix_len) - 1;
+
+	if (shift >= 64) {
+		/* (63 only matters when both prefixes are silly and the suffix is empty.) */
+		entry->xlat.hi_left = min(shift - 64, 63U);
+		entry->xlat.hi_right = 0;
+		entry->xlat.lo_shift = 0;
+		entry->xlat.lo_mask = 0;
+	} else {
+		entry->xlat.hi_left = 0;
+		entry->xlat.hi_right = min(64 - shift, 32U);
+		entry->xlat.lo_shift = shift;
+		entry->xlat.lo_mask = ~0ULL;
+	}
+}
+
 static struct eam_entry *eamt_create_entry(struct ipv6_prefix *ip6, struct ipv4_prefix *ip4)
 {
 	struct eam_entry *entry;
 
-	entry = kmem_cache_alloc(entry_cache, GFP_ATOMIC);
+	entry = kmem_cache_alloc(entry_cache, GFP_KERNEL);
 	if (!entry)
 		return NULL;
 
 	entry->pref4 = *ip4;
 	entry->pref6 = *ip6;
+	compute_xlat(entry);
 	RB_CLEAR_NODE(&entry->tree4_hook);
 	RB_CLEAR_NODE(&entry->tree6_hook);
 
@@ -153,21 +226,176 @@ static int compare_prefix4(struct eam_entry *entry, struct ipv4_prefix *prefix4)
 	return gap;
 }
 
-static int eam_remove(struct eam_entry *entry, struct eam_db *table)
+/**
+ * Withdraws "entry" from all of "table"'s indexes.
+ * The packet path might still be looking at "entry", so release it through eam_kfree_rcu().
+ */
+static void eam_remove(struct eam_entry *entry, struct eam_db *table)
 {
+	trie_remove(&table->trie6, &entry->pref6.address, entry->pref6.len, entry);
+	trie_remove(&table->trie4, &entry->pref4.address, entry->pref4.len, entry);
+
 	if (!RB_EMPTY_NODE(&entry->tree6_hook))
 		rb_erase(&entry->tree6_hook, &table->EAMT_tree6);
 	if (!RB_EMPTY_NODE(&entry->tree4_hook))
 		rb_erase(&entry->tree4_hook, &table->EAMT_tree4);
+}
+
+/**
+ * Indexes "eam" in all of the table's indexes and publishes it to the packet path.
+ * Assumes eam_mutex is held. Does not release "eam" on failure, but the packet path might have
+ * seen it anyway, so use eam_kfree_rcu().
+ */
+static int eam_insert(struct eam_db *table, struct eam_entry *eam)
+{
+	struct rb_node **node, *parent;
+	int error;
+
+	rbtree_find_node(&eam->pref6, &table->EAMT_tree6, compare_prefix6, struct eam_entry,
+			tree6_hook, parent, node);
+	if (*node) {
+		log_debug("IPv6 Prefix %pI6c/%u already exist in the database.",
+				&eam->pref6.address, eam->pref6.len);
+		return -EEXIST;
+	}
+
+	/* Index it by IPv6. We already have the slot, so we don't need to do another rbtree_find(). */
+	rb_link_node(&eam->tree6_hook, parent, node);
+	rb_insert_color(&eam->tree6_hook, &table->EAMT_tree6);
+
+	/* Index it by IPv4. */
+	error = rbtree_add(eam, &eam->pref4, &table->EAMT_tree4, compare_prefix4,
+			struct eam_entry, tree4_hook);
+	if (error) {
+		rb_erase(&eam->tree6_hook, &table->EAMT_tree6);
+		log_debug("IPv4 Prefix %pI4/%u already exists in the database.",
+				&eam->pref4.address, eam->pref4.len);
+		return error;
+	}
+
+	/* Publish it to the packet path. */
+	error = trie_add(&table->trie6, &eam->pref6.address, eam->pref6.len, eam);
+	if (error)
+		goto trie_fail;
+	error = trie_add(&table->trie4, &eam->pref4.address, eam->pref4.len, eam);
+	if (error) {
+		trie_remove(&table->trie6, &eam->pref6.address, eam->pref6.len, eam);
+		goto trie_fail;
+	}
+
+	table->count++;
+	return 0;
+
+trie_fail:
+	rb_erase(&eam->tree4_hook, &table->EAMT_tree4);
+	rb_erase(&eam->tree6_hook, &table->EAMT_tree6);
+	log_debug("Entry %pI6c/%u - %pI4/%u overlaps with an existing one.", &eam->pref6.address,
+			eam->pref6.len, &eam->pref4.address, eam->pref4.len);
+	return error;
+}
 
-	return 1;
+static void eamt_destroy_aux(struct rb_node *node)
+{
+	eam_kfree(rb_entry(node, struct eam_entry, tree6_hook));
 }
 
-int eamt_add(struct ipv6_prefix *ip6_pref, struct ipv4_prefix *ip4_pref)
+static struct eam_db *table_alloc(void)
 {
+	struct eam_db *table;
+
+	table = kmalloc(sizeof(*table), GFP_KERNEL);
+	if (!table)
+		return NULL;
+
+	table->EAMT_tree4 = RB_ROOT;
+	table->EAMT_tree6 = RB_ROOT;
+	trie_init(&table->trie6, sizeof(struct in6_addr));
+	trie_init(&table->trie4, sizeof(struct in_addr));
+	table->count = 0;
+
+	return table;
+}
+
+/**
+ * Releases "table" and its entries. Nobody can be reading it anymore.
+ */
+static void table_free(struct eam_db *table)
+{
+	if (!table)
+		return;
+
+	trie_destroy(&table->trie6);
+	trie_destroy(&table->trie4);
+	/*
+	 * The values need to be released only in one of the trees
+	 * because both of them point to the same values.
+	 */
+	rbtree_clear(&table->EAMT_tree6, eamt_destroy_aux);
+	kfree(table);
+}
+
+/**
+ * Returns the table the control plane should see. Assumes eam_mutex is held.
+ */
+static struct eam_db *live_table(void)
+{
+	return rcu_dereference_protected(eam_table, true);
+}
+
+/**
+ * Returns the table writers should edit: "candidate" if there's a transaction, "eam_table"
+ * otherwise. Assumes eam_mutex is held.
+ */
+static int get_writable_table(struct eam_db **result)
+{
+	struct rb_node *node;
+	struct eam_entry *old, *new;
 	int error;
+
+	if (!txn_open) {
+		*result = live_table();
+		return 0;
+	}
+
+	if (!candidate) {
+		candidate = table_alloc();
+		if (!candidate)
+			return -ENOMEM;
+
+		for (node = rb_first(&live_table()->EAMT_tree4); node; node = rb_next(node)) {
+			old = rb_entry(node, struct eam_entry, tree4_hook);
+			new = eamt_create_entry(&old->pref6, &old->pref4);
+			error = new ? eam_insert(candidate, new) : -ENOMEM;
+			if (error) {
+				if (new)
+					eam_kfree(new);
+				table_free(candidate);
+				candidate = NULL;
+				return error;
+			}
+		}
+	}
+
+	*result = candidate;
+	return 0;
+}
+
+/**
+ * Makes "new" the table the packet path sees, and returns the old one.
+ * Assumes eam_mutex is held. The caller has to wait for a grace period before releasing the result.
+ */
+static struct eam_db *table_replace(struct eam_db *new)
+{
+	struct eam_db *old = live_table();
+	rcu_assign_pointer(eam_table, new);
+	return old;
+}
+
+int eamt_add(struct ipv6_prefix *ip6_pref, struct ipv4_prefix *ip4_pref)
+{
+	struct eam_db *table;
 	struct eam_entry *eam;
-	struct rb_node **node, *parent;
+	int error;
 
 	if (!ip6_pref || !ip4_pref) {
 		log_err("ip6_prefix or ipv4 can't be NULL");
@@ -181,56 +409,83 @@ int eamt_add(struct ipv6_prefix *ip6_pref, struct ipv4_prefix *ip4_pref)
 	log_debug("Inserting address mapping to the db: %pI6c/%u - %pI4/%u", &ip6_pref->address,
 			ip6_pref->len, &ip4_pref->address, ip4_pref->len);
 
-	spin_lock_bh(&eam_lock);
-	rbtree_find_node(ip6_pref, &eam_table.EAMT_tree6, compare_prefix6, struct eam_entry, tree6_hook,
-			parent, node);
-	if (*node) {
-		spin_unlock_bh(&eam_lock);
-		log_debug("IPv6 Prefix %pI6c/%u already exist in the database.", &ip6_pref->address, ip6_pref->len);
-		return -EEXIST;
-	}
-
-	/* The eam_entry is not on the table, so create it. */
 	eam = eamt_create_entry(ip6_pref, ip4_pref);
-	if (!eam) {
-		spin_unlock_bh(&eam_lock);
+	if (!eam)
 		return -ENOMEM;
-	}
 
-	/* Index it by IPv6. We already have the slot, so we don't need to do another rbtree_find(). */
-	rb_link_node(&eam->tree6_hook, parent, node);
-	rb_insert_color(&eam->tree6_hook, &eam_table.EAMT_tree6);
+	mutex_lock(&eam_mutex);
+	error = get_writable_table(&table);
+	if (!error)
+		error = eam_insert(table, eam);
+	mutex_unlock(&eam_mutex);
 
-	/* Index it by IPv4. */
-	error = rbtree_add(eam, &eam->pref4, &eam_table.EAMT_tree4, compare_prefix4, struct eam_entry,
-			tree4_hook);
 	if (error) {
-		rb_erase(&eam->tree6_hook, &eam_table.EAMT_tree6);
-		spin_unlock_bh(&eam_lock);
-		log_err("IPv4 Prefix %pI4/%u could not be added to the database. Maybe an entry with the "
-				"same IPv4 Prefix and different IPv6 Prefix already exists?", &eam->pref4.address,
-				eam->pref4.len);
-		eam_kfree(eam);
-		return error;
+		if (error == -EEXIST)
+			log_err("Entry %pI6c/%u - %pI4/%u collides or overlaps with an existing "
+					"one.", &ip6_pref->address, ip6_pref->len,
+					&ip4_pref->address, ip4_pref->len);
+		eam_kfree_rcu(eam);
 	}
 
-	eam_table.count++;
-	spin_unlock_bh(&eam_lock);
+	return error;
+}
+
+int eamt_add_batch(struct eam_entry_usr *entries, unsigned int count, __s32 *results)
+{
+	struct eam_db *table;
+	struct eam_entry **eams;
+	unsigned int i;
+	int error;
+
+	eams = kcalloc(count, sizeof(*eams), GFP_KERNEL);
+	if (!eams)
+		return -ENOMEM;
+
+	/* Validate and allocate without the lock; nobody else can see these yet. */
+	for (i = 0; i < count; i++) {
+		error = validate_prefixes(&entries[i].pref6, &entries[i].pref4);
+		if (!error) {
+			eams[i] = eamt_create_entry(&entries[i].pref6, &entries[i].pref4);
+			if (!eams[i])
+				error = -ENOMEM;
+		}
+		results[i] = error;
+	}
+
+	mutex_lock(&eam_mutex);
+	error = get_writable_table(&table);
+	for (i = 0; i < count; i++)
+		if (eams[i])
+			results[i] = error ? error : eam_insert(table, eams[i]);
+	mutex_unlock(&eam_mutex);
+
+	for (i = 0; i < count; i++)
+		if (eams[i] && results[i])
+			eam_kfree_rcu(eams[i]);
+
+	kfree(eams);
 	return 0;
 }
 
 int eamt_remove(struct ipv6_prefix *prefix6, struct ipv4_prefix *prefix4)
 {
-	int count;
+	struct eam_db *table;
 	struct eam_entry *eam;
+	int error;
 
-	spin_lock_bh(&eam_lock);
+	mutex_lock(&eam_mutex);
+
+	error = get_writable_table(&table);
+	if (error) {
+		mutex_unlock(&eam_mutex);
+		return error;
+	}
 
 	if (prefix6) {
-		eam = rbtree_find(prefix6, &eam_table.EAMT_tree6, compare_prefix6, struct eam_entry,
+		eam = rbtree_find(prefix6, &table->EAMT_tree6, compare_prefix6, struct eam_entry,
 				tree6_hook);
 		if (!eam) {
-			spin_unlock_bh(&eam_lock);
+			mutex_unlock(&eam_mutex);
 			log_err("There is no EAM entry for prefix %pI6c/%u.", &prefix6->address, prefix6->len);
 			return -ESRCH;
 		}
@@ -240,86 +495,66 @@ int eamt_remove(struct ipv6_prefix *prefix6, struct ipv4_prefix *prefix4)
 					&eam->pref6.address, eam->pref6.len,
 					&eam->pref4.address, eam->pref4.len,
 					&prefix4->address, prefix4->len);
-			spin_unlock_bh(&eam_lock);
+			mutex_unlock(&eam_mutex);
 			return -EINVAL;
 		}
 
-		count = eam_remove(eam, &eam_table);
+		eam_remove(eam, table);
 
 	} else if (prefix4) {
-		eam = rbtree_find(prefix4, &eam_table.EAMT_tree4, compare_prefix4, struct eam_entry,
+		eam = rbtree_find(prefix4, &table->EAMT_tree4, compare_prefix4, struct eam_entry,
 				tree4_hook);
 		if (!eam) {
-			spin_unlock_bh(&eam_lock);
+			mutex_unlock(&eam_mutex);
 			log_err("There is no EAM entry for prefix %pI4/%u.", &prefix4->address, prefix4->len);
 			return -ESRCH;
 		}
 
-		count = eam_remove(eam, &eam_table);
+		eam_remove(eam, table);
 	} else {
-		spin_unlock_bh(&eam_lock);
+		mutex_unlock(&eam_mutex);
 		WARN(true, "Both prefixes are NULL.");
 		return -EINVAL;
 	}
 
-	eam_table.count -= count;
-	spin_unlock_bh(&eam_lock);
-	eam_kfree(eam);
+	table->count--;
+	mutex_unlock(&eam_mutex);
+	eam_kfree_rcu(eam);
 	return 0;
 }
 
 bool eamt_contains_ipv6(struct in6_addr *addr)
 {
-	struct ipv6_prefix prefix;
-	struct eam_entry *eam;
+	bool result;
 
 	if (!addr) {
 		log_err("addr6 can't be NULL");
 		return false;
 	}
 
-	prefix.address = *addr;
-	prefix.len = IPV6_PREFIX;
-
-	spin_lock_bh(&eam_lock);
-	eam = rbtree_find(&prefix, &eam_table.EAMT_tree6, compare_prefix6, struct eam_entry,
-			tree6_hook);
+	rcu_read_lock_bh();
+	result = trie_find(&rcu_dereference_bh(eam_table)->trie6, addr) != NULL;
+	rcu_read_unlock_bh();
 
-	if (!eam) {
-		spin_unlock_bh(&eam_lock);
-		return false;
-	}
-	spin_unlock_bh(&eam_lock);
-	return true;
+	return result;
 }
 
 bool eamt_contains_ipv4(__be32 addr)
 {
-	struct ipv4_prefix prefix;
-	struct eam_entry *eam;
+	bool result;
 
-	prefix.address.s_addr = addr;
-	prefix.len = IPV4_PREFIX;
+	rcu_read_lock_bh();
+	result = trie_find(&rcu_dereference_bh(eam_table)->trie4, &addr) != NULL;
+	rcu_read_unlock_bh();
 
-	spin_lock_bh(&eam_lock);
-	eam = rbtree_find(&prefix, &eam_table.EAMT_tree4, compare_prefix4, struct eam_entry,
-			tree4_hook);
-
-	if (!eam) {
-		spin_unlock_bh(&eam_lock);
-		return false;
-	}
-	spin_unlock_bh(&eam_lock);
-	return true;
+	return result;
 }
 
 int eamt_get_ipv6_by_ipv4(struct in_addr *addr, struct in6_addr *result)
 {
-	struct ipv4_prefix prefix4;
-	struct ipv6_prefix prefix6;
 	struct eam_entry *eam;
-	unsigned int suffix4_len;
-	unsigned int i;
+	__u64 suffix;
+	__u64 hi, lo;
 
 	if (!addr) {
 		log_err("The IPv4 Address 'addr' can't be NULL");
@@ -327,76 +562,57 @@ int eamt_get_ipv6_by_ipv4(struct in_addr *addr, struct in6_addr *result)
 	}
 
 	/* Find the entry. */
-	prefix4.address.s_addr = addr->s_addr;
-	prefix4.len = IPV4_PREFIX;
-
-	spin_lock_bh(&eam_lock);
-	eam = rbtree_find(&prefix4, &eam_table.EAMT_tree4, compare_prefix4, struct eam_entry,
-			tree4_hook);
+	rcu_read_lock_bh();
+	eam = trie_find(&rcu_dereference_bh(eam_table)->trie4, &addr->s_addr);
 	if (!eam) {
-		spin_unlock_bh(&eam_lock);
+		rcu_read_unlock_bh();
 		return -ESRCH;
 	}
 
-	prefix4 = eam->pref4;
-	prefix6 = eam->pref6;
-	spin_unlock_bh(&eam_lock);
-
-	/* Translate the address. */
-	suffix4_len = IPV4_PREFIX - prefix4.len;
+	/* Translate the address. (The prefixes are zero-trimmed; see validate_prefixes().) */
+	suffix = be32_to_cpu(addr->s_addr) & eam->xlat.suffix_mask;
+	hi = eam->xlat.prefix6_hi | ((suffix << eam->xlat.hi_left) >> eam->xlat.hi_right);
+	lo = eam->xlat.prefix6_lo | ((suffix & eam->xlat.lo_mask) << eam->xlat.lo_shift);
+	rcu_read_unlock_bh();
 
-	for (i = 0; i < suffix4_len; i++) {
-		unsigned int offset4 = prefix4.len + i;
-		unsigned int offset6 = prefix6.len + i;
-		addr6_set_bit(&prefix6.address, offset6, addr4_get_bit(addr, offset4));
-	}
-
-	*result = prefix6.address; /* I'm assuming the prefix address is already zero-trimmed. */
+	addr6_set_halves(result, hi, lo);
 	return 0;
 }
 
 int eamt_get_ipv4_by_ipv6(struct in6_addr *addr6, struct in_addr *result)
 {
-	struct ipv4_prefix prefix4;
-	struct ipv6_prefix prefix6;
 	struct eam_entry *eam;
-	unsigned int i;
+	__u64 hi, lo;
+	__u64 suffix;
 
 	if (!addr6) {
 		log_err("The IPv6 Address 'addr6' can't be NULL");
 		return -EINVAL;
 	}
 
-	prefix6.address = *addr6;
-	prefix6.len = IPV6_PREFIX;
-
-	spin_lock_bh(&eam_lock);
-	eam = rbtree_find(&prefix6, &eam_table.EAMT_tree6, compare_prefix6, struct eam_entry,
-			tree6_hook);
+	rcu_read_lock_bh();
+	eam = trie_find(&rcu_dereference_bh(eam_table)->trie6, addr6);
 	if (!eam) {
-		spin_unlock_bh(&eam_lock);
+		rcu_read_unlock_bh();
 		return -ESRCH;
 	}
 
-	prefix4 = eam->pref4;
-	prefix6 = eam->pref6;
-	spin_unlock_bh(&eam_lock);
-
-	for (i = 0; i < IPV4_PREFIX - prefix4.len; i++) {
-		unsigned int offset4 = prefix4.len + i;
-		unsigned int offset6 = prefix6.len + i;
-		addr4_set_bit(&prefix4.address, offset4, addr6_get_bit(addr6, offset6));
-	}
+	/* Translate the address. (The prefixes are zero-trimmed; see validate_prefixes().) */
+	hi = addr6_get_hi(addr6);
+	lo = addr6_get_lo(addr6);
+	suffix = ((hi >> eam->xlat.hi_left) << eam->xlat.hi_right)
+			| ((lo & eam->xlat.lo_mask) >> eam->xlat.lo_shift);
+	result->s_addr = cpu_to_be32(eam->xlat.prefix4 | (__u32) (suffix & eam->xlat.suffix_mask));
+	rcu_read_unlock_bh();
 
-	*result = prefix4.address; /* I'm assuming the prefix address is already zero-trimmed. */
 	return 0;
 }
 
 int eamt_count(__u64 *count)
 {
-	spin_lock_bh(&eam_lock);
-	*count = eam_table.count;
-	spin_unlock_bh(&eam_lock);
+	mutex_lock(&eam_mutex);
+	*count = live_table()->count;
+	mutex_unlock(&eam_mutex);
 	return 0;
 }
 
@@ -414,15 +630,15 @@ bool eamt_is_empty(void)
 /**
  * See the function of the same name from the BIB DB module for comments on this.
  */
-static struct rb_node *find_next_chunk(struct ipv4_prefix *offset)
+static struct rb_node *find_next_chunk(struct eam_db *table, struct ipv4_prefix *offset)
 {
 	struct rb_node **node, *parent;
 	struct eam_entry *eam;
 
 	if (!offset)
-		return rb_first(&eam_table.EAMT_tree4);
+		return rb_first(&table->EAMT_tree4);
 
-	rbtree_find_node(offset, &eam_table.EAMT_tree4, compare_prefix4, struct eam_entry, tree4_hook,
+	rbtree_find_node(offset, &table->EAMT_tree4, compare_prefix4, struct eam_entry, tree4_hook,
 			parent, node);
 	if (*node)
 		return rb_next(*node);
@@ -436,84 +652,111 @@ int eamt_for_each(int (*func)(struct eam_entry *, void *), void *arg,
 {
 	struct rb_node *node;
 	int error = 0;
-	spin_lock_bh(&eam_lock);
+	mutex_lock(&eam_mutex);
 
-	for (node = find_next_chunk(offset); node && !error; node = rb_next(node))
+	for (node = find_next_chunk(live_table(), offset); node && !error; node = rb_next(node))
 		error = func(rb_entry(node, struct eam_entry, tree4_hook), arg);
 
-	spin_unlock_bh(&eam_lock);
+	mutex_unlock(&eam_mutex);
 	return error;
 }
 
 int eamt_flush(void)
 {
-	struct eam_entry *root_eam, *eam;
-	struct rb_node *node;
-	int counter = 0;
+	struct eam_db *new, *old;
 
 	log_debug("Emptying the EAM table...");
-	spin_lock_bh(&eam_lock);
-
-	node = eam_table.EAMT_tree4.rb_node;
-	if (!node)
-		goto success;
 
-	root_eam = rb_entry(node, struct eam_entry, tree4_hook);
-	if (!root_eam)
-		goto success;
+	new = table_alloc();
+	if (!new)
+		return -ENOMEM;
 
-	node = rb_prev(&root_eam->tree4_hook);
-	while (node) {
-		eam = rb_entry(node, struct eam_entry, tree4_hook);
-		node = rb_prev(&eam->tree4_hook);
-		counter += eam_remove(eam, &eam_table);
+	mutex_lock(&eam_mutex);
+	if (txn_open) {
+		old = candidate;
+		candidate = new;
+		mutex_unlock(&eam_mutex);
+	} else {
+		/* Readers see either the whole old table or an empty one; nothing in between. */
+		old = table_replace(new);
+		mutex_unlock(&eam_mutex);
+		synchronize_rcu_bh();
 	}
 
-	node = rb_next(&root_eam->tree4_hook);
-	while (node) {
-		eam = rb_entry(node, struct eam_entry, tree4_hook);
-		node = rb_next(&eam->tree4_hook);
-		counter += eam_remove(eam, &eam_table);
+	if (old)
+		log_debug("Deleted %llu EAM entries.", old->count);
+	table_free(old);
+	return 0;
+}
+
+void eamt_txn_begin(void)
+{
+	mutex_lock(&eam_mutex);
+	txn_open = true;
+	mutex_unlock(&eam_mutex);
+}
+
+void eamt_txn_commit(void)
+{
+	struct eam_db *old = NULL;
+
+	mutex_lock(&eam_mutex);
+	if (candidate)
+		old = table_replace(candidate);
+	candidate = NULL;
+	txn_open = false;
+	mutex_unlock(&eam_mutex);
+
+	if (old) {
+		synchronize_rcu_bh();
+		table_free(old);
 	}
+}
 
-	counter += eam_remove(root_eam, &eam_table);
-	eam_table.count -= counter;
-	/* Fall through. */
+void eamt_txn_abort(void)
+{
+	struct eam_db *old;
 
-success:
-	spin_unlock_bh(&eam_lock);
-	log_debug("Deleted %d EAM entries.", counter);
-	return 0;
+	mutex_lock(&eam_mutex);
+	old = candidate;
+	candidate = NULL;
+	txn_open = false;
+	mutex_unlock(&eam_mutex);
+
+	table_free(old);
 }
 
 int eamt_init(void)
 {
+	struct eam_db *table;
+
 	entry_cache = kmem_cache_create("address_mapping_entries", sizeof(struct eam_entry), 0, 0, NULL);
 	if (!entry_cache) {
 		log_err("Could not allocate the Address mapping entry cache.");
 		return -ENOMEM;
 	}
 
-	eam_table.EAMT_tree4 = RB_ROOT;
-	eam_table.EAMT_tree6 = RB_ROOT;
-	eam_table.count = 0;
+	table = table_alloc();
+	if (!table) {
+		kmem_cache_destroy(entry_cache);
+		return -ENOMEM;
+	}
 
+	RCU_INIT_POINTER(eam_table, table);
+	txn_open = false;
+	candidate = NULL;
 	return 0;
 }
 
-static void eamt_destroy_aux(struct rb_node *node)
-{
-	eam_kfree(rb_entry(node, struct eam_entry, tree6_hook));
-}
-
 void eamt_destroy(void)
 {
 	log_debug("Emptying the Address Mapping table...");
-	/*
-	 * The values need to be released only in one of the trees
-	 * because both of them point to the same values.
-	 */
-	rbtree_clear(&eam_table.EAMT_tree6, eamt_destroy_aux);
+	table_free(candidate);
+	candidate = NULL;
+	table_free(live_table());
+	RCU_INIT_POINTER(eam_table, NULL);
 
+	/* Wait for eam_kfree_rcu()'s and the tries' callbacks; they live in this module. */
+	rcu_barrier_bh();
 	kmem_cache_destroy(entry_cache);
 }
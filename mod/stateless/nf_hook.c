@@ -1,11 +1,10 @@
+#include "nat64/mod/common/classifier.h"
 #include "nat64/mod/common/config.h"
 #include "nat64/mod/common/core.h"
 #include "nat64/mod/common/nl_handler.h"
 #include "nat64/mod/common/pool6.h"
 #include "nat64/mod/common/types.h"
-#ifdef BENCHMARK
 #include "nat64/mod/common/log_time.h"
-#endif
 #include "nat64/mod/stateless/eam.h"
 #include "nat64/mod/stateless/pool4.h"
 #include "nat64/mod/stateless/rfc6791.h"
@@ -86,11 +85,9 @@ static int __init nat64_init(void)
 	error = eamt_init();
 	if (error)
 		goto eamt_failure;
-#ifdef BENCHMARK
 	error = logtime_init();
 	if (error)
 		goto log_time_failure;
-#endif
 	error = nlhandler_init();
 	if (error)
 		goto nlhandler_failure;
@@ -100,6 +97,9 @@ static int __init nat64_init(void)
 	error = pool4_init(blacklist, blacklist_size);
 	if (error)
 		goto pool4_failure;
+	error = classifier_init();
+	if (error)
+		goto classifier_failure;
 	error = rfc6791_init(pool6791, pool6791_size);
 	if (error)
 		goto rfc6791_failure;
@@ -117,6 +117,9 @@ nf_register_hooks_failure:
 	rfc6791_destroy();
 
 rfc6791_failure:
+	classifier_destroy();
+
+classifier_failure:
 	pool4_destroy();
 
 pool4_failure:
@@ -126,11 +129,9 @@ pool6_failure:
 	nlhandler_destroy();
 
 nlhandler_failure:
-#ifdef BENCHMARK
 	logtime_destroy();
 
 log_time_failure:
-#endif
 	eamt_destroy();
 
 eamt_failure:
@@ -147,12 +148,11 @@ static void __exit nat64_exit(void)
 
 	/* Deinitialize the submodules. */
 	rfc6791_destroy();
+	classifier_destroy();
 	pool4_destroy();
 	pool6_destroy();
 	nlhandler_destroy();
-#ifdef BENCHMARK
 	logtime_destroy();
-#endif
 	eamt_destroy();
 	config_destroy();
 
@@ -104,14 +104,15 @@ int pool_add(struct list_head *pool, struct ipv4_prefix *prefix)
 	return 0;
 }
 
-int pool_remove(struct list_head *pool, struct ipv4_prefix *prefix)
+static int __pool_remove(struct list_head *pool, struct ipv4_prefix *prefix, bool sync)
 {
 	struct pool_entry *entry;
 
 	list_for_each_entry(entry, pool, list_hook) {
 		if (prefix4_equals(prefix, &entry->prefix)) {
 			list_del_rcu(&entry->list_hook);
-			synchronize_rcu_bh();
+			if (sync)
+				synchronize_rcu_bh();
 			kfree(entry);
 			return 0;
 		}
@@ -121,12 +122,134 @@ int pool_remove(struct list_head *pool, struct ipv4_prefix *prefix)
 	return -ESRCH;
 }
 
+int pool_remove(struct list_head *pool, struct ipv4_prefix *prefix)
+{
+	return __pool_remove(pool, prefix, true);
+}
+
 int pool_flush(struct list_head *pool)
 {
 	__pool_flush(pool, true);
 	return 0;
 }
 
+void pool_txn_begin(struct pool_txn *txn)
+{
+	txn->open = true;
+	txn->dirty = false;
+	INIT_LIST_HEAD(&txn->candidate);
+}
+
+/**
+ * Makes sure "txn"'s candidate is a copy of "pool", so it can be edited.
+ */
+static int txn_prepare(struct list_head *pool, struct pool_txn *txn)
+{
+	struct pool_entry *entry, *copy;
+
+	if (txn->dirty)
+		return 0;
+
+	list_for_each_entry(entry, pool, list_hook) {
+		copy = kmalloc(sizeof(*copy), GFP_KERNEL);
+		if (!copy) {
+			pool_destroy(&txn->candidate);
+			return -ENOMEM;
+		}
+		copy->prefix = entry->prefix;
+		list_add_tail(&copy->list_hook, &txn->candidate);
+	}
+
+	txn->dirty = true;
+	return 0;
+}
+
+int pool_txn_add(struct list_head *pool, struct pool_txn *txn, struct ipv4_prefix *prefix)
+{
+	int error;
+
+	error = txn_prepare(pool, txn);
+	if (error)
+		return error;
+
+	return pool_add(&txn->candidate, prefix);
+}
+
+int pool_txn_remove(struct list_head *pool, struct pool_txn *txn, struct ipv4_prefix *prefix)
+{
+	int error;
+
+	error = txn_prepare(pool, txn);
+	if (error)
+		return error;
+
+	/* Nobody else can see the candidate, so there are no readers to wait for. */
+	return __pool_remove(&txn->candidate, prefix, false);
+}
+
+int pool_txn_flush(struct pool_txn *txn)
+{
+	pool_destroy(&txn->candidate);
+	txn->dirty = true;
+	return 0;
+}
+
+/**
+ * Moves "candidate"'s entries to "pool", replacing the ones it had.
+ *
+ * Readers are switched with a single pointer store (the head's "next"). The old entries remain
+ * chained to each other and to the head until the grace period ends, so anyone who is still
+ * walking them finishes normally.
+ */
+static void pool_replace(struct list_head *pool, struct list_head *candidate)
+{
+	struct list_head *old_first = pool->next;
+	struct list_head *new_first, *new_last;
+	struct list_head *cursor, *next;
+
+	if (list_empty(candidate)) {
+		new_first = pool;
+		new_last = pool;
+	} else {
+		new_first = candidate->next;
+		new_last = candidate->prev;
+		new_first->prev = pool;
+		new_last->next = pool;
+	}
+
+	rcu_assign_pointer(list_next_rcu(pool), new_first);
+	pool->prev = new_last;
+	INIT_LIST_HEAD(candidate);
+
+	synchronize_rcu_bh();
+
+	for (cursor = old_first; cursor != pool; cursor = next) {
+		next = cursor->next;
+		kfree(list_entry(cursor, struct pool_entry, list_hook));
+	}
+}
+
+bool pool_txn_commit(struct list_head *pool, struct pool_txn *txn)
+{
+	bool changed = txn->open && txn->dirty;
+
+	if (changed)
+		pool_replace(pool, &txn->candidate);
+
+	txn->open = false;
+	txn->dirty = false;
+	return changed;
+}
+
+void pool_txn_abort(struct pool_txn *txn)
+{
+	if (txn->dirty)
+		pool_destroy(&txn->candidate);
+
+	txn->open = false;
+	txn->dirty = false;
+}
+
 int pool_for_each(struct list_head *pool, int (*func)(struct ipv4_prefix *, void *), void *arg,
 		struct ipv4_prefix *offset)
 {
@@ -2,40 +2,365 @@
 
 #include <linux/rculist.h>
 #include <linux/inet.h>
+#include <linux/jhash.h>
 #include <linux/netdevice.h>
 #include <linux/inetdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/sort.h>
 
 #include "nat64/common/str_utils.h"
+#include "nat64/mod/common/trie.h"
 #include "nat64/mod/stateless/pool.h"
 
 static struct list_head pool;
+/** Changes the current configuration transaction wants to apply to "pool", if any. */
+static struct pool_txn txn;
+
+/**
+ * Every address pool4_contains() should return true for, flattened into a read-only structure so
+ * the packet path doesn't have to walk the pool or the interfaces.
+ *
+ * It is never edited; whenever the pool or the addresses of the interfaces change, a new one is
+ * built and replaces it.
+ */
+struct pool4_set {
+	/**
+	 * The pool's entries which are shorter than /32. Only membership matters, so every value is
+	 * the set itself.
+	 */
+	struct trie prefixes;
+
+	/**
+	 * Hash set (open addressing, linear probing) of the node's own addresses and the pool's /32
+	 * entries. Zero marks empty slots.
+	 */
+	__be32 *addrs;
+	/** Length of "addrs". Always a power of two. */
+	unsigned int slots;
+	/** Whether 0.0.0.0 is a member (since it can't be stored in "addrs"). */
+	bool has_zero;
+
+	struct rcu_head rcu;
+};
+
+/**
+ * The current set. Writers need to hold the RTNL (since the set depends on the interfaces).
+ * NULL means the last rebuild failed, in which case pool4_contains() falls back to the slow way.
+ */
+static struct pool4_set __rcu *set;
+
+static void set_free(struct pool4_set *old)
+{
+	trie_destroy(&old->prefixes);
+	kfree(old->addrs);
+	kfree(old);
+}
+
+static void set_free_rcu(struct rcu_head *rcu)
+{
+	set_free(container_of(rcu, struct pool4_set, rcu));
+}
+
+static unsigned int set_slot(struct pool4_set *new, __be32 addr)
+{
+	return jhash_1word((__force u32) addr, 0) & (new->slots - 1);
+}
+
+static void set_add_addr(struct pool4_set *new, __be32 addr)
+{
+	unsigned int i;
+
+	if (!addr) {
+		new->has_zero = true;
+		return;
+	}
+
+	for (i = set_slot(new, addr); new->addrs[i]; i = (i + 1) & (new->slots - 1))
+		if (new->addrs[i] == addr)
+			return;
+
+	new->addrs[i] = addr;
+}
+
+static int compare_prefix_len(const void *a, const void *b)
+{
+	return ((struct ipv4_prefix *) a)->len - ((struct ipv4_prefix *) b)->len;
+}
+
+/**
+ * Indexes "prefixes" in "new"'s trie. Sorts them in the process.
+ *
+ * The trie refuses overlapping prefixes, and the module parameters are not checked for
+ * intersections the way pool4_add() is. So the shorter prefixes go first, and the ones they
+ * contain are left out; they would not change the result of any lookup.
+ */
+static int set_add_prefixes(struct pool4_set *new, struct ipv4_prefix *prefixes,
+		unsigned int count)
+{
+	unsigned int i;
+	int error;
+
+	sort(prefixes, count, sizeof(*prefixes), compare_prefix_len, NULL);
+
+	for (i = 0; i < count; i++) {
+		error = trie_add(&new->prefixes, &prefixes[i].address, prefixes[i].len, new);
+		if (error && error != -EEXIST)
+			return error;
+	}
+
+	return 0;
+}
+
+static bool set_contains(struct pool4_set *current_set, __be32 addr)
+{
+	unsigned int i;
+
+	if (!addr)
+		return current_set->has_zero;
+
+	/* There's always at least one empty slot, so this ends. */
+	for (i = set_slot(current_set, addr); current_set->addrs[i];
+			i = (i + 1) & (current_set->slots - 1)) {
+		if (current_set->addrs[i] == addr)
+			return true;
+	}
+
+	return trie_find(&current_set->prefixes, &addr) != NULL;
+}
+
+/**
+ * Replaces the set with one built from the current pool and interfaces.
+ * The caller must hold the RTNL.
+ */
+static int set_rebuild(void)
+{
+	struct pool4_set *new, *old;
+	struct pool_entry *entry;
+	struct net_device *dev;
+	struct in_device *in_dev;
+	struct in_ifaddr *ifa;
+	struct ipv4_prefix *prefixes = NULL;
+	unsigned int prefix_count = 0;
+	unsigned int addr_count = 0;
+
+	ASSERT_RTNL();
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		goto fail;
+	trie_init(&new->prefixes, sizeof(struct in_addr));
+
+	list_for_each_entry(entry, &pool, list_hook) {
+		if (entry->prefix.len == 32)
+			addr_count++;
+		else
+			prefix_count++;
+	}
+	for_each_netdev(&init_net, dev) {
+		in_dev = __in_dev_get_rtnl(dev);
+		if (!in_dev)
+			continue;
+		for (ifa = in_dev->ifa_list; ifa; ifa = ifa->ifa_next)
+			addr_count++;
+	}
+
+	/* Keep the load factor at 50% or less. */
+	new->slots = roundup_pow_of_two(2 * addr_count + 1);
+	new->addrs = kcalloc(new->slots, sizeof(*new->addrs), GFP_KERNEL);
+	if (!new->addrs)
+		goto fail;
+	if (prefix_count) {
+		prefixes = kcalloc(prefix_count, sizeof(*prefixes), GFP_KERNEL);
+		if (!prefixes)
+			goto fail;
+	}
+
+	prefix_count = 0;
+	list_for_each_entry(entry, &pool, list_hook) {
+		if (entry->prefix.len == 32)
+			set_add_addr(new, entry->prefix.address.s_addr);
+		else
+			prefixes[prefix_count++] = entry->prefix;
+	}
+	if (set_add_prefixes(new, prefixes, prefix_count))
+		goto fail;
+	kfree(prefixes);
+
+	for_each_netdev(&init_net, dev) {
+		in_dev = __in_dev_get_rtnl(dev);
+		if (!in_dev)
+			continue;
+		for (ifa = in_dev->ifa_list; ifa; ifa = ifa->ifa_next)
+			set_add_addr(new, ifa->ifa_address);
+	}
+
+	old = rtnl_dereference(set);
+	rcu_assign_pointer(set, new);
+	if (old)
+		call_rcu_bh(&old->rcu, set_free_rcu);
+	return 0;
+
+fail:
+	kfree(prefixes);
+	if (new)
+		set_free(new);
+
+	log_err("Could not allocate the blacklist's lookup set; lookups are going to be slower.");
+	old = rtnl_dereference(set);
+	RCU_INIT_POINTER(set, NULL);
+	if (old)
+		call_rcu_bh(&old->rcu, set_free_rcu);
+	return -ENOMEM;
+}
+
+static int inetaddr_notify(struct notifier_block *nb, unsigned long event, void *ptr)
+{
+	struct in_ifaddr *ifa = ptr;
+
+	if (!net_eq(dev_net(ifa->ifa_dev->dev), &init_net))
+		return NOTIFY_DONE;
+
+	/*
+	 * By the time these are delivered, the address has already been added to or removed from
+	 * the interface's list.
+	 */
+	if (event == NETDEV_UP || event == NETDEV_DOWN)
+		set_rebuild();
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block inetaddr_notifier = {
+	.notifier_call = inetaddr_notify,
+};
 
 int pool4_init(char *pref_strs[], int pref_count)
 {
-	return pool_init(pref_strs, pref_count, &pool);
+	int error;
+
+	RCU_INIT_POINTER(set, NULL);
+
+	error = pool_init(pref_strs, pref_count, &pool);
+	if (error)
+		return error;
+
+	error = register_inetaddr_notifier(&inetaddr_notifier);
+	if (error)
+		goto pool_fail;
+
+	rtnl_lock();
+	error = set_rebuild();
+	rtnl_unlock();
+	if (error)
+		goto notifier_fail;
+
+	return 0;
+
+notifier_fail:
+	unregister_inetaddr_notifier(&inetaddr_notifier);
+	/* Fall through. */
+pool_fail:
+	pool_destroy(&pool);
+	return error;
 }
 
 void pool4_destroy(void)
 {
-	return pool_destroy(&pool);
+	struct pool4_set *old;
+
+	unregister_inetaddr_notifier(&inetaddr_notifier);
+	pool_txn_abort(&txn);
+
+	old = rcu_dereference_protected(set, true);
+	RCU_INIT_POINTER(set, NULL);
+	/* Wait for the sets the notifier replaced. */
+	rcu_barrier_bh();
+	if (old)
+		set_free(old);
+
+	pool_destroy(&pool);
 }
 
+/*
+ * The pool is edited with the RTNL held so set_rebuild() can trust it won't change while the
+ * set is being built, regardless of who triggered the rebuild.
+ * Rebuild failures are not reported to the user, since the pool itself was updated and
+ * pool4_contains() can cope without the set.
+ * Changes staged by a transaction do not touch the pool, so they don't need any of that until the
+ * transaction is committed.
+ */
+
 int pool4_add(struct ipv4_prefix *prefix)
 {
-	return pool_add(&pool, prefix);
+	int error;
+
+	if (txn.open)
+		return pool_txn_add(&pool, &txn, prefix);
+
+	rtnl_lock();
+	error = pool_add(&pool, prefix);
+	if (!error)
+		set_rebuild();
+	rtnl_unlock();
+
+	return error;
 }
 
 int pool4_remove(struct ipv4_prefix *prefix)
 {
-	return pool_remove(&pool, prefix);
+	int error;
+
+	if (txn.open)
+		return pool_txn_remove(&pool, &txn, prefix);
+
+	rtnl_lock();
+	error = pool_remove(&pool, prefix);
+	if (!error)
+		set_rebuild();
+	rtnl_unlock();
+
+	return error;
 }
 
 int pool4_flush(void)
 {
-	return pool_flush(&pool);
+	int error;
+
+	if (txn.open)
+		return pool_txn_flush(&txn);
+
+	rtnl_lock();
+	error = pool_flush(&pool);
+	if (!error)
+		set_rebuild();
+	rtnl_unlock();
+
+	return error;
 }
 
-bool pool4_contains(__be32 addr)
+void pool4_txn_begin(void)
+{
+	pool_txn_begin(&txn);
+}
+
+void pool4_txn_commit(void)
+{
+	rtnl_lock();
+	if (pool_txn_commit(&pool, &txn))
+		set_rebuild();
+	rtnl_unlock();
+}
+
+void pool4_txn_abort(void)
+{
+	pool_txn_abort(&txn);
+}
+
+/**
+ * The way pool4_contains() used to work, before the set existed. Only used when the set could not
+ * be allocated.
+ */
+static bool slow_contains(__be32 addr)
 {
 	struct net_device *dev;
 	struct in_device *in_dev;
@@ -43,31 +368,38 @@ bool pool4_contains(__be32 addr)
 	struct pool_entry *entry;
 	struct in_addr inaddr = { .s_addr = addr };
 	struct in_addr net_addr;
-	bool result = false;
 
-	rcu_read_lock_bh();
 	list_for_each_entry_rcu(entry, &pool, list_hook) {
-		if (prefix4_contains(&entry->prefix, &inaddr)) {
-			result = true;
-			goto end;
-		}
+		if (prefix4_contains(&entry->prefix, &inaddr))
+			return true;
 	}
 
 	for_each_netdev_rcu(&init_net, dev) {
 		in_dev = rcu_dereference(dev->ip_ptr);
+		if (!in_dev)
+			continue;
 		ifaddr = in_dev->ifa_list;
 		while (ifaddr) {
 			net_addr.s_addr = ifaddr->ifa_address;
-			if (ipv4_addr_cmp(&net_addr, &inaddr) == 0) {
-				result = true;
-				goto end;
-			}
+			if (ipv4_addr_cmp(&net_addr, &inaddr) == 0)
+				return true;
 			ifaddr = ifaddr->ifa_next;
 		}
 	}
 
-end:
+	return false;
+}
+
+bool pool4_contains(__be32 addr)
+{
+	struct pool4_set *current_set;
+	bool result;
+
+	rcu_read_lock_bh();
+	current_set = rcu_dereference_bh(set);
+	result = current_set ? set_contains(current_set, addr) : slow_contains(addr);
 	rcu_read_unlock_bh();
+
 	return result;
 }
 
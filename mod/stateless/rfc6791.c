@@ -5,6 +5,8 @@
 #include <linux/in_route.h>
 #include <linux/netdevice.h>
 #include <linux/inetdevice.h>
+#include <linux/rtnetlink.h>
+#include <linux/sort.h>
 #include <net/ip_fib.h>
 
 #include "nat64/mod/common/config.h"
@@ -14,35 +16,309 @@
 #include "nat64/mod/common/route.h"
 
 static struct list_head pool;
+/** Changes the current configuration transaction wants to apply to "pool", if any. */
+static struct pool_txn txn;
+
+/**
+ * The pool, flattened so an address can be picked by index without walking the list.
+ * It is never edited; whenever the pool changes, a new one is built and replaces it.
+ */
+struct pool_index {
+	/** Number of addresses in the pool. */
+	__u64 addr_count;
+	/** Length of "prefixes". */
+	unsigned int prefix_count;
+	struct {
+		/** The prefix's first address, in host byte order. */
+		__u32 first;
+		/** Number of addresses in this prefix and all of the previous ones. */
+		__u64 sum;
+	} prefixes[];
+};
+
+/**
+ * The current index. Writers are serialized by the configuration mutex.
+ * NULL if the pool is empty, or if the last rebuild failed.
+ */
+static struct pool_index __rcu *pool_index;
+
+/**
+ * The first non-loopback address of every interface, sorted by interface index.
+ * This is what ICMP errors are sourced with when the pool is empty.
+ */
+struct host_addrs {
+	unsigned int count;
+	struct host_addr {
+		int ifindex;
+		__be32 addr;
+	} devs[];
+};
+
+/**
+ * The current address cache. Writers need the RTNL (since the cache depends on the interfaces).
+ * NULL if it could not be allocated.
+ */
+static struct host_addrs __rcu *host_addrs;
+
+/**
+ * Replaces the index with one built from the current pool.
+ * The caller must serialize writers.
+ */
+static void index_rebuild(void)
+{
+	struct pool_index *new, *old;
+	struct pool_entry *entry;
+	unsigned int prefix_count = 0;
+	__u64 sum = 0;
+
+	list_for_each_entry(entry, &pool, list_hook)
+		prefix_count++;
+
+	new = NULL;
+	if (prefix_count) {
+		new = kmalloc(sizeof(*new) + prefix_count * sizeof(new->prefixes[0]), GFP_KERNEL);
+		if (new) {
+			new->prefix_count = 0;
+			list_for_each_entry(entry, &pool, list_hook) {
+				sum += prefix4_get_addr_count(&entry->prefix);
+				new->prefixes[new->prefix_count].first =
+						ntohl(entry->prefix.address.s_addr);
+				new->prefixes[new->prefix_count].sum = sum;
+				new->prefix_count++;
+			}
+			new->addr_count = sum;
+		} else {
+			log_err("Could not allocate the RFC 6791 pool's index; lookups will be slower.");
+		}
+	}
+
+	old = rcu_dereference_protected(pool_index, true);
+	rcu_assign_pointer(pool_index, new);
+	if (old) {
+		synchronize_rcu_bh();
+		kfree(old);
+	}
+}
+
+static int host_addr_cmp(const void *a1, const void *a2)
+{
+	const struct host_addr *addr1 = a1;
+	const struct host_addr *addr2 = a2;
+	return addr1->ifindex - addr2->ifindex;
+}
+
+/**
+ * Replaces the address cache with one built from the current interfaces.
+ * The caller must hold the RTNL.
+ */
+static void host_addrs_rebuild(void)
+{
+	struct host_addrs *new, *old;
+	struct net_device *dev;
+	struct in_device *in_dev;
+	struct in_ifaddr *ifa;
+	unsigned int dev_count = 0;
+
+	ASSERT_RTNL();
+
+	for_each_netdev(&init_net, dev)
+		dev_count++;
+
+	new = kmalloc(sizeof(*new) + dev_count * sizeof(new->devs[0]), GFP_KERNEL);
+	if (new) {
+		new->count = 0;
+		for_each_netdev(&init_net, dev) {
+			in_dev = __in_dev_get_rtnl(dev);
+			if (!in_dev)
+				continue;
+			for (ifa = in_dev->ifa_list; ifa; ifa = ifa->ifa_next) {
+				if (IN_LOOPBACK(ntohl(ifa->ifa_address)))
+					continue;
+				new->devs[new->count].ifindex = dev->ifindex;
+				new->devs[new->count].addr = ifa->ifa_address;
+				new->count++;
+				break;
+			}
+		}
+		sort(new->devs, new->count, sizeof(new->devs[0]), host_addr_cmp, NULL);
+	} else {
+		log_err("Could not allocate the interface address cache; lookups will be slower.");
+	}
+
+	old = rtnl_dereference(host_addrs);
+	rcu_assign_pointer(host_addrs, new);
+	if (old) {
+		synchronize_rcu_bh();
+		kfree(old);
+	}
+}
+
+static int inetaddr_notify(struct notifier_block *nb, unsigned long event, void *ptr)
+{
+	struct in_ifaddr *ifa = ptr;
+
+	if (!net_eq(dev_net(ifa->ifa_dev->dev), &init_net))
+		return NOTIFY_DONE;
+
+	/*
+	 * By the time these are delivered, the address has already been added to or removed from
+	 * the interface's list. Devices which are unregistered lose their addresses first, so this
+	 * also covers stale interface indexes.
+	 */
+	if (event == NETDEV_UP || event == NETDEV_DOWN)
+		host_addrs_rebuild();
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block inetaddr_notifier = {
+	.notifier_call = inetaddr_notify,
+};
 
 int rfc6791_init(char *pref_strs[], int pref_count)
 {
-	return pool_init(pref_strs, pref_count, &pool);
+	int error;
+
+	RCU_INIT_POINTER(pool_index, NULL);
+	RCU_INIT_POINTER(host_addrs, NULL);
+
+	error = pool_init(pref_strs, pref_count, &pool);
+	if (error)
+		return error;
+	index_rebuild();
+
+	error = register_inetaddr_notifier(&inetaddr_notifier);
+	if (error) {
+		kfree(rcu_dereference_protected(pool_index, true));
+		RCU_INIT_POINTER(pool_index, NULL);
+		pool_destroy(&pool);
+		return error;
+	}
+
+	rtnl_lock();
+	host_addrs_rebuild();
+	rtnl_unlock();
+
+	return 0;
 }
 
 void rfc6791_destroy(void)
 {
-	return pool_destroy(&pool);
+	unregister_inetaddr_notifier(&inetaddr_notifier);
+	pool_txn_abort(&txn);
+
+	kfree(rcu_dereference_protected(host_addrs, true));
+	RCU_INIT_POINTER(host_addrs, NULL);
+	kfree(rcu_dereference_protected(pool_index, true));
+	RCU_INIT_POINTER(pool_index, NULL);
+
+	pool_destroy(&pool);
 }
 
 int rfc6791_add(struct ipv4_prefix *prefix)
 {
-	return pool_add(&pool, prefix);
+	int error;
+
+	if (txn.open)
+		return pool_txn_add(&pool, &txn, prefix);
+
+	error = pool_add(&pool, prefix);
+	if (!error)
+		index_rebuild();
+
+	return error;
 }
 
 int rfc6791_remove(struct ipv4_prefix *prefix)
 {
-	return pool_remove(&pool, prefix);
+	int error;
+
+	if (txn.open)
+		return pool_txn_remove(&pool, &txn, prefix);
+
+	error = pool_remove(&pool, prefix);
+	if (!error)
+		index_rebuild();
+
+	return error;
 }
 
 int rfc6791_flush(void)
 {
-	return pool_flush(&pool);
+	int error;
+
+	if (txn.open)
+		return pool_txn_flush(&txn);
+
+	error = pool_flush(&pool);
+	if (!error)
+		index_rebuild();
+
+	return error;
+}
+
+void rfc6791_txn_begin(void)
+{
+	pool_txn_begin(&txn);
+}
+
+void rfc6791_txn_commit(void)
+{
+	if (pool_txn_commit(&pool, &txn))
+		index_rebuild();
+}
+
+void rfc6791_txn_abort(void)
+{
+	pool_txn_abort(&txn);
+}
+
+static unsigned int get_addr_index(struct packet *in, __u64 count)
+{
+	unsigned int addr_index;
+
+	addr_index = in->config->randomize_error_addresses
+			? get_random_u32()
+			: pkt_ip6_hdr(in)->hop_limit;
+	/* unsigned int % __u64 does something weird, hence the trouble. */
+	if (count <= 0xFFFFFFFFU)
+		addr_index %= (unsigned int) count;
+
+	return addr_index;
+}
+
+/**
+ * Returns in "result" the IPv4 address an ICMP error towards "out"'s destination should be sourced
+ * with, using "index" (which must not be empty).
+ * RCU locks must be already held.
+ */
+static int get_indexed_address(struct packet *in, struct pool_index *index,
+		struct in_addr *result)
+{
+	unsigned int addr_index;
+	unsigned int left = 0, right = index->prefix_count - 1;
+	unsigned int middle;
+	__u64 offset;
+
+	addr_index = get_addr_index(in, index->addr_count);
+
+	/* Find the first prefix whose sum exceeds the address index. */
+	while (left < right) {
+		middle = left + (right - left) / 2;
+		if (index->prefixes[middle].sum > addr_index)
+			right = middle;
+		else
+			left = middle + 1;
+	}
+
+	offset = left ? index->prefixes[left - 1].sum : 0;
+	result->s_addr = htonl(index->prefixes[left].first + (__u32) (addr_index - offset));
+	return 0;
 }
 
 /**
  * Returns in "result" the IPv4 address an ICMP error towards "out"'s destination should be sourced
- * with.
+ * with, walking the pool. Only used when the index could not be allocated.
  * RCU locks must be already held.
  */
 static int get_rfc6791_address(struct packet *in, __u64 count, struct in_addr *result)
@@ -50,14 +326,11 @@ static int get_rfc6791_address(struct packet *in, __u64 count, struct in_addr *r
 	struct pool_entry *entry;
 	unsigned int addr_index;
 
-	addr_index = config_randomize_rfc6791_pool() ? get_random_u32() : pkt_ip6_hdr(in)->hop_limit;
-	/* unsigned int % __u64 does something weird, hence the trouble. */
-	if (count <= 0xFFFFFFFFU)
-		addr_index %= (unsigned int) count;
+	addr_index = get_addr_index(in, count);
 
 	list_for_each_entry_rcu(entry, &pool, list_hook) {
 		count = prefix4_get_addr_count(&entry->prefix);
-		if (count >= addr_index)
+		if (count > addr_index)
 			break;
 		addr_index -= count;
 	}
@@ -66,6 +339,26 @@ static int get_rfc6791_address(struct packet *in, __u64 count, struct in_addr *r
 	return 0;
 }
 
+static bool get_cached_host_address(struct host_addrs *cache, int ifindex, __be32 *result)
+{
+	unsigned int left = 0, right = cache->count;
+	unsigned int middle;
+
+	while (left < right) {
+		middle = left + (right - left) / 2;
+		if (cache->devs[middle].ifindex == ifindex) {
+			*result = cache->devs[middle].addr;
+			return true;
+		}
+		if (cache->devs[middle].ifindex < ifindex)
+			left = middle + 1;
+		else
+			right = middle;
+	}
+
+	return false;
+}
+
 /**
  * Returns in "result" the IPv4 address an ICMP error towards "out"'s destination should be sourced
  * with, assuming the RFC6791 pool is empty.
@@ -73,16 +366,26 @@ static int get_rfc6791_address(struct packet *in, __u64 count, struct in_addr *r
  */
 static int get_host_address(struct packet *in, struct packet *out, struct in_addr *result)
 {
+	struct host_addrs *cache;
 	struct net_device *dev;
 	struct in_device *in_dev;
 	struct in_ifaddr *ifaddr;
 	int error;
 
+	/* The packet needs a route anyway; the sending code will reuse this one. */
 	error = __route4(in, out);
 	if (error)
 		return error;
 
 	dev = out->skb->dev;
+
+	cache = rcu_dereference_bh(host_addrs);
+	if (cache) {
+		if (get_cached_host_address(cache, dev->ifindex, &result->s_addr))
+			return 0;
+		goto fail;
+	}
+
 	in_dev = rcu_dereference(dev->ip_ptr);
 	ifaddr = in_dev->ifa_list;
 	while (ifaddr) {
@@ -93,7 +396,9 @@ static int get_host_address(struct packet *in, struct packet *out, struct in_add
 		result->s_addr = ifaddr->ifa_address;
 		return 0;
 	}
+	/* Fall through. */
 
+fail:
 	log_warn_once("The kernel routed an IPv4 packet via device %s, which doesn't have any "
 			"(non-loopback) IPv4 addresses.", dev->name);
 	return -EINVAL;
@@ -101,17 +406,25 @@ static int get_host_address(struct packet *in, struct packet *out, struct in_add
 
 int rfc6791_get(struct packet *in, struct packet *out, struct in_addr *result)
 {
+	struct pool_index *index;
 	__u64 count;
 	int error;
 
 	rcu_read_lock_bh();
 
 	/*
-	 * I'm counting the list elements instead of using an algorithm like reservoir sampling
+	 * I'm indexing the pool instead of using an algorithm like reservoir sampling
 	 * (http://stackoverflow.com/questions/54059) because the random function can be really
 	 * expensive. Reservoir sampling requires one random per iteration, this way requires one
 	 * random period.
 	 */
+	index = rcu_dereference_bh(pool_index);
+	if (index) {
+		error = get_indexed_address(in, index, result);
+		goto end;
+	}
+
+	/* Either the pool is empty or the index could not be allocated. */
 	error = pool_count(&pool, &count);
 	if (error) {
 		log_debug("pool_count failed with errcode %d.", error);
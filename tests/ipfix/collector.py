@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+
+# A minimal IPFIX collector stand-in. Listens on UDP, decodes the messages jool-ipfix sends
+# (templates and data sets) and prints one line per data record.
+#
+# Usage: collector.py [ADDRESS [PORT [COUNT]]]
+# Quits after COUNT data records (default: never).
+
+import socket
+import struct
+import sys
+
+FIELD_NAMES = {
+	4: "protocolIdentifier",
+	7: "sourceTransportPort",
+	11: "destinationTransportPort",
+	27: "sourceIPv6Address",
+	28: "destinationIPv6Address",
+	225: "postNATSourceIPv4Address",
+	226: "postNATDestinationIPv4Address",
+	227: "postNAPTSourceTransportPort",
+	228: "postNAPTDestinationTransportPort",
+	230: "natEvent",
+	323: "observationTimeMilliseconds",
+}
+
+
+def decode(field_id, value):
+	if field_id in (27, 28):
+		return socket.inet_ntop(socket.AF_INET6, value)
+	if field_id in (225, 226):
+		return socket.inet_ntop(socket.AF_INET, value)
+	return str(int.from_bytes(value, "big"))
+
+
+def parse(message, templates, out):
+	version, length, export_time, sequence, domain = struct.unpack("!HHIII", message[:16])
+	if version != 10 or length != len(message):
+		raise ValueError("Bad message header: version %u, length %u/%u"
+				% (version, length, len(message)))
+
+	records = 0
+	offset = 16
+	while offset < length:
+		set_id, set_len = struct.unpack("!HH", message[offset:offset + 4])
+		body = message[offset + 4:offset + set_len]
+		offset += set_len
+
+		if set_id == 2:
+			while body:
+				template_id, count = struct.unpack("!HH", body[:4])
+				fields = [struct.unpack("!HH", body[4 + 4 * i:8 + 4 * i]) for i in range(count)]
+				templates[template_id] = fields
+				body = body[4 + 4 * count:]
+			continue
+
+		fields = templates[set_id]
+		record_len = sum(field[1] for field in fields)
+		while len(body) >= record_len:
+			values = []
+			for field_id, field_len in fields:
+				values.append("%s=%s" % (FIELD_NAMES.get(field_id, field_id),
+						decode(field_id, body[:field_len])))
+				body = body[field_len:]
+			out.write("seq=%u template=%u %s\n" % (sequence + records, set_id,
+					" ".join(values)))
+			records += 1
+
+	out.flush()
+	return records
+
+
+def main():
+	address = sys.argv[1] if len(sys.argv) > 1 else "127.0.0.1"
+	port = int(sys.argv[2]) if len(sys.argv) > 2 else 4739
+	limit = int(sys.argv[3]) if len(sys.argv) > 3 else None
+
+	family = socket.AF_INET6 if ":" in address else socket.AF_INET
+	sock = socket.socket(family, socket.SOCK_DGRAM)
+	sock.bind((address, port))
+
+	templates = {}
+	total = 0
+	while limit is None or total < limit:
+		message = sock.recv(65535)
+		total += parse(message, templates, sys.stdout)
+
+
+if __name__ == "__main__":
+	main()
@@ -0,0 +1,60 @@
+#!/bin/bash
+
+# See ReadMe.txt.
+
+JOOL_IPFIX=${JOOL_IPFIX:-../../usr/stateful/jool-ipfix}
+PORT=14739
+EVENTS=$(mktemp)
+OUTPUT=$(mktemp)
+
+cleanup() {
+	kill $COLLECTOR 2> /dev/null
+	rm -f $EVENTS $OUTPUT
+}
+trap cleanup EXIT
+
+# A jool-log file with two BIB events and two session events, in this machine's byte order.
+python3 - $EVENTS <<'PYTHON'
+import socket, struct, sys
+
+def addr6(addr, port):
+	return socket.inet_pton(socket.AF_INET6, addr) + struct.pack("=H2x", port)
+
+def addr4(addr, port):
+	return socket.inet_pton(socket.AF_INET, addr) + struct.pack("=H2x", port)
+
+def event(time, event_type, l4_proto):
+	return struct.pack("=Q", time) \
+		+ addr6("2001:db8::2", 1234) + addr6("64:ff9b::c000:202", 80) \
+		+ addr4("192.0.2.1", 61000) + addr4("192.0.2.2", 80) \
+		+ struct.pack("=IBB2x", 0, l4_proto, event_type)
+
+TCP = 0
+with open(sys.argv[1], "wb") as file:
+	file.write(b"jlog" + struct.pack("=II", 1, 72))
+	file.write(event(1500000000000000000, 0, TCP)) # BIB created
+	file.write(event(1500000000001000000, 2, TCP)) # Session created
+	file.write(event(1500000000002000000, 3, TCP)) # Session removed
+	file.write(event(1500000000003000000, 1, TCP)) # BIB removed
+PYTHON
+
+python3 collector.py 127.0.0.1 $PORT 4 > $OUTPUT &
+COLLECTOR=$!
+sleep 1
+
+$JOOL_IPFIX --collector 127.0.0.1 --port $PORT --replay $EVENTS > /dev/null || exit 1
+wait $COLLECTOR
+
+cat $OUTPUT
+EXPECTED="seq=0 template=257 observationTimeMilliseconds=1500000000000 natEvent=8 sourceIPv6Address=2001:db8::2 postNATSourceIPv4Address=192.0.2.1 protocolIdentifier=6 sourceTransportPort=1234 postNAPTSourceTransportPort=61000
+seq=1 template=256 observationTimeMilliseconds=1500000000001 natEvent=4 sourceIPv6Address=2001:db8::2 postNATSourceIPv4Address=192.0.2.1 protocolIdentifier=6 sourceTransportPort=1234 postNAPTSourceTransportPort=61000 destinationIPv6Address=64:ff9b::c000:202 postNATDestinationIPv4Address=192.0.2.2 destinationTransportPort=80 postNAPTDestinationTransportPort=80
+seq=2 template=256 observationTimeMilliseconds=1500000000002 natEvent=5 sourceIPv6Address=2001:db8::2 postNATSourceIPv4Address=192.0.2.1 protocolIdentifier=6 sourceTransportPort=1234 postNAPTSourceTransportPort=61000 destinationIPv6Address=64:ff9b::c000:202 postNATDestinationIPv4Address=192.0.2.2 destinationTransportPort=80 postNAPTDestinationTransportPort=80
+seq=3 template=257 observationTimeMilliseconds=1500000000003 natEvent=9 sourceIPv6Address=2001:db8::2 postNATSourceIPv4Address=192.0.2.1 protocolIdentifier=6 sourceTransportPort=1234 postNAPTSourceTransportPort=61000"
+
+if [ "$(cat $OUTPUT)" == "$EXPECTED" ]; then
+	echo "Success."
+	exit 0
+fi
+
+echo "The collector did not get the expected records."
+exit 1
@@ -0,0 +1,64 @@
+#!/bin/bash
+
+# See ReadMe.txt.
+
+JOOL=${JOOL:-../../usr/stateful/jool}
+JOOL_SYNC=${JOOL_SYNC:-../../usr/stateful/jool-sync}
+OUTPUT=$(mktemp)
+
+cleanup() {
+	kill $SENDER $RECEIVER 2> /dev/null
+	wait $SENDER $RECEIVER 2> /dev/null
+	ip netns del sync-client 2> /dev/null
+	ip netns del sync-standby 2> /dev/null
+	$JOOL --session-sync false > /dev/null
+	rm -f $OUTPUT
+}
+trap cleanup EXIT
+
+set -e
+
+# The IPv6 client, whose ping will create the session.
+ip netns add sync-client
+ip link add sync-c0 type veth peer name sync-c1
+ip link set sync-c1 netns sync-client
+ip addr add 2001:db8:5::1/64 dev sync-c0 nodad
+ip link set sync-c0 up
+ip netns exec sync-client ip addr add 2001:db8:5::2/64 dev sync-c1 nodad
+ip netns exec sync-client ip link set sync-c1 up
+ip netns exec sync-client ip -6 route add 64:ff9b::/96 via 2001:db8:5::1
+sysctl -qw net.ipv6.conf.all.forwarding=1
+
+# The standby, which only runs the receiver.
+ip netns add sync-standby
+ip link add sync-s0 type veth peer name sync-s1
+ip link set sync-s1 netns sync-standby
+ip addr add 10.99.0.1/24 dev sync-s0
+ip link set sync-s0 up
+ip netns exec sync-standby ip addr add 10.99.0.2/24 dev sync-s1
+ip netns exec sync-standby ip link set sync-s1 up
+
+$JOOL --session-sync true > /dev/null
+
+ip netns exec sync-standby $JOOL_SYNC --receive --listen 10.99.0.2 --dry-run > $OUTPUT &
+RECEIVER=$!
+sleep 1
+$JOOL_SYNC --send 10.99.0.2 > /dev/null &
+SENDER=$!
+sleep 1
+
+set +e
+
+# Nobody answers; the session is created regardless.
+ip netns exec sync-client ping6 -c 1 -W 1 64:ff9b::192.0.2.2 > /dev/null
+sleep 1
+
+echo "Received:"
+cat $OUTPUT
+if grep -q "^ICMP UPDATE 2001:db8:5::2#" $OUTPUT; then
+	echo "Success."
+	exit 0
+fi
+
+echo "The ICMP session did not reach the standby."
+exit 1
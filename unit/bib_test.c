@@ -454,6 +454,67 @@ fail:
 	return false;
 }
 
+struct log_counters {
+	struct log_event_usr first;
+	unsigned int events;
+	unsigned int lost;
+};
+
+static int count_event(struct log_event_usr *event, void *arg)
+{
+	struct log_counters *counters = arg;
+
+	if (event->type == LOG_EVENT_LOST) {
+		counters->lost += event->lost;
+		return 0;
+	}
+
+	if (counters->events == 0)
+		counters->first = *event;
+	counters->events++;
+	return 0;
+}
+
+static bool test_event_log(void)
+{
+	struct bib_entry *bib;
+	struct log_counters counters;
+	unsigned int i;
+	bool success = true;
+
+	bib = bib_create(&addr4[0], &addr6[0], false, L4PROTO_UDP);
+	if (!bib)
+		return false;
+	if (eventlog_init()) {
+		bib_kfree(bib);
+		return false;
+	}
+
+	eventlog_bib(bib, LOG_EVENT_BIB_ADD);
+	memset(&counters, 0, sizeof(counters));
+	success &= assert_equals_int(0, eventlog_drain(count_event, &counters), "Drain");
+	success &= assert_equals_int(1, counters.events, "Event count");
+	success &= assert_equals_int(LOG_EVENT_BIB_ADD, counters.first.type, "Type");
+	success &= assert_equals_int(L4PROTO_UDP, counters.first.l4_proto, "Protocol");
+	success &= assert_equals_ipv6(&addr6[0].l3, &counters.first.remote6.l3, "IPv6 address");
+	success &= assert_equals_u16(addr6[0].l4, counters.first.remote6.l4, "IPv6 port");
+	success &= assert_equals_ipv4(&addr4[0].l3, &counters.first.local4.l3, "IPv4 address");
+	success &= assert_equals_u16(addr4[0].l4, counters.first.local4.l4, "IPv4 port");
+	success &= assert_true(counters.first.time != 0, "Timestamp");
+
+	/* Way more than any CPU can hold; the ring has to report the excess instead. */
+	for (i = 0; i < 100000; i++)
+		eventlog_bib(bib, LOG_EVENT_BIB_REMOVE);
+	memset(&counters, 0, sizeof(counters));
+	success &= assert_equals_int(0, eventlog_drain(count_event, &counters), "Overflow drain");
+	success &= assert_true(counters.lost > 0, "Overflow was reported");
+	success &= assert_equals_int(100000, counters.events + counters.lost, "All accounted");
+
+	eventlog_destroy();
+	bib_kfree(bib);
+	return success;
+}
+
 static bool init(void)
 {
 	char *pool4_addrs[] = { "1.1.1.1", "2.2.2.2" };
@@ -479,7 +540,7 @@ static bool init(void)
 		return false;
 	}
 
-	if (is_error(bibdb_init())) {
+	if (is_error(bibdb_init(0))) {
 		pool4_destroy();
 		config_destroy();
 		return false;
@@ -504,6 +565,7 @@ int init_module(void)
 	INIT_CALL_END(init(), test_compare_addr6(), end(), "compare_addr6");
 	INIT_CALL_END(init(), test_compare_full6(), end(), "compare_full6");
 	INIT_CALL_END(init(), test_compare_addr4(), end(), "compare_addr4");
+	INIT_CALL_END(init(), test_event_log(), end(), "Binary event log");
 
 	END_TESTS;
 }
@@ -0,0 +1,159 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Unit tests for the blacklist (SIIT's pool4)");
+
+#include "nat64/common/str_utils.h"
+#include "nat64/unit/unit_test.h"
+#include "../mod/stateless/pool4.c"
+
+static bool init(void)
+{
+	return !pool4_init(NULL, 0);
+}
+
+static void end(void)
+{
+	pool4_destroy();
+}
+
+static int add(char *addr_str, __u8 len)
+{
+	struct ipv4_prefix prefix;
+
+	if (str_to_addr4(addr_str, &prefix.address))
+		return -EINVAL;
+	prefix.len = len;
+
+	return pool4_add(&prefix);
+}
+
+static int rm(char *addr_str, __u8 len)
+{
+	struct ipv4_prefix prefix;
+
+	if (str_to_addr4(addr_str, &prefix.address))
+		return -EINVAL;
+	prefix.len = len;
+
+	return pool4_remove(&prefix);
+}
+
+static bool contains(char *addr_str, bool expected)
+{
+	struct in_addr addr;
+
+	if (str_to_addr4(addr_str, &addr))
+		return false;
+
+	return assert_equals_int(expected, pool4_contains(addr.s_addr), addr_str);
+}
+
+/**
+ * The set has to follow every change made to the pool, whether the address lands in the hash or
+ * in the trie.
+ */
+static bool test_pool_changes(void)
+{
+	bool success = true;
+
+	success &= contains("192.0.2.1", false);
+	success &= contains("198.51.100.77", false);
+
+	success &= assert_equals_int(0, add("192.0.2.1", 32), "add /32");
+	success &= assert_equals_int(0, add("198.51.100.0", 24), "add /24");
+	success &= assert_equals_int(0, add("203.0.113.16", 28), "add /28");
+	success &= assert_equals_int(0, add("0.0.0.0", 32), "add 0.0.0.0");
+
+	success &= contains("192.0.2.1", true);
+	success &= contains("192.0.2.2", false);
+	success &= contains("198.51.100.0", true);
+	success &= contains("198.51.100.255", true);
+	success &= contains("198.51.101.0", false);
+	success &= contains("203.0.113.15", false);
+	success &= contains("203.0.113.20", true);
+	success &= contains("203.0.113.32", false);
+	success &= contains("0.0.0.0", true);
+
+	success &= assert_equals_int(0, rm("198.51.100.0", 24), "remove /24");
+	success &= contains("198.51.100.77", false);
+	success &= contains("203.0.113.20", true);
+	success &= assert_equals_int(0, rm("192.0.2.1", 32), "remove /32");
+	success &= contains("192.0.2.1", false);
+
+	success &= assert_equals_int(0, pool4_flush(), "flush");
+	success &= contains("203.0.113.20", false);
+	success &= contains("0.0.0.0", false);
+
+	return success;
+}
+
+/**
+ * The node's own addresses are members as well; loopback is always there.
+ */
+static bool test_interfaces(void)
+{
+	return contains("127.0.0.1", true);
+}
+
+/**
+ * Staged changes must not reach the set until the transaction is committed.
+ */
+static bool test_transaction(void)
+{
+	bool success = true;
+
+	pool4_txn_begin();
+	success &= assert_equals_int(0, add("192.0.2.0", 24), "staged add");
+	success &= contains("192.0.2.10", false);
+	pool4_txn_commit();
+	success &= contains("192.0.2.10", true);
+
+	pool4_txn_begin();
+	success &= assert_equals_int(0, rm("192.0.2.0", 24), "staged remove");
+	pool4_txn_abort();
+	success &= contains("192.0.2.10", true);
+
+	return success;
+}
+
+/**
+ * The module parameters are not checked for intersections, so the trie has to cope with nested
+ * prefixes no matter their order.
+ */
+static bool test_nested_params(void)
+{
+	char *params[] = { "10.0.0.0/24", "10.0.0.0/8", "10.1.0.0/16", "10.2.2.2" };
+	bool success = true;
+
+	if (pool4_init(params, ARRAY_SIZE(params)))
+		return false;
+
+	success &= contains("10.0.0.1", true);
+	success &= contains("10.200.1.1", true);
+	success &= contains("10.1.1.1", true);
+	success &= contains("10.2.2.2", true);
+	success &= contains("11.0.0.0", false);
+
+	pool4_destroy();
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("Blacklist");
+
+	INIT_CALL_END(init(), test_pool_changes(), end(), "Pool changes");
+	INIT_CALL_END(init(), test_interfaces(), end(), "Interface addresses");
+	INIT_CALL_END(init(), test_transaction(), end(), "Transactions");
+	CALL_TEST(test_nested_params(), "Nested module parameters");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -0,0 +1,335 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Unit tests for the classifier");
+
+#include "nat64/common/str_utils.h"
+#include "nat64/unit/unit_test.h"
+#include "../mod/common/classifier.c"
+
+static bool add4(struct range_list *list, char *addr_str, __u8 len)
+{
+	struct ipv4_prefix prefix;
+	int error;
+
+	if (str_to_addr4(addr_str, &prefix.address))
+		return false;
+	prefix.len = len;
+
+	error = add_prefix4(&prefix, list);
+	if (error == -ENOSPC) {
+		if (list_grow(list))
+			return false;
+		error = add_prefix4(&prefix, list);
+	}
+
+	return assert_equals_int(0, error, addr_str);
+}
+
+static bool add6(struct range_list *list, char *addr_str, __u8 len)
+{
+	struct ipv6_prefix prefix;
+	int error;
+
+	if (str_to_addr6(addr_str, &prefix.address))
+		return false;
+	prefix.len = len;
+
+	error = add_prefix6(&prefix, list);
+	if (error == -ENOSPC) {
+		if (list_grow(list))
+			return false;
+		error = add_prefix6(&prefix, list);
+	}
+
+	return assert_equals_int(0, error, addr_str);
+}
+
+static bool lookup4(struct classifier_table *table, char *addr_str, enum classifier_class expected)
+{
+	struct in_addr addr;
+	struct classifier_key key;
+
+	if (str_to_addr4(addr_str, &addr))
+		return false;
+	key4_init(&key, addr.s_addr);
+
+	return assert_equals_int(expected, table_lookup(table, &key), addr_str);
+}
+
+static bool lookup6(struct classifier_table *table, char *addr_str, enum classifier_class expected)
+{
+	struct in6_addr addr;
+	struct classifier_key key;
+
+	if (str_to_addr6(addr_str, &addr))
+		return false;
+	key6_init(&key, &addr);
+
+	return assert_equals_int(expected, table_lookup(table, &key), addr_str);
+}
+
+/**
+ * The compiled table has to start at zero, be sorted, and never repeat a class in consecutive
+ * segments. Also, every segment start has to agree with the uncompiled lists.
+ */
+static bool validate_table(struct classifier_table *table, struct range_list *blacklist,
+		struct range_list *pool)
+{
+	struct classifier_segment *segment;
+	unsigned int i;
+	bool success = true;
+
+	if (!assert_true(table->count > 0, "segment count"))
+		return false;
+	success &= assert_equals_u64(0, table->segments[0].start.hi, "first start (hi)");
+	success &= assert_equals_u64(0, table->segments[0].start.lo, "first start (lo)");
+
+	for (i = 0; i < table->count; i++) {
+		segment = &table->segments[i];
+		success &= assert_equals_int(classify_key(blacklist, pool, &segment->start),
+				segment->class, "segment class");
+		if (i == 0)
+			continue;
+		success &= assert_true(key_cmp(&segment[-1].start, &segment->start) < 0, "sorted");
+		success &= assert_true(segment[-1].class != segment->class, "merged");
+	}
+
+	return success;
+}
+
+static bool test_compile4(void)
+{
+	struct range_list blacklist = { .ranges = NULL, .count = 0, .capacity = 0 };
+	struct range_list pool = { .ranges = NULL, .count = 0, .capacity = 0 };
+	struct classifier_table table = { .segments = NULL, .count = 0 };
+	bool success = true;
+
+	/* Nested and overlapping blacklist prefixes. */
+	success &= add4(&blacklist, "10.0.0.0", 8);
+	success &= add4(&blacklist, "10.1.0.0", 16);
+	success &= add4(&blacklist, "192.0.2.128", 25);
+	success &= add4(&blacklist, "255.255.255.255", 32);
+
+	/* Pool prefixes which overlap each other, fall inside of the blacklist, or straddle it. */
+	success &= add4(&pool, "10.1.2.0", 24);
+	success &= add4(&pool, "192.0.2.0", 24);
+	success &= add4(&pool, "192.0.2.0", 26);
+	success &= add4(&pool, "198.51.100.0", 31);
+	success &= add4(&pool, "198.51.100.1", 32);
+	/* Contiguous; should become a single segment. */
+	success &= add4(&pool, "203.0.113.0", 25);
+	success &= add4(&pool, "203.0.113.128", 25);
+	if (!success)
+		goto end;
+
+	list_normalize(&blacklist, &max4);
+	list_normalize(&pool, &max4);
+	success &= assert_equals_int(3, blacklist.count, "normalized blacklist");
+	success &= assert_equals_int(4, pool.count, "normalized pool");
+
+	if (!assert_equals_int(0, table_compile(&table, &blacklist, &pool, &max4), "compile"))
+		goto end;
+	success &= validate_table(&table, &blacklist, &pool);
+
+	success &= lookup4(&table, "0.0.0.0", CLASS_NONE);
+	success &= lookup4(&table, "9.255.255.255", CLASS_NONE);
+	success &= lookup4(&table, "10.0.0.0", CLASS_BLACKLIST);
+	success &= lookup4(&table, "10.1.2.3", CLASS_BLACKLIST);
+	success &= lookup4(&table, "10.255.255.255", CLASS_BLACKLIST);
+	success &= lookup4(&table, "11.0.0.0", CLASS_NONE);
+	success &= lookup4(&table, "192.0.1.255", CLASS_NONE);
+	success &= lookup4(&table, "192.0.2.0", CLASS_POOL);
+	success &= lookup4(&table, "192.0.2.63", CLASS_POOL);
+	success &= lookup4(&table, "192.0.2.127", CLASS_POOL);
+	success &= lookup4(&table, "192.0.2.128", CLASS_BLACKLIST);
+	success &= lookup4(&table, "192.0.2.255", CLASS_BLACKLIST);
+	success &= lookup4(&table, "192.0.3.0", CLASS_NONE);
+	success &= lookup4(&table, "198.51.100.0", CLASS_POOL);
+	success &= lookup4(&table, "198.51.100.1", CLASS_POOL);
+	success &= lookup4(&table, "198.51.100.2", CLASS_NONE);
+	success &= lookup4(&table, "203.0.113.127", CLASS_POOL);
+	success &= lookup4(&table, "203.0.113.128", CLASS_POOL);
+	success &= lookup4(&table, "203.0.114.0", CLASS_NONE);
+	success &= lookup4(&table, "255.255.255.254", CLASS_NONE);
+	success &= lookup4(&table, "255.255.255.255", CLASS_BLACKLIST);
+
+	/*
+	 * none, blacklist (10/8), none, pool (192.0.2.0/25), blacklist (192.0.2.128/25), none,
+	 * pool (198.51.100.0/31), none, pool (203.0.113.0/24), none, blacklist (255.255.255.255).
+	 */
+	success &= assert_equals_int(11, table.count, "segment count");
+
+end:
+	kfree(table.segments);
+	kfree(blacklist.ranges);
+	kfree(pool.ranges);
+	return success;
+}
+
+/**
+ * Ranges that reach the end of the address space must not overflow the bounds.
+ */
+static bool test_compile6(void)
+{
+	struct range_list blacklist = { .ranges = NULL, .count = 0, .capacity = 0 };
+	struct range_list pool = { .ranges = NULL, .count = 0, .capacity = 0 };
+	struct classifier_table table = { .segments = NULL, .count = 0 };
+	bool success = true;
+
+	success &= add6(&blacklist, "fe80::", 10);
+	success &= add6(&blacklist, "fe80::1", 128);
+	success &= add6(&blacklist, "ff00::", 8);
+	success &= add6(&pool, "::", 0);
+	success &= add6(&pool, "64:ff9b::", 96);
+	if (!success)
+		goto end;
+
+	list_normalize(&blacklist, &max6);
+	list_normalize(&pool, &max6);
+	success &= assert_equals_int(2, blacklist.count, "normalized blacklist");
+	success &= assert_equals_int(1, pool.count, "normalized pool");
+
+	if (!assert_equals_int(0, table_compile(&table, &blacklist, &pool, &max6), "compile"))
+		goto end;
+	success &= validate_table(&table, &blacklist, &pool);
+
+	success &= lookup6(&table, "::", CLASS_POOL);
+	success &= lookup6(&table, "64:ff9b::192.0.2.1", CLASS_POOL);
+	success &= lookup6(&table, "2001:db8::1", CLASS_POOL);
+	success &= lookup6(&table, "fe7f:ffff:ffff:ffff:ffff:ffff:ffff:ffff", CLASS_POOL);
+	success &= lookup6(&table, "fe80::1", CLASS_BLACKLIST);
+	success &= lookup6(&table, "febf:ffff:ffff:ffff:ffff:ffff:ffff:ffff", CLASS_BLACKLIST);
+	success &= lookup6(&table, "fec0::", CLASS_POOL);
+	success &= lookup6(&table, "ff02::1", CLASS_BLACKLIST);
+	success &= lookup6(&table, "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", CLASS_BLACKLIST);
+	success &= assert_equals_int(4, table.count, "segment count");
+
+end:
+	kfree(table.segments);
+	kfree(blacklist.ranges);
+	kfree(pool.ranges);
+	return success;
+}
+
+static bool translate4(char *src_str, char *dst_str, bool expected)
+{
+	struct in_addr src, dst;
+	bool result;
+
+	if (str_to_addr4(src_str, &src) || str_to_addr4(dst_str, &dst))
+		return false;
+
+	rcu_read_lock_bh();
+	result = classifier_translate4(src.s_addr, dst.s_addr);
+	rcu_read_unlock_bh();
+
+	return assert_equals_int(expected, result, dst_str);
+}
+
+static bool translate6(char *src_str, char *dst_str, bool expected)
+{
+	struct in6_addr src, dst;
+	bool result;
+
+	if (str_to_addr6(src_str, &src) || str_to_addr6(dst_str, &dst))
+		return false;
+
+	rcu_read_lock_bh();
+	result = classifier_translate6(&src, &dst);
+	rcu_read_unlock_bh();
+
+	return assert_equals_int(expected, result, dst_str);
+}
+
+#define FILL_COUNT 20
+
+/** Pretends to be a pool of FILL_COUNT prefixes (192.0.2.0/32 onwards). */
+static int fill_many(struct range_list *list)
+{
+	struct ipv4_prefix prefix;
+	unsigned int i;
+	int error;
+
+	prefix.len = 32;
+	for (i = 0; i < FILL_COUNT; i++) {
+		prefix.address.s_addr = cpu_to_be32(0xc0000200U | i);
+		error = add_prefix4(&prefix, list);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+/**
+ * The list can't grow while a pool is visiting it, so list_fill() has to start over whenever it
+ * runs out of room.
+ */
+static bool test_fill(void)
+{
+	struct range_list list = { .ranges = NULL, .count = 0, .capacity = 0 };
+	bool success = true;
+
+	success &= assert_equals_int(0, list_fill(&list, fill_many), "result");
+	success &= assert_equals_int(FILL_COUNT, list.count, "count");
+	success &= assert_true(list.capacity >= FILL_COUNT, "capacity");
+
+	kfree(list.ranges);
+	return success;
+}
+
+/**
+ * The whole thing, out of the actual blacklist and pools.
+ * (pool4 is the impersonator, which only contains 192.0.2.128.)
+ */
+static bool test_rebuild(void)
+{
+	char *pool6_prefixes[] = { "64:ff9b::/96" };
+	bool success = true;
+
+	if (pool4_init(NULL, 0))
+		return false;
+	if (pool6_init(pool6_prefixes, ARRAY_SIZE(pool6_prefixes)))
+		goto pool6_fail;
+	if (!assert_equals_int(0, classifier_init(), "init"))
+		goto classifier_fail;
+
+	success &= translate4("203.0.113.1", "192.0.2.128", true);
+	success &= translate4("203.0.113.1", "192.0.2.129", false);
+	success &= translate4("127.0.0.1", "192.0.2.128", false);
+	success &= translate4("203.0.113.1", "224.0.0.1", false);
+
+	success &= translate6("2001:db8::1", "64:ff9b::192.0.2.1", true);
+	success &= translate6("2001:db8::1", "64:ff9c::192.0.2.1", false);
+	success &= translate6("fe80::1", "64:ff9b::192.0.2.1", false);
+	success &= translate6("::1", "64:ff9b::192.0.2.1", false);
+
+	classifier_destroy();
+	/* Fall through. */
+classifier_fail:
+	pool6_destroy();
+	/* Fall through. */
+pool6_fail:
+	pool4_destroy();
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("Classifier");
+
+	CALL_TEST(test_compile4(), "IPv4 compilation");
+	CALL_TEST(test_compile6(), "IPv6 compilation");
+	CALL_TEST(test_fill(), "Refill on growth");
+	CALL_TEST(test_rebuild(), "Full rebuild");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
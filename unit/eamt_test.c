@@ -8,6 +8,7 @@
 #include <linux/module.h> /* Needed by all modules */
 #include <linux/kernel.h> /* Needed for KERN_INFO */
 #include <linux/init.h> /* Needed for the macros */
+#include <linux/ktime.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("dhernandez");
@@ -107,6 +108,48 @@ static bool test(char *addr4_str, char *addr6_str)
 	return success;
 }
 
+static bool init_entry_usr(struct eam_entry_usr *entry, char *addr4, __u8 len4, char *addr6,
+		__u8 len6)
+{
+	if (str_to_addr4(addr4, &entry->pref4.address))
+		return false;
+	entry->pref4.len = len4;
+
+	if (str_to_addr6(addr6, &entry->pref6.address))
+		return false;
+	entry->pref6.len = len6;
+
+	return true;
+}
+
+static bool add_batch_test(void)
+{
+	struct eam_entry_usr entries[4];
+	__s32 results[4];
+	bool success = true;
+
+	if (!init_entry_usr(&entries[0], "1.0.0.0", 24, "1::", 120))
+		return false;
+	if (!init_entry_usr(&entries[1], "1.0.0.0", 24, "1::", 120))
+		return false;
+	if (!init_entry_usr(&entries[2], "2.0.0.0", 24, "2::", 124))
+		return false;
+	if (!init_entry_usr(&entries[3], "3.0.0.0", 24, "3::", 120))
+		return false;
+
+	success &= assert_equals_int(0, eamt_add_batch(entries, 4, results), "batch result");
+	success &= assert_equals_int(0, results[0], "first");
+	success &= assert_equals_int(-EEXIST, results[1], "collides with the first");
+	success &= assert_equals_int(-EINVAL, results[2], "bigger suffix4");
+	success &= assert_equals_int(0, results[3], "unrelated to the rest");
+	success &= assert_equals_u64(2, live_table()->count, "Table count");
+
+	success &= test("1.0.0.1", "1::1");
+	success &= test("3.0.0.255", "3::ff");
+
+	return success;
+}
+
 static bool daniel_test(void)
 {
 	bool success = true;
@@ -154,6 +197,67 @@ static bool anderson_test(void)
 	return success;
 }
 
+/**
+ * Suffixes which land on the upper half of the IPv6 address, or straddle both halves.
+ */
+static bool halves_test(void)
+{
+	bool success = true;
+
+	success &= add_entry("10.1.0.0", 16, "2001:db8:200:fff0::", 60);
+	success &= add_entry("172.16.0.0", 12, "2001:db8::", 44);
+	success &= add_entry("192.0.0.0", 8, "2001:db8:100::", 104);
+	if (!success)
+		return false;
+
+	success &= test("10.1.0.0", "2001:db8:200:fff0::");
+	success &= test("10.1.171.205", "2001:db8:200:fffa:bcd0::");
+	success &= test("10.1.255.255", "2001:db8:200:ffff:fff0::");
+	success &= test("172.20.3.4", "2001:db8:4:304::");
+	success &= test("172.31.255.255", "2001:db8:f:ffff::");
+	success &= test("192.1.2.3", "2001:db8:100::1:203");
+
+	return success;
+}
+
+#define BENCHMARK_ITERATIONS 1000000
+
+/**
+ * Not really a test; measures how long an EAM round trip takes for the given prefix lengths.
+ * The round trip has to survive every iteration, so the compiler can't optimize the loop away.
+ */
+static bool benchmark(char *addr4_str, __u8 len4, char *addr6_str, __u8 len6)
+{
+	struct in_addr prefix4, addr4, expected;
+	struct in6_addr addr6;
+	__u32 suffix_mask = (1U << (32 - len4)) - 1;
+	ktime_t start, end;
+	unsigned int i;
+	bool success = true;
+
+	if (!add_entry(addr4_str, len4, addr6_str, len6))
+		return false;
+	if (str_to_addr4(addr4_str, &prefix4))
+		return false;
+
+	addr4 = prefix4;
+	start = ktime_get();
+	for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		addr4.s_addr = cpu_to_be32(be32_to_cpu(prefix4.s_addr) | (i & suffix_mask));
+		eamt_get_ipv6_by_ipv4(&addr4, &addr6);
+		eamt_get_ipv4_by_ipv6(&addr6, &addr4);
+	}
+	end = ktime_get();
+
+	expected.s_addr = cpu_to_be32(be32_to_cpu(prefix4.s_addr)
+			| ((BENCHMARK_ITERATIONS - 1) & suffix_mask));
+	success &= assert_equals_ipv4(&expected, &addr4, "Round trip");
+
+	log_info("/%u <-> /%u: %lld nsecs per round trip.", len4, len6,
+			ktime_to_ns(ktime_sub(end, start)) / BENCHMARK_ITERATIONS);
+	return success;
+}
+
 static bool remove_entry(char *addr4, __u8 len4, char *addr6, __u8 len6, int expected_error)
 {
 	struct ipv4_prefix prefix4;
@@ -199,7 +303,7 @@ static bool remove_test(void)
 	success &= remove_entry("10.0.1.0", 24, "1::", 120, -EINVAL);
 	success &= remove_entry("10.0.0.0", 24, "1::", 120, 0);
 
-	success &= assert_equals_u64(0, eam_table.count, "Table count");
+	success &= assert_equals_u64(0, live_table()->count, "Table count");
 	if (!success)
 		return false;
 
@@ -210,7 +314,38 @@ static bool remove_test(void)
 		return false;
 
 	success &= assert_equals_int(0, eamt_flush(), "flush result");
-	success &= assert_equals_u64(0, eam_table.count, "Table count 2");
+	success &= assert_equals_u64(0, live_table()->count, "Table count 2");
+
+	return success;
+}
+
+static bool txn_test(void)
+{
+	struct in_addr addr4;
+	struct in6_addr result6;
+	bool success = true;
+
+	if (str_to_addr4("2.0.0.1", &addr4))
+		return false;
+
+	success &= add_entry("1.0.0.0", 24, "1::", 120);
+
+	eamt_txn_begin();
+	success &= add_entry("2.0.0.0", 24, "2::", 120);
+	success &= remove_entry("1.0.0.0", 24, "1::", 120, 0);
+	/* The packet path still sees the old table. */
+	success &= test("1.0.0.1", "1::1");
+	success &= assert_equals_int(-ESRCH, eamt_get_ipv6_by_ipv4(&addr4, &result6), "staged");
+	success &= assert_equals_u64(1, live_table()->count, "Count before commit");
+
+	eamt_txn_commit();
+	success &= test("2.0.0.1", "2::1");
+	success &= assert_equals_u64(1, live_table()->count, "Count after commit");
+
+	eamt_txn_begin();
+	success &= assert_equals_int(0, eamt_flush(), "flush result");
+	eamt_txn_abort();
+	success &= test("2.0.0.1", "2::1");
 
 	return success;
 }
@@ -220,9 +355,20 @@ static int address_mapping_test_init(void)
 	START_TESTS("Address Mapping test");
 
 	INIT_CALL_END(init(), add_test(), end(), "add function");
+	INIT_CALL_END(init(), add_batch_test(), end(), "batched add function");
 	INIT_CALL_END(init(), daniel_test(), end(), "Daniel's translation tests");
 	INIT_CALL_END(init(), anderson_test(), end(), "Translation tests from T. Anderson's draft");
+	INIT_CALL_END(init(), halves_test(), end(), "Translations across the IPv6 halves");
 	INIT_CALL_END(init(), remove_test(), end(), "remove function");
+	INIT_CALL_END(init(), txn_test(), end(), "transactions");
+
+	INIT_CALL_END(init(), benchmark("192.0.2.1", 32, "2001:db8::1", 128), end(), "Benchmark /32");
+	INIT_CALL_END(init(), benchmark("192.0.2.0", 24, "2001:db8::", 120), end(), "Benchmark /24");
+	INIT_CALL_END(init(), benchmark("10.0.0.0", 16, "2001:db8::", 112), end(), "Benchmark /16");
+	INIT_CALL_END(init(), benchmark("10.0.0.0", 16, "2001:db8::", 48), end(),
+			"Benchmark /16 (upper half)");
+	INIT_CALL_END(init(), benchmark("10.0.0.0", 8, "2001:db8::", 56), end(),
+			"Benchmark /8 (straddling)");
 
 	END_TESTS;
 }
@@ -396,7 +396,7 @@ static bool test_tcp_closed_state_handle_4(void)
 	success &= assert_equals_int(1, icmp64_pop(), "ICMP sent");
 
 	session_return(session);
-	/* kfree_skb(skb); "skb" kfreed when pktqueue is executed */
+	/* kfree_skb(skb); "skb" kfreed when the packet is queued */
 	return success;
 }
 
@@ -484,12 +484,120 @@ static bool test_tcp(void)
 	return success;
 }
 
+/**
+ * The chain is V6 SYN (to someone else, to create the BIB entry) --> stateless V4 SYN -->
+ * V6 SYN+ACK.
+ * Then a second stateless V4 SYN, this time "answered" by a plain V6 SYN.
+ */
+static bool test_tcp_stateless(void)
+{
+	struct global_config config;
+	struct tuple tuple6, tuple4;
+	struct packet pkt;
+	struct sk_buff *skb;
+	bool success = true;
+
+	if (is_error(init_ipv6_tuple(&tuple6, "1::2", 1212, "3::5", 3434, L4PROTO_TCP)))
+		return false;
+	if (is_error(init_ipv4_tuple(&tuple4, "0.0.0.4", 3434, "192.0.2.128", 1024, L4PROTO_TCP)))
+		return false;
+
+	/* V6 SYN */
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV6, true, false, false)))
+		return false;
+	if (is_error(pkt_init_ipv6(&pkt, skb)))
+		return false;
+
+	config = *pkt.config;
+	config.stateless_external_tcp = true;
+
+	success &= assert_equals_int(VERDICT_CONTINUE, tcp(&pkt, &tuple6), "V6 SYN result");
+	success &= assert_session_count(1, L4PROTO_TCP);
+	kfree_skb(skb);
+
+	/* V4 SYN */
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV4, true, false, false)))
+		return false;
+	if (is_error(pkt_init_ipv4(&pkt, skb)))
+		return false;
+	pkt.config = &config;
+
+	success &= assert_equals_int(VERDICT_CONTINUE, tcp(&pkt, &tuple4), "V4 SYN result");
+	success &= assert_session_count(1, L4PROTO_TCP);
+	kfree_skb(skb);
+
+	/* V6 SYN+ACK (the answer) */
+	if (is_error(init_ipv6_tuple(&tuple6, "1::2", 1212, "3::4", 3434, L4PROTO_TCP)))
+		return false;
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV6, true, false, false)))
+		return false;
+	if (is_error(pkt_init_ipv6(&pkt, skb)))
+		return false;
+	pkt.config = &config;
+	pkt_tcp_hdr(&pkt)->ack = 1;
+
+	success &= assert_equals_int(VERDICT_CONTINUE, tcp(&pkt, &tuple6), "Answer result");
+	success &= assert_session_count(2, L4PROTO_TCP);
+	success &= assert_session_exists("1::2", 1212, "3::4", 3434,
+			"192.0.2.128", 1024, "0.0.0.4", 3434,
+			L4PROTO_TCP, ESTABLISHED);
+	kfree_skb(skb);
+
+	/* Another V4 SYN */
+	if (is_error(init_ipv4_tuple(&tuple4, "0.0.0.6", 3434, "192.0.2.128", 1024, L4PROTO_TCP)))
+		return false;
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV4, true, false, false)))
+		return false;
+	if (is_error(pkt_init_ipv4(&pkt, skb)))
+		return false;
+	pkt.config = &config;
+
+	success &= assert_equals_int(VERDICT_CONTINUE, tcp(&pkt, &tuple4), "V4 SYN 2 result");
+	success &= assert_session_count(2, L4PROTO_TCP);
+	kfree_skb(skb);
+
+	/* V6 SYN (no ACK, so not an answer) */
+	if (is_error(init_ipv6_tuple(&tuple6, "1::2", 1212, "3::6", 3434, L4PROTO_TCP)))
+		return false;
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV6, true, false, false)))
+		return false;
+	if (is_error(pkt_init_ipv6(&pkt, skb)))
+		return false;
+	pkt.config = &config;
+
+	success &= assert_equals_int(VERDICT_CONTINUE, tcp(&pkt, &tuple6), "Plain SYN result");
+	success &= assert_session_count(3, L4PROTO_TCP);
+	success &= assert_session_exists("1::2", 1212, "3::6", 3434,
+			"192.0.2.128", 1024, "0.0.0.6", 3434,
+			L4PROTO_TCP, V6_INIT);
+	kfree_skb(skb);
+
+	return success;
+}
+
 static void end(void)
 {
 	icmp64_pop();
 	end_full();
 }
 
+static bool init_stateless(void)
+{
+	if (!init_full())
+		return false;
+	if (is_error(synfilter_init(0))) {
+		end();
+		return false;
+	}
+	return true;
+}
+
+static void end_stateless(void)
+{
+	synfilter_destroy();
+	end();
+}
+
 static int filtering_test_init(void)
 {
 	START_TESTS("Filtering and Updating");
@@ -507,6 +615,7 @@ static int filtering_test_init(void)
 	INIT_CALL_END(init_full(), test_tcp_closed_state_handle_6(), end(), "TCP-CLOSED-6");
 	INIT_CALL_END(init_full(), test_tcp_closed_state_handle_4(), end(), "TCP-CLOSED-4");
 	INIT_CALL_END(init_full(), test_tcp(), end(), "test_tcp");
+	INIT_CALL_END(init_stateless(), test_tcp_stateless(), end_stateless(), "Stateless V4 SYN");
 
 	END_TESTS;
 }
@@ -0,0 +1,231 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include "nat64/mod/common/ipv6_hdr_iterator.h"
+#include "nat64/unit/unit_test.h"
+#include "nat64/unit/skb_generator.h"
+#include "nat64/unit/types.h"
+
+#include "fragment_cache.c"
+
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Fragment cache test");
+
+
+static struct tuple tuple6;
+/** Stands in for the tuple the first fragment would have been translated with. */
+static struct tuple tuple_out;
+
+static bool init_pkt(struct packet *pkt, struct sk_buff *skb)
+{
+	return assert_equals_int(0, pkt_init_ipv6(pkt, skb), "pkt init");
+}
+
+static bool validate_counters(unsigned int entries, unsigned int waiting)
+{
+	bool success = true;
+
+	spin_lock_bh(&cache_lock);
+	success &= assert_equals_int(entries, entry_count, "Entry count");
+	success &= assert_equals_int(waiting, waiting_count, "Waiting fragment count");
+	spin_unlock_bh(&cache_lock);
+
+	return success;
+}
+
+/**
+ * Makes every entry expire, and asserts the cache ends up empty.
+ */
+static bool flush(void)
+{
+	struct fragcache_entry *entry;
+
+	spin_lock_bh(&cache_lock);
+	list_for_each_entry(entry, &expire_list, list_hook)
+		entry->dying_time = jiffies - 1;
+	spin_unlock_bh(&cache_lock);
+
+	clean_expired_entries();
+	return validate_counters(0, 0);
+}
+
+static void set_frag_id(struct sk_buff *skb, unsigned int id)
+{
+	struct frag_hdr *hdr = hdr_iterator_find(ipv6_hdr(skb), NEXTHDR_FRAGMENT);
+	hdr->identification = cpu_to_be32(id);
+}
+
+static bool test_in_order(void)
+{
+	struct sk_buff *skb;
+	struct packet pkt;
+	struct sk_buff_head waiting;
+	struct tuple result;
+	bool success = true;
+
+	/* First fragment. */
+	if (create_skb6_udp_frag(&tuple6, &skb, 64 - sizeof(struct udphdr), 256, true, true, 0, 32))
+		return false;
+	if (!init_pkt(&pkt, skb))
+		return false;
+	success &= assert_true(fragcache_is_first(&pkt), "First is first");
+	success &= assert_false(fragcache_is_subsequent(&pkt), "First is not subsequent");
+	success &= assert_equals_int(VERDICT_CONTINUE, fragcache_validate(&pkt), "UDP validates");
+
+	__skb_queue_head_init(&waiting);
+	fragcache_add(&pkt, &tuple_out, &waiting);
+	success &= assert_true(skb_queue_empty(&waiting), "Nobody was waiting");
+	success &= validate_counters(1, 0);
+	kfree_skb(skb);
+
+	/* Subsequent fragment. */
+	if (create_skb6_udp_frag(&tuple6, &skb, 64, 256, true, true, 64, 32))
+		return false;
+	if (!init_pkt(&pkt, skb))
+		return false;
+	success &= assert_false(fragcache_is_first(&pkt), "Second is not first");
+	success &= assert_true(fragcache_is_subsequent(&pkt), "Second is subsequent");
+
+	success &= assert_equals_int(VERDICT_CONTINUE, fragcache_get(&pkt, &result), "get");
+	success &= assert_equals_ipv4(&tuple_out.dst.addr4.l3, &result.dst.addr4.l3, "dst addr");
+	success &= assert_equals_u16(tuple_out.dst.addr4.l4, result.dst.addr4.l4, "dst port");
+	success &= validate_counters(1, 0);
+	kfree_skb(skb);
+
+	success &= flush();
+	return success;
+}
+
+static bool test_out_of_order(void)
+{
+	struct sk_buff *skb1, *skb2, *skb3;
+	struct packet pkt;
+	struct sk_buff_head waiting;
+	struct tuple result;
+	bool success = true;
+
+	/* The last two fragments arrive first, and have to wait. */
+	if (create_skb6_udp_frag(&tuple6, &skb3, 64, 192, true, false, 128, 32))
+		return false;
+	if (!init_pkt(&pkt, skb3))
+		return false;
+	success &= assert_equals_int(VERDICT_STOLEN, fragcache_get(&pkt, &result), "get 3");
+	success &= validate_counters(1, 1);
+
+	if (create_skb6_udp_frag(&tuple6, &skb2, 64, 192, true, true, 64, 32))
+		return false;
+	if (!init_pkt(&pkt, skb2))
+		return false;
+	success &= assert_equals_int(VERDICT_STOLEN, fragcache_get(&pkt, &result), "get 2");
+	success &= validate_counters(1, 2);
+
+	/* The first one releases them, in arrival order. */
+	if (create_skb6_udp_frag(&tuple6, &skb1, 64 - sizeof(struct udphdr), 192, true, true, 0,
+			32))
+		return false;
+	if (!init_pkt(&pkt, skb1))
+		return false;
+
+	__skb_queue_head_init(&waiting);
+	fragcache_add(&pkt, &tuple_out, &waiting);
+	success &= assert_equals_int(2, skb_queue_len(&waiting), "Released fragments");
+	success &= assert_true(__skb_dequeue(&waiting) == skb3, "Third fragment released first");
+	success &= assert_true(__skb_dequeue(&waiting) == skb2, "Second fragment released second");
+	success &= validate_counters(1, 0);
+
+	kfree_skb(skb1);
+	kfree_skb(skb2);
+	kfree_skb(skb3);
+	success &= flush();
+	return success;
+}
+
+static bool test_limits(void)
+{
+	struct sk_buff *skb;
+	struct packet pkt;
+	struct tuple result;
+	unsigned int i;
+	bool success = true;
+
+	/* Fill the waiting room with orphans from different packets. */
+	for (i = 0; i < FRAGMENT_FWD_MAX_WAITING; i++) {
+		if (create_skb6_udp_frag(&tuple6, &skb, 64, 192, true, true, 64, 32))
+			return false;
+		set_frag_id(skb, i);
+		if (!init_pkt(&pkt, skb))
+			return false;
+		if (fragcache_get(&pkt, &result) != VERDICT_STOLEN) {
+			kfree_skb(skb);
+			return assert_true(false, "Orphan could not be stored");
+		}
+	}
+
+	if (create_skb6_udp_frag(&tuple6, &skb, 64, 192, true, true, 64, 32))
+		return false;
+	if (!init_pkt(&pkt, skb))
+		return false;
+	success &= assert_equals_int(VERDICT_DROP, fragcache_get(&pkt, &result), "Full room");
+	kfree_skb(skb);
+
+	/* Once their time comes, they all go away. */
+	success &= flush();
+	return success;
+}
+
+static bool test_validate(void)
+{
+	struct sk_buff *skb;
+	struct packet pkt;
+	struct tuple tuple;
+	bool success = true;
+
+	if (init_ipv6_tuple(&tuple, "1::2", 1212, "3::4", 1212, L4PROTO_ICMP))
+		return false;
+	if (create_skb6_icmp_info_frag(&tuple, &skb, 64 - sizeof(struct icmp6hdr), 192, true, true,
+			0, 32))
+		return false;
+	if (!init_pkt(&pkt, skb))
+		return false;
+
+	success &= assert_equals_int(VERDICT_DROP, fragcache_validate(&pkt), "ICMP validates");
+
+	kfree_skb(skb);
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("Fragment cache");
+
+	if (is_error(config_init(false)))
+		return -EINVAL;
+	if (is_error(fragcache_init(true))) {
+		config_destroy();
+		return -EINVAL;
+	}
+	if (init_ipv6_tuple(&tuple6, "1::2", 1212, "3::4", 3434, L4PROTO_UDP)
+			|| init_ipv4_tuple(&tuple_out, "192.0.2.1", 5678, "203.0.113.4", 3434,
+					L4PROTO_UDP)) {
+		fragcache_destroy();
+		config_destroy();
+		return -EINVAL;
+	}
+
+	CALL_TEST(test_in_order(), "First fragment arrives first");
+	CALL_TEST(test_out_of_order(), "First fragment arrives last");
+	CALL_TEST(test_limits(), "Waiting room limits");
+	CALL_TEST(test_validate(), "Untranslatable fragments");
+
+	fragcache_destroy();
+	config_destroy();
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
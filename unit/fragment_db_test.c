@@ -7,7 +7,6 @@
 #include "nat64/unit/validator.h"
 #include "nat64/unit/types.h"
 
-#define GENERATE_FOR_EACH true
 #include "fragment_db.c"
 
 
@@ -89,11 +88,18 @@ static bool validate_fragment(struct sk_buff *skb, bool has_frag_hdr, int l3_pay
 	return success;
 }
 
-static int fragdb_counter(struct reassembly_buffer *buffer, void *arg)
+static int count_table(void)
 {
-	unsigned int *int_arg = arg;
-	(*int_arg)++;
-	return 0;
+	struct frag_table *current_table = rcu_dereference_protected(table, true);
+	struct hlist_node *node;
+	unsigned int i;
+	int result = 0;
+
+	for (i = 0; i < current_table->size; i++)
+		hlist_for_each(node, &current_table->buckets[i].chain)
+			result++;
+
+	return result;
 }
 
 static bool validate_database(int expected_count)
@@ -109,9 +115,8 @@ static bool validate_database(int expected_count)
 	success &= assert_equals_int(expected_count, p, "Packets in the list");
 
 	/* table */
-	p = 0;
-	fragdb_table_for_each(&table, fragdb_counter, &p);
-	success &= assert_equals_int(expected_count, p, "Packets in the hash table");
+	success &= assert_equals_int(expected_count, count_table(), "Packets in the hash table");
+	success &= assert_equals_int(expected_count, atomic_read(&buffer_count), "Buffer counter");
 
 	return success;
 }
@@ -198,6 +203,88 @@ static bool test_happy_path(void)
 	return success;
 }
 
+static bool test_out_of_order(void)
+{
+	struct sk_buff *skb, *first;
+	struct tuple tuple6;
+	int error;
+	bool success = true;
+
+	error = init_ipv6_tuple(&tuple6, "1::2", 1212, "3::4", 3434, L4PROTO_UDP);
+	if (error)
+		return false;
+
+	/* Last fragment arrives. */
+	error = create_skb6_udp_frag(&tuple6, &skb, 192, 384, true, false, 192, 32);
+	if (error)
+		return false;
+	success &= assert_fragdb_handle(skb, VERDICT_STOLEN);
+	success &= validate_database(1);
+
+	/* First fragment arrives. */
+	error = create_skb6_udp_frag(&tuple6, &first, 64 - sizeof(struct udphdr), 384, true, true, 0,
+			32);
+	if (error)
+		return false;
+	success &= assert_fragdb_handle(first, VERDICT_STOLEN);
+	success &= validate_database(1);
+
+	/* The hole in the middle is plugged. */
+	error = create_skb6_udp_frag(&tuple6, &skb, 128, 384, true, true, 64, 32);
+	if (error)
+		return false;
+	success &= assert_fragdb_handle(skb, VERDICT_CONTINUE);
+	success &= validate_database(0);
+
+	success &= validate_packet(first, 3);
+	if (!success)
+		return false;
+
+	success &= validate_fragment(first, true, 64);
+	success &= validate_fragment(skb_shinfo(first)->frag_list, true, 128);
+	success &= validate_fragment(skb_shinfo(first)->frag_list->next, true, 192);
+
+	kfree_skb(first);
+	return success;
+}
+
+static bool test_overlap(void)
+{
+	struct sk_buff *skb;
+	struct tuple tuple6;
+	int error;
+	bool success = true;
+
+	error = init_ipv6_tuple(&tuple6, "1::2", 1212, "3::4", 3434, L4PROTO_UDP);
+	if (error)
+		return false;
+
+	error = create_skb6_udp_frag(&tuple6, &skb, 64 - sizeof(struct udphdr), 384, true, true, 0, 32);
+	if (error)
+		return false;
+	success &= assert_fragdb_handle(skb, VERDICT_STOLEN);
+	success &= validate_database(1);
+
+	/* Duplicates are dropped, but the packet survives. */
+	error = create_skb6_udp_frag(&tuple6, &skb, 64 - sizeof(struct udphdr), 384, true, true, 0, 32);
+	if (error)
+		return false;
+	success &= assert_fragdb_handle(skb, VERDICT_DROP);
+	success &= validate_database(1);
+	kfree_skb(skb);
+
+	/* Overlaps take the whole packet with them. */
+	error = create_skb6_udp_frag(&tuple6, &skb, 64, 384, true, true, 32, 32);
+	if (error)
+		return false;
+	success &= assert_fragdb_handle(skb, VERDICT_DROP);
+	success &= validate_database(0);
+	kfree_skb(skb);
+
+	success &= assert_equals_int(0, atomic_read(&mem), "Memory after the overlap");
+	return success;
+}
+
 struct frag_summary {
 	l3_protocol l3_proto;
 	union {
@@ -330,6 +417,106 @@ static bool test_timer(void)
 	return success;
 }
 
+static void set_frag_id(struct sk_buff *skb, unsigned int id)
+{
+	get_frag_hdr(skb)->identification = cpu_to_be32(id);
+}
+
+static verdict fragdb_handle_skb(struct sk_buff *skb)
+{
+	struct packet pkt;
+
+	if (pkt_init_ipv6(&pkt, skb))
+		return VERDICT_DROP;
+
+	return fragdb_handle(&pkt);
+}
+
+/**
+ * Times the storage and reassembly of "count" concurrent two-fragment packets.
+ */
+static bool benchmark(unsigned int count)
+{
+	struct sk_buff **firsts, **seconds;
+	struct tuple tuple6;
+	ktime_t start, middle, end;
+	unsigned int i;
+	unsigned int failures = 0;
+	bool success = true;
+
+	if (init_ipv6_tuple(&tuple6, "1::2", 1212, "3::4", 3434, L4PROTO_UDP))
+		return false;
+
+	firsts = vzalloc(count * sizeof(*firsts));
+	seconds = vzalloc(count * sizeof(*seconds));
+	if (!firsts || !seconds) {
+		success = false;
+		goto end;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (create_skb6_udp_frag(&tuple6, &firsts[i], 64 - sizeof(struct udphdr), 128,
+				true, true, 0, 32)) {
+			success = false;
+			goto end;
+		}
+		set_frag_id(firsts[i], i);
+		if (create_skb6_udp_frag(&tuple6, &seconds[i], 64, 128, true, false, 64, 32)) {
+			success = false;
+			goto end;
+		}
+		set_frag_id(seconds[i], i);
+	}
+
+	/* The point is to measure the table, not the eviction. */
+	high_thresh = INT_MAX;
+	low_thresh = INT_MAX;
+	source_thresh = INT_MAX;
+
+	start = ktime_get();
+	for (i = 0; i < count; i++) {
+		if (fragdb_handle_skb(firsts[i]) != VERDICT_STOLEN) {
+			kfree_skb(firsts[i]);
+			firsts[i] = NULL;
+			failures++;
+		}
+	}
+	middle = ktime_get();
+	for (i = 0; i < count; i++) {
+		if (!firsts[i])
+			continue;
+		if (fragdb_handle_skb(seconds[i]) == VERDICT_CONTINUE) {
+			seconds[i] = NULL; /* It now belongs to firsts[i]. */
+		} else {
+			/* Still in the database; fragdb_destroy() will free it. */
+			firsts[i] = NULL;
+			failures++;
+		}
+	}
+	end = ktime_get();
+
+	high_thresh = FRAGMENT_HIGH_THRESH;
+	low_thresh = FRAGMENT_LOW_THRESH;
+	source_thresh = FRAGMENT_SOURCE_THRESH;
+
+	log_info("%u packets: %lld nsecs storing the first fragments, %lld nsecs reassembling.",
+			count, ktime_to_ns(ktime_sub(middle, start)),
+			ktime_to_ns(ktime_sub(end, middle)));
+
+	success &= assert_equals_int(0, failures, "Unexpected verdicts");
+	success &= validate_database(0);
+	/* Fall through. */
+
+end:
+	for (i = 0; firsts && i < count; i++)
+		kfree_skb(firsts[i]);
+	for (i = 0; seconds && i < count; i++)
+		kfree_skb(seconds[i]);
+	vfree(firsts);
+	vfree(seconds);
+	return success;
+}
+
 int init_module(void)
 {
 	START_TESTS("Fragment database");
@@ -344,6 +531,10 @@ int init_module(void)
 	CALL_TEST(test_no_frags(), "Unfragmented IPv6 packet arrives");
 	CALL_TEST(test_happy_path(), "Happy defragmentation.");
 	CALL_TEST(test_timer(), "Timer test.");
+	CALL_TEST(test_out_of_order(), "Out of order defragmentation.");
+	CALL_TEST(test_overlap(), "Overlapping fragments.");
+	CALL_TEST(benchmark(1000), "Benchmark, 1000 packets.");
+	CALL_TEST(benchmark(100000), "Benchmark, 100000 packets.");
 
 	fragdb_destroy();
 	config_destroy();
@@ -24,10 +24,10 @@ bool init_full(void)
 	error = pktqueue_init();
 	if (error)
 		goto pktqueue_fail;
-	error = bibdb_init();
+	error = bibdb_init(0);
 	if (error)
 		goto bibdb_fail;
-	error = sessiondb_init();
+	error = sessiondb_init(0);
 	if (error)
 		goto sessiondb_fail;
 
@@ -11,6 +11,7 @@
 #include "nat64/unit/types.h"
 
 #include "nat64/common/str_utils.h"
+#include "nat64/mod/common/classifier.h"
 #include "nat64/mod/common/pool6.h"
 #include "nat64/mod/stateful/pool4.h"
 #include "nat64/mod/stateful/pkt_queue.h"
@@ -21,6 +22,7 @@
 #include "nat64/mod/stateful/filtering_and_updating.h"
 #include "nat64/mod/common/rfc6145/core.h"
 #include "nat64/mod/common/core.h"
+#include "nat64/mod/common/log_time.h"
 
 /**
  * There's a IPv6 network and the IPv4 Internet. The admin places a NAT64 in-between using the
@@ -235,16 +237,22 @@ static bool test_icmp(void)
 
 static void deinit(void)
 {
+	classifier_destroy();
 	end_full();
 	fragdb_destroy();
+	logtime_destroy();
 }
 
 static bool init(void)
 {
+	if (is_error(logtime_init()))
+		goto logtime_fail;
 	if (is_error(fragdb_init()))
 		goto fragdb_fail;
 	if (!init_full())
 		goto initfull_fail;
+	if (is_error(classifier_init()))
+		goto classifier_fail;
 
 	if (!bib_inject_str(SERVER_ADDR6, SERVER_PORT6, NAT64_POOL4, SERVER_PORT6, L4PROTO_UDP))
 		goto inject_fail;
@@ -256,10 +264,14 @@ static bool init(void)
 	return true;
 
 inject_fail:
+	classifier_destroy();
+classifier_fail:
 	end_full();
 initfull_fail:
 	fragdb_destroy();
 fragdb_fail:
+	logtime_destroy();
+logtime_fail:
 	return false;
 }
 
@@ -116,9 +116,14 @@ bool pool4_contains(__be32 address)
 int pool4_for_each(int (*func)(struct ipv4_prefix *, void *), void * arg,
 		struct ipv4_prefix *offset)
 {
-	/* Meh, whatever. */
-	log_debug("Somebody asked me to iterate through the pool.");
-	return -EINVAL;
+	struct ipv4_prefix prefix;
+
+	if (offset)
+		return addr4_equals(&offset->address, &pool_address) ? 0 : -ESRCH;
+
+	prefix.address = pool_address;
+	prefix.len = 32;
+	return func(&prefix, arg);
 }
 
 int pool4_flush(void)
@@ -7,6 +7,12 @@ int route4(struct packet *pkt)
 	return 0;
 }
 
+int __route4(struct packet *in, struct packet *out)
+{
+	log_debug("I'm pretending I'm routing an IPv4 packet.");
+	return 0;
+}
+
 int route6(struct packet *pkt)
 {
 	log_debug("I'm pretending I'm sending an IPv6 packet.");
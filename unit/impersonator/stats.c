@@ -14,3 +14,28 @@ void inc_stats_skb4(struct sk_buff *skb, int field)
 {
 	/* No code. */
 }
+
+void stats_received(void)
+{
+	/* No code. */
+}
+
+void stats_translated(void)
+{
+	/* No code. */
+}
+
+void stats_hairpinned(void)
+{
+	/* No code. */
+}
+
+void stats_drop(enum drop_reason reason)
+{
+	/* No code. */
+}
+
+void __stats_verdict(enum stats_stage stage, verdict result)
+{
+	/* No code. */
+}
@@ -1,15 +1,8 @@
-/*
- * log_time_test.c
- *
- *  Created on: Oct 13, 2014
- *      Author: dhernandez
- */
-
 #include <linux/module.h> /* Needed by all modules */
 #include <linux/kernel.h> /* Needed for KERN_INFO */
 #include <linux/init.h> /* Needed for the macros */
 #include <linux/printk.h> /* pr_* */
-#include <linux/time.h>
+#include <linux/bottom_half.h>
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("dhernandez");
@@ -21,18 +14,11 @@ MODULE_ALIAS("nat64_test_log_time");
 #include "nat64/unit/unit_test.h"
 #include "log_time.c"
 
+static struct global_config config;
+
 static bool init(void)
 {
-	int error;
-
-	error = logtime_init();
-	if (error)
-		goto fail;
-
-	return true;
-
-fail:
-	return false;
+	return !logtime_init();
 }
 
 static void end(void)
@@ -40,35 +26,101 @@ static void end(void)
 	logtime_destroy();
 }
 
-static bool simple_substraction(void)
+/**
+ * Every value has to land in the bucket whose boundaries contain it, and the buckets have to be
+ * contiguous.
+ */
+static bool test_buckets(void)
 {
-	bool result = true;
-	struct timespec start;
-	struct timespec end;
-	struct log_node *node;
-
-	logtime_create_node(&node);
-	if (!node)
-		return false;
+	__u64 values[] = { 0, 1, 7, 8, 15, 16, 17, 31, 32, 100, 1000, 12345, 1 << 20,
+			0x7FFFFFFFU, 0xFFFFFFFFU };
+	unsigned int bucket;
+	unsigned int i;
+	bool success = true;
+
+	for (i = 0; i < ARRAY_SIZE(values); i++) {
+		bucket = get_bucket(values[i]);
+		success &= assert_true(bucket < LOGTIME_BUCKETS, "bucket in range");
+		success &= assert_true(logtime_bucket_floor(bucket) <= values[i], "floor");
+		success &= assert_true(values[i] < logtime_bucket_ceil(bucket), "ceil");
+	}
+
+	for (i = 0; i < LOGTIME_BUCKETS; i++) {
+		success &= assert_equals_u64(i, get_bucket(logtime_bucket_floor(i)),
+				"first value's bucket");
+		success &= assert_equals_u64(i, get_bucket(logtime_bucket_ceil(i) - 1),
+				"last value's bucket");
+	}
+
+	success &= assert_equals_u64(LOGTIME_BUCKETS - 1, get_bucket(1ULL << 32), "2^32");
+	success &= assert_equals_u64(LOGTIME_BUCKETS - 1, get_bucket(~0ULL), "Way too slow");
+
+	return success;
+}
 
-	start.tv_sec = 1L;
-	start.tv_nsec = 999999999L;
-	end.tv_sec = 2L;
-	end.tv_nsec = 0L;
+static bool test_record(void)
+{
+	struct packet pkt;
+	struct logtime_histogram_usr *histogram;
+	__u64 before;
+	bool success = true;
 
-	subtract_timespec(&start, &end, node);
-	result &= assert_equals_u64(0, node->time.tv_sec, "node tv_sec");
-	result &= assert_equals_u64(1, node->time.tv_nsec, "node tv_nsec");
+	histogram = kmalloc(sizeof(*histogram), GFP_KERNEL);
+	if (!histogram)
+		return false;
 
-	logtime_delete_node(node);
-	return result;
+	memset(&pkt, 0, sizeof(pkt));
+	pkt.l3_proto = L3PROTO_IPV6;
+	pkt.l4_proto = L4PROTO_UDP;
+	pkt.config = &config;
+
+	local_bh_disable();
+	before = logtime_now() - 1000000;
+	/* Disabled; must not be recorded. */
+	config.latency_histograms = false;
+	success &= assert_equals_u64(0, logtime(&pkt, LOGTIME_STAGE_TRANSLATE, before),
+			"disabled result");
+	config.latency_histograms = true;
+	logtime(&pkt, LOGTIME_STAGE_TRANSLATE, before);
+	logtime(&pkt, LOGTIME_STAGE_TRANSLATE, before);
+	/* From the future; has to count as zero. */
+	logtime(&pkt, LOGTIME_STAGE_TRANSLATE, logtime_now() + 1000000);
+	local_bh_enable();
+
+	success &= assert_equals_int(0, logtime_get(L3PROTO_IPV6, L4PROTO_UDP,
+			LOGTIME_STAGE_TRANSLATE, histogram), "get result");
+	success &= assert_equals_u64(3, histogram->count, "count");
+	success &= assert_equals_u64(1, histogram->buckets[0], "zero bucket");
+	success &= assert_true(histogram->sum >= 2000000, "sum");
+	success &= assert_true(histogram->max >= 1000000, "max");
+
+	/* The rest of the histograms should not have been touched. */
+	success &= assert_equals_int(0, logtime_get(L3PROTO_IPV6, L4PROTO_UDP,
+			LOGTIME_STAGE_TOTAL, histogram), "other stage result");
+	success &= assert_equals_u64(0, histogram->count, "other stage count");
+	success &= assert_equals_int(0, logtime_get(L3PROTO_IPV4, L4PROTO_UDP,
+			LOGTIME_STAGE_TRANSLATE, histogram), "other l3 result");
+	success &= assert_equals_u64(0, histogram->count, "other l3 count");
+
+	success &= assert_equals_int(-EINVAL, logtime_get(L3PROTO_IPV4, L4PROTO_UDP,
+			LOGTIME_STAGE_COUNT, histogram), "invalid stage");
+
+	logtime_flush();
+	success &= assert_equals_int(0, logtime_get(L3PROTO_IPV6, L4PROTO_UDP,
+			LOGTIME_STAGE_TRANSLATE, histogram), "get result after flush");
+	success &= assert_equals_u64(0, histogram->count, "count after flush");
+	success &= assert_equals_u64(0, histogram->max, "max after flush");
+
+	kfree(histogram);
+	return success;
 }
 
 static int logtime_test_init(void)
 {
 	START_TESTS("Log time test");
 
-	INIT_CALL_END(init(), simple_substraction(), end(), "test_log_time substraction 1");
+	CALL_TEST(test_buckets(), "Bucket boundaries");
+	INIT_CALL_END(init(), test_record(), end(), "Recording and aggregation");
 
 	END_TESTS;
 }
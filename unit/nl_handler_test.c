@@ -12,6 +12,7 @@ MODULE_ALIAS("nat64_test_pkt_queue");
 #include "nat64/common/str_utils.h"
 #include "nat64/unit/types.h"
 #include "nat64/unit/unit_test.h"
+#include "nat64/unit/bib.h"
 #include "nat64/mod/stateful/filtering_and_updating.h"
 #include "nat64/mod/stateful/pkt_queue.h"
 #include "nat64/mod/stateful/fragment_db.h"
@@ -58,10 +59,12 @@ static bool compare_global_configs(struct global_config *expected, struct global
 			"drop_by_addr equals");
 	success &= assert_equals_u8(expected->drop_external_tcp, actual->drop_external_tcp,
 			"drop_external_tcp equals");
+	success &= assert_equals_u8(expected->stateless_external_tcp,
+			actual->stateless_external_tcp, "stateless_external_tcp equals");
 	success &= assert_equals_u8(expected->drop_icmp6_info, actual->drop_icmp6_info,
 			"drop_icmp6_info equals");
 
-	success &= assert_equals_u64(expected->max_stored_pkts, actual->max_stored_pkts,
+	success &= assert_equals_u64(expected->so_max_mem, actual->so_max_mem,
 			"max_pkts equals test");
 
 	return success;
@@ -145,6 +148,68 @@ static bool translate_nulls_mtu(void)
 	return success;
 }
 
+/**
+ * Dumps a BIB table in skbs too small for the whole thing, and checks every entry arrives once and
+ * in order.
+ */
+static bool test_bib_dump(void)
+{
+	unsigned char request[NLMSG_SPACE(sizeof(struct request_hdr) + sizeof(struct request_bib))];
+	struct nlmsghdr *request_hdr = (struct nlmsghdr *) request;
+	struct request_bib *payload;
+	struct netlink_callback cb;
+	struct sk_buff *skb;
+	struct nlmsghdr *nl_hdr;
+	struct bib_entry_usr *entries;
+	u16 ports[] = { 1000, 2000, 3000 };
+	unsigned int entry_count, total = 0, calls = 0, i;
+	int len;
+	bool success = true;
+
+	for (i = 0; i < ARRAY_SIZE(ports); i++)
+		if (!bib_inject_str("1::1", ports[i], "192.0.2.1", ports[i], L4PROTO_UDP))
+			return false;
+
+	memset(request, 0, sizeof(request));
+	request_hdr->nlmsg_seq = 1234;
+	payload = NLMSG_DATA(request_hdr) + sizeof(struct request_hdr);
+	payload->l4_proto = L4PROTO_UDP;
+
+	memset(&cb, 0, sizeof(cb));
+	cb.nlh = request_hdr;
+
+	do {
+		skb = alloc_skb(NLMSG_SPACE(sizeof(*entries)), GFP_KERNEL);
+		if (!skb)
+			return false;
+
+		len = bib_dump(skb, &cb);
+		if (len > 0) {
+			nl_hdr = nlmsg_hdr(skb);
+			success &= assert_equals_int(skb->len, len, "Returned length");
+			success &= assert_equals_u32(1234, nl_hdr->nlmsg_seq, "Sequence");
+			success &= assert_equals_u16(NLM_F_MULTI, nl_hdr->nlmsg_flags, "Multipart");
+
+			entries = nlmsg_data(nl_hdr);
+			entry_count = nlmsg_len(nl_hdr) / sizeof(*entries);
+			success &= assert_true(entry_count > 0, "Message is not empty");
+			for (i = 0; i < entry_count && total < ARRAY_SIZE(ports); i++, total++) {
+				success &= assert_equals_u16(ports[total], entries[i].addr4.l4,
+						"Port");
+			}
+		}
+
+		kfree_skb(skb);
+		calls++;
+	} while (len > 0 && calls < 10);
+
+	bib_dump_done(&cb);
+	success &= assert_equals_int(0, len, "Dump ended");
+	success &= assert_equals_u32(ARRAY_SIZE(ports), total, "Entry count");
+
+	return success;
+}
+
 static bool init(void)
 {
 	if (is_error(fragdb_init()))
@@ -169,6 +234,7 @@ static int configproto_test_init(void)
 
 	INIT_CALL_END(init(), basic_test(), end(), "basic test");
 	INIT_CALL_END(init(), translate_nulls_mtu(), end(), "nulls mtus");
+	INIT_CALL_END(init(), test_bib_dump(), end(), "BIB dump");
 
 	END_TESTS;
 }
@@ -48,13 +48,13 @@ static bool test_pkt_queue_asr(void)
 
 	/* Test */
 	success &= assert_equals_int(0, pktqueue_add(session, &pkt), "pktqueue_add 1");
+	kfree_skb(skb); /* pktqueue keeps its own copy of the headers. */
 	success &= assert_equals_int(0, pktqueue_send(session), "pktqueue_send 1");
 	success &= assert_equals_int(1, icmp64_pop(), "pktqueue sent an icmp error");
 	success &= assert_equals_int(-ESRCH, pktqueue_remove(session), "pktqueue_remove 1");
 
 
 	session_return(session);
-	/* kfree_skb(skb); "skb" kfreed when pktqueue_send is executed */
 	return success;
 
 fail:
@@ -93,13 +93,13 @@ static bool test_pkt_queue_ars(void)
 	hdr_tcp->fin = false;
 
 	success &= assert_equals_int(0, pktqueue_add(session, &pkt), "pktqueue_add 1");
+	kfree_skb(skb); /* pktqueue keeps its own copy of the headers. */
 	success &= assert_equals_int(0, pktqueue_remove(session), "pktqueue_remove 1");
 	success &= assert_equals_int(-ESRCH, pktqueue_send(session), "pktqueue_send 1");
 	success &= assert_equals_int(0, icmp64_pop(), "pktqueue not sent an icmp error");
 
 
 	session_return(session);
-	/* kfree_skb(skb); "skb" kfreed when pktqueue_remove is executed */
 	return success;
 
 fail:
@@ -107,12 +107,115 @@ fail:
 	return false;
 }
 
+static bool init_syn(struct tuple *tuple4, struct sk_buff **skb, struct packet *pkt)
+{
+	if (is_error(init_ipv4_tuple(tuple4, "5.6.7.8", 5678, "192.168.2.1", 8765, L4PROTO_TCP)))
+		return false;
+	if (is_error(create_skb4_tcp(tuple4, skb, 100, 32)))
+		return false;
+	if (is_error(pkt_init_ipv4(pkt, *skb))) {
+		kfree_skb(*skb);
+		return false;
+	}
+
+	tcp_hdr(*skb)->syn = true;
+	return true;
+}
+
+static bool test_pkt_queue_budget(void)
+{
+	struct session_entry *session1, *session2;
+	struct global_config config;
+	struct packet pkt;
+	struct sk_buff *skb;
+	struct tuple tuple4;
+	bool success = true;
+
+	session1 = session_create_str_tcp("1::2", 1212, "3::4", 3434, "192.168.2.1", 8765,
+			"5.6.7.8", 5678, V4_INIT);
+	if (!session1)
+		return false;
+	session2 = session_create_str_tcp("1::2", 1213, "3::4", 3434, "192.168.2.1", 8766,
+			"5.6.7.8", 5678, V4_INIT);
+	if (!session2)
+		goto fail2;
+	if (!init_syn(&tuple4, &skb, &pkt))
+		goto fail1;
+
+	/* Only one packet fits. */
+	config = *pkt.config;
+	config.so_max_mem = sizeof(struct packet_node);
+	pkt.config = &config;
+
+	success &= assert_equals_int(0, pktqueue_add(session1, &pkt), "add 1");
+	success &= assert_equals_int(-E2BIG, pktqueue_add(session2, &pkt), "add 2 over budget");
+	success &= assert_equals_int(0, pktqueue_remove(session1), "remove 1");
+	success &= assert_equals_int(0, pktqueue_add(session2, &pkt), "add 2 within budget");
+	success &= assert_equals_int(0, pktqueue_remove(session2), "remove 2");
+	success &= assert_equals_int(0, atomic_read(&mem), "memory is returned");
+
+	kfree_skb(skb);
+	session_return(session2);
+	session_return(session1);
+	return success;
+
+fail1:
+	session_return(session2);
+fail2:
+	session_return(session1);
+	return false;
+}
+
+static bool test_pkt_queue_expiration(void)
+{
+	struct session_entry *session;
+	struct packet_node *node;
+	struct packet pkt;
+	struct sk_buff *skb;
+	struct tuple tuple4;
+	unsigned int i;
+	bool found;
+	bool success = true;
+
+	session = session_create_str_tcp("1::2", 1212, "3::4", 3434, "192.168.2.1", 8765,
+			"5.6.7.8", 5678, V4_INIT);
+	if (!session)
+		return false;
+	if (!init_syn(&tuple4, &skb, &pkt)) {
+		session_return(session);
+		return false;
+	}
+
+	success &= assert_equals_int(0, pktqueue_add(session, &pkt), "add");
+	kfree_skb(skb);
+
+	/* Not yet. */
+	clean_expired_nodes(&found);
+	success &= assert_true(found, "node survives");
+	success &= assert_equals_int(0, icmp64_pop(), "no error yet");
+
+	/* Pretend the session was lost and the node's time came. */
+	for (i = 0; i < shard_count; i++)
+		list_for_each_entry(node, &shards[i].expire_list, list_hook)
+			node->dying_time = jiffies - 1;
+
+	clean_expired_nodes(&found);
+	success &= assert_false(found, "node is gone");
+	success &= assert_equals_int(1, icmp64_pop(), "error sent");
+	success &= assert_equals_int(-ESRCH, pktqueue_remove(session), "nothing to remove");
+
+	session_return(session);
+	return success;
+}
+
 static int pktqueue_test_init(void)
 {
 	START_TESTS("Packet queue");
 
 	INIT_CALL_END(init_full(), test_pkt_queue_asr(), end_full(), "test_pkt_queue 1");
 	INIT_CALL_END(init_full(), test_pkt_queue_ars(), end_full(), "test_pkt_queue 2");
+	INIT_CALL_END(init_full(), test_pkt_queue_budget(), end_full(), "Memory budget");
+	INIT_CALL_END(init_full(), test_pkt_queue_expiration(), end_full(), "Expiration");
 
 	END_TESTS;
 }
@@ -0,0 +1,191 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include "nat64/common/str_utils.h"
+#include "nat64/unit/unit_test.h"
+#include "../mod/common/pool6.c"
+
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("IPv6 pool module test");
+
+
+static bool init(void)
+{
+	return pool6_init(NULL, 0) ? false : true;
+}
+
+static void end(void)
+{
+	pool6_destroy();
+}
+
+static bool add_prefix(char *addr_str, __u8 len, int expected)
+{
+	struct ipv6_prefix prefix;
+
+	if (str_to_addr6(addr_str, &prefix.address))
+		return false;
+	prefix.len = len;
+
+	return assert_equals_int(expected, pool6_add(&prefix), addr_str);
+}
+
+static bool remove_prefix(char *addr_str, __u8 len, int expected)
+{
+	struct ipv6_prefix prefix;
+
+	if (str_to_addr6(addr_str, &prefix.address))
+		return false;
+	prefix.len = len;
+
+	return assert_equals_int(expected, pool6_remove(&prefix), addr_str);
+}
+
+/**
+ * Asserts "addr_str" belongs to "prefix_str"/"len". If "prefix_str" is NULL, asserts "addr_str"
+ * doesn't belong to the pool.
+ */
+static bool get(char *addr_str, char *prefix_str, __u8 len)
+{
+	struct in6_addr addr;
+	struct ipv6_prefix expected, actual;
+	bool success = true;
+
+	if (str_to_addr6(addr_str, &addr))
+		return false;
+
+	if (!prefix_str)
+		return assert_equals_int(-ESRCH, pool6_get(&addr, &actual), addr_str);
+
+	if (str_to_addr6(prefix_str, &expected.address))
+		return false;
+	expected.len = len;
+
+	success &= assert_equals_int(0, pool6_get(&addr, &actual), addr_str);
+	success &= assert_equals_ipv6(&expected.address, &actual.address, addr_str);
+	success &= assert_equals_int(expected.len, actual.len, addr_str);
+	return success;
+}
+
+static bool test_lookup(void)
+{
+	bool success = true;
+
+	success &= get("64:ff9b::192.0.2.1", NULL, 0);
+
+	success &= add_prefix("64:ff9b::", 96, 0);
+	success &= add_prefix("2001:db8::", 32, 0);
+	success &= add_prefix("2001:db8:100::", 40, 0);
+	success &= add_prefix("2001:db8:1:2::", 64, 0);
+	success &= add_prefix("2001:db8::", 33, -EINVAL);
+	success &= add_prefix("2001:db8::1", 64, -EINVAL);
+	success &= add_prefix("2001:db8:100::", 40, -EEXIST);
+
+	success &= get("64:ff9b::192.0.2.1", "64:ff9b::", 96);
+	success &= get("64:ff9b:0:0:1::", NULL, 0);
+	/* The longest prefix wins, regardless of insertion order. */
+	success &= get("2001:db8:100::1", "2001:db8:100::", 40);
+	success &= get("2001:db8:1:2::1", "2001:db8:1:2::", 64);
+	success &= get("2001:db8:1:3::1", "2001:db8::", 32);
+	success &= get("2001:db9::1", NULL, 0);
+
+	success &= remove_prefix("2001:db8:100::", 40, 0);
+	success &= remove_prefix("2001:db8:100::", 40, -ESRCH);
+	success &= get("2001:db8:100::1", "2001:db8::", 32);
+
+	success &= assert_equals_int(0, pool6_flush(), "flush");
+	success &= get("64:ff9b::192.0.2.1", NULL, 0);
+	success &= get("2001:db8:1:2::1", NULL, 0);
+
+	return success;
+}
+
+/**
+ * Lots of prefixes of the same length; they all have to remain reachable.
+ */
+static bool test_many(void)
+{
+	struct ipv6_prefix prefix;
+	struct in6_addr addr;
+	struct ipv6_prefix result;
+	__u64 count;
+	unsigned int i;
+	bool success = true;
+
+	if (str_to_addr6("2001:db8::", &prefix.address))
+		return false;
+	prefix.len = 64;
+
+	for (i = 0; i < 4096; i++) {
+		prefix.address.s6_addr32[1] = cpu_to_be32(i);
+		if (pool6_add(&prefix)) {
+			log_err("Could not add prefix #%u.", i);
+			return false;
+		}
+	}
+
+	success &= assert_equals_int(0, pool6_count(&count), "count result");
+	success &= assert_equals_u64(4096, count, "count");
+
+	addr = prefix.address;
+	addr.s6_addr32[3] = cpu_to_be32(1);
+	for (i = 0; i < 4096 && success; i++) {
+		prefix.address.s6_addr32[1] = cpu_to_be32(i);
+		addr.s6_addr32[1] = cpu_to_be32(i);
+		success &= assert_equals_int(0, pool6_get(&addr, &result), "get result");
+		success &= assert_equals_ipv6(&prefix.address, &result.address, "get prefix");
+	}
+
+	return success;
+}
+
+/**
+ * Staged changes must not be visible until they are committed.
+ */
+static bool test_transaction(void)
+{
+	bool success = true;
+
+	success &= add_prefix("64:ff9b::", 96, 0);
+
+	pool6_txn_begin();
+	success &= add_prefix("2001:db8::", 32, 0);
+	success &= remove_prefix("64:ff9b::", 96, 0);
+	success &= get("64:ff9b::192.0.2.1", "64:ff9b::", 96);
+	success &= get("2001:db8::1", NULL, 0);
+
+	pool6_txn_commit();
+	success &= get("64:ff9b::192.0.2.1", NULL, 0);
+	success &= get("2001:db8::1", "2001:db8::", 32);
+
+	pool6_txn_begin();
+	success &= assert_equals_int(0, pool6_flush(), "flush");
+	success &= get("2001:db8::1", "2001:db8::", 32);
+
+	pool6_txn_abort();
+	success &= get("2001:db8::1", "2001:db8::", 32);
+
+	/* Outside of transactions, changes are immediate again. */
+	success &= remove_prefix("2001:db8::", 32, 0);
+	success &= get("2001:db8::1", NULL, 0);
+
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("IPv6 pool");
+
+	INIT_CALL_END(init(), test_lookup(), end(), "Longest prefix match");
+	INIT_CALL_END(init(), test_many(), end(), "Many prefixes");
+	INIT_CALL_END(init(), test_transaction(), end(), "Transactions");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -1,6 +1,7 @@
 #include <linux/module.h>
 #include <linux/printk.h>
 #include <linux/inet.h>
+#include <linux/ktime.h>
 
 #include "nat64/unit/unit_test.h"
 #include "nat64/common/types.h"
@@ -72,6 +73,38 @@ static bool test_addr_4to6(struct in_addr *src, struct ipv6_prefix *prefix, stru
 	return success;
 }
 
+#define BENCHMARK_ITERATIONS 1000000
+
+/**
+ * Not really a test; measures how long each prefix length takes to translate in both directions.
+ * Also makes sure the round trip survives every iteration, so the compiler can't optimize the
+ * loops away.
+ */
+static bool benchmark(struct ipv6_prefix *prefix)
+{
+	struct in_addr addr4 = ipv4_addr;
+	struct in_addr expected;
+	struct in6_addr addr6;
+	ktime_t start, end;
+	unsigned int i;
+	bool success = true;
+
+	start = ktime_get();
+	for (i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		addr4.s_addr = cpu_to_be32(be32_to_cpu(ipv4_addr.s_addr) + i);
+		addr_4to6(&addr4, prefix, &addr6);
+		addr_6to4(&addr6, prefix, &addr4);
+	}
+	end = ktime_get();
+
+	expected.s_addr = cpu_to_be32(be32_to_cpu(ipv4_addr.s_addr) + BENCHMARK_ITERATIONS - 1);
+	success &= assert_equals_ipv4(&expected, &addr4, "Round trip");
+
+	log_info("/%u: %lld nsecs per round trip.", prefix->len,
+			ktime_to_ns(ktime_sub(end, start)) / BENCHMARK_ITERATIONS);
+	return success;
+}
+
 static bool init(void)
 {
 	int i;
@@ -119,6 +152,10 @@ int init_module(void)
 				&ipv6_addr[i]);
 	}
 
+	/* Benchmark the translation kernels. */
+	for (i = 0; i < 6; i++)
+		CALL_TEST(benchmark(&prefixes[i]), "Benchmark-/%u", prefixes[i].len);
+
 	END_TESTS;
 }
 
@@ -0,0 +1,251 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/ipv6.h>
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Unit tests for the RFC 6791 pool");
+
+#include "nat64/common/str_utils.h"
+#include "nat64/unit/unit_test.h"
+#include "../mod/stateless/rfc6791.c"
+
+/** The only field get_addr_index() reads is "randomize_error_addresses". */
+static struct global_config config;
+
+static bool init(void)
+{
+	return !rfc6791_init(NULL, 0);
+}
+
+static void end(void)
+{
+	rfc6791_destroy();
+}
+
+static bool add(char *addr_str, __u8 len)
+{
+	struct ipv4_prefix prefix;
+
+	if (str_to_addr4(addr_str, &prefix.address))
+		return false;
+	prefix.len = len;
+
+	return assert_equals_int(0, rfc6791_add(&prefix), addr_str);
+}
+
+static bool rm(char *addr_str, __u8 len)
+{
+	struct ipv4_prefix prefix;
+
+	if (str_to_addr4(addr_str, &prefix.address))
+		return false;
+	prefix.len = len;
+
+	return assert_equals_int(0, rfc6791_remove(&prefix), addr_str);
+}
+
+/**
+ * Builds a packet whose hop limit is "hop_limit"; since the addresses are not randomized, this is
+ * what decides which address gets picked.
+ */
+static int init_packet(struct packet *pkt, __u8 hop_limit)
+{
+	struct sk_buff *skb;
+
+	skb = alloc_skb(sizeof(struct ipv6hdr), GFP_KERNEL);
+	if (!skb)
+		return -ENOMEM;
+	skb_put(skb, sizeof(struct ipv6hdr));
+	skb_reset_network_header(skb);
+	memset(ipv6_hdr(skb), 0, sizeof(struct ipv6hdr));
+	ipv6_hdr(skb)->hop_limit = hop_limit;
+
+	memset(pkt, 0, sizeof(*pkt));
+	pkt->skb = skb;
+	pkt->config = &config;
+	return 0;
+}
+
+/**
+ * Asserts that the indexed lookup picks "expected" for "hop_limit", and that it agrees with the
+ * unindexed walk.
+ */
+static bool test_pick(__u8 hop_limit, char *expected_str)
+{
+	struct packet pkt;
+	struct pool_index *index;
+	struct in_addr expected, indexed, walked;
+	__u64 count;
+	bool success = true;
+
+	if (str_to_addr4(expected_str, &expected))
+		return false;
+	if (init_packet(&pkt, hop_limit))
+		return false;
+
+	rcu_read_lock_bh();
+	index = rcu_dereference_bh(pool_index);
+	success &= assert_not_null(index, "index");
+	if (index) {
+		success &= assert_equals_int(0, get_indexed_address(&pkt, index, &indexed),
+				"indexed lookup");
+		success &= assert_equals_ipv4(&expected, &indexed, expected_str);
+
+		success &= assert_equals_int(0, pool_count(&pool, &count), "count");
+		success &= assert_equals_int(0, get_rfc6791_address(&pkt, count, &walked),
+				"walked lookup");
+		success &= assert_equals_ipv4(&indexed, &walked, "index agrees with walk");
+	}
+	rcu_read_unlock_bh();
+
+	kfree_skb(pkt.skb);
+	return success;
+}
+
+static bool test_index(void)
+{
+	bool success = true;
+
+	config.randomize_error_addresses = false;
+
+	success &= assert_null(rcu_dereference_protected(pool_index, true), "empty pool's index");
+
+	success &= add("192.0.2.0", 30);
+	success &= add("198.51.100.8", 29);
+	success &= add("203.0.113.1", 32);
+	if (!success)
+		return false;
+
+	/* 13 addresses; the binary search has to land on every prefix boundary. */
+	success &= test_pick(0, "192.0.2.0");
+	success &= test_pick(3, "192.0.2.3");
+	success &= test_pick(4, "198.51.100.8");
+	success &= test_pick(7, "198.51.100.11");
+	success &= test_pick(11, "198.51.100.15");
+	success &= test_pick(12, "203.0.113.1");
+	success &= test_pick(13, "192.0.2.0");
+	success &= test_pick(255, "198.51.100.12");
+
+	/* The index has to follow the pool. */
+	success &= rm("198.51.100.8", 29);
+	success &= test_pick(4, "203.0.113.1");
+	success &= test_pick(5, "192.0.2.0");
+
+	rfc6791_txn_begin();
+	success &= add("198.51.100.8", 31);
+	success &= test_pick(5, "192.0.2.0");
+	rfc6791_txn_commit();
+	success &= test_pick(5, "198.51.100.8");
+	success &= test_pick(6, "198.51.100.9");
+
+	success &= assert_equals_int(0, rfc6791_flush(), "flush");
+	success &= assert_null(rcu_dereference_protected(pool_index, true), "flushed index");
+
+	return success;
+}
+
+/**
+ * Asserts that "cache" holds exactly the first non-loopback address of every interface.
+ * The caller must hold the RTNL.
+ */
+static bool validate_host_addrs(struct host_addrs *cache)
+{
+	struct net_device *dev;
+	struct in_device *in_dev;
+	struct in_ifaddr *ifa;
+	__be32 cached;
+	unsigned int count = 0;
+	bool found;
+	bool success = true;
+
+	for_each_netdev(&init_net, dev) {
+		in_dev = __in_dev_get_rtnl(dev);
+		found = get_cached_host_address(cache, dev->ifindex, &cached);
+
+		for (ifa = in_dev ? in_dev->ifa_list : NULL; ifa; ifa = ifa->ifa_next)
+			if (!IN_LOOPBACK(ntohl(ifa->ifa_address)))
+				break;
+
+		if (ifa) {
+			success &= assert_true(found, dev->name);
+			success &= assert_equals_be32(ifa->ifa_address, found ? cached : 0,
+					dev->name);
+			count++;
+		} else {
+			success &= assert_false(found, dev->name);
+		}
+	}
+
+	success &= assert_equals_int(count, cache->count, "cached interfaces");
+	return success;
+}
+
+/**
+ * Address notifications have to replace the interface address cache, so stale entries (eg. from
+ * removed addresses or interfaces) go away.
+ */
+static bool test_host_addrs(void)
+{
+	struct host_addrs *stale, *cache;
+	struct in_ifaddr ifa;
+	__be32 addr;
+	bool success = true;
+
+	rtnl_lock();
+
+	cache = rtnl_dereference(host_addrs);
+	if (!assert_not_null(cache, "initial cache")) {
+		rtnl_unlock();
+		return false;
+	}
+	success &= validate_host_addrs(cache);
+
+	/* Pretend the loopback interface had an address which has since been removed. */
+	stale = kmalloc(sizeof(*stale) + sizeof(stale->devs[0]), GFP_KERNEL);
+	if (!stale) {
+		rtnl_unlock();
+		return false;
+	}
+	stale->count = 1;
+	stale->devs[0].ifindex = init_net.loopback_dev->ifindex;
+	stale->devs[0].addr = cpu_to_be32(0xC0000201U);
+	rcu_assign_pointer(host_addrs, stale);
+	synchronize_rcu_bh();
+	kfree(cache);
+
+	memset(&ifa, 0, sizeof(ifa));
+	ifa.ifa_dev = __in_dev_get_rtnl(init_net.loopback_dev);
+
+	/* Unrelated events do not touch the cache. */
+	inetaddr_notify(NULL, NETDEV_CHANGE, &ifa);
+	success &= assert_equals_ptr(stale, rtnl_dereference(host_addrs), "untouched cache");
+
+	inetaddr_notify(NULL, NETDEV_DOWN, &ifa);
+	cache = rtnl_dereference(host_addrs);
+	success &= assert_not_equals_ptr(stale, cache, "replaced cache");
+	if (cache) {
+		success &= assert_false(get_cached_host_address(cache,
+				init_net.loopback_dev->ifindex, &addr), "loopback");
+		success &= validate_host_addrs(cache);
+	}
+
+	rtnl_unlock();
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("RFC 6791 pool");
+
+	INIT_CALL_END(init(), test_index(), end(), "Pool index");
+	INIT_CALL_END(init(), test_host_addrs(), end(), "Interface address cache");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -1,11 +1,13 @@
 #include <linux/module.h>
 #include <linux/printk.h>
+#include <linux/ktime.h>
 
 #include "nat64/unit/session.h"
 #include "nat64/unit/skb_generator.h"
 #include "nat64/unit/unit_test.h"
 #include "nat64/common/str_utils.h"
 #include "nat64/mod/stateful/pool4.h"
+#include "nat64/mod/stateful/session_sync.h"
 #include "session_db.c"
 
 
@@ -13,6 +15,11 @@ MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Alberto Leiva Popper <aleiva@nic.mx>");
 MODULE_DESCRIPTION("Session module test.");
 
+static bool benchmark;
+module_param(benchmark, bool, 0);
+MODULE_PARM_DESC(benchmark, "Also measure the session and BIB lookup speeds. Slow and memory "
+		"hungry.");
+
 #define TCPTRANS_TIMEOUT msecs_to_jiffies(1000 * TCP_TRANS)
 #define TCPEST_TIMEOUT msecs_to_jiffies(1000 * TCP_EST)
 
@@ -165,6 +172,567 @@ static bool simple_session(void)
 	return true;
 }
 
+static bool assert_fast(struct session_entry *session, bool expected, char *test_name)
+{
+	struct tuple tuple6, tuple4, out;
+	bool success = true;
+
+	tuple6.src.addr6 = session->remote6;
+	tuple6.dst.addr6 = session->local6;
+	tuple6.l3_proto = L3PROTO_IPV6;
+	tuple6.l4_proto = session->l4_proto;
+
+	tuple4.src.addr4 = session->remote4;
+	tuple4.dst.addr4 = session->local4;
+	tuple4.l3_proto = L3PROTO_IPV4;
+	tuple4.l4_proto = session->l4_proto;
+
+	success &= assert_equals_int(expected, sessiondb_get_fast(&tuple6, &out), test_name);
+	if (expected) {
+		success &= assert_equals_int(L3PROTO_IPV4, out.l3_proto, "6to4 l3 proto");
+		success &= assert_equals_ipv4(&session->local4.l3, &out.src.addr4.l3, "6to4 src");
+		success &= assert_equals_u16(session->local4.l4, out.src.addr4.l4, "6to4 src l4");
+		success &= assert_equals_ipv4(&session->remote4.l3, &out.dst.addr4.l3, "6to4 dst");
+		success &= assert_equals_u16(session->remote4.l4, out.dst.addr4.l4, "6to4 dst l4");
+	}
+
+	success &= assert_equals_int(expected, sessiondb_get_fast(&tuple4, &out), test_name);
+	if (expected) {
+		success &= assert_equals_int(L3PROTO_IPV6, out.l3_proto, "4to6 l3 proto");
+		success &= assert_equals_ipv6(&session->local6.l3, &out.src.addr6.l3, "4to6 src");
+		success &= assert_equals_u16(session->local6.l4, out.src.addr6.l4, "4to6 src l4");
+		success &= assert_equals_ipv6(&session->remote6.l3, &out.dst.addr6.l3, "4to6 dst");
+		success &= assert_equals_u16(session->remote6.l4, out.dst.addr6.l4, "4to6 dst l4");
+	}
+
+	return success;
+}
+
+/**
+ * The fast path should mirror established UDP and TCP sessions, and nothing else.
+ */
+static bool test_fast_path(void)
+{
+	struct session_entry *udp, *tcp, *icmp;
+	bool success = true;
+
+	udp = create_and_insert_session(1, 0, 1, 0);
+	tcp = create_session_entry(2, 1, 2, 1, L4PROTO_TCP);
+	icmp = create_session_entry(1, 1, 2, 2, L4PROTO_ICMP);
+	if (!udp || !tcp || !icmp)
+		return false;
+	tcp->state = V4_INIT;
+
+	success &= assert_equals_int(0, sessiondb_add(tcp, SESSIONTIMER_SYN), "TCP insertion");
+	success &= assert_equals_int(0, sessiondb_add(icmp, SESSIONTIMER_ICMP), "ICMP insertion");
+
+	success &= assert_fast(udp, true, "UDP is fast");
+	success &= assert_fast(tcp, false, "V4 INIT is slow");
+	success &= assert_fast(icmp, false, "ICMP is slow");
+
+	spin_lock_bh(&session_table_tcp.lock);
+	set_state(tcp, ESTABLISHED);
+	spin_unlock_bh(&session_table_tcp.lock);
+	success &= assert_fast(tcp, true, "ESTABLISHED is fast");
+
+	spin_lock_bh(&session_table_tcp.lock);
+	set_state(tcp, V4_FIN_RCV);
+	spin_unlock_bh(&session_table_tcp.lock);
+	success &= assert_fast(tcp, false, "V4 FIN RCV is slow");
+
+	success &= assert_equals_int(0, sessiondb_flush(), "flush");
+	success &= assert_fast(udp, false, "Flushed UDP is gone");
+
+	return success;
+}
+
+static void init_tuple6(struct session_entry *session, struct tuple *tuple6)
+{
+	tuple6->src.addr6 = session->remote6;
+	tuple6->dst.addr6 = session->local6;
+	tuple6->l3_proto = L3PROTO_IPV6;
+	tuple6->l4_proto = session->l4_proto;
+}
+
+/**
+ * Established flows should be refreshed without the trees, and everything else should be sent to
+ * the slow path.
+ */
+static bool test_fast_refresh(void)
+{
+	struct session_entry *udp, *tcp;
+	struct tuple tuple6, udp6;
+	struct packet pkt;
+	struct sk_buff *skb;
+	unsigned long old_time = jiffies - msecs_to_jiffies(10000);
+	bool success = true;
+
+	udp = create_and_insert_session(1, 0, 1, 0);
+	tcp = create_session_entry(2, 1, 2, 1, L4PROTO_TCP);
+	if (!udp || !tcp)
+		return false;
+	tcp->state = ESTABLISHED;
+	success &= assert_equals_int(0, sessiondb_add(tcp, SESSIONTIMER_EST), "TCP insertion");
+
+	/* UDP never looks at the packet. */
+	udp->update_time = old_time;
+	init_tuple6(udp, &udp6);
+	success &= assert_equals_int(0, sessiondb_refresh_fast(NULL, &udp6), "UDP result");
+	success &= assert_true(time_after(udp->update_time, old_time), "UDP was refreshed");
+	success &= assert_true(udp->expirer == &expirer_udp, "UDP expirer");
+
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV6, false, false, false)))
+		return false;
+	if (is_error(pkt_init_ipv6(&pkt, skb)))
+		return false;
+	tcp->update_time = old_time;
+	init_tuple6(tcp, &tuple6);
+	success &= assert_equals_int(0, sessiondb_refresh_fast(&pkt, &tuple6), "TCP result");
+	success &= assert_true(time_after(tcp->update_time, old_time), "TCP was refreshed");
+	success &= assert_true(tcp->expirer == &expirer_tcp_est, "TCP expirer");
+	success &= assert_equals_u8(ESTABLISHED, tcp->state, "TCP state");
+	kfree_skb(skb);
+
+	/* FINs have to go through the state machine. */
+	if (is_error(create_tcp_packet(&skb, L3PROTO_IPV6, false, false, true)))
+		return false;
+	if (is_error(pkt_init_ipv6(&pkt, skb)))
+		return false;
+	tcp->update_time = old_time;
+	success &= assert_equals_int(-ESRCH, sessiondb_refresh_fast(&pkt, &tuple6), "FIN result");
+	success &= assert_equals_ulong(old_time, tcp->update_time, "FIN did not refresh");
+	kfree_skb(skb);
+
+	success &= assert_equals_int(0, sessiondb_flush(), "flush");
+	success &= assert_equals_int(-ESRCH, sessiondb_refresh_fast(NULL, &udp6), "Flushed UDP");
+
+	return success;
+}
+
+struct visit_args {
+	struct session_entry *visited[4];
+	unsigned int count;
+	unsigned int limit;
+};
+
+static int visit_session(struct session_entry *session, void *arg)
+{
+	struct visit_args *args = arg;
+
+	if (args->count >= args->limit)
+		return 1;
+
+	args->visited[args->count++] = session;
+	return 0;
+}
+
+/**
+ * A cursor should survive the death of the session it points to.
+ */
+static bool test_iterate_cursor(void)
+{
+	struct session_entry *s1, *s2, *s3;
+	struct sessiondb_cursor cursor = { .session = NULL, .serial = 0 };
+	struct visit_args args = { .count = 0, .limit = 1 };
+	bool success = true;
+
+	s1 = create_and_insert_session(1, 0, 1, 0);
+	s2 = create_and_insert_session(2, 1, 2, 1);
+	s3 = create_and_insert_session(1, 1, 2, 2);
+	if (!s1 || !s2 || !s3)
+		return false;
+
+	success &= assert_equals_int(1, sessiondb_iterate(L4PROTO_UDP, visit_session, &args,
+			&cursor), "First chunk result");
+	success &= assert_equals_u32(1, args.count, "First chunk count");
+	success &= assert_equals_ptr(s1, args.visited[0], "First chunk session");
+	success &= assert_equals_ptr(s1, cursor.session, "Cursor");
+
+	spin_lock_bh(&session_table_udp.lock);
+	session_table_udp.count -= remove(s1, &session_table_udp);
+	spin_unlock_bh(&session_table_udp.lock);
+
+	args.count = 0;
+	args.limit = ARRAY_SIZE(args.visited);
+	success &= assert_equals_int(0, sessiondb_iterate(L4PROTO_UDP, visit_session, &args,
+			&cursor), "Second chunk result");
+	success &= assert_equals_u32(2, args.count, "Second chunk count");
+	success &= assert_equals_ptr(s2, args.visited[0], "Second chunk, first session");
+	success &= assert_equals_ptr(s3, args.visited[1], "Second chunk, second session");
+
+	sessiondb_cursor_release(&cursor);
+	session_return(s1);
+	session_return(s2);
+	session_return(s3);
+	return success;
+}
+
+/**
+ * Restored sessions should keep their time to live, and land in the right spot of their timer's
+ * list.
+ */
+static bool test_add_batch(void)
+{
+	struct session_entry *live, *sessions[4];
+	enum session_timer_type timers[] = { SESSIONTIMER_UDP, SESSIONTIMER_UDP, SESSIONTIMER_UDP,
+			SESSIONTIMER_EST };
+	unsigned int ttls[] = { 1000, 500, 1000, 1000 };
+	__s32 results[ARRAY_SIZE(sessions)];
+	unsigned long timeout = config_get_ttl_udp();
+	struct list_head *hook;
+	bool success = true;
+
+	live = create_and_insert_session(1, 0, 1, 0);
+	sessions[0] = create_session_entry(2, 1, 2, 1, L4PROTO_UDP);
+	sessions[1] = create_session_entry(1, 1, 2, 2, L4PROTO_UDP);
+	/* Same as "live". */
+	sessions[2] = create_session_entry(1, 0, 1, 0, L4PROTO_UDP);
+	/* Wrong timer. */
+	sessions[3] = create_session_entry(2, 2, 2, 2, L4PROTO_UDP);
+	if (!live || !sessions[0] || !sessions[1] || !sessions[2] || !sessions[3])
+		return false;
+
+	success &= assert_equals_int(0, sessiondb_add_batch(L4PROTO_UDP, sessions, timers, ttls,
+			ARRAY_SIZE(sessions), false, results), "Batch result");
+	success &= assert_equals_int(0, results[0], "Session 0 result");
+	success &= assert_equals_int(0, results[1], "Session 1 result");
+	success &= assert_equals_int(-EEXIST, results[2], "Duplicate result");
+	success &= assert_equals_int(-EINVAL, results[3], "Wrong timer result");
+	success &= assert_equals_u64(3, session_table_udp.count, "Table count");
+
+	success &= assert_true(time_before_eq(sessions[0]->update_time + timeout,
+			jiffies + msecs_to_jiffies(1000)), "Session 0 kept its TTL");
+	success &= assert_true(time_before_eq(sessions[1]->update_time + timeout,
+			jiffies + msecs_to_jiffies(500)), "Session 1 kept its TTL");
+
+	/* Sorted by expiration date: the restored sessions die before the live one. */
+	hook = expirer_udp.sessions.next;
+	success &= assert_equals_ptr(sessions[1], list_entry(hook, struct session_entry,
+			expire_list_hook), "First to die");
+	hook = hook->next;
+	success &= assert_equals_ptr(sessions[0], list_entry(hook, struct session_entry,
+			expire_list_hook), "Second to die");
+	hook = hook->next;
+	success &= assert_equals_ptr(live, list_entry(hook, struct session_entry,
+			expire_list_hook), "Last to die");
+
+	success &= assert_true(timer_pending(&expirer_udp.timer), "Timer scheduled");
+	success &= assert_true(time_before_eq(expirer_udp.timer.expires,
+			jiffies + msecs_to_jiffies(500) + MIN_TIMER_SLEEP), "Timer scheduled early");
+
+	session_return(live);
+	session_return(sessions[0]);
+	session_return(sessions[1]);
+	session_return(sessions[2]);
+	session_return(sessions[3]);
+	return success;
+}
+
+static int count_restores(struct log_event_usr *event, void *arg)
+{
+	unsigned int *restores = arg;
+
+	if (event->type == LOG_EVENT_SESSION_RESTORE)
+		(*restores)++;
+	return 0;
+}
+
+/**
+ * Makes the session module log its events to the event log, so the tests can look at them.
+ */
+static bool enable_binary_logging(void)
+{
+	struct global_config *config;
+
+	config = kmalloc(sizeof(*config), GFP_KERNEL);
+	if (!config)
+		return false;
+	if (config_clone(config)) {
+		kfree(config);
+		return false;
+	}
+
+	config->session_logging = true;
+	config->logging_binary = true;
+	return !config_set(config);
+}
+
+static bool test_sync_batches(void)
+{
+	struct session_entry *live, *update[2], *keys[2];
+	enum session_timer_type timers[] = { SESSIONTIMER_UDP, SESSIONTIMER_UDP };
+	unsigned int ttls[] = { 500, 500 };
+	__s32 results[2];
+	unsigned long timeout = config_get_ttl_udp();
+	unsigned int restores = 0;
+	bool success = true;
+
+	if (!enable_binary_logging() || eventlog_init())
+		return false;
+
+	live = create_and_insert_session(1, 0, 1, 0);
+	update[0] = create_session_entry(1, 0, 1, 0, L4PROTO_UDP);
+	update[1] = create_session_entry(2, 1, 2, 1, L4PROTO_UDP);
+	keys[0] = create_session_entry(1, 0, 1, 0, L4PROTO_UDP);
+	keys[1] = create_session_entry(2, 2, 2, 2, L4PROTO_UDP);
+	if (!live || !update[0] || !update[1] || !keys[0] || !keys[1]) {
+		success = false;
+		goto end;
+	}
+
+	/*
+	 * The active NAT64 says the first session has less time left than we thought, and tells us
+	 * about a new one.
+	 */
+	success &= assert_equals_int(0, sessiondb_add_batch(L4PROTO_UDP, update, timers, ttls, 2,
+			true, results), "Update result");
+	success &= assert_equals_int(0, results[0], "Updated session result");
+	success &= assert_equals_int(0, results[1], "New session result");
+	success &= assert_equals_u64(2, session_table_udp.count, "Only one was added");
+	success &= assert_true(time_before_eq(live->update_time + timeout,
+			jiffies + msecs_to_jiffies(500)), "Live session adopted the TTL");
+
+	/* Refreshing the existing session is not a restoration. */
+	success &= assert_equals_int(0, eventlog_drain(count_restores, &restores), "Drain");
+	success &= assert_equals_int(1, restores, "Restoration events");
+
+	/* Then it says the session died. */
+	success &= assert_equals_int(0, sessiondb_remove_batch(L4PROTO_UDP, keys, 2, results),
+			"Removal result");
+	success &= assert_equals_int(0, results[0], "Removed session result");
+	success &= assert_equals_int(-ESRCH, results[1], "Unknown session result");
+	success &= assert_equals_u64(1, session_table_udp.count, "Table count");
+
+	/* Fall through. */
+end:
+	if (live)
+		session_return(live);
+	if (update[0])
+		session_return(update[0]);
+	if (update[1])
+		session_return(update[1]);
+	if (keys[0])
+		session_return(keys[0]);
+	if (keys[1])
+		session_return(keys[1]);
+	eventlog_destroy();
+	return success;
+}
+
+static int take_one_record(struct session_record_usr *record, void *arg)
+{
+	unsigned int *taken = arg;
+
+	if (*taken > 0)
+		return 1;
+	(*taken)++;
+	return 0;
+}
+
+static bool test_sync_ring(void)
+{
+	struct session_record_usr record;
+	unsigned int taken;
+	bool success = true;
+
+	if (sessionsync_init())
+		return false;
+
+	memset(&record, 0, sizeof(record));
+	sessionsync_add(&record);
+	sessionsync_add(&record);
+
+	taken = 0;
+	success &= assert_equals_int(1, sessionsync_drain(take_one_record, &taken), "Stop early");
+	success &= assert_equals_int(1, taken, "One record drained");
+	taken = 0;
+	success &= assert_equals_int(1, sessionsync_drain(take_one_record, &taken), "Leftover");
+	success &= assert_equals_int(1, taken, "The rejected record stayed queued");
+	taken = 0;
+	success &= assert_equals_int(0, sessionsync_drain(take_one_record, &taken), "Empty");
+	success &= assert_equals_int(0, taken, "Nothing left");
+
+	sessionsync_destroy();
+	return success;
+}
+
+static const unsigned int BENCHMARK_SIZES[] = { 1000000, 10000000, 50000000 };
+#define BENCHMARK_LOOKUPS 1000000
+/* Number of lookups whose first phase is issued before any of them is resolved. */
+#define BENCHMARK_BATCH 32
+/* The tables are as big as they get, so the chains stay short even at the largest size. */
+#define BENCHMARK_BUCKETS FASTPATH_MAX_BUCKETS
+
+/**
+ * Builds the "i"th IPv4 tuple of the benchmark. Every "i" yields a different session.
+ */
+static void benchmark_tuple(unsigned int i, struct tuple *tuple4)
+{
+	tuple4->src.addr4.l3.s_addr = cpu_to_be32(0x0A000000U | (i >> 16));
+	tuple4->src.addr4.l4 = i & 0xFFFFU;
+	tuple4->dst.addr4 = addr4[1];
+	tuple4->l3_proto = L3PROTO_IPV4;
+	tuple4->l4_proto = L4PROTO_TCP;
+}
+
+/**
+ * Builds the "i"th IPv6 tuple of the benchmark; its source is the "i"th BIB entry's IPv6 address.
+ */
+static void benchmark_tuple6(unsigned int i, struct tuple *tuple6)
+{
+	tuple6->src.addr6 = addr6[0];
+	tuple6->src.addr6.l3.s6_addr32[3] = cpu_to_be32(i);
+	tuple6->dst.addr6 = addr6[1];
+	tuple6->l3_proto = L3PROTO_IPV6;
+	tuple6->l4_proto = L4PROTO_TCP;
+}
+
+/**
+ * Inserts the "i"th session and BIB entry of the benchmark. The session is an established TCP
+ * session, so the fast path mirrors it, and its timer outlives the benchmark.
+ */
+static int benchmark_add(unsigned int i)
+{
+	struct tuple tuple4, tuple6;
+	struct ipv4_transport_addr bib4;
+	struct session_entry *session;
+	struct bib_entry *bib;
+	int error;
+
+	benchmark_tuple(i, &tuple4);
+	/* The IPv6 index needs to be unique too. */
+	benchmark_tuple6(i, &tuple6);
+
+	session = session_create(&tuple6.src.addr6, &tuple6.dst.addr6, &tuple4.dst.addr4,
+			&tuple4.src.addr4, L4PROTO_TCP, NULL);
+	if (!session)
+		return -ENOMEM;
+	session->state = ESTABLISHED;
+
+	error = sessiondb_add(session, SESSIONTIMER_EST);
+	session_return(session);
+	if (error)
+		return error;
+
+	/* The BIB's IPv4 index needs unique keys, so this does not match the session. */
+	bib4.l3.s_addr = cpu_to_be32(0xC0000000U | (i >> 16));
+	bib4.l4 = i & 0xFFFFU;
+	bib = bib_create(&bib4, &tuple6.src.addr6, false, L4PROTO_TCP);
+	if (!bib)
+		return -ENOMEM;
+	error = bibdb_add(bib);
+	if (error)
+		bib_kfree(bib);
+	return error;
+}
+
+/**
+ * Converts "count" operations in "nsecs" nanoseconds into operations per second.
+ */
+static u64 benchmark_rate(unsigned int count, s64 nsecs)
+{
+	return nsecs ? div64_u64((u64) count * NSEC_PER_SEC, nsecs) : 0;
+}
+
+/**
+ * Returns the number of fast path lookups per second over a table of "size" entries.
+ *
+ * If "two_phase" is true, the lookups are done in batches of BENCHMARK_BATCH; every bucket of the
+ * batch is prefetched before the first one is resolved, so the cache misses overlap.
+ */
+static u64 benchmark_session_lookups(unsigned int size, bool two_phase)
+{
+	struct tuple tuples[BENCHMARK_BATCH], out;
+	ktime_t start, end;
+	unsigned int i, b;
+	unsigned int found = 0;
+
+	start = ktime_get();
+	for (i = 0; i < BENCHMARK_LOOKUPS; i += BENCHMARK_BATCH) {
+		for (b = 0; b < BENCHMARK_BATCH; b++) {
+			/* Jump around the table so the cache doesn't help. */
+			benchmark_tuple(((i + b) * 2654435761U) % size, &tuples[b]);
+			if (two_phase)
+				sessiondb_prefetch(&tuples[b]);
+		}
+		for (b = 0; b < BENCHMARK_BATCH; b++)
+			found += sessiondb_get_fast(&tuples[b], &out);
+	}
+	end = ktime_get();
+
+	if (found != i)
+		log_err("Only %u out of %u session lookups succeeded.", found, i);
+
+	return benchmark_rate(i, ktime_to_ns(ktime_sub(end, start)));
+}
+
+/**
+ * Same as benchmark_session_lookups(), except over the BIB's IPv6 index.
+ */
+static u64 benchmark_bib_lookups(unsigned int size, bool two_phase)
+{
+	struct tuple tuples[BENCHMARK_BATCH];
+	struct bib_entry *bib;
+	ktime_t start, end;
+	unsigned int i, b;
+	unsigned int found = 0;
+
+	start = ktime_get();
+	for (i = 0; i < BENCHMARK_LOOKUPS; i += BENCHMARK_BATCH) {
+		for (b = 0; b < BENCHMARK_BATCH; b++) {
+			benchmark_tuple6(((i + b) * 2654435761U) % size, &tuples[b]);
+			if (two_phase)
+				bibdb_prefetch(&tuples[b]);
+		}
+		for (b = 0; b < BENCHMARK_BATCH; b++) {
+			if (bibdb_get(&tuples[b], &bib))
+				continue;
+			bib_return(bib);
+			found++;
+		}
+	}
+	end = ktime_get();
+
+	if (found != i)
+		log_err("Only %u out of %u BIB lookups succeeded.", found, i);
+
+	return benchmark_rate(i, ktime_to_ns(ktime_sub(end, start)));
+}
+
+/**
+ * Not really a test; reports how many session and BIB lookups per second we get on increasingly
+ * large tables, both resolving every lookup right away and splitting batches of them into the
+ * prefetch and resolve phases. Only runs if the "benchmark" module parameter is set (eg. "insmod
+ * session.ko benchmark=1"), since the biggest table needs tens of gigabytes. If memory runs out,
+ * the sizes which could not be reached are skipped.
+ */
+static bool benchmark_lookups(void)
+{
+	unsigned int size, s;
+	unsigned int i = 0;
+
+	for (s = 0; s < ARRAY_SIZE(BENCHMARK_SIZES); s++) {
+		size = BENCHMARK_SIZES[s];
+		for (; i < size; i++) {
+			if (benchmark_add(i)) {
+				log_info("Ran out of memory at %u entries; skipping the bigger tables.", i);
+				return true;
+			}
+			if ((i & 0xFFFF) == 0)
+				cond_resched();
+		}
+
+		log_info("%u sessions: %llu lookups/sec (one phase), %llu (two phases).",
+				size, benchmark_session_lookups(size, false),
+				benchmark_session_lookups(size, true));
+		log_info("%u BIB entries: %llu lookups/sec (one phase), %llu (two phases).",
+				size, benchmark_bib_lookups(size, false),
+				benchmark_bib_lookups(size, true));
+	}
+
+	return true;
+}
+
 static bool test_address_filtering_aux(int src_addr_id, int src_port_id, int dst_addr_id,
 		int dst_port_id)
 {
@@ -814,7 +1382,10 @@ static bool test_tcp_trans_state_handle_else(void)
 	return success;
 }
 
-static bool init(void)
+/**
+ * Initializes the databases; "buckets" is the size of their hash indexes (zero means default).
+ */
+static bool init_sized(unsigned int buckets)
 {
 	int i;
 
@@ -838,9 +1409,9 @@ static bool init(void)
 		goto pool4_fail;
 	if (is_error(pool6_init(NULL, 0)))
 		goto pool6_fail;
-	if (is_error(bibdb_init()))
+	if (is_error(bibdb_init(buckets)))
 		goto bib_fail;
-	if (is_error(sessiondb_init()))
+	if (is_error(sessiondb_init(buckets)))
 		goto session_fail;
 
 	return true;
@@ -859,6 +1430,16 @@ config_fail:
 	return false;
 }
 
+static bool init(void)
+{
+	return init_sized(0);
+}
+
+static bool benchmark_init(void)
+{
+	return init_sized(BENCHMARK_BUCKETS);
+}
+
 static void end(void)
 {
 	sessiondb_destroy();
@@ -876,6 +1457,15 @@ int init_module(void)
 	INIT_CALL_END(init(), simple_session(), end(), "Single Session");
 	INIT_CALL_END(init(), test_address_filtering(), end(), "Address-dependent filtering.");
 	INIT_CALL_END(init(), test_compare_session4(), end(), "compare_session4()");
+	INIT_CALL_END(init(), test_fast_path(), end(), "Fast path");
+	INIT_CALL_END(init(), test_fast_refresh(), end(), "Fast path refresh");
+	INIT_CALL_END(init(), test_iterate_cursor(), end(), "Snapshot iteration cursor");
+	INIT_CALL_END(init(), test_add_batch(), end(), "Restored sessions");
+	INIT_CALL_END(init(), test_sync_batches(), end(), "Synchronized sessions");
+	CALL_TEST(test_sync_ring(), "Synchronization ring");
+	if (benchmark) {
+		INIT_CALL_END(benchmark_init(), benchmark_lookups(), end(), "Lookup benchmark");
+	}
 
 	INIT_CALL_END(init(), test_tcp_v4_init_state_handle_v6syn(), end(), "TCP-V4 INIT-V6 syn");
 	INIT_CALL_END(init(), test_tcp_v4_init_state_handle_else(), end(), "TCP-V4 INIT-else");
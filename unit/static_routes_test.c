@@ -0,0 +1,136 @@
+#include <linux/module.h>
+#include <linux/printk.h>
+
+#include "nat64/common/str_utils.h"
+#include "nat64/mod/common/config.h"
+#include "nat64/mod/stateful/pool4.h"
+#include "nat64/unit/unit_test.h"
+#include "static_routes.c"
+
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva Popper <aleiva@nic.mx>");
+MODULE_DESCRIPTION("Static routes module test.");
+
+static bool init_bib_usr(struct bib_entry_usr *entry, char *addr4_str, __u16 port4,
+		char *addr6_str, __u16 port6)
+{
+	if (is_error(str_to_addr4(addr4_str, &entry->addr4.l3)))
+		return false;
+	if (is_error(str_to_addr6(addr6_str, &entry->addr6.l3)))
+		return false;
+	entry->addr4.l4 = port4;
+	entry->addr6.l4 = port6;
+	entry->is_static = true;
+	return true;
+}
+
+static bool assert_static_bib(struct bib_entry_usr *entry, bool expected, char *test_name)
+{
+	struct bib_entry *bib;
+	bool success = true;
+
+	success &= assert_equals_int(expected ? 0 : -ESRCH,
+			bibdb_get_by_ipv6(&entry->addr6, L4PROTO_UDP, &bib), test_name);
+	if (!expected || !success)
+		return success;
+
+	success &= assert_true(ipv4_transport_addr_equals(&entry->addr4, &bib->ipv4), test_name);
+	success &= assert_true(bib->is_static, test_name);
+	bib_return(bib);
+	return success;
+}
+
+/**
+ * The entries of a loaded batch are rejected one by one; the good ones still make it in.
+ * (The pool4 impersonator only contains 192.0.2.128.)
+ */
+static bool test_load_bibs(void)
+{
+	struct request_bib req;
+	struct bib_entry_usr entries[6];
+	__s32 results[ARRAY_SIZE(entries)];
+	__u64 count;
+	bool success = true;
+
+	/* Already in the database before the load. */
+	req.l4_proto = L4PROTO_UDP;
+	if (!init_bib_usr(&entries[0], "192.0.2.128", 1000, "2001:db8::1", 1000))
+		return false;
+	req.add.addr4 = entries[0].addr4;
+	req.add.addr6 = entries[0].addr6;
+	if (!assert_equals_int(0, add_static_route(&req), "Preexisting entry"))
+		return false;
+
+	success &= init_bib_usr(&entries[0], "192.0.2.128", 2000, "2001:db8::2", 2000);
+	/* Not in pool4. */
+	success &= init_bib_usr(&entries[1], "203.0.113.1", 2001, "2001:db8::3", 2001);
+	/* Same IPv4 transport address as the preexisting entry. */
+	success &= init_bib_usr(&entries[2], "192.0.2.128", 1000, "2001:db8::4", 2002);
+	/* Same IPv6 transport address as the preexisting entry. */
+	success &= init_bib_usr(&entries[3], "192.0.2.128", 2003, "2001:db8::1", 1000);
+	/* Same IPv6 transport address as entry 0, which is earlier in the same batch. */
+	success &= init_bib_usr(&entries[4], "192.0.2.128", 2004, "2001:db8::2", 2000);
+	success &= init_bib_usr(&entries[5], "192.0.2.128", 2005, "2001:db8::5", 2005);
+	if (!success)
+		return false;
+
+	success &= assert_equals_int(0, add_static_routes(L4PROTO_UDP, entries,
+			ARRAY_SIZE(entries), results), "Batch result");
+	success &= assert_equals_int(0, results[0], "Good entry result");
+	success &= assert_equals_int(-EINVAL, results[1], "Foreign address result");
+	success &= assert_equals_int(-EEXIST, results[2], "IPv4 collision result");
+	success &= assert_equals_int(-EEXIST, results[3], "IPv6 collision result");
+	success &= assert_equals_int(-EEXIST, results[4], "Intra-batch collision result");
+	success &= assert_equals_int(0, results[5], "Last entry result");
+
+	success &= assert_equals_int(0, bibdb_count(L4PROTO_UDP, &count), "Count result");
+	success &= assert_equals_u64(3, count, "BIB count");
+
+	success &= assert_static_bib(&entries[0], true, "Good entry");
+	success &= assert_static_bib(&entries[1], false, "Foreign address");
+	success &= assert_static_bib(&entries[2], false, "IPv4 collision");
+	success &= assert_static_bib(&entries[5], true, "Last entry");
+
+	return success;
+}
+
+static bool init(void)
+{
+	if (is_error(config_init(false)))
+		goto config_fail;
+	if (is_error(pool4_init(NULL, 0)))
+		goto pool4_fail;
+	if (is_error(bibdb_init(0)))
+		goto bib_fail;
+
+	return true;
+
+bib_fail:
+	pool4_destroy();
+pool4_fail:
+	config_destroy();
+config_fail:
+	return false;
+}
+
+static void end(void)
+{
+	bibdb_destroy();
+	pool4_destroy();
+	config_destroy();
+}
+
+int init_module(void)
+{
+	START_TESTS("Static routes");
+
+	INIT_CALL_END(init(), test_load_bibs(), end(), "Loaded BIB entries");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
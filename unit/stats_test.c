@@ -0,0 +1,77 @@
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Unit tests for Jool's own counters");
+
+#include "nat64/unit/unit_test.h"
+#include "../mod/common/stats.c"
+
+/**
+ * Drop reasons and stage verdicts have to land in their own counters, and flushing has to reset
+ * all of them.
+ */
+static bool test_counters(void)
+{
+	struct stats_usr *stats;
+	bool success = true;
+
+	stats = kmalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return false;
+
+	stats_flush();
+
+	stats_received();
+	stats_received();
+	stats_translated();
+	stats_drop(DROP_TTL);
+	stats_drop(DROP_TTL);
+	stats_drop(DROP_ROUTE);
+	success &= assert_equals_int(VERDICT_DROP,
+			stats_verdict(STATS_STAGE_FILTERING, VERDICT_DROP), "verdict returned");
+	stats_verdict(STATS_STAGE_FILTERING, VERDICT_CONTINUE);
+	stats_verdict(STATS_STAGE_SEND, VERDICT_STOLEN);
+
+	stats_get(stats);
+	success &= assert_equals_u64(2, stats->received, "received");
+	success &= assert_equals_u64(1, stats->translated, "translated");
+	success &= assert_equals_u64(0, stats->hairpinned, "hairpinned");
+	success &= assert_equals_u64(2, stats->drops[DROP_TTL], "TTL drops");
+	success &= assert_equals_u64(1, stats->drops[DROP_ROUTE], "route drops");
+	success &= assert_equals_u64(0, stats->drops[DROP_MALFORMED], "malformed drops");
+	success &= assert_equals_u64(1, stats->stages[STATS_STAGE_FILTERING][STATS_DROPPED],
+			"filtering drops");
+	success &= assert_equals_u64(0, stats->stages[STATS_STAGE_FILTERING][STATS_ACCEPTED],
+			"filtering accepts");
+	success &= assert_equals_u64(0, stats->stages[STATS_STAGE_FILTERING][STATS_STOLEN],
+			"filtering steals");
+	success &= assert_equals_u64(1, stats->stages[STATS_STAGE_SEND][STATS_STOLEN],
+			"send steals");
+
+	stats_flush();
+	stats_get(stats);
+	success &= assert_equals_u64(0, stats->received, "flushed received");
+	success &= assert_equals_u64(0, stats->drops[DROP_TTL], "flushed TTL drops");
+	success &= assert_equals_u64(0, stats->stages[STATS_STAGE_FILTERING][STATS_DROPPED],
+			"flushed filtering drops");
+
+	kfree(stats);
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("Stats");
+
+	CALL_TEST(test_counters(), "Counters");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
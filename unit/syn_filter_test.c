@@ -0,0 +1,117 @@
+#include <linux/module.h>
+
+#include "nat64/common/str_utils.h"
+#include "nat64/unit/unit_test.h"
+
+#include "syn_filter.c"
+
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("SYN filter test");
+
+
+static bool init_addrs(struct ipv4_transport_addr *remote4, struct ipv4_transport_addr *local4,
+		u16 remote_port)
+{
+	if (is_error(str_to_addr4("198.51.100.1", &remote4->l3)))
+		return false;
+	if (is_error(str_to_addr4("192.0.2.1", &local4->l3)))
+		return false;
+	remote4->l4 = remote_port;
+	local4->l4 = 80;
+	return true;
+}
+
+/**
+ * Moves the filter one period ahead in time.
+ */
+static void force_rotation(void)
+{
+	rotation_time = jiffies - 1;
+	rotate();
+}
+
+static bool test_contains(void)
+{
+	struct ipv4_transport_addr remote4, local4;
+	struct ipv4_transport_addr other_remote4, other_local4;
+	bool success = true;
+
+	if (!init_addrs(&remote4, &local4, 1234))
+		return false;
+	if (!init_addrs(&other_remote4, &other_local4, 4321))
+		return false;
+
+	success &= assert_false(synfilter_contains(&remote4, &local4), "Empty");
+
+	synfilter_add(&remote4, &local4);
+	success &= assert_true(synfilter_contains(&remote4, &local4), "Added");
+	/* This one could be a false positive, but only if the hash is awful. */
+	success &= assert_false(synfilter_contains(&other_remote4, &other_local4), "Not added");
+
+	return success;
+}
+
+static bool test_rotation(void)
+{
+	struct ipv4_transport_addr remote4, local4;
+	bool success = true;
+
+	if (!init_addrs(&remote4, &local4, 1234))
+		return false;
+
+	synfilter_add(&remote4, &local4);
+
+	force_rotation();
+	success &= assert_true(synfilter_contains(&remote4, &local4), "Survives one rotation");
+
+	force_rotation();
+	success &= assert_false(synfilter_contains(&remote4, &local4), "Dies in the second one");
+
+	/* A long period of inactivity empties the whole filter. */
+	synfilter_add(&remote4, &local4);
+	rotation_time = jiffies - get_period() - 1;
+	rotate();
+	success &= assert_false(synfilter_contains(&remote4, &local4), "Idle filter is cleared");
+
+	return success;
+}
+
+static bool test_size(void)
+{
+	bool success = true;
+
+	success &= assert_equals_int(GENERATION_DEFAULT_BITS, generation_bits, "Default");
+	synfilter_destroy();
+
+	success &= assert_equals_int(0, synfilter_init(100000), "Odd size result");
+	success &= assert_equals_int(1 << 17, generation_bits, "Rounded up");
+	synfilter_destroy();
+
+	success &= assert_equals_int(-EINVAL, synfilter_init(GENERATION_MAX_BITS + 1), "Too big");
+
+	/* Leave something for the caller to destroy. */
+	return synfilter_init(0) ? false : success;
+}
+
+static bool init(void)
+{
+	return !synfilter_init(0);
+}
+
+int init_module(void)
+{
+	START_TESTS("SYN filter");
+
+	INIT_CALL_END(init(), test_contains(), synfilter_destroy(), "Add and query");
+	INIT_CALL_END(init(), test_rotation(), synfilter_destroy(), "Rotation");
+	INIT_CALL_END(init(), test_size(), synfilter_destroy(), "Size");
+
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -0,0 +1,227 @@
+#include <linux/module.h>
+#include <linux/slab.h>
+
+#include "nat64/common/str_utils.h"
+#include "nat64/unit/unit_test.h"
+#include "../mod/common/trie.c"
+
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Alberto Leiva");
+MODULE_DESCRIPTION("Trie module test");
+
+
+/** Values we'll be storing in the tries. Only their addresses matter. */
+static int values[8];
+
+static bool add4(struct trie *trie, char *addr_str, __u8 len, int *value, int expected)
+{
+	struct in_addr addr;
+
+	if (str_to_addr4(addr_str, &addr))
+		return false;
+
+	return assert_equals_int(expected, trie_add(trie, &addr, len, value), addr_str);
+}
+
+static bool remove4(struct trie *trie, char *addr_str, __u8 len, int *value, int expected)
+{
+	struct in_addr addr;
+
+	if (str_to_addr4(addr_str, &addr))
+		return false;
+
+	return assert_equals_int(expected, trie_remove(trie, &addr, len, value), addr_str);
+}
+
+static bool find4(struct trie *trie, char *addr_str, int *expected)
+{
+	struct in_addr addr;
+	void *value;
+
+	if (str_to_addr4(addr_str, &addr))
+		return false;
+
+	rcu_read_lock_bh();
+	value = trie_find(trie, &addr);
+	rcu_read_unlock_bh();
+
+	if (expected)
+		return assert_not_null(value, addr_str) && assert_equals_int(expected - values,
+				((int *) value) - values, addr_str);
+	return assert_null(value, addr_str);
+}
+
+static bool find6(struct trie *trie, char *addr_str, int *expected)
+{
+	struct in6_addr addr;
+	void *value;
+
+	if (str_to_addr6(addr_str, &addr))
+		return false;
+
+	rcu_read_lock_bh();
+	value = trie_find(trie, &addr);
+	rcu_read_unlock_bh();
+
+	if (expected)
+		return assert_not_null(value, addr_str) && assert_equals_int(expected - values,
+				((int *) value) - values, addr_str);
+	return assert_null(value, addr_str);
+}
+
+static bool test_ipv4(void)
+{
+	struct trie trie;
+	bool success = true;
+
+	trie_init(&trie, sizeof(struct in_addr));
+
+	success &= add4(&trie, "10.0.0.0", 30, &values[0], 0);
+	success &= add4(&trie, "10.0.0.12", 30, &values[1], 0);
+	success &= add4(&trie, "10.0.0.16", 28, &values[2], 0);
+	success &= add4(&trie, "10.0.0.254", 32, &values[3], 0);
+	success &= add4(&trie, "10.0.1.0", 24, &values[4], 0);
+
+	/* Overlaps. */
+	success &= add4(&trie, "10.0.0.0", 24, &values[5], -EEXIST);
+	success &= add4(&trie, "10.0.0.0", 8, &values[5], -EEXIST);
+	success &= add4(&trie, "10.0.0.17", 32, &values[5], -EEXIST);
+	success &= add4(&trie, "10.0.1.128", 25, &values[5], -EEXIST);
+	success &= add4(&trie, "0.0.0.0", 0, &values[5], -EEXIST);
+
+	success &= find4(&trie, "10.0.0.2", &values[0]);
+	success &= find4(&trie, "10.0.0.4", NULL);
+	success &= find4(&trie, "10.0.0.14", &values[1]);
+	success &= find4(&trie, "10.0.0.31", &values[2]);
+	success &= find4(&trie, "10.0.0.32", NULL);
+	success &= find4(&trie, "10.0.0.254", &values[3]);
+	success &= find4(&trie, "10.0.0.255", NULL);
+	success &= find4(&trie, "10.0.1.200", &values[4]);
+	success &= find4(&trie, "11.0.1.200", NULL);
+
+	/* Removals need to match the insertions exactly. */
+	success &= remove4(&trie, "10.0.1.0", 24, &values[0], -ESRCH);
+	success &= remove4(&trie, "10.0.1.0", 23, &values[4], -ESRCH);
+	success &= remove4(&trie, "10.0.1.0", 24, &values[4], 0);
+	success &= find4(&trie, "10.0.1.200", NULL);
+	success &= find4(&trie, "10.0.0.2", &values[0]);
+
+	success &= remove4(&trie, "10.0.0.0", 30, &values[0], 0);
+	success &= remove4(&trie, "10.0.0.12", 30, &values[1], 0);
+	success &= remove4(&trie, "10.0.0.16", 28, &values[2], 0);
+	success &= remove4(&trie, "10.0.0.254", 32, &values[3], 0);
+	/* Empty nodes should have been pruned. */
+	success &= assert_null(trie.root, "root after removals");
+
+	/* The zero-length prefix contains everything. */
+	success &= add4(&trie, "0.0.0.0", 0, &values[6], 0);
+	success &= find4(&trie, "1.2.3.4", &values[6]);
+	success &= add4(&trie, "1.2.3.4", 32, &values[7], -EEXIST);
+
+	trie_flush(&trie);
+	success &= assert_null(trie.root, "root after flush");
+	success &= find4(&trie, "1.2.3.4", NULL);
+
+	trie_destroy(&trie);
+	return success;
+}
+
+static bool test_ipv6(void)
+{
+	struct trie trie;
+	struct in6_addr addr;
+	bool success = true;
+
+	trie_init(&trie, sizeof(struct in6_addr));
+
+	if (str_to_addr6("2001:db8::", &addr))
+		return false;
+	success &= assert_equals_int(0, trie_add(&trie, &addr, 124, &values[0]), "add /124");
+	if (str_to_addr6("2001:db8::10", &addr))
+		return false;
+	success &= assert_equals_int(0, trie_add(&trie, &addr, 128, &values[1]), "add /128");
+	if (str_to_addr6("2001:db8:1::", &addr))
+		return false;
+	success &= assert_equals_int(0, trie_add(&trie, &addr, 48, &values[2]), "add /48");
+
+	success &= find6(&trie, "2001:db8::f", &values[0]);
+	success &= find6(&trie, "2001:db8::10", &values[1]);
+	success &= find6(&trie, "2001:db8::11", NULL);
+	success &= find6(&trie, "2001:db8:1:ffff::1", &values[2]);
+	success &= find6(&trie, "2001:db8:2::", NULL);
+
+	/* The siblings of the removed prefixes need to remain reachable. */
+	if (str_to_addr6("2001:db8::10", &addr))
+		return false;
+	success &= assert_equals_int(0, trie_remove(&trie, &addr, 128, &values[1]), "rm /128");
+	success &= find6(&trie, "2001:db8::10", NULL);
+	success &= find6(&trie, "2001:db8::f", &values[0]);
+	success &= find6(&trie, "2001:db8:1:ffff::1", &values[2]);
+
+	if (str_to_addr6("2001:db8::", &addr))
+		return false;
+	success &= assert_equals_int(0, trie_remove(&trie, &addr, 124, &values[0]), "rm /124");
+	success &= find6(&trie, "2001:db8::f", NULL);
+	success &= find6(&trie, "2001:db8:1:ffff::1", &values[2]);
+
+	trie_destroy(&trie);
+	return success;
+}
+
+/**
+ * Fills the trie with prefixes which share most of their bits, then removes every other one.
+ */
+static bool test_many(void)
+{
+	struct trie trie;
+	struct in_addr addr;
+	void *value;
+	unsigned int i;
+	bool success = true;
+
+	trie_init(&trie, sizeof(struct in_addr));
+
+	for (i = 0; i < 256; i++) {
+		addr.s_addr = cpu_to_be32(0xC0000200U | i);
+		success &= assert_equals_int(0, trie_add(&trie, &addr, 32, &values[i & 7]), "add");
+	}
+
+	for (i = 0; i < 256; i += 2) {
+		addr.s_addr = cpu_to_be32(0xC0000200U | i);
+		success &= assert_equals_int(0, trie_remove(&trie, &addr, 32, &values[i & 7]),
+				"remove");
+	}
+
+	rcu_read_lock_bh();
+	for (i = 0; i < 256; i++) {
+		addr.s_addr = cpu_to_be32(0xC0000200U | i);
+		value = trie_find(&trie, &addr);
+		if (i & 1)
+			success &= assert_true(value == &values[i & 7], "odd entries survive");
+		else
+			success &= assert_null(value, "even entries are gone");
+	}
+	rcu_read_unlock_bh();
+
+	trie_destroy(&trie);
+	return success;
+}
+
+int init_module(void)
+{
+	START_TESTS("Trie");
+
+	CALL_TEST(test_ipv4(), "IPv4 keys");
+	CALL_TEST(test_ipv6(), "IPv6 keys");
+	CALL_TEST(test_many(), "Lots of similar keys");
+
+	/* The removed nodes are released by callbacks from this module. */
+	rcu_barrier_bh();
+	END_TESTS;
+}
+
+void cleanup_module(void)
+{
+	/* No code. */
+}
@@ -28,10 +28,12 @@ static int handle_display_response(struct nl_msg *msg, void *arg)
 	for (i = 0; i < conf->mtu_plateau_count; i++) {
 		printf("      %u\n", plateaus[i]);
 	}
+	printf("  --%s: %s\n", OPTNAME_LATENCY_HISTOGRAMS,
+			conf->latency_histograms ? "ON" : "OFF");
 
 #ifdef STATEFUL
-	printf("  --%s: %llu\n", OPTNAME_MAX_SO,
-			conf->max_stored_pkts);
+	printf("  --%s: %llu\n", OPTNAME_SO_MAX_MEM,
+			conf->so_max_mem);
 	printf("  --%s: %s\n", OPTNAME_SRC_ICMP6E_BETTER,
 			conf->src_icmp6errs_better ? "ON" : "OFF");
 #else
@@ -72,6 +74,13 @@ static int handle_display_response(struct nl_msg *msg, void *arg)
 			conf->bib_logging ? "ON" : "OFF");
 	printf("  --%s: %s\n", OPTNAME_SESSION_LOGGING,
 			conf->session_logging ? "ON" : "OFF");
+	printf("  --%s: %s\n", OPTNAME_LOGGING_BINARY,
+			conf->logging_binary ? "ON" : "OFF");
+	printf("\n");
+
+	printf("  High availability:\n");
+	printf("  --%s: %s\n", OPTNAME_SESSION_SYNC,
+			conf->session_sync ? "ON" : "OFF");
 	printf("\n");
 
 	printf("  Filtering:\n");
@@ -81,6 +90,8 @@ static int handle_display_response(struct nl_msg *msg, void *arg)
 			conf->drop_icmp6_info ? "ON" : "OFF");
 	printf("    --%s: %s\n",
 			OPTNAME_DROP_EXTERNAL_TCP, conf->drop_external_tcp ? "ON" : "OFF");
+	printf("    --%s: %s\n", OPTNAME_STATELESS_EXTERNAL_TCP,
+			conf->stateless_external_tcp ? "ON" : "OFF");
 	printf("\n");
 
 	printf("  Timeouts:\n");
@@ -25,6 +25,9 @@
 #include "nat64/usr/eam.h"
 #include "nat64/usr/global.h"
 #include "nat64/usr/log_time.h"
+#include "nat64/usr/stats.h"
+#include "nat64/usr/transaction.h"
+#include "nat64/usr/netlink.h"
 
 
 const char *argp_program_version = JOOL_VERSION_STR;
@@ -40,6 +43,8 @@ struct arguments {
 	struct {
 		/* This is actually only common to the pools; the tables don't use it. */
 		bool quick;
+		/* File the entries of a load operation are read from. */
+		char *load_file;
 
 		struct {
 			struct ipv6_prefix prefix;
@@ -55,6 +60,8 @@ struct arguments {
 			bool tcp, udp, icmp;
 			bool numeric;
 			bool csv_format;
+			/* File the tables are saved to, instead of being printed. */
+			char *save_file;
 
 			struct {
 				struct ipv6_transport_addr addr6;
@@ -70,6 +77,11 @@ struct arguments {
 		size_t size;
 		void *data;
 	} global;
+
+	struct {
+		enum transaction_action action;
+		bool action_set;
+	} txn;
 };
 
 /**
@@ -85,7 +97,9 @@ enum argp_flags {
 	ARGP_BLACKLIST = 7000,
 	ARGP_RFC6791 = 6791,
 	ARGP_LOGTIME = 'l',
+	ARGP_STATS = 7001,
 	ARGP_GLOBAL = 'g',
+	ARGP_TRANSACTION = 5100,
 
 	/* Operations */
 	ARGP_DISPLAY = 'd',
@@ -94,6 +108,10 @@ enum argp_flags {
 	ARGP_UPDATE = 5000,
 	ARGP_REMOVE = 'r',
 	ARGP_FLUSH = 'f',
+	ARGP_LOAD = 5001,
+	ARGP_BEGIN = 5101,
+	ARGP_COMMIT = 5102,
+	ARGP_ABORT = 5103,
 
 	/* Pools */
 	ARGP_PREFIX = 1000,
@@ -106,6 +124,7 @@ enum argp_flags {
 	ARGP_ICMP = 'i',
 	ARGP_NUMERIC_HOSTNAME = 'n',
 	ARGP_CSV = 2022,
+	ARGP_SAVE = 2023,
 	ARGP_BIB_IPV6 = 2020,
 	ARGP_BIB_IPV4 = 2021,
 
@@ -113,14 +132,18 @@ enum argp_flags {
 	ARGP_DROP_ADDR = 3000,
 	ARGP_DROP_INFO = 3001,
 	ARGP_DROP_TCP = 3002,
+	ARGP_STATELESS_TCP = 3003,
 	ARGP_UDP_TO = 3010,
 	ARGP_ICMP_TO = 3011,
 	ARGP_TCP_TO = 3012,
 	ARGP_TCP_TRANS_TO = 3013,
-	ARGP_STORED_PKTS = 3014,
+	ARGP_SO_MAX_MEM = 3014,
 	ARGP_SRC_ICMP6ERRS_BETTER = 3015,
 	ARGP_BIB_LOGGING,
 	ARGP_SESSION_LOGGING,
+	ARGP_LOGGING_BINARY,
+	ARGP_SESSION_SYNC,
+	ARGP_STORED_PKTS = 3020,
 	ARGP_RESET_TCLASS = 4002,
 	ARGP_RESET_TOS = 4003,
 	ARGP_NEW_TOS = 4004,
@@ -135,6 +158,7 @@ enum argp_flags {
 	ARGP_COMPUTE_CSUM_ZERO = 4015,
 	ARGP_RANDOMIZE_RFC6791 = 4017,
 	ARGP_ATOMIC_FRAGMENTS = 4016,
+	ARGP_LATENCY_HISTOGRAMS = 4018,
 };
 
 #define BOOL_FORMAT "BOOL"
@@ -167,12 +191,13 @@ static struct argp_option options[] =
 			"blacklist." },
 	{ "pool6791", ARGP_RFC6791, NULL, 0, "The command will operate on the RFC6791 pool."},
 #endif
-#ifdef BENCHMARK
-	{ "logTime", ARGP_LOGTIME, NULL, 0, "The command will operate on the logs times database."},
-#endif
+	{ "logTime", ARGP_LOGTIME, NULL, 0, "The command will operate on the latency histograms."},
+	{ "stats", ARGP_STATS, NULL, 0, "The command will operate on the packet counters."},
 	{ "global", ARGP_GLOBAL, NULL, 0, "The command will operate on miscellaneous configuration "
 			"values (default)." },
 	{ "general", 0, NULL, OPTION_ALIAS, ""},
+	{ "transaction", ARGP_TRANSACTION, NULL, 0, "The command will operate on the configuration "
+			"transaction." },
 
 	{ NULL, 0, NULL, 0, "Operations:", 3 },
 	{ "display", ARGP_DISPLAY, NULL, 0, "Print the target (default)." },
@@ -181,6 +206,12 @@ static struct argp_option options[] =
 	{ "update", ARGP_UPDATE, NULL, 0, "Change something in the target." },
 	{ "remove", ARGP_REMOVE, NULL, 0, "Remove an element from the target." },
 	{ "flush", ARGP_FLUSH, NULL, 0, "Clear the target." },
+	{ "load", ARGP_LOAD, "FILE", 0, "Add all the entries listed in FILE (- is standard input) "
+			"to the target." },
+	{ "begin", ARGP_BEGIN, NULL, 0, "Stage the following changes to the pools and tables "
+			"instead of applying them." },
+	{ "commit", ARGP_COMMIT, NULL, 0, "Apply the staged changes, all at once." },
+	{ "abort", ARGP_ABORT, NULL, 0, "Drop the staged changes." },
 
 #ifdef STATEFUL
 	{ NULL, 0, NULL, 0, "IPv4 and IPv6 Pool options:", 4 },
@@ -195,6 +226,9 @@ static struct argp_option options[] =
 			"Available on display operation only." },
 	{ "csv", ARGP_CSV, NULL, 0, "Print in CSV format. "
 			"Available on display operation only."},
+	{ "save", ARGP_SAVE, "FILE", 0, "Write the BIB entries and sessions to FILE in binary "
+			"format, so they can be restored later using --session --load. "
+			"Available on session display operation only."},
 
 #else
 	{ NULL, 0, NULL, 0, "EAMT only options:", 4 },
@@ -219,6 +253,8 @@ static struct argp_option options[] =
 	{ OPTNAME_MTU_PLATEAUS, ARGP_PLATEAUS, NUM_ARRAY_FORMAT, 0,
 			"Set the list of plateaus for ICMPv4 Fragmentation Neededs with MTU unset.\n" },
 	{ "plateaus", 0, NULL, OPTION_ALIAS, ""},
+	{ OPTNAME_LATENCY_HISTOGRAMS, ARGP_LATENCY_HISTOGRAMS, BOOL_FORMAT, 0,
+			"Record every packet's latency in the --logTime histograms?\n" },
 #ifdef STATEFUL
 	{ OPTNAME_DROP_BY_ADDR, ARGP_DROP_ADDR, BOOL_FORMAT, 0,
 			"Use Address-Dependent Filtering? "
@@ -230,6 +266,8 @@ static struct argp_option options[] =
 	{ OPTNAME_DROP_EXTERNAL_TCP, ARGP_DROP_TCP, BOOL_FORMAT, 0,
 			"Drop externally initiated TCP connections?\n" },
 	{ "dropTCP", 0, NULL, OPTION_ALIAS, ""},
+	{ OPTNAME_STATELESS_EXTERNAL_TCP, ARGP_STATELESS_TCP, BOOL_FORMAT, 0,
+			"Don't create state for externally initiated TCP connections until IPv6 answers?\n" },
 
 	{ OPTNAME_UDP_TIMEOUT, ARGP_UDP_TO, NUM_FORMAT, 0,
 			"Set the UDP session lifetime (in seconds).\n" },
@@ -247,9 +285,9 @@ static struct argp_option options[] =
 			"Set the timeout for arrival of fragments.\n" },
 	{ "toFrag", 0, NULL, OPTION_ALIAS, ""},
 
-	{ OPTNAME_MAX_SO, ARGP_STORED_PKTS, NUM_FORMAT, 0,
-			"Set the maximum allowable 'simultaneous' Simultaneos Opens of TCP connections.\n" },
-	{ "maxStoredPkts", 0, NULL, OPTION_ALIAS, ""},
+	{ OPTNAME_SO_MAX_MEM, ARGP_SO_MAX_MEM, NUM_FORMAT, 0,
+			"Set the memory budget of the Simultaneous Open packets (in bytes).\n" },
+	{ "so-max-mem", 0, NULL, OPTION_ALIAS, ""},
 	{ OPTNAME_SRC_ICMP6E_BETTER, ARGP_SRC_ICMP6ERRS_BETTER, BOOL_FORMAT, 0,
 			"Translate source addresses directly on 4-to-6 ICMP errors?\n" },
 
@@ -257,6 +295,10 @@ static struct argp_option options[] =
 			"Log BIBs as they are created and destroyed?\n" },
 	{ OPTNAME_SESSION_LOGGING, ARGP_SESSION_LOGGING, BOOL_FORMAT, 0,
 			"Log sessions as they are created and destroyed?\n" },
+	{ OPTNAME_LOGGING_BINARY, ARGP_LOGGING_BINARY, BOOL_FORMAT, 0,
+			"Queue the BIB and session logs for jool-log instead of printing them?\n" },
+	{ OPTNAME_SESSION_SYNC, ARGP_SESSION_SYNC, BOOL_FORMAT, 0,
+			"Queue session changes so jool-sync can replicate them in a standby NAT64?\n" },
 #else
 	{ OPTNAME_AMEND_UDP_CSUM, ARGP_COMPUTE_CSUM_ZERO, BOOL_FORMAT, 0,
 			"Compute the UDP checksum of IPv4-UDP packets whose value is zero? "
@@ -280,6 +322,9 @@ static struct argp_option options[] =
 			"Decrease MTU failure rate?" },
 
 #ifdef STATEFUL
+	{ OPTNAME_MAX_SO, ARGP_STORED_PKTS, NUM_FORMAT, 0,
+			"Replaced by --" OPTNAME_SO_MAX_MEM ", which is a byte budget." },
+	{ "maxStoredPkts", 0, NULL, OPTION_ALIAS, ""},
 	{ "prefix", ARGP_PREFIX, PREFIX6_FORMAT, 0, "Prefix to be added to or removed from "
 			"the IPv6 pool. You no longer need to name this." },
 	{ "address", ARGP_ADDRESS, PREFIX4_FORMAT, 0, "'Address' to be added to or removed from "
@@ -319,6 +364,22 @@ fail:
 	return -EINVAL;
 }
 
+static int set_txn_action(struct arguments *args, enum transaction_action action)
+{
+	int error = update_state(args, MODE_TRANSACTION, OP_UPDATE);
+	if (error)
+		return error;
+
+	if (args->txn.action_set) {
+		log_err("Only one of --begin, --commit and --abort can be requested at a time.");
+		return -EINVAL;
+	}
+
+	args->txn.action = action;
+	args->txn.action_set = true;
+	return 0;
+}
+
 static int set_global_arg(struct arguments *args, __u8 type, size_t size, void *value)
 {
 	int error = update_state(args, MODE_GLOBAL, OP_UPDATE);
@@ -547,6 +608,12 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 	case ARGP_LOGTIME:
 		error = update_state(args, MODE_LOGTIME, LOGTIME_OPS);
 		break;
+	case ARGP_STATS:
+		error = update_state(args, MODE_STATS, STATS_OPS);
+		break;
+	case ARGP_TRANSACTION:
+		error = update_state(args, MODE_TRANSACTION, TRANSACTION_OPS);
+		break;
 
 	case ARGP_DISPLAY:
 		error = update_state(args, DISPLAY_MODES, OP_DISPLAY);
@@ -566,6 +633,19 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 	case ARGP_FLUSH:
 		error = update_state(args, FLUSH_MODES, OP_FLUSH);
 		break;
+	case ARGP_LOAD:
+		error = update_state(args, LOAD_MODES, OP_LOAD);
+		args->db.load_file = str;
+		break;
+	case ARGP_BEGIN:
+		error = set_txn_action(args, TXN_BEGIN);
+		break;
+	case ARGP_COMMIT:
+		error = set_txn_action(args, TXN_COMMIT);
+		break;
+	case ARGP_ABORT:
+		error = set_txn_action(args, TXN_ABORT);
+		break;
 
 	case ARGP_UDP:
 		error = update_state(args, MODE_BIB | MODE_SESSION, BIB_OPS | SESSION_OPS);
@@ -587,6 +667,10 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 		error = update_state(args, MODE_EAMT | MODE_BIB | MODE_SESSION, OP_DISPLAY);
 		args->db.tables.csv_format = true;
 		break;
+	case ARGP_SAVE:
+		error = update_state(args, MODE_SESSION, OP_DISPLAY);
+		args->db.tables.save_file = str;
+		break;
 
 	case ARGP_QUICK:
 		error = update_state(args, MODE_POOL6 | MODE_POOL4, OP_REMOVE | OP_FLUSH);
@@ -610,6 +694,9 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 	case ARGP_DROP_TCP:
 		error = set_global_bool(args, DROP_EXTERNAL_TCP, str);
 		break;
+	case ARGP_STATELESS_TCP:
+		error = set_global_bool(args, STATELESS_EXTERNAL_TCP, str);
+		break;
 
 	case ARGP_UDP_TO:
 		error = set_global_u64(args, UDP_TIMEOUT, str, UDP_MIN, MAX_U32/1000, 1000);
@@ -627,8 +714,14 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 		error = set_global_u64(args, FRAGMENT_TIMEOUT, str, FRAGMENT_MIN, MAX_U32/1000, 1000);
 		break;
 
+	case ARGP_SO_MAX_MEM:
+		error = set_global_u64(args, SO_MAX_MEM, str, 0, MAX_U64, 1);
+		break;
 	case ARGP_STORED_PKTS:
-		error = set_global_u64(args, MAX_PKTS, str, 0, MAX_U64, 1);
+		/* The old value was a packet count; reinterpreting it as bytes would be wrong. */
+		log_err("--%s is now a byte budget; use --%s (--so-max-mem) instead.",
+				OPTNAME_MAX_SO, OPTNAME_SO_MAX_MEM);
+		error = -EINVAL;
 		break;
 	case ARGP_SRC_ICMP6ERRS_BETTER:
 		error = set_global_bool(args, SRC_ICMP6ERRS_BETTER, str);
@@ -640,6 +733,12 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 	case ARGP_SESSION_LOGGING:
 		error = set_global_bool(args, SESSION_LOGGING, str);
 		break;
+	case ARGP_LOGGING_BINARY:
+		error = set_global_bool(args, LOGGING_BINARY, str);
+		break;
+	case ARGP_SESSION_SYNC:
+		error = set_global_bool(args, SESSION_SYNC, str);
+		break;
 #else
 	case ARGP_COMPUTE_CSUM_ZERO:
 		error = set_global_bool(args, COMPUTE_UDP_CSUM_ZERO, str);
@@ -689,6 +788,9 @@ static int parse_opt(int key, char *str, struct argp_state *state)
 	case ARGP_ATOMIC_FRAGMENTS:
 		error = set_global_bool(args, ATOMIC_FRAGMENTS, str);
 		break;
+	case ARGP_LATENCY_HISTOGRAMS:
+		error = set_global_bool(args, LATENCY_HISTOGRAMS, str);
+		break;
 	case ARGP_KEY_ARG:
 		error = set_ip_args(args, str);
 		break;
@@ -881,6 +983,10 @@ static int main_wrapped(int argc, char **argv)
 					args.db.tables.bib.addr6_set, &args.db.tables.bib.addr6,
 					args.db.tables.bib.addr4_set, &args.db.tables.bib.addr4);
 
+		case OP_LOAD:
+			return bib_load(args.db.tables.tcp, args.db.tables.udp, args.db.tables.icmp,
+					args.db.load_file);
+
 		default:
 			log_err("Unknown operation for BIB mode: %u.", args.op);
 			return -EINVAL;
@@ -895,10 +1001,15 @@ static int main_wrapped(int argc, char **argv)
 
 		switch (args.op) {
 		case OP_DISPLAY:
+			if (args.db.tables.save_file)
+				return session_save(args.db.tables.tcp, args.db.tables.udp,
+						args.db.tables.icmp, args.db.tables.save_file);
 			return session_display(args.db.tables.tcp, args.db.tables.udp, args.db.tables.icmp,
 					args.db.tables.numeric, args.db.tables.csv_format);
 		case OP_COUNT:
 			return session_count(args.db.tables.tcp, args.db.tables.udp, args.db.tables.icmp);
+		case OP_LOAD:
+			return session_load(args.db.load_file);
 		default:
 			log_err("Unknown operation for session mode: %u.", args.op);
 			return -EINVAL;
@@ -932,6 +1043,8 @@ static int main_wrapped(int argc, char **argv)
 					args.db.pool4.prefix_set, &args.db.pool4.prefix);
 		case OP_FLUSH:
 			return eam_flush();
+		case OP_LOAD:
+			return eam_load(args.db.load_file);
 		default:
 			log_err("Unknown operation for EAMT mode: %u.", args.op);
 			return -EINVAL;
@@ -939,20 +1052,29 @@ static int main_wrapped(int argc, char **argv)
 		break;
 
 	case MODE_LOGTIME:
-		if (!is_logtime_enabled()) {
-			log_err("This is benchmark configuration mode despite benchmark being disabled.");
-			return -EINVAL;
-		}
-
 		switch (args.op) {
 		case OP_DISPLAY:
 			return logtime_display();
+		case OP_FLUSH:
+			return logtime_flush();
 		default:
 			log_err("Unknown operation for log time mode: %u.", args.op);
 			break;
 		}
 		break;
 
+	case MODE_STATS:
+		switch (args.op) {
+		case OP_DISPLAY:
+			return stats_display();
+		case OP_FLUSH:
+			return stats_flush();
+		default:
+			log_err("Unknown operation for stats mode: %u.", args.op);
+			break;
+		}
+		break;
+
 	case MODE_GLOBAL:
 		switch (args.op) {
 		case OP_DISPLAY:
@@ -965,6 +1087,27 @@ static int main_wrapped(int argc, char **argv)
 			log_err("Unknown operation for global mode: %u.", args.op);
 			return -EINVAL;
 		}
+
+	case MODE_TRANSACTION:
+		switch (args.op) {
+		case OP_DISPLAY:
+			return txn_display();
+		case OP_UPDATE:
+			if (!args.txn.action_set) {
+				log_err("Please specify --begin, --commit or --abort.");
+				return -EINVAL;
+			}
+			return txn_update(args.txn.action);
+		default:
+			log_err("Unknown operation for transaction mode: %u.", args.op);
+			return -EINVAL;
+		}
+	case MODE_SYNC:
+		/* This one belongs to jool-sync. */
+		break;
+	case MODE_LOG:
+		/* This one belongs to jool-log. */
+		break;
 	}
 
 	log_err("Unknown configuration mode: %u", args.mode);
@@ -973,5 +1116,10 @@ static int main_wrapped(int argc, char **argv)
 
 int main(int argc, char **argv)
 {
-	return -main_wrapped(argc, argv);
+	int error;
+
+	error = main_wrapped(argc, argv);
+	netlink_destroy();
+
+	return -error;
 }
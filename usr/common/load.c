@@ -0,0 +1,138 @@
+#include "nat64/usr/load.h"
+#include "nat64/usr/types.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define DELIMITERS " \t\r\n"
+
+int load_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr = nlmsg_hdr(msg);
+	struct load_batch *batch = arg;
+	__s32 *results;
+	unsigned int result_count, i;
+
+	results = nlmsg_data(hdr);
+	result_count = nlmsg_datalen(hdr) / sizeof(*results);
+	if (result_count != batch->count) {
+		log_err("Jool answered %u results to a batch of %u entries.", result_count,
+				batch->count);
+		batch->failed += batch->count;
+		return 0;
+	}
+
+	for (i = 0; i < result_count; i++) {
+		if (results[i]) {
+			log_err("%s %u (%s): %s", batch->unit ? batch->unit : "Line",
+					batch->lines[i], batch->table, strerror(abs(results[i])));
+			batch->failed++;
+		} else {
+			batch->loaded++;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Extracts the two addresses from "line". Returns 1 if the line has no entry.
+ */
+static int tokenize(char *line, char **str1, char **str2)
+{
+	char *extra;
+
+	*str1 = strtok(line, DELIMITERS);
+	if (!(*str1) || (*str1)[0] == '#')
+		return 1;
+
+	*str2 = strtok(NULL, DELIMITERS);
+	extra = strtok(NULL, DELIMITERS);
+	if (!(*str2) || (extra && extra[0] != '#'))
+		return -EINVAL;
+
+	return 0;
+}
+
+int load_file(char *file_name, size_t request_len, size_t entry_size,
+		int (*parse)(char *str1, char *str2, void *entry),
+		int (*send)(void *request, struct load_batch *batch, void *arg),
+		void *arg)
+{
+	FILE *file;
+	unsigned char *request;
+	unsigned char *entry;
+	struct load_batch batch;
+	char *line = NULL;
+	size_t line_size = 0;
+	unsigned int line_num = 0;
+	char *str1, *str2;
+	int status;
+	int error = 0;
+
+	file = strcmp(file_name, "-") ? fopen(file_name, "r") : stdin;
+	if (!file) {
+		error = -errno;
+		log_err("Could not open '%s': %s", file_name, strerror(errno));
+		return error;
+	}
+
+	request = malloc(request_len + LOAD_BATCH_SIZE * entry_size);
+	if (!request) {
+		log_err("Could not allocate the request.");
+		error = -ENOMEM;
+		goto end;
+	}
+
+	memset(&batch, 0, sizeof(batch));
+
+	while (getline(&line, &line_size, file) != -1) {
+		line_num++;
+
+		status = tokenize(line, &str1, &str2);
+		if (status == 1)
+			continue;
+		entry = request + request_len + batch.count * entry_size;
+		if (!status)
+			status = parse(str1, str2, entry);
+		if (status) {
+			log_err("Line %u: Could not parse the entry.", line_num);
+			batch.failed++;
+			continue;
+		}
+
+		batch.lines[batch.count] = line_num;
+		batch.count++;
+
+		if (batch.count == LOAD_BATCH_SIZE) {
+			error = send(request, &batch, arg);
+			if (error)
+				break;
+			batch.count = 0;
+		}
+	}
+
+	if (ferror(file)) {
+		log_err("Error reading '%s'.", file_name);
+		error = -EIO;
+	} else if (!error && batch.count > 0) {
+		error = send(request, &batch, arg);
+	}
+
+	free(line);
+	free(request);
+
+	if (!error) {
+		log_info("Loaded %u entries; %u failed.", batch.loaded, batch.failed);
+		if (batch.failed)
+			error = -EINVAL;
+	}
+	/* Fall through. */
+
+end:
+	if (file != stdin)
+		fclose(file);
+	return error;
+}
@@ -1,10 +1,3 @@
-/*
- * log_time.c
- *
- *  Created on: Oct 3, 2014
- *      Author: dhernandez
- */
-
 #include "nat64/usr/log_time.h"
 #include "nat64/common/config.h"
 #include "nat64/common/str_utils.h"
@@ -15,98 +8,148 @@
 #define HDR_LEN sizeof(struct request_hdr)
 #define PAYLOAD_LEN sizeof(struct request_logtime)
 
-struct display_params {
-	struct request_logtime *req_payload;
-	int row_count;
-};
+/** The percentiles printed, in thousandths. */
+static const unsigned int PERCENTILES[] = { 500, 900, 990, 999 };
 
-static int logtime_display_response(struct nl_msg *msg, void *arg)
+static char *stage_to_string(enum logtime_stage stage)
 {
-	struct nlmsghdr *hdr;
-	struct logtime_entry_usr *entries;
-	struct display_params *params = arg;
-	const char *l3_proto_out, *l4_proto;
-	char *l3_proto_in;
-	__u16 entry_count, i;
+	switch (stage) {
+	case LOGTIME_STAGE_CLASSIFY:
+		return "Classify";
+	case LOGTIME_STAGE_TRANSLATE:
+		return "Translate";
+	case LOGTIME_STAGE_SEND:
+		return "Send";
+	case LOGTIME_STAGE_TOTAL:
+		return "Total";
+	}
 
-	hdr = nlmsg_hdr(msg);
-	entries = nlmsg_data(hdr);
-	entry_count = nlmsg_datalen(hdr) / sizeof(*entries);
+	return "Unknown";
+}
 
-	if (params->req_payload->l3_proto == L3PROTO_IPV4) {
-		l3_proto_in = "IPv6";
-	} else {
-		l3_proto_in = "IPv4";
+/**
+ * Returns the smallest latency (in nanoseconds) at least "permille" thousandths of the packets in
+ * "histogram" did not exceed. As always with histograms, this is rounded up to the end of its
+ * bucket.
+ */
+static __u64 get_percentile(struct logtime_histogram_usr *histogram, unsigned int permille)
+{
+	__u64 target;
+	__u64 seen = 0;
+	__u64 result;
+	unsigned int i;
+
+	/* Round up; the 99.9th percentile of 10 packets is the slowest one. */
+	target = (histogram->count * permille + 999) / 1000;
+	if (target == 0)
+		target = 1;
+
+	for (i = 0; i < LOGTIME_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+		if (seen >= target) {
+			result = logtime_bucket_ceil(i) - 1;
+			return (result < histogram->max) ? result : histogram->max;
+		}
 	}
-	l3_proto_out = l3proto_to_string(params->req_payload->l3_proto);
-	l4_proto = l4proto_to_string(params->req_payload->l4_proto);
 
-	for (i = 0; i < entry_count; i++) {
-		printf ("%s->%s,", l3_proto_in, l3_proto_out);
-		printf ("%s,", l4_proto);
-		printf ("%ld,%ld\n", entries[i].time.tv_sec, entries[i].time.tv_nsec);
-	}
+	return histogram->max;
+}
 
-	params->row_count += entry_count;
+static int logtime_display_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr;
+	struct logtime_histogram_usr *histogram = arg;
 
-	if (hdr->nlmsg_flags & NLM_F_MULTI) {
-		params->req_payload->display.iterate = true;
-	} else {
-		params->req_payload->display.iterate = false;
+	hdr = nlmsg_hdr(msg);
+	if (nlmsg_datalen(hdr) != sizeof(*histogram)) {
+		log_err("The kernel module's response has the wrong size (%d, expected %zu).",
+				nlmsg_datalen(hdr), sizeof(*histogram));
+		log_err("Perhaps the module and the application are out of sync.");
+		return -EINVAL;
 	}
+
+	memcpy(histogram, nlmsg_data(hdr), sizeof(*histogram));
 	return 0;
 }
 
-
-static bool display_single_db(l3_protocol l3_proto, l4_protocol l4_proto)
+static int display_single_histogram(l3_protocol l3_proto, l4_protocol l4_proto,
+		enum logtime_stage stage, unsigned int *row_count)
 {
 	unsigned char request[HDR_LEN + PAYLOAD_LEN];
 	struct request_hdr *hdr = (struct request_hdr *) request;
 	struct request_logtime *payload = (struct request_logtime *) (request + HDR_LEN);
-	struct display_params params;
-	bool error;
+	struct logtime_histogram_usr histogram;
+	unsigned int i;
+	int error;
 
 	init_request_hdr(hdr, sizeof(request), MODE_LOGTIME, OP_DISPLAY);
-	payload->l3_proto = (__u8) l3_proto;
-	payload->l4_proto = (__u8) l4_proto;
-	payload->display.iterate = false;
-
-	params.row_count = 0;
-	params.req_payload = payload;
-
-	do {
-		error = netlink_request(request, hdr->length, logtime_display_response, &params);
-		if (error)
-			break;
-	} while (params.req_payload->display.iterate);
-
-	if (!error) {
-		if (params.row_count > 0)
-			printf("  (Fetched %u entries.)\n", params.row_count);
-		else
-			printf("  (empty)\n");
+	payload->l3_proto = l3_proto;
+	payload->l4_proto = l4_proto;
+	payload->stage = stage;
+
+	memset(&histogram, 0, sizeof(histogram));
+	error = netlink_request(request, hdr->length, logtime_display_response, &histogram);
+	if (error)
+		return error;
+
+	if (histogram.count == 0)
+		return 0;
+
+	printf("%s,%s,%s,%llu,%llu", (l3_proto == L3PROTO_IPV6) ? "IPv6->IPv4" : "IPv4->IPv6",
+			l4proto_to_string(l4_proto), stage_to_string(stage),
+			(unsigned long long) histogram.count,
+			(unsigned long long) (histogram.sum / histogram.count));
+	for (i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++)
+		printf(",%llu", (unsigned long long) get_percentile(&histogram, PERCENTILES[i]));
+	printf(",%llu\n", (unsigned long long) histogram.max);
+
+	(*row_count)++;
+	return 0;
+}
+
+int logtime_display(void)
+{
+	l3_protocol l3_protos[] = { L3PROTO_IPV6, L3PROTO_IPV4 };
+	l4_protocol l4_protos[] = { L4PROTO_TCP, L4PROTO_UDP, L4PROTO_ICMP, L4PROTO_OTHER };
+	unsigned int row_count = 0;
+	unsigned int l3, l4, stage;
+	int error;
+
+	printf("Direction,Protocol,Stage,Packets,Mean,50%%,90%%,99%%,99.9%%,Max\n");
+
+	for (l3 = 0; l3 < sizeof(l3_protos) / sizeof(l3_protos[0]); l3++) {
+		for (l4 = 0; l4 < sizeof(l4_protos) / sizeof(l4_protos[0]); l4++) {
+			for (stage = 0; stage < LOGTIME_STAGE_COUNT; stage++) {
+				error = display_single_histogram(l3_protos[l3], l4_protos[l4],
+						stage, &row_count);
+				if (error)
+					return error;
+			}
+		}
 	}
 
-	return error;
+	if (row_count > 0)
+		printf("  (Latencies are in nanoseconds.)\n");
+	else
+		printf("  (empty)\n");
+
+	return 0;
+}
+
+static int logtime_flush_response(struct nl_msg *msg, void *arg)
+{
+	log_info("The latency histograms were reset successfully.");
+	return 0;
 }
 
-int logtime_display()
+int logtime_flush(void)
 {
-	int tcp_ip6_error = 0;
-	int udp_ip6_error = 0;
-	int icmp_ip6_error = 0;
-	int tcp_ip4_error = 0;
-	int udp_ip4_error = 0;
-	int icmp_ip4_error = 0;
-
-	printf("L3 protocol,L4 Protocol,seconds,nanoseconds\n");
-	tcp_ip6_error = display_single_db(L3PROTO_IPV6, L4PROTO_TCP);
-	udp_ip6_error = display_single_db(L3PROTO_IPV6, L4PROTO_UDP);
-	icmp_ip6_error = display_single_db(L3PROTO_IPV6, L4PROTO_ICMP);
-	tcp_ip4_error = display_single_db(L3PROTO_IPV4, L4PROTO_TCP);
-	udp_ip4_error = display_single_db(L3PROTO_IPV4, L4PROTO_UDP);
-	icmp_ip4_error = display_single_db(L3PROTO_IPV4, L4PROTO_ICMP);
-
-	return (tcp_ip6_error || udp_ip6_error || icmp_ip6_error || tcp_ip4_error || udp_ip4_error
-			|| icmp_ip4_error ) ? -EINVAL : 0;
+	unsigned char request[HDR_LEN + PAYLOAD_LEN];
+	struct request_hdr *hdr = (struct request_hdr *) request;
+	struct request_logtime *payload = (struct request_logtime *) (request + HDR_LEN);
+
+	init_request_hdr(hdr, sizeof(request), MODE_LOGTIME, OP_FLUSH);
+	memset(payload, 0, sizeof(*payload));
+
+	return netlink_request(request, hdr->length, logtime_flush_response, NULL);
 }
@@ -4,23 +4,52 @@
 #include <errno.h>
 #include <unistd.h>
 
-/*
- * TODO (performance) we're creating a separate nl connection for every request.
- * Some of Jool's requests (--display commands in particular) could be grouped into a single
- * connection.
+/**
+ * The connection to Jool. It's opened during the first request and reused by the following ones,
+ * so commands which need several of them (such as displaying the three session tables) don't
+ * have to reconnect every time.
  */
+static struct nl_sock *sk;
+
+static int connect_to_jool(void)
+{
+	int error;
+
+	sk = nl_socket_alloc();
+	if (!sk) {
+		log_err("Could not allocate a socket; cannot speak to the NAT64.");
+		return -ENOMEM;
+	}
+
+	/*
+	 * The BIB and session tables arrive in skbs much larger than a page. Peeking lets libnl
+	 * size its buffer after every message instead of truncating them.
+	 */
+	nl_socket_enable_msg_peek(sk);
+
+	error = nl_connect(sk, NETLINK_USERSOCK);
+	if (error < 0) {
+		log_err("Could not bind the socket to Jool.\n"
+				"Netlink error message: %s (Code %d)", nl_geterror(error), error);
+		nl_socket_free(sk);
+		sk = NULL;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 int netlink_request(void *request, __u16 request_len, int (*cb)(struct nl_msg *, void *),
 		void *cb_arg)
 {
-	struct nl_sock *sk;
 	enum nl_cb_type callbacks[] = { NL_CB_VALID, NL_CB_FINISH, NL_CB_ACK };
 	int i;
 	int error;
 
-	sk = nl_socket_alloc();
 	if (!sk) {
-		log_err("Could not allocate a socket; cannot speak to the NAT64.");
-		return -ENOMEM;
+		error = connect_to_jool();
+		if (error)
+			return error;
 	}
 
 	for (i = 0; i < (sizeof(callbacks) / sizeof(callbacks[0])); i++) {
@@ -29,39 +58,32 @@ int netlink_request(void *request, __u16 request_len, int (*cb)(struct nl_msg *,
 			log_err("Could not register response handler. "
 					"I won't be able to parse Jool's response, so I won't send the request.\n"
 					"Netlink error message: %s (Code %d)", nl_geterror(error), error);
-			goto fail_free;
+			return -EINVAL;
 		}
 	}
 
-	error = nl_connect(sk, NETLINK_USERSOCK);
-	if (error < 0) {
-		log_err("Could not bind the socket to Jool.\n"
-				"Netlink error message: %s (Code %d)", nl_geterror(error), error);
-		goto fail_free;
-	}
-
 	error = nl_send_simple(sk, MSG_TYPE_JOOL, 0, request, request_len);
 	if (error < 0) {
 		log_err("Could not send the request to Jool (is it really up?).\n"
 				"Netlink error message: %s (Code %d)", nl_geterror(error), error);
-		goto fail_close;
+		return -EINVAL;
 	}
 
 	error = nl_recvmsgs_default(sk);
 	if (error < 0) {
 		log_err("%s (System error %d)", nl_geterror(error), error);
-		goto fail_close;
+		return -EINVAL;
 	}
 
-	nl_close(sk);
-	nl_socket_free(sk);
 	return 0;
+}
 
-fail_close:
-	nl_close(sk);
-	/* Fall through. */
+void netlink_destroy(void)
+{
+	if (!sk)
+		return;
 
-fail_free:
+	nl_close(sk);
 	nl_socket_free(sk);
-	return -EINVAL;
+	sk = NULL;
 }
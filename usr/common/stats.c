@@ -0,0 +1,125 @@
+#include "nat64/usr/stats.h"
+#include "nat64/common/config.h"
+#include "nat64/usr/types.h"
+#include "nat64/usr/netlink.h"
+#include <errno.h>
+
+static char *stage_to_string(enum stats_stage stage)
+{
+	switch (stage) {
+	case STATS_STAGE_PREPARE:
+		return "Prepare";
+	case STATS_STAGE_DETERMINE_IN_TUPLE:
+		return "Determine incoming tuple";
+	case STATS_STAGE_FRAGMENTS:
+		return "Fragments";
+	case STATS_STAGE_FILTERING:
+		return "Filtering and updating";
+	case STATS_STAGE_COMPUTE_OUT_TUPLE:
+		return "Compute outgoing tuple";
+	case STATS_STAGE_TRANSLATE:
+		return "Translate";
+	case STATS_STAGE_HAIRPINNING:
+		return "Hairpinning";
+	case STATS_STAGE_SEND:
+		return "Send";
+	}
+
+	return "Unknown";
+}
+
+static char *reason_to_string(enum drop_reason reason)
+{
+	switch (reason) {
+	case DROP_MALFORMED:
+		return "Malformed packet";
+	case DROP_CHECKSUM:
+		return "Bad checksum";
+	case DROP_UNKNOWN_PROTO:
+		return "Unknown protocol";
+	case DROP_ADDRESS:
+		return "Address mismatch";
+	case DROP_NO_BIB:
+		return "No BIB entry";
+	case DROP_POOL4_EXHAUSTED:
+		return "pool4 exhausted";
+	case DROP_FILTERED:
+		return "Filtered by policy";
+	case DROP_ENOMEM:
+		return "Out of memory";
+	case DROP_ROUTE:
+		return "Route failure";
+	case DROP_PMTU:
+		return "Packet too big";
+	case DROP_XMIT:
+		return "Transmission failure";
+	case DROP_TTL:
+		return "TTL expired";
+	}
+
+	return "Unknown";
+}
+
+static int stats_display_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr;
+	struct stats_usr *stats = arg;
+
+	hdr = nlmsg_hdr(msg);
+	if (nlmsg_datalen(hdr) != sizeof(*stats)) {
+		log_err("The kernel module's response has the wrong size (%d, expected %zu).",
+				nlmsg_datalen(hdr), sizeof(*stats));
+		log_err("Perhaps the module and the application are out of sync.");
+		return -EINVAL;
+	}
+
+	memcpy(stats, nlmsg_data(hdr), sizeof(*stats));
+	return 0;
+}
+
+int stats_display(void)
+{
+	struct request_hdr request;
+	struct stats_usr stats;
+	unsigned int i;
+	int error;
+
+	init_request_hdr(&request, sizeof(request), MODE_STATS, OP_DISPLAY);
+
+	memset(&stats, 0, sizeof(stats));
+	error = netlink_request(&request, request.length, stats_display_response, &stats);
+	if (error)
+		return error;
+
+	printf("Received: %llu\n", (unsigned long long) stats.received);
+	printf("Translated: %llu\n", (unsigned long long) stats.translated);
+	printf("Hairpinned: %llu\n", (unsigned long long) stats.hairpinned);
+
+	printf("\nStage,Accepted,Dropped,Stolen\n");
+	for (i = 0; i < STATS_STAGE_COUNT; i++) {
+		printf("%s,%llu,%llu,%llu\n", stage_to_string(i),
+				(unsigned long long) stats.stages[i][STATS_ACCEPTED],
+				(unsigned long long) stats.stages[i][STATS_DROPPED],
+				(unsigned long long) stats.stages[i][STATS_STOLEN]);
+	}
+
+	printf("\nReason,Packets\n");
+	for (i = 0; i < DROP_REASON_COUNT; i++)
+		printf("%s,%llu\n", reason_to_string(i), (unsigned long long) stats.drops[i]);
+
+	return 0;
+}
+
+static int stats_flush_response(struct nl_msg *msg, void *arg)
+{
+	log_info("The packet counters were reset successfully.");
+	return 0;
+}
+
+int stats_flush(void)
+{
+	struct request_hdr request;
+
+	init_request_hdr(&request, sizeof(request), MODE_STATS, OP_FLUSH);
+	return netlink_request(&request, request.length, stats_flush_response, NULL);
+}
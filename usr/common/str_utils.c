@@ -1,4 +1,5 @@
 #include "nat64/usr/str_utils.h"
+#include "nat64/common/config.h"
 #include "nat64/common/constants.h"
 #include "nat64/common/nat64.h"
 #include "nat64/usr/types.h"
@@ -44,6 +45,26 @@ const char *l4proto_to_string(l4_protocol l4_proto)
 	return NULL;
 }
 
+const char *log_event_to_string(__u8 type)
+{
+	switch (type) {
+	case LOG_EVENT_BIB_ADD:
+		return "Mapped";
+	case LOG_EVENT_BIB_REMOVE:
+		return "Forgot";
+	case LOG_EVENT_SESSION_ADD:
+		return "Added session";
+	case LOG_EVENT_SESSION_REMOVE:
+		return "Forgot session";
+	case LOG_EVENT_SESSION_RESTORE:
+		return "Restored session";
+	case LOG_EVENT_LOST:
+		return "Lost events";
+	}
+
+	return "Unknown event";
+}
+
 int str_to_bool(const char *str, __u8 *bool_out)
 {
 	if (strcasecmp(str, "true") == 0 || strcasecmp(str, "1") == 0
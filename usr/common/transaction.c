@@ -0,0 +1,57 @@
+#include "nat64/usr/transaction.h"
+#include "nat64/usr/types.h"
+#include "nat64/usr/netlink.h"
+#include <errno.h>
+
+
+#define HDR_LEN sizeof(struct request_hdr)
+#define PAYLOAD_LEN sizeof(struct request_transaction)
+
+
+static int txn_display_response(struct nl_msg *msg, void *arg)
+{
+	__u8 *open = nlmsg_data(nlmsg_hdr(msg));
+
+	printf("%s\n", *open
+			? "A transaction is in progress; staged changes are not in effect yet."
+			: "There is no transaction in progress.");
+	return 0;
+}
+
+int txn_display(void)
+{
+	unsigned char request[HDR_LEN + PAYLOAD_LEN];
+	struct request_hdr *hdr = (struct request_hdr *) request;
+
+	init_request_hdr(hdr, sizeof(request), MODE_TRANSACTION, OP_DISPLAY);
+	return netlink_request(request, hdr->length, txn_display_response, NULL);
+}
+
+static int txn_update_response(struct nl_msg *msg, void *arg)
+{
+	switch (*((enum transaction_action *) arg)) {
+	case TXN_BEGIN:
+		log_info("Transaction started. Changes will be staged until --commit or --abort.");
+		break;
+	case TXN_COMMIT:
+		log_info("The staged changes are now in effect.");
+		break;
+	case TXN_ABORT:
+		log_info("The staged changes were dropped.");
+		break;
+	}
+
+	return 0;
+}
+
+int txn_update(enum transaction_action action)
+{
+	unsigned char request[HDR_LEN + PAYLOAD_LEN];
+	struct request_hdr *hdr = (struct request_hdr *) request;
+	struct request_transaction *payload = (struct request_transaction *) (request + HDR_LEN);
+
+	init_request_hdr(hdr, sizeof(request), MODE_TRANSACTION, OP_UPDATE);
+	payload->action = action;
+
+	return netlink_request(request, hdr->length, txn_update_response, &action);
+}
@@ -2,9 +2,12 @@
 #include "nat64/common/config.h"
 #include "nat64/common/str_utils.h"
 #include "nat64/usr/types.h"
+#include "nat64/usr/load.h"
 #include "nat64/usr/netlink.h"
 #include "nat64/usr/dns.h"
+#include "nat64/usr/str_utils.h"
 #include <errno.h>
+#include <string.h>
 
 
 #define HDR_LEN sizeof(struct request_hdr)
@@ -26,6 +29,9 @@ static int bib_display_response(struct nl_msg *msg, void *arg)
 	__u16 entry_count, i;
 
 	hdr = nlmsg_hdr(msg);
+	if (hdr->nlmsg_type == NLMSG_DONE)
+		return 0;
+
 	entries = nlmsg_data(hdr);
 	entry_count = nlmsg_datalen(hdr) / sizeof(*entries);
 
@@ -50,9 +56,6 @@ static int bib_display_response(struct nl_msg *msg, void *arg)
 	}
 
 	params->row_count += entry_count;
-	params->req_payload->display.addr4_set = hdr->nlmsg_flags & NLM_F_MULTI;
-	if (entry_count > 0)
-		params->req_payload->display.addr4 = entries[entry_count - 1].addr4;
 	return 0;
 }
 
@@ -69,17 +72,14 @@ static bool display_single_table(l4_protocol l4_proto, bool numeric_hostname, bo
 
 	init_request_hdr(hdr, sizeof(request), MODE_BIB, OP_DISPLAY);
 	payload->l4_proto = l4_proto;
-	payload->display.addr4_set = false;
-	memset(&payload->display.addr4, 0, sizeof(payload->display.addr4));
 
 	params.numeric_hostname = numeric_hostname;
 	params.csv_format = csv_format;
 	params.row_count = 0;
 	params.req_payload = payload;
 
-	do {
-		error = netlink_request(request, hdr->length, bib_display_response, &params);
-	} while (!error && payload->display.addr4_set);
+	/* The whole table arrives as a single multipart response. */
+	error = netlink_request(request, hdr->length, bib_display_response, &params);
 
 	if (!csv_format && !error) {
 		if (params.row_count > 0)
@@ -215,3 +215,66 @@ int bib_remove(bool use_tcp, bool use_udp, bool use_icmp,
 
 	return exec_request(use_tcp, use_udp, use_icmp, hdr, payload, bib_remove_response);
 }
+
+struct load_tables {
+	bool tcp, udp, icmp;
+};
+
+static int bib_load_parse(char *str1, char *str2, void *entry)
+{
+	struct bib_entry_usr *bib = entry;
+	int error;
+
+	if (strchr(str1, ':')) {
+		error = str_to_addr6_port(str1, &bib->addr6);
+		return error ? : str_to_addr4_port(str2, &bib->addr4);
+	}
+
+	error = str_to_addr4_port(str1, &bib->addr4);
+	return error ? : str_to_addr6_port(str2, &bib->addr6);
+}
+
+static int bib_load_send_single(void *request, struct load_batch *batch, l4_protocol l4_proto)
+{
+	struct request_hdr *hdr = request;
+	struct request_bib *payload = (struct request_bib *) (hdr + 1);
+
+	init_request_hdr(hdr, HDR_LEN + PAYLOAD_LEN + batch->count * sizeof(struct bib_entry_usr),
+			MODE_BIB, OP_LOAD);
+	payload->l4_proto = l4_proto;
+	payload->load.count = batch->count;
+	batch->table = l4proto_to_string(l4_proto);
+
+	return netlink_request(request, hdr->length, load_response, batch);
+}
+
+static int bib_load_send(void *request, struct load_batch *batch, void *arg)
+{
+	struct load_tables *tables = arg;
+	int error;
+
+	if (tables->tcp) {
+		error = bib_load_send_single(request, batch, L4PROTO_TCP);
+		if (error)
+			return error;
+	}
+	if (tables->udp) {
+		error = bib_load_send_single(request, batch, L4PROTO_UDP);
+		if (error)
+			return error;
+	}
+	if (tables->icmp) {
+		error = bib_load_send_single(request, batch, L4PROTO_ICMP);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+int bib_load(bool use_tcp, bool use_udp, bool use_icmp, char *file_name)
+{
+	struct load_tables tables = { .tcp = use_tcp, .udp = use_udp, .icmp = use_icmp };
+	return load_file(file_name, HDR_LEN + PAYLOAD_LEN, sizeof(struct bib_entry_usr),
+			bib_load_parse, bib_load_send, &tables);
+}
@@ -0,0 +1,98 @@
+#include "nat64/usr/event_log.h"
+#include <errno.h>
+#include <string.h>
+#include "nat64/usr/netlink.h"
+#include "nat64/usr/types.h"
+
+
+struct drain_args {
+	int (*cb)(struct log_event_usr *, unsigned int, void *);
+	void *arg;
+};
+
+static int drain_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr;
+	struct drain_args *args = arg;
+
+	hdr = nlmsg_hdr(msg);
+	if (hdr->nlmsg_type == NLMSG_DONE)
+		return 0;
+
+	return args->cb(nlmsg_data(hdr), nlmsg_datalen(hdr) / sizeof(struct log_event_usr),
+			args->arg);
+}
+
+int eventlog_drain(int (*cb)(struct log_event_usr *events, unsigned int count, void *arg),
+		void *arg)
+{
+	struct request_hdr hdr;
+	struct drain_args args = { .cb = cb, .arg = arg };
+
+	init_request_hdr(&hdr, sizeof(hdr), MODE_LOG, OP_DISPLAY);
+	return netlink_request(&hdr, hdr.length, drain_response, &args);
+}
+
+static void init_file_hdr(struct log_file_hdr *hdr)
+{
+	memcpy(hdr->magic, LOG_FILE_MAGIC, sizeof(hdr->magic));
+	hdr->version = LOG_FILE_VERSION;
+	hdr->event_size = sizeof(struct log_event_usr);
+}
+
+FILE *eventlog_open_append(char *path)
+{
+	struct log_file_hdr hdr;
+	FILE *file;
+
+	file = fopen(path, "ab");
+	if (!file) {
+		log_err("Could not open '%s': %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fseek(file, 0, SEEK_END) || ftell(file) != 0)
+		return file;
+
+	init_file_hdr(&hdr);
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 || fflush(file)) {
+		log_err("Could not write to '%s': %s", path, strerror(errno));
+		fclose(file);
+		return NULL;
+	}
+
+	return file;
+}
+
+int eventlog_write(FILE *file, struct log_event_usr *events, unsigned int count)
+{
+	if (fwrite(events, sizeof(*events), count, file) != count) {
+		log_err("Could not write the events: %s", strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
+
+FILE *eventlog_open_read(char *path)
+{
+	struct log_file_hdr expected, actual;
+	FILE *file;
+
+	file = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	if (!file) {
+		log_err("Could not open '%s': %s", path, strerror(errno));
+		return NULL;
+	}
+
+	init_file_hdr(&expected);
+	if (fread(&actual, sizeof(actual), 1, file) != 1
+			|| memcmp(&expected, &actual, sizeof(expected))) {
+		log_err("'%s' does not look like a log of this version of jool-log.", path);
+		if (file != stdin)
+			fclose(file);
+		return NULL;
+	}
+
+	return file;
+}
@@ -0,0 +1,650 @@
+/**
+ * @file
+ * Main for jool-ipfix, the daemon which exports the binary BIB and session logs (see MODE_LOG and
+ * --logging-binary) to an IPFIX collector (RFC 7011), as the NAT64 events of RFC 8158.
+ *
+ * Two templates are used: one for NAT64 session creation and deletion, and one for NAT64 BIB
+ * creation and deletion, each with the information elements RFC 8158 lists for them. Everything
+ * goes over UDP, so the templates are resent every once in a while (RFC 7011 section 8.4).
+ *
+ * ICMP sessions carry the ICMP identifiers in the port fields, just like Jool's tables do.
+ *
+ * Jool only has one set of queues, so jool-ipfix can also do jool-log's job (--log) instead of
+ * competing with it for the events.
+ */
+
+#include <argp.h>
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "nat64/common/config.h"
+#include "nat64/common/constants.h"
+#include "nat64/usr/event_log.h"
+#include "nat64/usr/netlink.h"
+#include "nat64/usr/str_utils.h"
+#include "nat64/usr/types.h"
+
+
+const char *argp_program_version = JOOL_VERSION_STR;
+const char *argp_program_bug_address = "jool@nic.mx";
+
+#define DEFAULT_PORT "4739"
+/** Default milliseconds between two drains of the kernel's queues. */
+#define DEFAULT_INTERVAL 100
+/** Default seconds between two template retransmissions. */
+#define DEFAULT_TEMPLATE_REFRESH 60
+/** Default maximum size of an IPFIX message, in bytes. Should fit in one packet. */
+#define DEFAULT_MTU 1400
+#define MIN_MTU 256
+
+#define IPFIX_VERSION 10
+#define IPFIX_SET_TEMPLATE 2
+#define TEMPLATE_SESSION 256
+#define TEMPLATE_BIB 257
+
+/* Information elements (https://www.iana.org/assignments/ipfix). */
+#define IE_PROTOCOL_IDENTIFIER 4
+#define IE_SOURCE_TRANSPORT_PORT 7
+#define IE_DESTINATION_TRANSPORT_PORT 11
+#define IE_SOURCE_IPV6_ADDRESS 27
+#define IE_DESTINATION_IPV6_ADDRESS 28
+#define IE_POST_NAT_SOURCE_IPV4_ADDRESS 225
+#define IE_POST_NAT_DESTINATION_IPV4_ADDRESS 226
+#define IE_POST_NAPT_SOURCE_TRANSPORT_PORT 227
+#define IE_POST_NAPT_DESTINATION_TRANSPORT_PORT 228
+#define IE_NAT_EVENT 230
+#define IE_OBSERVATION_TIME_MILLISECONDS 323
+
+/* natEvent values. */
+#define NAT_EVENT_NAT64_SESSION_CREATE 4
+#define NAT_EVENT_NAT64_SESSION_DELETE 5
+#define NAT_EVENT_NAT64_BIB_CREATE 8
+#define NAT_EVENT_NAT64_BIB_DELETE 9
+
+struct ipfix_field {
+	__u16 id;
+	__u16 length;
+};
+
+static const struct ipfix_field session_fields[] = {
+	{ IE_OBSERVATION_TIME_MILLISECONDS, 8 },
+	{ IE_NAT_EVENT, 1 },
+	{ IE_SOURCE_IPV6_ADDRESS, 16 },
+	{ IE_POST_NAT_SOURCE_IPV4_ADDRESS, 4 },
+	{ IE_PROTOCOL_IDENTIFIER, 1 },
+	{ IE_SOURCE_TRANSPORT_PORT, 2 },
+	{ IE_POST_NAPT_SOURCE_TRANSPORT_PORT, 2 },
+	{ IE_DESTINATION_IPV6_ADDRESS, 16 },
+	{ IE_POST_NAT_DESTINATION_IPV4_ADDRESS, 4 },
+	{ IE_DESTINATION_TRANSPORT_PORT, 2 },
+	{ IE_POST_NAPT_DESTINATION_TRANSPORT_PORT, 2 },
+};
+
+static const struct ipfix_field bib_fields[] = {
+	{ IE_OBSERVATION_TIME_MILLISECONDS, 8 },
+	{ IE_NAT_EVENT, 1 },
+	{ IE_SOURCE_IPV6_ADDRESS, 16 },
+	{ IE_POST_NAT_SOURCE_IPV4_ADDRESS, 4 },
+	{ IE_PROTOCOL_IDENTIFIER, 1 },
+	{ IE_SOURCE_TRANSPORT_PORT, 2 },
+	{ IE_POST_NAPT_SOURCE_TRANSPORT_PORT, 2 },
+};
+
+#define FIELD_COUNT(fields) (sizeof(fields) / sizeof(fields[0]))
+#define MSG_HDR_LEN 16
+#define SET_HDR_LEN 4
+#define SESSION_RECORD_LEN 58
+#define BIB_RECORD_LEN 34
+
+struct arguments {
+	char *collector;
+	char *port;
+	__u32 domain;
+	unsigned int interval;
+	unsigned int template_refresh;
+	unsigned int mtu;
+	/* jool-log file to export instead of the kernel's queues. */
+	char *replay;
+	/* jool-log file to also append the kernel's events to. */
+	char *log;
+};
+
+/** The IPFIX message being built, and the exporting process's state. */
+struct exporter {
+	int fd;
+	struct arguments *args;
+	/** The opened --log file; NULL if there is none. */
+	FILE *log;
+
+	unsigned char *buffer;
+	size_t len;
+	/** Offset of the header of the set currently being filled; 0 if there is none. */
+	size_t set_offset;
+	/** Template of the set currently being filled. */
+	__u16 set_template;
+	/** Data records in the current message. */
+	unsigned int records;
+
+	/** Data records sent so far (RFC 7011 section 3.1). */
+	__u32 sequence;
+	time_t last_template;
+	unsigned long long total;
+};
+
+enum argp_flags {
+	ARGP_COLLECTOR = 'c',
+	ARGP_PORT = 'p',
+	ARGP_DOMAIN = 'd',
+	ARGP_INTERVAL = 'i',
+	ARGP_TEMPLATE_REFRESH = 't',
+	ARGP_MTU = 'm',
+	ARGP_REPLAY = 'r',
+	ARGP_LOG = 'l',
+};
+
+static struct argp_option options[] = {
+	{ "collector", ARGP_COLLECTOR, "HOST", 0, "Send the IPFIX messages to HOST." },
+	{ "port", ARGP_PORT, "PORT", 0, "The collector's UDP port. Default: " DEFAULT_PORT },
+	{ "domain", ARGP_DOMAIN, "ID", 0, "Observation Domain ID. Default: 0" },
+	{ "interval", ARGP_INTERVAL, "MSECS", 0,
+			"Milliseconds the exporter waits between batches. Default: 100" },
+	{ "template-refresh", ARGP_TEMPLATE_REFRESH, "SECS", 0,
+			"Seconds between template retransmissions. Default: 60" },
+	{ "mtu", ARGP_MTU, "BYTES", 0, "Maximum size of each IPFIX message. Default: 1400" },
+	{ "replay", ARGP_REPLAY, "FILE", 0,
+			"Export the events jool-log stored in FILE instead of Jool's, then quit." },
+	{ "log", ARGP_LOG, "FILE", 0,
+			"Also append Jool's events to FILE, the way jool-log --collect would." },
+	{ NULL },
+};
+
+/** Set by the signal handlers; read by the exporter's loop. */
+static volatile sig_atomic_t stop;
+static volatile sig_atomic_t reopen;
+
+static int parse_opt(int key, char *str, struct argp_state *state)
+{
+	struct arguments *args = state->input;
+	__u64 number;
+	int error = 0;
+
+	switch (key) {
+	case ARGP_COLLECTOR:
+		args->collector = str;
+		break;
+	case ARGP_PORT:
+		args->port = str;
+		break;
+	case ARGP_DOMAIN:
+		error = str_to_u64(str, &number, 0, 0xFFFFFFFFU);
+		args->domain = number;
+		break;
+	case ARGP_INTERVAL:
+		error = str_to_u64(str, &number, 1, 60000);
+		args->interval = number;
+		break;
+	case ARGP_TEMPLATE_REFRESH:
+		error = str_to_u64(str, &number, 1, 86400);
+		args->template_refresh = number;
+		break;
+	case ARGP_MTU:
+		error = str_to_u64(str, &number, MIN_MTU, 65535);
+		args->mtu = number;
+		break;
+	case ARGP_REPLAY:
+		args->replay = str;
+		break;
+	case ARGP_LOG:
+		args->log = str;
+		break;
+	default:
+		error = ARGP_ERR_UNKNOWN;
+	}
+
+	return error;
+}
+
+static void put_u8(struct exporter *exp, __u8 value)
+{
+	exp->buffer[exp->len++] = value;
+}
+
+static void put_u16(struct exporter *exp, __u16 value)
+{
+	value = htons(value);
+	memcpy(&exp->buffer[exp->len], &value, sizeof(value));
+	exp->len += sizeof(value);
+}
+
+static void put_u32(struct exporter *exp, __u32 value)
+{
+	value = htonl(value);
+	memcpy(&exp->buffer[exp->len], &value, sizeof(value));
+	exp->len += sizeof(value);
+}
+
+static void put_u64(struct exporter *exp, __u64 value)
+{
+	put_u32(exp, value >> 32);
+	put_u32(exp, value & 0xFFFFFFFFU);
+}
+
+static void put_bytes(struct exporter *exp, void *bytes, size_t len)
+{
+	memcpy(&exp->buffer[exp->len], bytes, len);
+	exp->len += len;
+}
+
+/** Writes "value" over the two bytes at "offset", leaving exp->len alone. */
+static void set_u16(struct exporter *exp, size_t offset, __u16 value)
+{
+	value = htons(value);
+	memcpy(&exp->buffer[offset], &value, sizeof(value));
+}
+
+static void msg_begin(struct exporter *exp)
+{
+	exp->len = MSG_HDR_LEN;
+	exp->set_offset = 0;
+	exp->records = 0;
+}
+
+static void close_set(struct exporter *exp)
+{
+	if (exp->set_offset)
+		set_u16(exp, exp->set_offset + 2, exp->len - exp->set_offset);
+	exp->set_offset = 0;
+}
+
+static void open_set(struct exporter *exp, __u16 id)
+{
+	close_set(exp);
+	exp->set_offset = exp->len;
+	exp->set_template = id;
+	put_u16(exp, id);
+	put_u16(exp, 0); /* Length; close_set() fills it. */
+}
+
+/**
+ * Finishes the current message and sends it. Empty messages are not sent.
+ */
+static int msg_send(struct exporter *exp)
+{
+	size_t len;
+
+	close_set(exp);
+	len = exp->len;
+	if (len == MSG_HDR_LEN)
+		return 0;
+
+	exp->len = 0;
+	put_u16(exp, IPFIX_VERSION);
+	put_u16(exp, len);
+	put_u32(exp, time(NULL));
+	put_u32(exp, exp->sequence);
+	put_u32(exp, exp->args->domain);
+
+	if (send(exp->fd, exp->buffer, len, 0) < 0) {
+		/* Nobody listening is the collector's problem; try again next time. */
+		if (errno != ECONNREFUSED) {
+			log_err("Could not send to the collector: %s", strerror(errno));
+			return -errno;
+		}
+	}
+
+	exp->sequence += exp->records;
+	exp->total += exp->records;
+	msg_begin(exp);
+	return 0;
+}
+
+static void put_template(struct exporter *exp, __u16 id, const struct ipfix_field *fields,
+		unsigned int count)
+{
+	unsigned int i;
+
+	put_u16(exp, id);
+	put_u16(exp, count);
+	for (i = 0; i < count; i++) {
+		put_u16(exp, fields[i].id);
+		put_u16(exp, fields[i].length);
+	}
+}
+
+static int send_templates(struct exporter *exp)
+{
+	int error;
+
+	error = msg_send(exp);
+	if (error)
+		return error;
+
+	open_set(exp, IPFIX_SET_TEMPLATE);
+	put_template(exp, TEMPLATE_SESSION, session_fields, FIELD_COUNT(session_fields));
+	put_template(exp, TEMPLATE_BIB, bib_fields, FIELD_COUNT(bib_fields));
+	error = msg_send(exp);
+	if (error)
+		return error;
+
+	exp->last_template = time(NULL);
+	return 0;
+}
+
+static __u8 protocol_identifier(__u8 l4_proto)
+{
+	switch (l4_proto) {
+	case L4PROTO_TCP:
+		return IPPROTO_TCP;
+	case L4PROTO_UDP:
+		return IPPROTO_UDP;
+	case L4PROTO_ICMP:
+		return IPPROTO_ICMPV6;
+	}
+
+	return 0;
+}
+
+/**
+ * Appends "event" to the current message, sending it first if there is no room left.
+ */
+static int export_event(struct exporter *exp, struct log_event_usr *event)
+{
+	__u16 template;
+	size_t record_len;
+	__u8 nat_event;
+	int error;
+
+	switch (event->type) {
+	case LOG_EVENT_SESSION_ADD:
+	case LOG_EVENT_SESSION_RESTORE:
+		template = TEMPLATE_SESSION;
+		nat_event = NAT_EVENT_NAT64_SESSION_CREATE;
+		break;
+	case LOG_EVENT_SESSION_REMOVE:
+		template = TEMPLATE_SESSION;
+		nat_event = NAT_EVENT_NAT64_SESSION_DELETE;
+		break;
+	case LOG_EVENT_BIB_ADD:
+		template = TEMPLATE_BIB;
+		nat_event = NAT_EVENT_NAT64_BIB_CREATE;
+		break;
+	case LOG_EVENT_BIB_REMOVE:
+		template = TEMPLATE_BIB;
+		nat_event = NAT_EVENT_NAT64_BIB_DELETE;
+		break;
+	case LOG_EVENT_LOST:
+		/* IPFIX has no record for this. */
+		log_err("Jool had to drop %u events.", event->lost);
+		return 0;
+	default:
+		return 0;
+	}
+
+	record_len = (template == TEMPLATE_SESSION) ? SESSION_RECORD_LEN : BIB_RECORD_LEN;
+	if (exp->len + SET_HDR_LEN + record_len > exp->args->mtu) {
+		error = msg_send(exp);
+		if (error)
+			return error;
+	}
+
+	if (!exp->set_offset || exp->set_template != template)
+		open_set(exp, template);
+
+	put_u64(exp, event->time / 1000000ULL);
+	put_u8(exp, nat_event);
+	put_bytes(exp, &event->remote6.l3, 16);
+	put_bytes(exp, &event->local4.l3, 4);
+	put_u8(exp, protocol_identifier(event->l4_proto));
+	put_u16(exp, event->remote6.l4);
+	put_u16(exp, event->local4.l4);
+	if (template == TEMPLATE_SESSION) {
+		put_bytes(exp, &event->local6.l3, 16);
+		put_bytes(exp, &event->remote4.l3, 4);
+		put_u16(exp, event->local6.l4);
+		put_u16(exp, event->remote4.l4);
+	}
+
+	exp->records++;
+	return 0;
+}
+
+static int export_events(struct log_event_usr *events, unsigned int count, void *arg)
+{
+	struct exporter *exp = arg;
+	unsigned int i;
+	int error;
+
+	/* The file first; the collector is the one which might not be listening. */
+	if (exp->log) {
+		error = eventlog_write(exp->log, events, count);
+		if (error)
+			return error;
+	}
+
+	for (i = 0; i < count; i++) {
+		error = export_event(exp, &events[i]);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+static int connect_to_collector(struct arguments *args)
+{
+	struct addrinfo hints, *addrs, *addr;
+	int fd = -1;
+	int error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	error = getaddrinfo(args->collector, args->port, &hints, &addrs);
+	if (error) {
+		log_err("Could not resolve '%s': %s", args->collector, gai_strerror(error));
+		return -EINVAL;
+	}
+
+	for (addr = addrs; addr; addr = addr->ai_next) {
+		fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (!connect(fd, addr->ai_addr, addr->ai_addrlen))
+			break;
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(addrs);
+	if (fd < 0)
+		log_err("Could not reach '%s'.", args->collector);
+	return fd;
+}
+
+static void sleep_msecs(unsigned int msecs)
+{
+	struct timespec time;
+
+	time.tv_sec = msecs / 1000;
+	time.tv_nsec = (msecs % 1000) * 1000000L;
+	nanosleep(&time, NULL);
+}
+
+static void handle_stop(int sig)
+{
+	stop = 1;
+}
+
+static void handle_reopen(int sig)
+{
+	reopen = 1;
+}
+
+/**
+ * Same as jool-log's: the file has to be written by the time the next batch is drained.
+ */
+static int flush_log(struct exporter *exp)
+{
+	if (!exp->log)
+		return 0;
+
+	if (fflush(exp->log)) {
+		log_err("Could not write the events: %s", strerror(errno));
+		return -errno;
+	}
+
+	if (reopen) {
+		reopen = 0;
+		fclose(exp->log);
+		exp->log = eventlog_open_append(exp->args->log);
+		if (!exp->log)
+			return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int export_kernel(struct exporter *exp)
+{
+	struct sigaction action;
+	int error = 0;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	/* For logrotate and friends. */
+	action.sa_handler = handle_reopen;
+	sigaction(SIGHUP, &action, NULL);
+
+	if (exp->args->log) {
+		exp->log = eventlog_open_append(exp->args->log);
+		if (!exp->log)
+			return -EINVAL;
+	}
+
+	do {
+		sleep_msecs(exp->args->interval);
+
+		if (time(NULL) - exp->last_template >= exp->args->template_refresh) {
+			error = send_templates(exp);
+			if (error)
+				break;
+		}
+
+		/* Even if we're stopping, whatever is queued still has to be exported. */
+		error = eventlog_drain(export_events, exp);
+		if (error)
+			break;
+		error = flush_log(exp);
+		if (error)
+			break;
+		error = msg_send(exp);
+		if (error)
+			break;
+	} while (!stop);
+
+	if (exp->log)
+		fclose(exp->log);
+	return error;
+}
+
+static int export_file(struct exporter *exp)
+{
+	struct log_event_usr event;
+	FILE *file;
+	int error = 0;
+
+	file = eventlog_open_read(exp->args->replay);
+	if (!file)
+		return -EINVAL;
+
+	while (fread(&event, sizeof(event), 1, file) == 1) {
+		error = export_event(exp, &event);
+		if (error)
+			goto end;
+	}
+
+	error = msg_send(exp);
+	/* Fall through. */
+
+end:
+	if (file != stdin)
+		fclose(file);
+	return error;
+}
+
+static int main_wrapped(int argc, char **argv)
+{
+	struct arguments args;
+	struct exporter exp;
+	struct argp argp = { options, parse_opt, NULL,
+			"Exports Jool's binary BIB and session logs as IPFIX NAT64 events." };
+	int error;
+
+	memset(&args, 0, sizeof(args));
+	args.port = DEFAULT_PORT;
+	args.interval = DEFAULT_INTERVAL;
+	args.template_refresh = DEFAULT_TEMPLATE_REFRESH;
+	args.mtu = DEFAULT_MTU;
+
+	error = argp_parse(&argp, argc, argv, 0, NULL, &args);
+	if (error)
+		return error;
+
+	if (!args.collector) {
+		log_err("Please tell me where the collector is (--collector).");
+		return -EINVAL;
+	}
+	if (args.replay && args.log) {
+		log_err("--replay does not write logs; it reads them.");
+		return -EINVAL;
+	}
+
+	memset(&exp, 0, sizeof(exp));
+	exp.args = &args;
+	exp.buffer = malloc(args.mtu);
+	if (!exp.buffer) {
+		log_err("Out of memory.");
+		return -ENOMEM;
+	}
+	msg_begin(&exp);
+
+	exp.fd = connect_to_collector(&args);
+	if (exp.fd < 0) {
+		error = exp.fd;
+		goto end;
+	}
+
+	error = send_templates(&exp);
+	if (!error)
+		error = args.replay ? export_file(&exp) : export_kernel(&exp);
+	log_info("Exported %llu records.", exp.total);
+
+	close(exp.fd);
+	/* Fall through. */
+
+end:
+	free(exp.buffer);
+	return error;
+}
+
+int main(int argc, char **argv)
+{
+	int error;
+
+	error = main_wrapped(argc, argv);
+	netlink_destroy();
+
+	return -error;
+}
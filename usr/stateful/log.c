@@ -0,0 +1,306 @@
+/**
+ * @file
+ * Main for jool-log, the daemon which collects the binary BIB and session logs (see MODE_LOG and
+ * --logging-binary) and stores them in a file, and also the tool which turns such files into the
+ * same text lines the kernel would otherwise print.
+ *
+ * See event_log.h for the file format.
+ */
+
+#include <argp.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "nat64/common/config.h"
+#include "nat64/common/constants.h"
+#include "nat64/common/str_utils.h"
+#include "nat64/usr/event_log.h"
+#include "nat64/usr/netlink.h"
+#include "nat64/usr/str_utils.h"
+#include "nat64/usr/types.h"
+
+
+const char *argp_program_version = JOOL_VERSION_STR;
+const char *argp_program_bug_address = "jool@nic.mx";
+
+/** Default milliseconds between two drains of the kernel's queues. */
+#define DEFAULT_INTERVAL 100
+
+struct arguments {
+	/* File the collector appends to. NULL if this is a conversion. */
+	char *collect;
+	unsigned int interval;
+	/* Files to convert. */
+	char **files;
+	unsigned int file_count;
+};
+
+enum argp_flags {
+	ARGP_COLLECT = 'c',
+	ARGP_INTERVAL = 'i',
+};
+
+static struct argp_option options[] = {
+	{ "collect", ARGP_COLLECT, "FILE", 0,
+			"Collect the events from Jool and append them to FILE." },
+	{ "interval", ARGP_INTERVAL, "MSECS", 0,
+			"Milliseconds the collector waits between batches. Default: 100" },
+	{ NULL },
+};
+
+/** Set by the signal handlers; read by the collector's loop. */
+static volatile sig_atomic_t stop;
+static volatile sig_atomic_t reopen;
+
+static int parse_opt(int key, char *str, struct argp_state *state)
+{
+	struct arguments *args = state->input;
+	__u64 interval;
+	int error = 0;
+
+	switch (key) {
+	case ARGP_COLLECT:
+		args->collect = str;
+		break;
+	case ARGP_INTERVAL:
+		error = str_to_u64(str, &interval, 1, 60000);
+		args->interval = interval;
+		break;
+	case ARGP_KEY_ARGS:
+		args->files = state->argv + state->next;
+		args->file_count = state->argc - state->next;
+		break;
+	default:
+		error = ARGP_ERR_UNKNOWN;
+	}
+
+	return error;
+}
+
+static int write_events(struct log_event_usr *events, unsigned int event_count, void *arg)
+{
+	FILE *file = arg;
+	unsigned int i;
+
+	for (i = 0; i < event_count; i++)
+		if (events[i].type == LOG_EVENT_LOST)
+			log_err("Jool had to drop %u events.", events[i].lost);
+
+	return eventlog_write(file, events, event_count);
+}
+
+/**
+ * Moves the events the kernel queued since the last call to "file".
+ */
+static int drain(FILE *file)
+{
+	int error;
+
+	error = eventlog_drain(write_events, file);
+	if (error)
+		return error;
+
+	if (fflush(file)) {
+		log_err("Could not write the events: %s", strerror(errno));
+		return -errno;
+	}
+
+	return 0;
+}
+
+static void sleep_msecs(unsigned int msecs)
+{
+	struct timespec time;
+
+	time.tv_sec = msecs / 1000;
+	time.tv_nsec = (msecs % 1000) * 1000000L;
+	nanosleep(&time, NULL);
+}
+
+static void handle_stop(int sig)
+{
+	stop = 1;
+}
+
+static void handle_reopen(int sig)
+{
+	reopen = 1;
+}
+
+static int collect(struct arguments *args)
+{
+	struct sigaction action;
+	FILE *file;
+	int error;
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handle_stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	/* For logrotate and friends. */
+	action.sa_handler = handle_reopen;
+	sigaction(SIGHUP, &action, NULL);
+
+	file = eventlog_open_append(args->collect);
+	if (!file)
+		return -EINVAL;
+
+	do {
+		sleep_msecs(args->interval);
+
+		/* Even if we're stopping, whatever is queued still has to be saved. */
+		error = drain(file);
+		if (error)
+			break;
+
+		if (reopen) {
+			reopen = 0;
+			fclose(file);
+			file = eventlog_open_append(args->collect);
+			if (!file)
+				return -EINVAL;
+		}
+	} while (!stop);
+
+	fclose(file);
+	return error;
+}
+
+static void print_time(__u64 time)
+{
+	time_t seconds = time / 1000000000ULL;
+	struct tm tm;
+
+	gmtime_r(&seconds, &tm);
+	printf("%d/%02d/%02d %02d:%02d:%02d.%06llu (GMT)", 1900 + tm.tm_year, tm.tm_mon + 1,
+			tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+			(unsigned long long) (time % 1000000000ULL) / 1000);
+}
+
+static void print_addr6_raw(struct ipv6_transport_addr *addr)
+{
+	char str[INET6_ADDRSTRLEN];
+	inet_ntop(AF_INET6, &addr->l3, str, sizeof(str));
+	printf("%s#%u", str, addr->l4);
+}
+
+static void print_addr4_raw(struct ipv4_transport_addr *addr)
+{
+	char str[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &addr->l3, str, sizeof(str));
+	printf("%s#%u", str, addr->l4);
+}
+
+/**
+ * Prints "event" the way the kernel would have if --logging-binary were off.
+ */
+static void print_event(struct log_event_usr *event)
+{
+	print_time(event->time);
+	printf(" - %s ", log_event_to_string(event->type));
+
+	switch (event->type) {
+	case LOG_EVENT_BIB_ADD:
+	case LOG_EVENT_BIB_REMOVE:
+		print_addr6_raw(&event->remote6);
+		printf(" to ");
+		print_addr4_raw(&event->local4);
+		printf(" (%s)\n", l4proto_to_string(event->l4_proto));
+		return;
+	case LOG_EVENT_SESSION_ADD:
+	case LOG_EVENT_SESSION_REMOVE:
+	case LOG_EVENT_SESSION_RESTORE:
+		print_addr6_raw(&event->remote6);
+		printf("|");
+		print_addr6_raw(&event->local6);
+		printf("|");
+		print_addr4_raw(&event->local4);
+		printf("|");
+		print_addr4_raw(&event->remote4);
+		printf("|%s\n", l4proto_to_string(event->l4_proto));
+		return;
+	case LOG_EVENT_LOST:
+		printf("%u\n", event->lost);
+		return;
+	}
+
+	printf("(type %u)\n", event->type);
+}
+
+static int print_file(char *path)
+{
+	struct log_event_usr event;
+	FILE *file;
+	int error = 0;
+
+	file = eventlog_open_read(path);
+	if (!file)
+		return -EINVAL;
+
+	while (fread(&event, sizeof(event), 1, file) == 1)
+		print_event(&event);
+
+	if (ferror(file)) {
+		log_err("Could not read '%s': %s", path, strerror(errno));
+		error = -EIO;
+	}
+
+	if (file != stdin)
+		fclose(file);
+	return error;
+}
+
+static int print_files(struct arguments *args)
+{
+	char *stdin_path = "-";
+	unsigned int i;
+	int error;
+
+	if (args->file_count == 0)
+		return print_file(stdin_path);
+
+	for (i = 0; i < args->file_count; i++) {
+		error = print_file(args->files[i]);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+static int main_wrapped(int argc, char **argv)
+{
+	struct arguments args;
+	struct argp argp = { options, parse_opt, "[FILE...]",
+			"Collects Jool's binary BIB and session logs, or prints them as text." };
+	int error;
+
+	memset(&args, 0, sizeof(args));
+	args.interval = DEFAULT_INTERVAL;
+
+	error = argp_parse(&argp, argc, argv, 0, NULL, &args);
+	if (error)
+		return error;
+
+	if (args.collect && args.file_count) {
+		log_err("--collect does not print files.");
+		return -EINVAL;
+	}
+
+	return args.collect ? collect(&args) : print_files(&args);
+}
+
+int main(int argc, char **argv)
+{
+	int error;
+
+	error = main_wrapped(argc, argv);
+	netlink_destroy();
+
+	return -error;
+}
@@ -3,9 +3,12 @@
 #include "nat64/common/session.h"
 #include "nat64/usr/str_utils.h"
 #include "nat64/usr/types.h"
+#include "nat64/usr/load.h"
 #include "nat64/usr/netlink.h"
 #include "nat64/usr/dns.h"
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <sys/socket.h>
 
@@ -52,6 +55,9 @@ static int session_display_response(struct nl_msg *msg, void *arg)
 	__u16 entry_count, i;
 
 	hdr = nlmsg_hdr(msg);
+	if (hdr->nlmsg_type == NLMSG_DONE)
+		return 0;
+
 	entries = nlmsg_data(hdr);
 	entry_count = nlmsg_datalen(hdr) / sizeof(*entries);
 
@@ -106,11 +112,6 @@ static int session_display_response(struct nl_msg *msg, void *arg)
 	}
 
 	params->row_count += entry_count;
-	params->req_payload->display.connection_set = hdr->nlmsg_flags == NLM_F_MULTI;
-	if (entry_count > 0) {
-		params->req_payload->display.remote4 = entries[entry_count - 1].remote4;
-		params->req_payload->display.local4 = entries[entry_count - 1].local4;
-	}
 	return 0;
 }
 
@@ -129,18 +130,14 @@ static bool display_single_table(u_int8_t l4_proto, bool numeric_hostname, bool
 
 	init_request_hdr(hdr, sizeof(request), MODE_SESSION, OP_DISPLAY);
 	payload->l4_proto = l4_proto;
-	payload->display.connection_set = false;
-	memset(&payload->display.remote4, 0, sizeof(payload->display.remote4));
-	memset(&payload->display.local4, 0, sizeof(payload->display.local4));
 
 	params.numeric_hostname = numeric_hostname;
 	params.csv_format = csv_format;
 	params.row_count = 0;
 	params.req_payload = payload;
 
-	do {
-		error = netlink_request(request, hdr->length, session_display_response, &params);
-	} while (!error && params.req_payload->display.connection_set);
+	/* The whole table arrives as a single multipart response. */
+	error = netlink_request(request, hdr->length, session_display_response, &params);
 
 	if (!csv_format && !error) {
 		if (params.row_count > 0)
@@ -213,3 +210,354 @@ int session_count(bool use_tcp, bool use_udp, bool use_icmp)
 
 	return (tcp_error || udp_error || icmp_error) ? -EINVAL : 0;
 }
+
+/**
+ * Maximum number of records sent per restore request.
+ * (Requests are limited to 64 KB, and records are 64 bytes long.)
+ */
+#define RESTORE_BATCH_SIZE 512
+
+/**
+ * The records fetched from one of the protocols' tables, before they're written to the file.
+ */
+struct record_list {
+	struct session_record_usr *records;
+	size_t count;
+	size_t capacity;
+	__u8 l4_proto;
+	/* Number of sessions which could not be saved. */
+	unsigned int skipped;
+};
+
+static struct session_record_usr *record_list_add(struct record_list *list)
+{
+	struct session_record_usr *records;
+	size_t capacity;
+
+	if (list->count == list->capacity) {
+		capacity = list->capacity ? (2 * list->capacity) : 1024;
+		records = realloc(list->records, capacity * sizeof(*records));
+		if (!records)
+			return NULL;
+		list->records = records;
+		list->capacity = capacity;
+	}
+
+	return &list->records[list->count++];
+}
+
+static int save_bib_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr;
+	struct bib_entry_usr *entries;
+	struct record_list *list = arg;
+	struct session_record_usr *record;
+	__u16 entry_count, i;
+
+	hdr = nlmsg_hdr(msg);
+	if (hdr->nlmsg_type == NLMSG_DONE)
+		return 0;
+
+	entries = nlmsg_data(hdr);
+	entry_count = nlmsg_datalen(hdr) / sizeof(*entries);
+
+	/* Dynamic BIB entries come back to life along with their sessions. */
+	for (i = 0; i < entry_count; i++) {
+		if (!entries[i].is_static)
+			continue;
+
+		record = record_list_add(list);
+		if (!record)
+			return -ENOMEM;
+
+		memset(record, 0, sizeof(*record));
+		record->remote6 = entries[i].addr6;
+		record->local4 = entries[i].addr4;
+		record->l4_proto = list->l4_proto;
+		record->flags = SESSION_RECORD_STATIC_BIB | SESSION_RECORD_BIB_ONLY;
+	}
+
+	return 0;
+}
+
+static int save_session_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr;
+	struct session_entry_usr *entries;
+	struct record_list *list = arg;
+	struct session_record_usr *record;
+	__u16 entry_count, i;
+
+	hdr = nlmsg_hdr(msg);
+	if (hdr->nlmsg_type == NLMSG_DONE)
+		return 0;
+
+	entries = nlmsg_data(hdr);
+	entry_count = nlmsg_datalen(hdr) / sizeof(*entries);
+
+	for (i = 0; i < entry_count; i++) {
+		/* These are waiting to send an ICMP error, and the packet cannot be saved. */
+		if (entries[i].timer == SESSIONTIMER_SYN) {
+			list->skipped++;
+			continue;
+		}
+
+		record = record_list_add(list);
+		if (!record)
+			return -ENOMEM;
+
+		record->remote6 = entries[i].remote6;
+		record->local6 = entries[i].local6;
+		record->local4 = entries[i].local4;
+		record->remote4 = entries[i].remote4;
+		record->ttl = entries[i].dying_time;
+		record->l4_proto = list->l4_proto;
+		record->state = entries[i].state;
+		record->timer = entries[i].timer;
+		record->flags = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * The BIB-only records go first, so the static BIB entries exist by the time their sessions are
+ * restored. The sessions are sorted by time to live, which is the order the kernel expects.
+ */
+static int compare_records(const void *arg1, const void *arg2)
+{
+	const struct session_record_usr *record1 = arg1;
+	const struct session_record_usr *record2 = arg2;
+	bool bib_only1 = record1->flags & SESSION_RECORD_BIB_ONLY;
+	bool bib_only2 = record2->flags & SESSION_RECORD_BIB_ONLY;
+
+	if (bib_only1 != bib_only2)
+		return bib_only1 ? -1 : 1;
+	if (record1->ttl != record2->ttl)
+		return (record1->ttl < record2->ttl) ? -1 : 1;
+	return 0;
+}
+
+int session_fetch(l4_protocol l4_proto, struct session_record_usr **result, size_t *count,
+		unsigned int *skipped)
+{
+	unsigned char request[HDR_LEN + sizeof(struct request_bib)];
+	struct request_hdr *hdr = (struct request_hdr *) request;
+	struct request_bib *bib_payload = (struct request_bib *) (request + HDR_LEN);
+	struct request_session *session_payload = (struct request_session *) (request + HDR_LEN);
+	struct record_list list = { .records = NULL, .count = 0, .capacity = 0 };
+	int error;
+
+	list.l4_proto = l4_proto;
+	list.skipped = 0;
+
+	init_request_hdr(hdr, HDR_LEN + sizeof(struct request_bib), MODE_BIB, OP_DISPLAY);
+	bib_payload->l4_proto = l4_proto;
+	error = netlink_request(request, hdr->length, save_bib_response, &list);
+	if (error)
+		goto fail;
+
+	init_request_hdr(hdr, HDR_LEN + PAYLOAD_LEN, MODE_SESSION, OP_DISPLAY);
+	session_payload->l4_proto = l4_proto;
+	error = netlink_request(request, hdr->length, save_session_response, &list);
+	if (error)
+		goto fail;
+
+	qsort(list.records, list.count, sizeof(*list.records), compare_records);
+
+	*result = list.records;
+	*count = list.count;
+	*skipped = list.skipped;
+	return 0;
+
+fail:
+	free(list.records);
+	return error;
+}
+
+static int save_single_table(FILE *file, l4_protocol l4_proto, unsigned int *saved,
+		unsigned int *skipped)
+{
+	struct session_record_usr *records;
+	size_t count;
+	unsigned int table_skipped;
+	int error;
+
+	error = session_fetch(l4_proto, &records, &count, &table_skipped);
+	if (error)
+		return error;
+
+	if (fwrite(records, sizeof(*records), count, file) != count) {
+		log_err("Could not write the %s records: %s", l4proto_to_string(l4_proto),
+				strerror(errno));
+		error = -EIO;
+		goto end;
+	}
+
+	*saved += count;
+	*skipped += table_skipped;
+	/* Fall through. */
+
+end:
+	free(records);
+	return error;
+}
+
+int session_save(bool use_tcp, bool use_udp, bool use_icmp, char *file_name)
+{
+	struct session_file_hdr file_hdr;
+	FILE *file;
+	unsigned int saved = 0;
+	unsigned int skipped = 0;
+	int error = 0;
+
+	file = fopen(file_name, "wb");
+	if (!file) {
+		error = -errno;
+		log_err("Could not open '%s': %s", file_name, strerror(errno));
+		return error;
+	}
+
+	memcpy(file_hdr.magic, SESSION_FILE_MAGIC, sizeof(file_hdr.magic));
+	file_hdr.version = SESSION_FILE_VERSION;
+	file_hdr.save_time = time(NULL);
+	if (fwrite(&file_hdr, sizeof(file_hdr), 1, file) != 1) {
+		log_err("Could not write to '%s': %s", file_name, strerror(errno));
+		error = -EIO;
+		goto end;
+	}
+
+	if (use_tcp)
+		error = save_single_table(file, L4PROTO_TCP, &saved, &skipped);
+	if (!error && use_udp)
+		error = save_single_table(file, L4PROTO_UDP, &saved, &skipped);
+	if (!error && use_icmp)
+		error = save_single_table(file, L4PROTO_ICMP, &saved, &skipped);
+
+	if (!error) {
+		log_info("Saved %u records.", saved);
+		if (skipped)
+			log_info("(%u sessions were waiting for a simultaneous open; "
+					"they were left out.)", skipped);
+	}
+	/* Fall through. */
+
+end:
+	if (fclose(file) && !error) {
+		log_err("Could not write to '%s': %s", file_name, strerror(errno));
+		error = -EIO;
+	}
+	return error;
+}
+
+static int restore_send(unsigned char *request, struct load_batch *batch, __u8 l4_proto)
+{
+	struct request_hdr *hdr = (struct request_hdr *) request;
+	struct request_session *payload = (struct request_session *) (request + HDR_LEN);
+
+	init_request_hdr(hdr, HDR_LEN + PAYLOAD_LEN
+			+ batch->count * sizeof(struct session_record_usr), MODE_SESSION, OP_LOAD);
+	payload->l4_proto = l4_proto;
+	payload->load.count = batch->count;
+	payload->load.sync = false;
+	batch->table = l4proto_to_string(l4_proto);
+
+	return netlink_request(request, hdr->length, load_response, batch);
+}
+
+int session_load(char *file_name)
+{
+	struct session_file_hdr file_hdr;
+	FILE *file;
+	unsigned char *request;
+	struct session_record_usr *records;
+	struct session_record_usr record;
+	struct load_batch batch;
+	unsigned int record_num = 0;
+	time_t now;
+	__u64 elapsed;
+	__u8 l4_proto = 0;
+	int error = 0;
+
+	file = strcmp(file_name, "-") ? fopen(file_name, "rb") : stdin;
+	if (!file) {
+		error = -errno;
+		log_err("Could not open '%s': %s", file_name, strerror(errno));
+		return error;
+	}
+
+	if (fread(&file_hdr, sizeof(file_hdr), 1, file) != 1
+			|| memcmp(file_hdr.magic, SESSION_FILE_MAGIC, sizeof(file_hdr.magic))) {
+		log_err("'%s' does not look like a session file.", file_name);
+		error = -EINVAL;
+		goto end;
+	}
+	if (file_hdr.version != SESSION_FILE_VERSION) {
+		log_err("'%s' is a version %u session file; I only understand version %u.",
+				file_name, file_hdr.version, SESSION_FILE_VERSION);
+		error = -EINVAL;
+		goto end;
+	}
+
+	/* The sessions kept aging while the module was out. */
+	now = time(NULL);
+	elapsed = (now > file_hdr.save_time) ? (1000 * (now - file_hdr.save_time)) : 0;
+
+	request = malloc(HDR_LEN + PAYLOAD_LEN + RESTORE_BATCH_SIZE * sizeof(record));
+	if (!request) {
+		log_err("Could not allocate the request.");
+		error = -ENOMEM;
+		goto end;
+	}
+	records = (struct session_record_usr *) (request + HDR_LEN + PAYLOAD_LEN);
+
+	memset(&batch, 0, sizeof(batch));
+	batch.unit = "Record";
+
+	while (fread(&record, sizeof(record), 1, file) == 1) {
+		record_num++;
+
+		if (!(record.flags & SESSION_RECORD_BIB_ONLY)) {
+			if (record.ttl <= elapsed) {
+				/* It would have died already; Jool would have dropped it. */
+				continue;
+			}
+			record.ttl -= elapsed;
+		}
+
+		/* Each batch has to belong to a single table. */
+		if (batch.count == RESTORE_BATCH_SIZE
+				|| (batch.count > 0 && record.l4_proto != l4_proto)) {
+			error = restore_send(request, &batch, l4_proto);
+			if (error)
+				break;
+			batch.count = 0;
+		}
+
+		l4_proto = record.l4_proto;
+		records[batch.count] = record;
+		batch.lines[batch.count] = record_num;
+		batch.count++;
+	}
+
+	if (ferror(file)) {
+		log_err("Error reading '%s'.", file_name);
+		error = -EIO;
+	} else if (!error && batch.count > 0) {
+		error = restore_send(request, &batch, l4_proto);
+	}
+
+	free(request);
+
+	if (!error) {
+		log_info("Restored %u records; %u failed.", batch.loaded, batch.failed);
+		if (batch.failed)
+			error = -EINVAL;
+	}
+	/* Fall through. */
+
+end:
+	if (file != stdin)
+		fclose(file);
+	return error;
+}
@@ -0,0 +1,832 @@
+/**
+ * @file
+ * Main for jool-sync, the daemon which replicates the session tables of an active NAT64 in a
+ * standby one.
+ *
+ * The sender runs next to the active NAT64. Whenever it connects to the receiver, it sends the
+ * whole tables (the same records "jool --session --save" would write), and from then on it only
+ * forwards the events the kernel queues (see MODE_SYNC), in batches.
+ *
+ * The receiver runs next to the standby NAT64, and inserts whatever arrives (see OP_LOAD in
+ * MODE_SESSION).
+ */
+
+#include <argp.h>
+#include <endian.h>
+#include <errno.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "nat64/common/config.h"
+#include "nat64/common/constants.h"
+#include "nat64/common/session.h"
+#include "nat64/usr/dns.h"
+#include "nat64/usr/netlink.h"
+#include "nat64/usr/session.h"
+#include "nat64/usr/str_utils.h"
+#include "nat64/usr/types.h"
+
+
+const char *argp_program_version = JOOL_VERSION_STR;
+const char *argp_program_bug_address = "jool@nic.mx";
+
+#define HDR_LEN sizeof(struct request_hdr)
+#define PAYLOAD_LEN sizeof(struct request_session)
+
+/** First bytes of every frame. */
+#define SYNC_FRAME_MAGIC "jsyn"
+/**
+ * Maximum number of records per frame. It's also the size of the batches the receiver hands to
+ * the kernel, so it inherits RESTORE_BATCH_SIZE's limit (requests cannot exceed 64 KB).
+ */
+#define SYNC_FRAME_MAX 512
+#define DEFAULT_PORT "6146"
+/** Default milliseconds between two drains of the kernel's queues. */
+#define DEFAULT_INTERVAL 100
+
+/**
+ * Beginning of every message the sender sends. "count" records follow.
+ *
+ * Unlike the session files, this travels between different machines, so everything that is not
+ * already in network byte order is converted.
+ */
+struct sync_frame_hdr {
+	char magic[4];
+	__u32 count;
+};
+
+struct arguments {
+	/* The receiver's address, if this is a sender. */
+	char *peer;
+	bool receive;
+	/* Address the receiver binds to. NULL means any. */
+	char *listen;
+	char *port;
+	unsigned int interval;
+	bool dry_run;
+};
+
+/** A growable array of records. */
+struct record_array {
+	struct session_record_usr *records;
+	size_t count;
+	size_t capacity;
+	/** Did the kernel lose events? (see SESSION_RECORD_RESYNC) */
+	bool resync;
+};
+
+enum argp_flags {
+	ARGP_PEER = 's',
+	ARGP_RECEIVE = 'r',
+	ARGP_LISTEN = 'l',
+	ARGP_PORT = 'p',
+	ARGP_INTERVAL = 'i',
+	ARGP_DRY_RUN = 'd',
+};
+
+static struct argp_option options[] = {
+	{ "send", ARGP_PEER, "HOST", 0, "Run next to the active NAT64, sending to HOST." },
+	{ "receive", ARGP_RECEIVE, NULL, 0, "Run next to the standby NAT64." },
+	{ "listen", ARGP_LISTEN, "ADDR", 0,
+			"Address the receiver binds to. Defaults to all of them." },
+	{ "port", ARGP_PORT, "PORT", 0,
+			"TCP port the receiver listens to. Default: " DEFAULT_PORT },
+	{ "interval", ARGP_INTERVAL, "MSECS", 0,
+			"Milliseconds the sender waits between batches. Default: 100" },
+	{ "dry-run", ARGP_DRY_RUN, NULL, 0,
+			"Make the receiver print the records instead of handing them to Jool." },
+	{ NULL },
+};
+
+static int parse_opt(int key, char *str, struct argp_state *state)
+{
+	struct arguments *args = state->input;
+	__u64 interval;
+	int error = 0;
+
+	switch (key) {
+	case ARGP_PEER:
+		args->peer = str;
+		break;
+	case ARGP_RECEIVE:
+		args->receive = true;
+		break;
+	case ARGP_LISTEN:
+		args->listen = str;
+		break;
+	case ARGP_PORT:
+		args->port = str;
+		break;
+	case ARGP_INTERVAL:
+		error = str_to_u64(str, &interval, 1, 60000);
+		args->interval = interval;
+		break;
+	case ARGP_DRY_RUN:
+		args->dry_run = true;
+		break;
+	default:
+		error = ARGP_ERR_UNKNOWN;
+	}
+
+	return error;
+}
+
+static void record_hton(struct session_record_usr *record)
+{
+	record->remote6.l4 = htons(record->remote6.l4);
+	record->local6.l4 = htons(record->local6.l4);
+	record->local4.l4 = htons(record->local4.l4);
+	record->remote4.l4 = htons(record->remote4.l4);
+	record->ttl = htonl(record->ttl);
+	record->seq = htobe64(record->seq);
+}
+
+static void record_ntoh(struct session_record_usr *record)
+{
+	record->remote6.l4 = ntohs(record->remote6.l4);
+	record->local6.l4 = ntohs(record->local6.l4);
+	record->local4.l4 = ntohs(record->local4.l4);
+	record->remote4.l4 = ntohs(record->remote4.l4);
+	record->ttl = ntohl(record->ttl);
+	record->seq = be64toh(record->seq);
+}
+
+static int write_all(int fd, void *buffer, size_t len)
+{
+	unsigned char *bytes = buffer;
+	ssize_t written;
+
+	while (len > 0) {
+		written = write(fd, bytes, len);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			log_err("Could not send to the peer: %s", strerror(errno));
+			return -errno;
+		}
+		bytes += written;
+		len -= written;
+	}
+
+	return 0;
+}
+
+/**
+ * Returns 1 if the peer closed the connection before sending anything.
+ */
+static int read_all(int fd, void *buffer, size_t len)
+{
+	unsigned char *bytes = buffer;
+	size_t total = len;
+	ssize_t bytes_read;
+
+	while (len > 0) {
+		bytes_read = read(fd, bytes, len);
+		if (bytes_read < 0) {
+			if (errno == EINTR)
+				continue;
+			log_err("Could not read from the peer: %s", strerror(errno));
+			return -errno;
+		}
+		if (bytes_read == 0) {
+			if (len == total)
+				return 1;
+			log_err("The peer closed the connection in the middle of a frame.");
+			return -EPIPE;
+		}
+		bytes += bytes_read;
+		len -= bytes_read;
+	}
+
+	return 0;
+}
+
+/**
+ * Sends "records" to the peer, in as many frames as needed.
+ * The records are converted to network byte order in the process.
+ */
+static int send_records(int fd, struct session_record_usr *records, size_t count)
+{
+	struct sync_frame_hdr hdr;
+	size_t frame_count, i;
+	int error;
+
+	for (i = 0; i < count; i++)
+		record_hton(&records[i]);
+
+	while (count > 0) {
+		frame_count = (count > SYNC_FRAME_MAX) ? SYNC_FRAME_MAX : count;
+
+		memcpy(hdr.magic, SYNC_FRAME_MAGIC, sizeof(hdr.magic));
+		hdr.count = htonl(frame_count);
+		error = write_all(fd, &hdr, sizeof(hdr));
+		if (error)
+			return error;
+		error = write_all(fd, records, frame_count * sizeof(*records));
+		if (error)
+			return error;
+
+		records += frame_count;
+		count -= frame_count;
+	}
+
+	return 0;
+}
+
+static int record_array_add(struct record_array *array, struct session_record_usr *record)
+{
+	struct session_record_usr *records;
+	size_t capacity;
+
+	if (array->count == array->capacity) {
+		capacity = array->capacity ? (2 * array->capacity) : 1024;
+		records = realloc(array->records, capacity * sizeof(*records));
+		if (!records) {
+			log_err("Out of memory.");
+			return -ENOMEM;
+		}
+		array->records = records;
+		array->capacity = capacity;
+	}
+
+	array->records[array->count++] = *record;
+	return 0;
+}
+
+static int drain_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr;
+	struct session_record_usr *records;
+	struct record_array *array = arg;
+	unsigned int record_count, i;
+	int error;
+
+	hdr = nlmsg_hdr(msg);
+	if (hdr->nlmsg_type == NLMSG_DONE)
+		return 0;
+
+	records = nlmsg_data(hdr);
+	record_count = nlmsg_datalen(hdr) / sizeof(*records);
+
+	for (i = 0; i < record_count; i++) {
+		if (records[i].flags & SESSION_RECORD_RESYNC) {
+			array->resync = true;
+			continue;
+		}
+		error = record_array_add(array, &records[i]);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+/**
+ * Collects the events the kernel queued since the last call, and appends them to "array".
+ */
+static int drain(struct record_array *array)
+{
+	struct request_hdr hdr;
+
+	init_request_hdr(&hdr, sizeof(hdr), MODE_SYNC, OP_DISPLAY);
+	return netlink_request(&hdr, hdr.length, drain_response, array);
+}
+
+static int compare_keys(const struct session_record_usr *record1,
+		const struct session_record_usr *record2)
+{
+	int gap;
+
+	gap = record1->l4_proto - record2->l4_proto;
+	if (gap)
+		return gap;
+	gap = memcmp(&record1->remote6, &record2->remote6, sizeof(record1->remote6));
+	if (gap)
+		return gap;
+	return memcmp(&record1->local6, &record2->local6, sizeof(record1->local6));
+}
+
+static int compare_seqs(const struct session_record_usr *record1,
+		const struct session_record_usr *record2)
+{
+	return (record1->seq < record2->seq) ? -1 : (record1->seq > record2->seq);
+}
+
+static int compare_records_by_seq(const void *arg1, const void *arg2)
+{
+	return compare_seqs(arg1, arg2);
+}
+
+static int compare_records_by_key(const void *arg1, const void *arg2)
+{
+	return compare_keys(arg1, arg2);
+}
+
+/** The receiver's order: one run per protocol (see apply()), oldest first within each. */
+static int compare_records_by_proto(const void *arg1, const void *arg2)
+{
+	const struct session_record_usr *record1 = arg1;
+	const struct session_record_usr *record2 = arg2;
+	int gap;
+
+	gap = record1->l4_proto - record2->l4_proto;
+	return gap ? gap : compare_seqs(record1, record2);
+}
+
+static struct session_record_usr *sort_base;
+
+/** Sorts indexes of "sort_base" by session, and then by sequence number. */
+static int compare_indexes(const void *arg1, const void *arg2)
+{
+	size_t index1 = *((const size_t *) arg1);
+	size_t index2 = *((const size_t *) arg2);
+	int gap;
+
+	gap = compare_keys(&sort_base[index1], &sort_base[index2]);
+	return gap ? gap : compare_seqs(&sort_base[index1], &sort_base[index2]);
+}
+
+/**
+ * Is "record" older than the version of its session that was sent in the previous batch?
+ *
+ * This happens when "record" was queued on a CPU the previous drain had already visited, while a
+ * newer record of the same session was still waiting on one it had not.
+ */
+static bool is_stale(struct record_array *previous, struct session_record_usr *record)
+{
+	struct session_record_usr *sent;
+
+	sent = bsearch(record, previous->records, previous->count, sizeof(*record),
+			compare_records_by_key);
+	return sent && compare_seqs(sent, record) > 0;
+}
+
+/**
+ * Removes from "array" the records which are superseded by a newer record of the same session,
+ * whether it is in "array" itself or in "previous" (the batch that was sent last time). Whatever
+ * survives is sorted by sequence number.
+ *
+ * Then replaces "previous" with the survivors, sorted by session.
+ */
+static int coalesce(struct record_array *array, struct record_array *previous)
+{
+	size_t *indexes;
+	bool *keep;
+	size_t i, j;
+	int error;
+
+	if (array->count == 0) {
+		previous->count = 0;
+		return 0;
+	}
+
+	indexes = malloc(array->count * sizeof(*indexes));
+	keep = calloc(array->count, sizeof(*keep));
+	if (!indexes || !keep) {
+		error = -ENOMEM;
+		log_err("Out of memory.");
+		goto end;
+	}
+
+	for (i = 0; i < array->count; i++)
+		indexes[i] = i;
+	sort_base = array->records;
+	qsort(indexes, array->count, sizeof(*indexes), compare_indexes);
+
+	/* The last of each group of equal sessions has the highest sequence number. */
+	for (i = 0; i < array->count; i++) {
+		if (i + 1 != array->count && !compare_keys(&array->records[indexes[i]],
+				&array->records[indexes[i + 1]]))
+			continue;
+		if (is_stale(previous, &array->records[indexes[i]]))
+			continue;
+		keep[indexes[i]] = true;
+	}
+
+	/* Already in session order, so "previous" does not need to be sorted again. */
+	previous->count = 0;
+	for (i = 0; i < array->count; i++) {
+		if (!keep[indexes[i]])
+			continue;
+		error = record_array_add(previous, &array->records[indexes[i]]);
+		if (error)
+			goto end;
+	}
+
+	for (i = 0, j = 0; i < array->count; i++)
+		if (keep[i])
+			array->records[j++] = array->records[i];
+	array->count = j;
+	qsort(array->records, array->count, sizeof(*array->records), compare_records_by_seq);
+	error = 0;
+	/* Fall through. */
+
+end:
+	free(indexes);
+	free(keep);
+	return error;
+}
+
+/**
+ * Sends Jool's entire tables to the peer.
+ */
+static int send_snapshot(int fd)
+{
+	l4_protocol protos[] = { L4PROTO_TCP, L4PROTO_UDP, L4PROTO_ICMP };
+	struct session_record_usr *records;
+	size_t count, total = 0;
+	unsigned int skipped;
+	unsigned int i;
+	int error;
+
+	for (i = 0; i < sizeof(protos) / sizeof(protos[0]); i++) {
+		error = session_fetch(protos[i], &records, &count, &skipped);
+		if (error)
+			return error;
+		error = send_records(fd, records, count);
+		free(records);
+		if (error)
+			return error;
+		total += count;
+	}
+
+	log_info("Sent the full tables (%zu records).", total);
+	return 0;
+}
+
+static int connect_to_peer(struct arguments *args)
+{
+	struct addrinfo hints, *addrs, *addr;
+	int fd = -1;
+	int error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+
+	error = getaddrinfo(args->peer, args->port, &hints, &addrs);
+	if (error) {
+		log_err("Could not resolve '%s': %s", args->peer, gai_strerror(error));
+		return -EINVAL;
+	}
+
+	for (addr = addrs; addr; addr = addr->ai_next) {
+		fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if (fd < 0)
+			continue;
+		if (!connect(fd, addr->ai_addr, addr->ai_addrlen))
+			break;
+		close(fd);
+		fd = -1;
+	}
+
+	freeaddrinfo(addrs);
+	return fd;
+}
+
+static void sleep_msecs(unsigned int msecs)
+{
+	struct timespec time;
+
+	time.tv_sec = msecs / 1000;
+	time.tv_nsec = (msecs % 1000) * 1000000L;
+	nanosleep(&time, NULL);
+}
+
+/**
+ * Forwards events to the peer until the connection breaks (or something worse happens).
+ */
+static int send_loop(int fd, struct arguments *args)
+{
+	struct record_array array = { .records = NULL, .count = 0, .capacity = 0 };
+	/* The records sent by the previous iteration. */
+	struct record_array previous = { .records = NULL, .count = 0, .capacity = 0 };
+	int error;
+
+	/* Whatever is already queued is older than the snapshot. */
+	error = drain(&array);
+	if (error)
+		goto end;
+	error = send_snapshot(fd);
+	if (error)
+		goto end;
+
+	while (true) {
+		sleep_msecs(args->interval);
+
+		array.count = 0;
+		array.resync = false;
+		error = drain(&array);
+		if (error)
+			break;
+
+		if (array.resync) {
+			log_info("Jool lost some events; starting over.");
+			previous.count = 0;
+			error = send_snapshot(fd);
+			if (error)
+				break;
+			continue;
+		}
+
+		error = coalesce(&array, &previous);
+		if (error)
+			break;
+		error = send_records(fd, array.records, array.count);
+		if (error)
+			break;
+	}
+	/* Fall through. */
+
+end:
+	free(previous.records);
+	free(array.records);
+	return error;
+}
+
+static int run_sender(struct arguments *args)
+{
+	int fd;
+	int error;
+
+	while (true) {
+		fd = connect_to_peer(args);
+		if (fd < 0) {
+			if (fd != -1)
+				return fd;
+			sleep_msecs(1000);
+			continue;
+		}
+
+		log_info("Connected to %s.", args->peer);
+		error = send_loop(fd, args);
+		close(fd);
+
+		/* Lost the peer; reconnect. Anything else is not going to fix itself. */
+		if (error != -EPIPE && error != -ECONNRESET)
+			return error;
+		log_info("Lost the connection to %s; retrying.", args->peer);
+	}
+}
+
+static void print_record(struct session_record_usr *record)
+{
+	printf("%s %s ", l4proto_to_string(record->l4_proto),
+			(record->flags & SESSION_RECORD_REMOVED) ? "REMOVE" : "UPDATE");
+	print_addr6(&record->remote6, true, "#", record->l4_proto);
+	printf(" ");
+	print_addr6(&record->local6, true, "#", record->l4_proto);
+	printf(" ");
+	print_addr4(&record->local4, true, "#", record->l4_proto);
+	printf(" ");
+	print_addr4(&record->remote4, true, "#", record->l4_proto);
+	if (!(record->flags & SESSION_RECORD_REMOVED)) {
+		printf(" ttl:%ums", record->ttl);
+		if (record->l4_proto == L4PROTO_TCP)
+			printf(" %s", tcp_state_to_string(record->state));
+	}
+	printf("\n");
+}
+
+struct apply_batch {
+	struct session_record_usr *records;
+	unsigned int count;
+	unsigned int failed;
+};
+
+static int apply_response(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *hdr = nlmsg_hdr(msg);
+	struct apply_batch *batch = arg;
+	__s32 *results;
+	unsigned int result_count, i;
+
+	results = nlmsg_data(hdr);
+	result_count = nlmsg_datalen(hdr) / sizeof(*results);
+	if (result_count != batch->count) {
+		log_err("Jool answered %u results to a batch of %u records.", result_count,
+				batch->count);
+		batch->failed += batch->count;
+		return 0;
+	}
+
+	for (i = 0; i < result_count; i++) {
+		/* We might have never heard of the session (eg. we connected after it was born). */
+		if (results[i] == -ESRCH && (batch->records[i].flags & SESSION_RECORD_REMOVED))
+			continue;
+		if (results[i])
+			batch->failed++;
+	}
+
+	return 0;
+}
+
+/**
+ * Hands "count" records to Jool. All of them have to belong to the same protocol.
+ */
+static int apply(unsigned char *request, struct session_record_usr *records, unsigned int count)
+{
+	struct request_hdr *hdr = (struct request_hdr *) request;
+	struct request_session *payload = (struct request_session *) (request + HDR_LEN);
+	struct apply_batch batch = { .records = records, .count = count, .failed = 0 };
+	int error;
+
+	init_request_hdr(hdr, HDR_LEN + PAYLOAD_LEN + count * sizeof(*records), MODE_SESSION,
+			OP_LOAD);
+	payload->l4_proto = records[0].l4_proto;
+	payload->load.count = count;
+	payload->load.sync = true;
+	memcpy(payload + 1, records, count * sizeof(*records));
+
+	error = netlink_request(request, hdr->length, apply_response, &batch);
+	if (error)
+		return error;
+
+	if (batch.failed)
+		log_info("%u out of %u %s records could not be applied.", batch.failed, count,
+				l4proto_to_string(records[0].l4_proto));
+	return 0;
+}
+
+static int receive_frame(int fd, unsigned char *request, struct session_record_usr *records,
+		bool dry_run)
+{
+	struct sync_frame_hdr hdr;
+	unsigned int count, start, end, i;
+	int error;
+
+	error = read_all(fd, &hdr, sizeof(hdr));
+	if (error)
+		return error;
+
+	count = ntohl(hdr.count);
+	if (memcmp(hdr.magic, SYNC_FRAME_MAGIC, sizeof(hdr.magic)) || count > SYNC_FRAME_MAX) {
+		log_err("The peer does not seem to be speaking jool-sync.");
+		return -EINVAL;
+	}
+
+	error = read_all(fd, records, count * sizeof(*records));
+	if (error)
+		return (error == 1) ? -EPIPE : error;
+
+	for (i = 0; i < count; i++)
+		record_ntoh(&records[i]);
+	qsort(records, count, sizeof(*records), compare_records_by_proto);
+
+	if (dry_run) {
+		for (i = 0; i < count; i++)
+			print_record(&records[i]);
+		fflush(stdout);
+		return 0;
+	}
+
+	/* OP_LOAD wants one protocol per request; each request is applied in sequence order. */
+	for (start = 0; start < count; start = end) {
+		for (end = start + 1; end < count; end++)
+			if (records[end].l4_proto != records[start].l4_proto)
+				break;
+
+		error = apply(request, &records[start], end - start);
+		if (error)
+			return error;
+	}
+
+	return 0;
+}
+
+static int listen_to_peer(struct arguments *args)
+{
+	struct addrinfo hints, *addrs;
+	int fd;
+	int yes = 1;
+	int error;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	error = getaddrinfo(args->listen, args->port, &hints, &addrs);
+	if (error) {
+		log_err("Could not resolve '%s': %s", args->listen ? args->listen : "(any)",
+				gai_strerror(error));
+		return -EINVAL;
+	}
+
+	fd = socket(addrs->ai_family, addrs->ai_socktype, addrs->ai_protocol);
+	if (fd < 0) {
+		error = -errno;
+		log_err("Could not create the socket: %s", strerror(errno));
+		goto end;
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	if (bind(fd, addrs->ai_addr, addrs->ai_addrlen) || listen(fd, 1)) {
+		error = -errno;
+		log_err("Could not listen on port %s: %s", args->port, strerror(errno));
+		close(fd);
+		goto end;
+	}
+
+	error = fd;
+	/* Fall through. */
+
+end:
+	freeaddrinfo(addrs);
+	return error;
+}
+
+static int run_receiver(struct arguments *args)
+{
+	unsigned char *request;
+	struct session_record_usr *records;
+	int listen_fd, fd;
+	int error;
+
+	request = malloc(HDR_LEN + PAYLOAD_LEN + SYNC_FRAME_MAX * sizeof(*records));
+	records = malloc(SYNC_FRAME_MAX * sizeof(*records));
+	if (!request || !records) {
+		log_err("Out of memory.");
+		error = -ENOMEM;
+		goto end;
+	}
+
+	listen_fd = listen_to_peer(args);
+	if (listen_fd < 0) {
+		error = listen_fd;
+		goto end;
+	}
+
+	/* There is only one active NAT64, so peers are served one at a time. */
+	while (true) {
+		fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			error = -errno;
+			log_err("Could not accept the peer's connection: %s", strerror(errno));
+			break;
+		}
+
+		log_info("The active NAT64 connected.");
+		do {
+			error = receive_frame(fd, request, records, args->dry_run);
+		} while (!error);
+		close(fd);
+
+		if (error != 1 && error != -EPIPE && error != -ECONNRESET && error != -EINVAL)
+			break;
+		log_info("The active NAT64 disconnected.");
+	}
+
+	close(listen_fd);
+	/* Fall through. */
+
+end:
+	free(records);
+	free(request);
+	return error;
+}
+
+static int main_wrapped(int argc, char **argv)
+{
+	struct arguments args;
+	struct argp argp = { options, parse_opt, NULL,
+			"Replicates Jool's sessions from an active NAT64 to a standby one." };
+	int error;
+
+	memset(&args, 0, sizeof(args));
+	args.port = DEFAULT_PORT;
+	args.interval = DEFAULT_INTERVAL;
+
+	error = argp_parse(&argp, argc, argv, 0, NULL, &args);
+	if (error)
+		return error;
+
+	if (!args.peer == !args.receive) {
+		log_err("Please choose between --send and --receive.");
+		return -EINVAL;
+	}
+
+	/* A dead peer is handled by write(); don't let the signal kill us first. */
+	signal(SIGPIPE, SIG_IGN);
+
+	return args.receive ? run_receiver(&args) : run_sender(&args);
+}
+
+int main(int argc, char **argv)
+{
+	int error;
+
+	error = main_wrapped(argc, argv);
+	netlink_destroy();
+
+	return -error;
+}
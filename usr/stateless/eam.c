@@ -2,8 +2,11 @@
 #include "nat64/common/config.h"
 #include "nat64/common/str_utils.h"
 #include "nat64/usr/types.h"
+#include "nat64/usr/load.h"
+#include "nat64/usr/str_utils.h"
 #include "nat64/usr/netlink.h"
 #include <errno.h>
+#include <string.h>
 
 
 #define HDR_LEN sizeof(struct request_hdr)
@@ -155,3 +158,37 @@ int eam_flush()
 	init_request_hdr(&request, sizeof(request), MODE_EAMT, OP_FLUSH);
 	return netlink_request(&request, request.length, eam_flush_response, NULL);
 }
+
+static int eam_load_parse(char *str1, char *str2, void *entry)
+{
+	struct eam_entry_usr *eam = entry;
+	int error;
+
+	/* Same as --add: the IPv6 prefix goes first, but the user doesn't have to remember that. */
+	if (strchr(str1, ':')) {
+		error = str_to_ipv6_prefix(str1, &eam->pref6);
+		return error ? : str_to_ipv4_prefix(str2, &eam->pref4);
+	}
+
+	error = str_to_ipv4_prefix(str1, &eam->pref4);
+	return error ? : str_to_ipv6_prefix(str2, &eam->pref6);
+}
+
+static int eam_load_send(void *request, struct load_batch *batch, void *arg)
+{
+	struct request_hdr *hdr = request;
+	union request_eamt *payload = (union request_eamt *) (hdr + 1);
+
+	init_request_hdr(hdr, HDR_LEN + PAYLOAD_LEN + batch->count * sizeof(struct eam_entry_usr),
+			MODE_EAMT, OP_LOAD);
+	payload->load.count = batch->count;
+	batch->table = "EAMT";
+
+	return netlink_request(request, hdr->length, load_response, batch);
+}
+
+int eam_load(char *file_name)
+{
+	return load_file(file_name, HDR_LEN + PAYLOAD_LEN, sizeof(struct eam_entry_usr),
+			eam_load_parse, eam_load_send, NULL);
+}